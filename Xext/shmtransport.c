@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * SHM-TRANSPORT: requests and replies of local clients through shared
+ * memory rings instead of the socket. The protocol is described in
+ * shmtransportproto.h, the rings live in os/shmring.c.
+ */
+#include <dix-config.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+
+#include "dix/dix_priv.h"
+#include "dix/request_priv.h"
+#include "include/shmtransportproto.h"
+#include "miext/extinit_priv.h"
+#include "os/io_priv.h"
+#include "os/shmring_priv.h"
+
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "extnsionst.h"
+
+Bool noShmTransportExtension = FALSE;
+
+static int
+ProcShmTransportQueryVersion(ClientPtr client)
+{
+    REQUEST_SIZE_MATCH(xShmTransportQueryVersionReq);
+
+    xShmTransportQueryVersionReply reply = {
+        .majorVersion = SHMTRANSPORT_MAJOR_VERSION,
+        .minorVersion = SHMTRANSPORT_MINOR_VERSION
+    };
+
+    if (client->swapped) {
+        swapl(&reply.majorVersion);
+        swapl(&reply.minorVersion);
+    }
+
+    return X_SEND_REPLY_SIMPLE(client, reply);
+}
+
+/*
+ * The eventfds stay the ring's. The client gets copies, which go out with
+ * the next flush and are closed then, so nothing queued refers to an fd
+ * the ring closes when attaching fails.
+ */
+static int
+ShmTransportSendFd(ClientPtr client, int fd)
+{
+    if ((fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0)
+        return -1;
+    if (WriteFdToClient(client, fd, TRUE) < 0) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+ProcShmTransportAttach(ClientPtr client)
+{
+    REQUEST(xShmTransportAttachReq);
+    REQUEST_SIZE_MATCH(xShmTransportAttachReq);
+
+    OsCommPtr oc = client->osPrivate;
+    OsShmRingInfoRec info;
+    OsShmRingPtr ring;
+
+    /* the rings are in host byte order, only local clients share it */
+    if (!client->local || client->swapped)
+        return BadRequest;
+    if (oc->ring)
+        return BadAccess;
+
+    ring = OsShmRingCreate(stuff->requestSize, stuff->replySize, &info);
+    if (!ring)
+        return BadAlloc;
+
+    /* they go out with the reply, before the rings take over */
+    if (WriteFdToClient(client, info.memFd, TRUE) < 0) {
+        close(info.memFd);
+        OsShmRingFree(ring);
+        return BadAlloc;
+    }
+    if (ShmTransportSendFd(client, info.serverFd) < 0 ||
+        ShmTransportSendFd(client, info.clientFd) < 0) {
+        OsShmRingFree(ring);
+        return BadAlloc;
+    }
+
+    xShmTransportAttachReply reply = {
+        .nfd = 3,
+        .size = info.size,
+        .requestOffset = info.requestOffset,
+        .requestSize = info.requestSize,
+        .replyOffset = info.replyOffset,
+        .replySize = info.replySize,
+    };
+
+    int rc = X_SEND_REPLY_SIMPLE(client, reply);
+    OsShmRingAttach(client, ring);
+    return rc;
+}
+
+static int
+ProcShmTransportDispatch(ClientPtr client)
+{
+    REQUEST(xReq);
+    switch (stuff->data) {
+    case X_ShmTransportQueryVersion:
+        return ProcShmTransportQueryVersion(client);
+    case X_ShmTransportAttach:
+        return ProcShmTransportAttach(client);
+    default:
+        return BadRequest;
+    }
+}
+
+void
+ShmTransportExtensionInit(void)
+{
+    AddExtension(SHMTRANSPORT_NAME, 0, 0,
+                 ProcShmTransportDispatch, ProcShmTransportDispatch,
+                 NULL, StandardMinorOpcode);
+}
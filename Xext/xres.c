@@ -13,9 +13,11 @@
 
 #include "dix/client_priv.h"
 #include "dix/dix_priv.h"
+#include "dix/profile_priv.h"
 #include "dix/registry_priv.h"
 #include "dix/request_priv.h"
 #include "dix/resource_priv.h"
+#include "include/dispatchprofileproto.h"
 #include "os/client_priv.h"
 #include "miext/extinit_priv.h"
 #include "Xext/xace.h"
@@ -962,3 +964,171 @@ ResExtensionInit(void)
                         ProcResDispatch, ProcResDispatch,
                         NULL, StandardMinorOpcode);
 }
+
+/*
+ * DISPATCH-PROFILE hands out the counters +dispatchprofile collects, see
+ * dispatchprofileproto.h. It's a separate extension, the request has no
+ * place in the X-Resource protocol.
+ */
+
+static int
+ProcDispatchProfileQueryVersion(ClientPtr client)
+{
+    REQUEST_SIZE_MATCH(xDispatchProfileQueryVersionReq);
+
+    xDispatchProfileQueryVersionReply reply = {
+        .majorVersion = DISPATCHPROFILE_MAJOR_VERSION,
+        .minorVersion = DISPATCHPROFILE_MINOR_VERSION
+    };
+
+    if (client->swapped) {
+        swapl(&reply.majorVersion);
+        swapl(&reply.minorVersion);
+    }
+
+    return X_SEND_REPLY_SIMPLE(client, reply);
+}
+
+typedef struct {
+    x_rpcbuf_t *rpcbuf;
+    CARD32 numEntries;
+} ConstructClientProfileCtx;
+
+static void
+AddClientProfileEntry(ClientPtr client, int major, int minor,
+                      const DispatchProfileEntryRec *entry, void *closure)
+{
+    ConstructClientProfileCtx *ctx = closure;
+
+    x_rpcbuf_write_CARD32(ctx->rpcbuf, client->clientAsMask);
+    x_rpcbuf_write_CARD16(ctx->rpcbuf, major);
+    x_rpcbuf_write_CARD16(ctx->rpcbuf, minor);
+    x_rpcbuf_write_CARD64(ctx->rpcbuf, entry->count);
+    x_rpcbuf_write_CARD64(ctx->rpcbuf, entry->errors);
+    x_rpcbuf_write_CARD64(ctx->rpcbuf, entry->time);
+    x_rpcbuf_write_CARD64(ctx->rpcbuf, entry->maxTime);
+    x_rpcbuf_write_CARD64(ctx->rpcbuf, entry->bytesIn);
+    x_rpcbuf_write_CARD64(ctx->rpcbuf, entry->bytesOut);
+    ctx->numEntries++;
+}
+
+static int
+ProcDispatchProfileGetClientProfile(ClientPtr client)
+{
+    REQUEST(xDispatchProfileGetClientProfileReq);
+    REQUEST_SIZE_MATCH(xDispatchProfileGetClientProfileReq);
+
+    if (stuff->flags & ~DispatchProfileResetMask) {
+        client->errorValue = stuff->flags;
+        return BadValue;
+    }
+
+    Mask access = DixReadAccess;
+    if (stuff->flags & DispatchProfileResetMask)
+        access |= DixManageAccess;
+
+    ClientPtr aboutClient = NULL;
+    if (stuff->client != None) {
+        aboutClient = dixClientForXID(stuff->client);
+        if ((!aboutClient) ||
+            (dixCallClientAccessCallback(client, aboutClient, access)
+                                  != Success)) {
+            client->errorValue = stuff->client;
+            return BadValue;
+        }
+    }
+
+    x_rpcbuf_t rpcbuf = { .swapped = client->swapped, .err_clear = TRUE };
+    ConstructClientProfileCtx ctx = { .rpcbuf = &rpcbuf };
+
+    for (int i = 1; i < currentMaxClients; i++) {
+        ClientPtr walkClient = clients[i];
+
+        if (!walkClient || (aboutClient && walkClient != aboutClient))
+            continue;
+        if (!aboutClient &&
+            dixCallClientAccessCallback(client, walkClient, access) != Success)
+            continue;
+
+        DispatchProfileForEach(walkClient, AddClientProfileEntry, &ctx);
+    }
+
+    if (rpcbuf.error)
+        return BadAlloc;
+
+    /* only once the reply is complete, nothing is lost on BadAlloc */
+    if (stuff->flags & DispatchProfileResetMask) {
+        for (int i = 1; i < currentMaxClients; i++) {
+            ClientPtr walkClient = clients[i];
+
+            if (!walkClient || (aboutClient && walkClient != aboutClient))
+                continue;
+            if (!aboutClient &&
+                dixCallClientAccessCallback(client, walkClient,
+                                            access) != Success)
+                continue;
+
+            DispatchProfileReset(walkClient);
+        }
+    }
+
+    xDispatchProfileGetClientProfileReply reply = {
+        .numEntries = ctx.numEntries
+    };
+
+    if (client->swapped) {
+        swapl(&reply.numEntries);
+    }
+
+    return X_SEND_REPLY_WITH_RPCBUF(client, reply, rpcbuf);
+}
+
+static int
+ProcDispatchProfileDispatch(ClientPtr client)
+{
+    REQUEST(xReq);
+    switch (stuff->data) {
+    case X_DispatchProfileQueryVersion:
+        return ProcDispatchProfileQueryVersion(client);
+    case X_DispatchProfileGetClientProfile:
+        return ProcDispatchProfileGetClientProfile(client);
+    default:
+        return BadRequest;
+    }
+}
+
+static int _X_COLD
+SProcDispatchProfileGetClientProfile(ClientPtr client)
+{
+    REQUEST(xDispatchProfileGetClientProfileReq);
+    REQUEST_SIZE_MATCH(xDispatchProfileGetClientProfileReq);
+    swapl(&stuff->client);
+    swapl(&stuff->flags);
+    return ProcDispatchProfileGetClientProfile(client);
+}
+
+static int _X_COLD
+SProcDispatchProfileDispatch(ClientPtr client)
+{
+    REQUEST(xReq);
+    switch (stuff->data) {
+    case X_DispatchProfileQueryVersion:
+        return ProcDispatchProfileQueryVersion(client);
+    case X_DispatchProfileGetClientProfile:
+        return SProcDispatchProfileGetClientProfile(client);
+    default:
+        return BadRequest;
+    }
+}
+
+void
+DispatchProfileExtensionInit(void)
+{
+    if (!dispatchProfileEnabled)
+        return;
+
+    (void) AddExtension(DISPATCHPROFILE_NAME, 0, 0,
+                        ProcDispatchProfileDispatch,
+                        SProcDispatchProfileDispatch,
+                        NULL, StandardMinorOpcode);
+}
@@ -310,7 +310,7 @@ compScreenInit(ScreenPtr pScreen)
 {
     if (!dixRegisterPrivateKey(&CompScreenPrivateKeyRec, PRIVATE_SCREEN, 0))
         return FALSE;
-    if (!dixRegisterPrivateKey(&CompWindowPrivateKeyRec, PRIVATE_WINDOW, 0))
+    if (!dixRegisterHotPrivateKey(&CompWindowPrivateKeyRec, PRIVATE_WINDOW, 0))
         return FALSE;
     if (!dixRegisterPrivateKey(&CompSubwindowsPrivateKeyRec, PRIVATE_WINDOW, 0))
         return FALSE;
@@ -46,6 +46,7 @@ SOFTWARE.
 
 #include <dix-config.h>
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <X11/X.h>
@@ -59,84 +60,186 @@ SOFTWARE.
 #include "dix.h"
 
 #define InitialTableSize 256
+#define InitialHashSize 1024
+#define ArenaBlockSize 16384
+
+/*
+ * Atoms are never freed (short of a server reset), so we keep them in
+ * three flat structures:
+ *
+ *  - nodeTable, indexed by atom number, holding the string, its length
+ *    and its hash, for NameForAtom() and for rehashing;
+ *  - hashTable, an open addressing (linear probing) table of atom numbers
+ *    keyed on the string hash, for MakeAtom();
+ *  - a string arena the names of non-predefined atoms are copied into,
+ *    instead of one malloc per atom.
+ */
 
 typedef struct _Node {
-    struct _Node *left, *right;
-    Atom a;
-    unsigned int fingerPrint;
     const char *string;
+    unsigned int len;
+    unsigned int hash;
 } NodeRec, *NodePtr;
 
+typedef struct _ArenaBlock {
+    struct _ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlockRec, *ArenaBlockPtr;
+
 static Atom lastAtom = None;
-static NodePtr atomRoot = NULL;
 static unsigned long tableLength;
-static NodePtr *nodeTable;
+static NodePtr nodeTable;
+static Atom *hashTable;
+static unsigned long hashMask;
+static ArenaBlockPtr arena;
 
-Atom
-MakeAtom(const char *string, unsigned len, Bool makeit)
+/*
+ * FNV-1a over the string, followed by the murmur3 finalizer so that the
+ * low bits we mask with are well mixed even for short, similar names
+ * like "_NET_WM_STATE_..." families.
+ */
+static unsigned int
+AtomHash(const char *string, unsigned int len)
 {
-    NodePtr *np;
-    int comp;
-    unsigned int fp = 0;
-
-    np = &atomRoot;
-    for (unsigned int i = 0; i < (len + 1) / 2; i++) {
-        fp = fp * 27 + (unsigned int)string[i];
-        fp = fp * 27 + (unsigned int)string[len - 1 - i];
-    }
-    while (*np != NULL) {
-        if (fp < (*np)->fingerPrint)
-            np = &((*np)->left);
-        else if (fp > (*np)->fingerPrint)
-            np = &((*np)->right);
-        else {                  /* now start testing the strings */
-            comp = strncmp(string, (*np)->string, len);
-            if ((comp < 0) || ((comp == 0) && (len < strlen((*np)->string))))
-                np = &((*np)->left);
-            else if (comp > 0)
-                np = &((*np)->right);
-            else
-                return (*np)->a;
-        }
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (unsigned int i = 0; i < len; i++) {
+        h ^= (unsigned char) string[i];
+        h *= 0x100000001b3ULL;
     }
-    if (makeit) {
-        NodePtr nd = calloc(1, sizeof(NodeRec));
-        if (!nd)
-            return BAD_RESOURCE;
-        if (lastAtom < XA_LAST_PREDEFINED) {
-            nd->string = string;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (unsigned int) h;
+}
+
+static const char *
+ArenaStrndup(const char *string, unsigned int len)
+{
+    ArenaBlockPtr block = arena;
+    char *dst;
+
+    if (!block || block->size - block->used < (size_t) len + 1) {
+        size_t size = ArenaBlockSize;
+
+        if ((size_t) len + 1 > size)
+            size = (size_t) len + 1;
+        block = malloc(sizeof(ArenaBlockRec) + size);
+        if (!block)
+            return NULL;
+        block->used = 0;
+        block->size = size;
+        /* keep a partly filled current block in front for short names */
+        if (arena && size > ArenaBlockSize) {
+            block->next = arena->next;
+            arena->next = block;
         }
         else {
-            nd->string = strndup(string, len);
-            if (!nd->string) {
-                free(nd);
-                return BAD_RESOURCE;
-            }
-        }
-        if ((lastAtom + 1) >= tableLength) {
-            NodePtr *table;
-
-            table = reallocarray(nodeTable, tableLength, 2 * sizeof(NodePtr));
-            if (!table) {
-                if (nd->string != string) {
-                    /* nd->string has been strdup'ed */
-                    free((char *) nd->string);
-                }
-                free(nd);
-                return BAD_RESOURCE;
-            }
-            tableLength <<= 1;
-            nodeTable = table;
+            block->next = arena;
+            arena = block;
         }
-        *np = nd;
-        nd->left = nd->right = NULL;
-        nd->fingerPrint = fp;
-        nd->a = ++lastAtom;
-        nodeTable[lastAtom] = nd;
-        return nd->a;
     }
-    else
+    dst = block->data + block->used;
+    memcpy(dst, string, len);
+    dst[len] = '\0';
+    block->used += (size_t) len + 1;
+    return dst;
+}
+
+static void
+ArenaFree(void)
+{
+    while (arena) {
+        ArenaBlockPtr next = arena->next;
+
+        free(arena);
+        arena = next;
+    }
+}
+
+static Bool
+GrowHashTable(void)
+{
+    unsigned long size = (hashMask + 1) * 2;
+    Atom *table = calloc(size, sizeof(Atom));
+
+    if (!table)
+        return FALSE;
+    for (Atom a = 1; a <= lastAtom; a++) {
+        unsigned long i = nodeTable[a].hash & (size - 1);
+
+        while (table[i] != None)
+            i = (i + 1) & (size - 1);
+        table[i] = a;
+    }
+    free(hashTable);
+    hashTable = table;
+    hashMask = size - 1;
+    return TRUE;
+}
+
+Atom
+MakeAtom(const char *string, unsigned len, Bool makeit)
+{
+    unsigned int hash;
+    unsigned long i;
+    Atom a;
+
+    if (!hashTable)
+        return makeit ? BAD_RESOURCE : None;
+
+    /* names are stored NUL terminated, so never match past an embedded NUL */
+    len = strnlen(string, len);
+    hash = AtomHash(string, len);
+
+    for (i = hash & hashMask; (a = hashTable[i]) != None;
+         i = (i + 1) & hashMask) {
+        NodePtr nd = &nodeTable[a];
+
+        if (nd->hash == hash && nd->len == len &&
+            memcmp(nd->string, string, len) == 0)
+            return a;
+    }
+
+    if (!makeit)
         return None;
+
+    if ((lastAtom + 1) >= tableLength) {
+        NodePtr table;
+
+        table = reallocarray(nodeTable, tableLength, 2 * sizeof(NodeRec));
+        if (!table)
+            return BAD_RESOURCE;
+        tableLength <<= 1;
+        nodeTable = table;
+    }
+
+    /* keep the load factor at or below 1/2 */
+    if ((lastAtom + 1) * 2 > hashMask + 1) {
+        if (!GrowHashTable())
+            return BAD_RESOURCE;
+        for (i = hash & hashMask; hashTable[i] != None; i = (i + 1) & hashMask)
+            ;
+    }
+
+    a = lastAtom + 1;
+    if (lastAtom < XA_LAST_PREDEFINED) {
+        nodeTable[a].string = string;
+    }
+    else {
+        nodeTable[a].string = ArenaStrndup(string, len);
+        if (!nodeTable[a].string)
+            return BAD_RESOURCE;
+    }
+    nodeTable[a].len = len;
+    nodeTable[a].hash = hash;
+    hashTable[i] = a;
+    lastAtom = a;
+    return a;
 }
 
 Bool
@@ -148,39 +251,20 @@ ValidAtom(Atom atom)
 const char *
 NameForAtom(Atom atom)
 {
-    NodePtr node;
-
     if (atom > lastAtom)
         return 0;
-    if ((node = nodeTable[atom]) == NULL)
-        return 0;
-    return node->string;
-}
-
-static void
-FreeAtom(NodePtr patom)
-{
-    if (patom->left)
-        FreeAtom(patom->left);
-    if (patom->right)
-        FreeAtom(patom->right);
-    if (patom->a > XA_LAST_PREDEFINED) {
-        /*
-         * All strings above XA_LAST_PREDEFINED are strdup'ed, so it's safe to
-         * cast here
-         */
-        free((char *) patom->string);
-    }
-    free(patom);
+    return nodeTable[atom].string;
 }
 
 void
 FreeAllAtoms(void)
 {
-    if (atomRoot == NULL)
+    if (nodeTable == NULL)
         return;
-    FreeAtom(atomRoot);
-    atomRoot = NULL;
+    ArenaFree();
+    free(hashTable);
+    hashTable = NULL;
+    hashMask = 0;
     free(nodeTable);
     nodeTable = NULL;
     lastAtom = None;
@@ -191,10 +275,14 @@ InitAtoms(void)
 {
     FreeAllAtoms();
     tableLength = InitialTableSize;
-    nodeTable = calloc(InitialTableSize, sizeof(NodePtr));
+    nodeTable = calloc(InitialTableSize, sizeof(NodeRec));
     if (!nodeTable)
         FatalError("creating atom table");
-    nodeTable[None] = NULL;
+    hashTable = calloc(InitialHashSize, sizeof(Atom));
+    if (!hashTable)
+        FatalError("creating atom hash table");
+    hashMask = InitialHashSize - 1;
+    nodeTable[None].string = NULL;
     MakePredeclaredAtoms();
     if (lastAtom != XA_LAST_PREDEFINED)
         FatalError("builtin atom number mismatch");
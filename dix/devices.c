@@ -188,6 +188,13 @@ DeviceSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
         if (!checkonly)
             DeviceSetTransform(dev, f);
     }
+    else if (property == XIGetKnownProperty(XI_PROP_COALESCE_MOTION)) {
+        if (prop->format != 8 || prop->type != XA_INTEGER || prop->size != 1)
+            return BadValue;
+
+        if (!checkonly)
+            dev->coalesceMotion = !!(*(CARD8 *) prop->data);
+    }
 
     return Success;
 }
@@ -246,7 +253,7 @@ AddInputDevice(ClientPtr client, DeviceProc deviceProc, Bool autoStart)
     DeviceIntPtr dev, *prev;    /* not a typo */
     int devid;
     char devind[MAXDEVICES];
-    BOOL enabled;
+    BOOL enabled, coalesce;
     float transform[9];
 
     /* Find next available id, 0 and 1 are reserved */
@@ -332,6 +339,13 @@ AddInputDevice(ClientPtr client, DeviceProc deviceProc, Bool autoStart)
     XISetDevicePropertyDeletable(dev, XIGetKnownProperty(XI_PROP_TRANSFORM),
                                  FALSE);
 
+    coalesce = FALSE;
+    XIChangeDeviceProperty(dev, XIGetKnownProperty(XI_PROP_COALESCE_MOTION),
+                           XA_INTEGER, 8, PropModeReplace, 1, &coalesce, FALSE);
+    XISetDevicePropertyDeletable(dev,
+                                 XIGetKnownProperty(XI_PROP_COALESCE_MOTION),
+                                 FALSE);
+
     XIRegisterPropertyHandler(dev, DeviceSetProperty, NULL, NULL);
 
     return dev;
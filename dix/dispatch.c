@@ -110,6 +110,7 @@ Equipment Corporation.
 #include "dix/extension_priv.h"
 #include "dix/input_priv.h"
 #include "dix/gc_priv.h"
+#include "dix/profile_priv.h"
 #include "dix/registry_priv.h"
 #include "dix/request_priv.h"
 #include "dix/resource_priv.h"
@@ -124,6 +125,7 @@ Equipment Corporation.
 #include "os/auth.h"
 #include "os/client_priv.h"
 #include "os/ddx_priv.h"
+#include "os/io_priv.h"
 #include "os/osdep.h"
 #include "os/probes_priv.h"
 #include "os/screensaver.h"
@@ -562,8 +564,12 @@ Dispatch(void)
                     }
                     if (result == Success) {
                         currentClient = client;
+                        if (dispatchProfileEnabled)
+                            DispatchProfileBegin(client);
                         result =
                             (*client->requestVector[client->majorOp]) (client);
+                        if (dispatchProfileEnabled)
+                            DispatchProfileEnd(client, read_result, result);
                         currentClient = NULL;
                     }
                 }
@@ -597,6 +603,7 @@ Dispatch(void)
     ddxBeforeReset();
     KillAllClients();
     SmartScheduleLatencyLimited = 0;
+    OsLogIOStats();
     ResetOsBuffers();
 }
 
@@ -133,6 +133,7 @@ Equipment Corporation.
 #include "dix/screenint_priv.h"
 #include "dix/window_priv.h"
 #include "include/extinit.h"
+#include "mi/mi_priv.h"
 #include "os/bug_priv.h"
 #include "os/client_priv.h"
 #include "os/fmt.h"
@@ -3270,6 +3271,8 @@ WindowsRestructured(void)
 {
     DeviceIntPtr pDev = inputInfo.devices;
 
+    miWindowIndexInvalidate();
+
     while (pDev) {
         if (InputDevIsMaster(pDev) || InputDevIsFloating(pDev))
             CheckMotion(NULL, pDev);
@@ -91,6 +91,7 @@ Equipment Corporation.
 #include "dix/dix_priv.h"
 #include "dix/input_priv.h"
 #include "dix/gc_priv.h"
+#include "dix/profile_priv.h"
 #include "dix/registry_priv.h"
 #include "dix/screensaver_priv.h"
 #include "dix/selection_priv.h"
@@ -191,6 +192,8 @@ dix_main(int argc, char *argv[], char *envp[])
         InitFonts();
         InitCallbackManager();
         InitOutput(argc, argv);
+        /* after the DDX, which may have claimed SIGUSR2 */
+        DispatchProfileInit();
 
         if (screenInfo.numScreens < 1)
             FatalError("no screens found");
@@ -255,6 +258,7 @@ dix_main(int argc, char *argv[], char *envp[])
         });
 
         LogMessageVerb(X_INFO, 1, "Screen(s) initialized\n");
+        dixPrivateLayout();
 
         InitCoreDevices();
         InitInput(argc, argv);
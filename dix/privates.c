@@ -50,10 +50,13 @@ from The Open Group.
 
 #include <dix-config.h>
 
+#include <limits.h>
 #include <stddef.h>
+#include <stdlib.h>
 
 #include "dix/colormap_priv.h"
 #include "dix/screenint_priv.h"
+#include "os/log_priv.h"
 
 #include "windowstr.h"
 #include "resource.h"
@@ -128,6 +131,32 @@ static const Bool screen_specific_private[PRIVATE_LAST] = {
     [PRIVATE_GLYPHSET] = FALSE,
 };
 
+/*
+ * Keys registered as hot, looked up on most uses of their objects. The
+ * flag can't go into DevPrivateKeyRec, drivers have those in their own
+ * data. Keys beyond the table are cold, which only costs speed.
+ */
+#define MAX_HOT_KEYS    32
+
+static DevPrivateKey hot_keys[MAX_HOT_KEYS];
+static int num_hot_keys;
+
+static Bool
+private_key_hot(DevPrivateKey key)
+{
+    for (int i = 0; i < num_hot_keys; i++)
+        if (hot_keys[i] == key)
+            return TRUE;
+    return FALSE;
+}
+
+static void
+set_private_key_hot(DevPrivateKey key)
+{
+    if (num_hot_keys < MAX_HOT_KEYS && !private_key_hot(key))
+        hot_keys[num_hot_keys++] = key;
+}
+
 typedef Bool (*FixupFunc) (PrivatePtr *privates, int offset, unsigned bytes);
 
 typedef enum { FixupMove, FixupRealloc } FixupType;
@@ -379,6 +408,15 @@ dixRegisterPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size)
     return TRUE;
 }
 
+Bool
+dixRegisterHotPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size)
+{
+    if (!dixRegisterPrivateKey(key, type, size))
+        return FALSE;
+    set_private_key_hot(key);
+    return TRUE;
+}
+
 Bool
 dixRegisterScreenPrivateKey(DevScreenPrivateKeyPtr screenKey, ScreenPtr pScreen,
                             DevPrivateType type, unsigned size)
@@ -411,6 +449,163 @@ _dixGetScreenPrivateKey(const DevScreenPrivateKeyPtr key, ScreenPtr pScreen)
     return dixGetPrivate(&pScreen->devPrivates, &key->screenKey);
 }
 
+static unsigned
+private_key_bytes(DevPrivateKey key)
+{
+    unsigned bytes = key->size ? key->size : sizeof(void *);
+
+    return (bytes + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+static int
+compare_private_keys(const void *a, const void *b)
+{
+    DevPrivateKey ka = *(DevPrivateKey const *) a;
+    DevPrivateKey kb = *(DevPrivateKey const *) b;
+    Bool hot_a = private_key_hot(ka), hot_b = private_key_hot(kb);
+
+    /* hot ones first, the small ones of them before the large ones */
+    if (hot_a != hot_b)
+        return hot_a ? -1 : 1;
+    if (hot_a && private_key_bytes(ka) != private_key_bytes(kb))
+        return private_key_bytes(ka) < private_key_bytes(kb) ? -1 : 1;
+    return ka->offset - kb->offset;
+}
+
+/* the keys of a set in the order they're laid out in, into keys */
+static int
+sort_private_set(DevPrivateSetPtr set, DevPrivateKey *keys, int *nhot)
+{
+    int nkeys = 0;
+
+    for (DevPrivateKey k = set->key; k; k = k->next) {
+        keys[nkeys++] = k;
+        if (private_key_hot(k))
+            (*nhot)++;
+    }
+    qsort(keys, nkeys, sizeof(DevPrivateKey), compare_private_keys);
+    return nkeys;
+}
+
+static int
+place_private_keys(DevPrivateKey *keys, int nkeys, int offset)
+{
+    for (int i = 0; i < nkeys; i++) {
+        keys[i]->offset = offset;
+        offset += private_key_bytes(keys[i]);
+    }
+    return offset;
+}
+
+static int
+count_private_keys(DevPrivateSetPtr set, int *start)
+{
+    int nkeys = 0;
+
+    for (DevPrivateKey k = set->key; k; k = k->next) {
+        nkeys++;
+        if (k->offset < *start)
+            *start = k->offset;
+    }
+    return nkeys;
+}
+
+/*
+ * Lay out the privates of a type while there are no objects of it, so
+ * the hot ones share the cache lines right behind the object's own
+ * fields: the hot global ones, then the screen-specific ones of each
+ * screen, hot ones first, then the cold global ones. The screens share
+ * the space of their screen-specific privates, as large as the largest
+ * of them. Running it again without new keys keeps all the offsets.
+ */
+static void
+layout_private_type(DevPrivateType type)
+{
+    DevPrivateSetPtr sets[1 + MAXSCREENS + MAXGPUSCREENS];
+    DevPrivateKey *keys, *k;
+    int nsets = 0, total = 0, nhot = 0, start = global_keys[type].offset;
+    int global, ghot = 0, offset, end;
+
+    sets[nsets++] = &global_keys[type];
+    if (screen_specific_private[type]) {
+        DIX_FOR_EACH_SCREEN({
+            sets[nsets++] = &walkScreen->screenSpecificPrivates[type];
+        });
+        DIX_FOR_EACH_GPU_SCREEN({
+            sets[nsets++] = &walkScreen->screenSpecificPrivates[type];
+        });
+    }
+    for (int i = 0; i < nsets; i++)
+        total += count_private_keys(sets[i], &start);
+    if (!total || !(keys = calloc(total, sizeof(DevPrivateKey))))
+        return;
+
+    global = sort_private_set(sets[0], keys, &ghot);
+    nhot = ghot;
+    k = keys + global;
+    for (int i = 1; i < nsets; i++)
+        k += sort_private_set(sets[i], k, &nhot);
+    if (!nhot) {
+        free(keys);
+        return;
+    }
+
+    offset = place_private_keys(keys, ghot, start);
+    end = offset;
+    k = keys + global;
+    for (int i = 1; i < nsets; i++) {
+        int nkeys = 0, screen_end;
+
+        for (DevPrivateKey key = sets[i]->key; key; key = key->next)
+            nkeys++;
+        screen_end = place_private_keys(k, nkeys, offset);
+        if (screen_end > end)
+            end = screen_end;
+        k += nkeys;
+    }
+    end = place_private_keys(keys + ghot, global - ghot, end);
+
+    for (int i = 0; i < nsets; i++)
+        sets[i]->offset = end;
+    free(keys);
+}
+
+/*
+ * Reorder the screen-specific privates of a screen that has no objects
+ * of the type yet, while other screens do, within the space they take.
+ */
+static void
+layout_private_set(DevPrivateSetPtr set)
+{
+    DevPrivateKey *keys;
+    int nkeys, nhot = 0, start = set->offset;
+
+    nkeys = count_private_keys(set, &start);
+    if (!nkeys || !(keys = calloc(nkeys, sizeof(DevPrivateKey))))
+        return;
+    sort_private_set(set, keys, &nhot);
+    if (nhot)
+        place_private_keys(keys, nkeys, start);
+    free(keys);
+}
+
+/*
+ * Lay out the privates of a type once objects of it may be created, its
+ * size asked for or an object allocated. Types with objects before all
+ * keys are registered keep the order the keys were registered in.
+ */
+static void
+layout_privates(DevPrivateType type, ScreenPtr pScreen)
+{
+    if (!num_hot_keys || type == PRIVATE_XSELINUX || allocated_early[type])
+        return;
+    if (!global_keys[type].created)
+        layout_private_type(type);
+    else if (pScreen && screen_specific_private[type] &&
+             !pScreen->screenSpecificPrivates[type].created)
+        layout_private_set(&pScreen->screenSpecificPrivates[type]);
+}
+
 /*
  * Initialize privates by zeroing them
  */
@@ -419,6 +614,8 @@ _dixInitPrivates(PrivatePtr *privates, void *addr, DevPrivateType type)
 {
     assert (!screen_specific_private[type]);
 
+    if (!global_keys[type].created)
+        layout_privates(type, NULL);
     global_keys[type].created++;
     if (xselinux_private[type])
         global_keys[PRIVATE_XSELINUX].created++;
@@ -458,6 +655,7 @@ _dixAllocateObjectWithPrivates(unsigned baseSize, unsigned clear,
     assert(type < PRIVATE_LAST);
     assert(!screen_specific_private[type]);
 
+    layout_privates(type, NULL);
     /* round up so that void * is aligned */
     baseSize = (baseSize + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
     totalSize = baseSize + global_keys[type].offset;
@@ -541,6 +739,7 @@ dixPrivatesSize(DevPrivateType type)
     assert(type < PRIVATE_LAST);
     assert (!screen_specific_private[type]);
 
+    layout_privates(type, NULL);
     return global_keys[type].offset;
 }
 
@@ -619,6 +818,16 @@ dixRegisterScreenSpecificPrivateKey(ScreenPtr pScreen, DevPrivateKey key,
     return TRUE;
 }
 
+Bool
+dixRegisterHotScreenSpecificPrivateKey(ScreenPtr pScreen, DevPrivateKey key,
+                                       DevPrivateType type, unsigned size)
+{
+    if (!dixRegisterScreenSpecificPrivateKey(pScreen, key, type, size))
+        return FALSE;
+    set_private_key_hot(key);
+    return TRUE;
+}
+
 /* Clean up screen-specific privates before CloseScreen */
 void
 dixFreeScreenSpecificPrivates(ScreenPtr pScreen)
@@ -645,6 +854,7 @@ _dixInitScreenPrivates(ScreenPtr pScreen, PrivatePtr *privates, void *addr, DevP
     int privates_size;
     assert (screen_specific_private[type]);
 
+    layout_privates(type, pScreen);
     if (pScreen) {
         privates_size = pScreen->screenSpecificPrivates[type].offset;
         pScreen->screenSpecificPrivates[type].created++;
@@ -677,6 +887,7 @@ _dixAllocateScreenObjectWithPrivates(ScreenPtr pScreen,
     assert(type < PRIVATE_LAST);
     assert (screen_specific_private[type]);
 
+    layout_privates(type, pScreen);
     if (pScreen)
         privates_size = pScreen->screenSpecificPrivates[type].offset;
     else
@@ -702,6 +913,7 @@ dixScreenSpecificPrivatesSize(ScreenPtr pScreen, DevPrivateType type)
     assert(type >= PRIVATE_SCREEN);
     assert(type < PRIVATE_LAST);
 
+    layout_privates(type, pScreen);
     if (screen_specific_private[type])
         return pScreen->screenSpecificPrivates[type].offset;
     else
@@ -729,9 +941,66 @@ dixPrivateUsage(void)
     ErrorF("TOTAL: %d objects, %d bytes, %d allocs\n", objects, bytes, alloc);
 }
 
+static void
+log_private_set(const char *name, DevPrivateSetPtr set)
+{
+    int nkeys = 0, nhot = 0, start = INT_MAX, hot_end;
+
+    for (DevPrivateKey k = set->key; k; k = k->next)
+        if (k->offset < start)
+            start = k->offset;
+    hot_end = start;
+    for (DevPrivateKey k = set->key; k; k = k->next) {
+        nkeys++;
+        if (private_key_hot(k)) {
+            nhot++;
+            if (k->offset + (int) private_key_bytes(k) > hot_end)
+                hot_end = k->offset + private_key_bytes(k);
+        }
+    }
+    if (!nkeys)
+        return;
+    LogMessageVerb(X_DEBUG, 5, "privates: %s: %d keys, bytes %d to %d, "
+                   "%d hot in the first %d bytes\n", name, nkeys, start,
+                   (int) set->offset, nhot, hot_end - start);
+    /* by offset, the list is newest first */
+    for (int offset = start; offset < (int) set->offset;) {
+        DevPrivateKey key = NULL;
+
+        for (DevPrivateKey k = set->key; k; k = k->next)
+            if (k->offset >= offset && (!key || k->offset < key->offset))
+                key = k;
+        if (!key)
+            break;
+        LogMessageVerb(X_DEBUG, 5, "privates:   offset %4d size %4d%s\n",
+                       key->offset, key->size,
+                       private_key_hot(key) ? " hot" : "");
+        offset = key->offset + 1;
+    }
+}
+
+void
+dixPrivateLayout(void)
+{
+    for (DevPrivateType t = PRIVATE_XSELINUX; t < PRIVATE_LAST; t++) {
+        char name[64];
+
+        log_private_set(key_names[t], &global_keys[t]);
+        if (!screen_specific_private[t])
+            continue;
+        DIX_FOR_EACH_SCREEN({
+            snprintf(name, sizeof(name), "%s of screen %d", key_names[t],
+                     walkScreen->myNum);
+            log_private_set(name, &walkScreen->screenSpecificPrivates[t]);
+        });
+    }
+}
+
 void
 dixResetPrivates(void)
 {
+    num_hot_keys = 0;
+
     for (DevPrivateType t = PRIVATE_XSELINUX; t < PRIVATE_LAST; t++) {
         for (DevPrivateKey key = global_keys[t].key, next; key; key = next) {
             next = key->next;
@@ -0,0 +1,330 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Per-client request profiling
+ *
+ * When enabled with +dispatchprofile, Dispatch() brackets every request
+ * handler with DispatchProfileBegin() / DispatchProfileEnd(), which count
+ * requests, handler time on the monotonic clock and bytes in and out per
+ * client and (major, minor) opcode. Clients read them with the
+ * DISPATCH-PROFILE extension (Xext/xres.c), and they are dumped to the log
+ * on SIGUSR2 unless the DDX uses that signal.
+ */
+#include <dix-config.h>
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <X11/X.h>
+
+#include "dix/dix_priv.h"
+#include "dix/profile_priv.h"
+#include "dix/registry_priv.h"
+#include "os/client_priv.h"
+#include "os/io_priv.h"
+#include "os/osdep.h"
+
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "extnsionst.h"
+#include "privates.h"
+
+#define PROFILE_MAJORS  256
+/* minor opcodes beyond this are accounted to the last one */
+#define PROFILE_MINORS  256
+/* requests per client in the log dump */
+#define PROFILE_LOG_TOP 10
+
+typedef struct {
+    DispatchProfileEntryRec core[EXTENSION_BASE];
+    DispatchProfileEntryPtr ext[PROFILE_MAJORS - EXTENSION_BASE];
+} ClientProfileRec, *ClientProfilePtr;
+
+bool dispatchProfileEnabled;
+
+static DevPrivateKeyRec ClientProfilePrivateKeyRec;
+
+#define ClientProfilePrivateKey (&ClientProfilePrivateKeyRec)
+#define GetClientProfile(c) \
+    ((ClientProfilePtr) dixLookupPrivate(&(c)->devPrivates, ClientProfilePrivateKey))
+
+static uint64_t requestStart;
+static uint64_t requestBytesOut;
+/* looked up before the handler runs, which may free the client */
+static DispatchProfileEntryPtr requestEntry;
+static int requestClient;
+
+static volatile sig_atomic_t logRequested;
+
+static uint64_t
+ProfileNow(void)
+{
+#ifdef MONOTONIC_CLOCK
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+    return GetTimeInMicros() * 1000;
+}
+
+static uint64_t
+ClientBytesOut(ClientPtr client)
+{
+    OsCommPtr oc = client->osPrivate;
+
+    return oc ? oc->bytes_out : 0;
+}
+
+static DispatchProfileEntryPtr
+ProfileEntry(ClientPtr client, int major, int minor)
+{
+    ClientProfilePtr profile = GetClientProfile(client);
+    DispatchProfileEntryPtr *ext;
+
+    if (!profile) {
+        profile = calloc(1, sizeof(ClientProfileRec));
+        if (!profile)
+            return NULL;
+        dixSetPrivate(&client->devPrivates, ClientProfilePrivateKey, profile);
+    }
+
+    if (major < EXTENSION_BASE)
+        return &profile->core[major];
+
+    ext = &profile->ext[major - EXTENSION_BASE];
+    if (!*ext) {
+        *ext = calloc(PROFILE_MINORS, sizeof(DispatchProfileEntryRec));
+        if (!*ext)
+            return NULL;
+    }
+    if (minor >= PROFILE_MINORS)
+        minor = PROFILE_MINORS - 1;
+    return &(*ext)[minor];
+}
+
+static void
+ProfileFree(ClientProfilePtr profile)
+{
+    if (!profile)
+        return;
+    for (int i = 0; i < PROFILE_MAJORS - EXTENSION_BASE; i++)
+        free(profile->ext[i]);
+    free(profile);
+}
+
+void
+DispatchProfileBegin(ClientPtr client)
+{
+    requestEntry = ProfileEntry(client, client->majorOp, client->minorOp);
+    requestClient = client->index;
+    requestBytesOut = ClientBytesOut(client);
+    requestStart = ProfileNow();
+}
+
+void
+DispatchProfileEnd(ClientPtr client, long bytes, int result)
+{
+    uint64_t time = ProfileNow() - requestStart;
+    DispatchProfileEntryPtr entry = requestEntry;
+
+    requestEntry = NULL;
+    /* closed down by its own request (KillClient), the counters are gone */
+    if (clients[requestClient] != client || client->clientGone)
+        return;
+    if (!entry)
+        return;
+
+    entry->count++;
+    if (result != Success)
+        entry->errors++;
+    entry->time += time;
+    if (time > entry->maxTime)
+        entry->maxTime = time;
+    if (bytes > 0)
+        entry->bytesIn += bytes;
+    entry->bytesOut += ClientBytesOut(client) - requestBytesOut;
+}
+
+void
+DispatchProfileForEach(ClientPtr client, DispatchProfileProcPtr proc,
+                       void *closure)
+{
+    ClientProfilePtr profile;
+
+    if (!dispatchProfileEnabled)
+        return;
+    profile = GetClientProfile(client);
+    if (!profile)
+        return;
+
+    for (int major = 0; major < EXTENSION_BASE; major++)
+        if (profile->core[major].count)
+            proc(client, major, 0, &profile->core[major], closure);
+
+    for (int major = EXTENSION_BASE; major < PROFILE_MAJORS; major++) {
+        DispatchProfileEntryPtr ext = profile->ext[major - EXTENSION_BASE];
+
+        if (!ext)
+            continue;
+        for (int minor = 0; minor < PROFILE_MINORS; minor++)
+            if (ext[minor].count)
+                proc(client, major, minor, &ext[minor], closure);
+    }
+}
+
+/* the tables stay, the request being dispatched may still account to them */
+void
+DispatchProfileReset(ClientPtr client)
+{
+    ClientProfilePtr profile;
+
+    if (!dispatchProfileEnabled)
+        return;
+    profile = GetClientProfile(client);
+    if (!profile)
+        return;
+
+    memset(profile->core, 0, sizeof(profile->core));
+    for (int i = 0; i < PROFILE_MAJORS - EXTENSION_BASE; i++)
+        if (profile->ext[i])
+            memset(profile->ext[i], 0,
+                   PROFILE_MINORS * sizeof(DispatchProfileEntryRec));
+}
+
+typedef struct {
+    int major, minor;
+    DispatchProfileEntryRec entry;
+} ProfileLogRec;
+
+typedef struct {
+    ProfileLogRec top[PROFILE_LOG_TOP];
+    int numTop;
+    DispatchProfileEntryRec total;
+} ProfileLogCtx;
+
+/* keep the PROFILE_LOG_TOP requests with the most handler time */
+static void
+ProfileLogCollect(ClientPtr client, int major, int minor,
+                  const DispatchProfileEntryRec *entry, void *closure)
+{
+    ProfileLogCtx *ctx = closure;
+    int i;
+
+    ctx->total.count += entry->count;
+    ctx->total.errors += entry->errors;
+    ctx->total.time += entry->time;
+    ctx->total.bytesIn += entry->bytesIn;
+    ctx->total.bytesOut += entry->bytesOut;
+
+    for (i = ctx->numTop; i > 0 && ctx->top[i - 1].entry.time < entry->time; i--)
+        if (i < PROFILE_LOG_TOP)
+            ctx->top[i] = ctx->top[i - 1];
+    if (i >= PROFILE_LOG_TOP)
+        return;
+    ctx->top[i] = (ProfileLogRec) { major, minor, *entry };
+    if (ctx->numTop < PROFILE_LOG_TOP)
+        ctx->numTop++;
+}
+
+void
+DispatchProfileLog(void)
+{
+    if (!dispatchProfileEnabled)
+        return;
+
+    LogMessageVerb(X_INFO, 0, "dispatch profile:\n");
+    for (int i = 1; i < currentMaxClients; i++) {
+        ClientPtr client = clients[i];
+        ProfileLogCtx ctx = { 0 };
+        const char *cmd;
+
+        if (!client || client->clientState != ClientStateRunning)
+            continue;
+
+        DispatchProfileForEach(client, ProfileLogCollect, &ctx);
+        if (!ctx.total.count)
+            continue;
+
+        cmd = GetClientCmdName(client);
+        LogMessageVerb(X_NONE, 0,
+                       "  client %d (%s): %llu requests, %llu errors, "
+                       "%.3f ms, %llu bytes in, %llu bytes out\n",
+                       client->index, cmd ? cmd : "unknown",
+                       (unsigned long long) ctx.total.count,
+                       (unsigned long long) ctx.total.errors,
+                       ctx.total.time / 1e6,
+                       (unsigned long long) ctx.total.bytesIn,
+                       (unsigned long long) ctx.total.bytesOut);
+
+        for (int j = 0; j < ctx.numTop; j++) {
+            const ProfileLogRec *r = &ctx.top[j];
+
+            LogMessageVerb(X_NONE, 0,
+                           "    %-32s %10llu x %10.3f ms (max %.3f ms), "
+                           "%llu in, %llu out, %llu errors\n",
+                           LookupRequestName(r->major, r->minor),
+                           (unsigned long long) r->entry.count,
+                           r->entry.time / 1e6, r->entry.maxTime / 1e6,
+                           (unsigned long long) r->entry.bytesIn,
+                           (unsigned long long) r->entry.bytesOut,
+                           (unsigned long long) r->entry.errors);
+        }
+    }
+}
+
+static void
+ProfileClientState(CallbackListPtr *pcbl, void *unused, void *calldata)
+{
+    NewClientInfoRec *pci = calldata;
+
+    if (pci->client->clientState == ClientStateGone) {
+        ProfileFree(GetClientProfile(pci->client));
+        dixSetPrivate(&pci->client->devPrivates, ClientProfilePrivateKey, NULL);
+    }
+}
+
+#if !defined(WIN32) || defined(__CYGWIN__)
+static void
+ProfileSignal(int signo)
+{
+    logRequested = 1;
+}
+#endif
+
+/* the signal interrupts the poll, so we get here right after it */
+static void
+ProfileWakeup(void *data, int result)
+{
+    if (logRequested) {
+        logRequested = 0;
+        DispatchProfileLog();
+    }
+}
+
+void
+DispatchProfileInit(void)
+{
+    if (!dispatchProfileEnabled)
+        return;
+
+    if (!dixRegisterPrivateKey(ClientProfilePrivateKey, PRIVATE_CLIENT, 0))
+        FatalError("failed to register dispatch profile private\n");
+    if (!AddCallback(&ClientStateCallback, ProfileClientState, NULL))
+        FatalError("failed to register dispatch profile callback\n");
+    RegisterBlockAndWakeupHandlers((ServerBlockHandlerProcPtr) NoopDDA,
+                                   ProfileWakeup, NULL);
+#if !defined(WIN32) || defined(__CYGWIN__)
+    /* the Solaris DDX releases the VT on SIGUSR2 */
+    struct sigaction old;
+
+    if (sigaction(SIGUSR2, NULL, &old) == 0 &&
+        old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN &&
+        old.sa_handler != ProfileSignal)
+        LogMessageVerb(X_WARNING, 0, "dispatch profile: SIGUSR2 is in use, "
+                       "the profile can't be logged on it\n");
+    else
+        OsSignal(SIGUSR2, ProfileSignal);
+#endif
+}
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Per-client request profiling
+ */
+#ifndef _XSERVER_DIX_PROFILE_PRIV_H
+#define _XSERVER_DIX_PROFILE_PRIV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "include/dix.h"
+
+/* Counters for one request type (major, minor opcode) of one client */
+typedef struct {
+    uint64_t count;             /* requests dispatched */
+    uint64_t errors;            /* ... of which failed */
+    uint64_t time;              /* total time spent in the handler, ns */
+    uint64_t maxTime;           /* longest single request, ns */
+    uint64_t bytesIn;           /* request bytes */
+    uint64_t bytesOut;          /* bytes queued to the client meanwhile */
+} DispatchProfileEntryRec, *DispatchProfileEntryPtr;
+
+typedef void (*DispatchProfileProcPtr) (ClientPtr client, int major,
+                                        int minor,
+                                        const DispatchProfileEntryRec *entry,
+                                        void *closure);
+
+/* set by the +dispatchprofile command line option */
+extern bool dispatchProfileEnabled;
+
+/*
+ * @brief set up profiling for a new server generation
+ *
+ * Does nothing unless dispatchProfileEnabled is set. Otherwise it
+ * registers the client private and the SIGUSR2 handler that dumps the
+ * profile to the log. Call after InitOutput(), the handler isn't installed
+ * when the DDX already handles SIGUSR2.
+ */
+void DispatchProfileInit(void);
+
+/*
+ * @brief mark the start of a request handler
+ *
+ * Only call when dispatchProfileEnabled, paired with DispatchProfileEnd().
+ */
+void DispatchProfileBegin(ClientPtr client);
+
+/*
+ * @brief account a request after its handler returned
+ *
+ * Safe to call when the handler closed the client down, the request isn't
+ * accounted then.
+ *
+ * @param client  the client, with majorOp and minorOp set
+ * @param bytes   size of the request
+ * @param result  the handler's result
+ */
+void DispatchProfileEnd(ClientPtr client, long bytes, int result);
+
+/*
+ * @brief call proc for every request type the client has issued
+ */
+void DispatchProfileForEach(ClientPtr client, DispatchProfileProcPtr proc,
+                            void *closure);
+
+/*
+ * @brief clear all counters of the client
+ *
+ * Safe to call from a request handler, the request is still accounted.
+ */
+void DispatchProfileReset(ClientPtr client);
+
+/*
+ * @brief log the most expensive requests of every client
+ */
+void DispatchProfileLog(void);
+
+#endif /* _XSERVER_DIX_PROFILE_PRIV_H */
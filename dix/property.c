@@ -93,6 +93,182 @@ PrintPropertys(WindowPtr pWin)
 }
 #endif
 
+/*
+ * Windows carrying many properties (most notably the root window, with
+ * EWMH, XSETTINGS, RESOURCE_MANAGER and friends) get a hash index keyed on
+ * the property name next to their property list, so lookups don't have to
+ * walk the list.  Each entry also records the link pointing to the property
+ * (either &pWin->properties or the previous property's next field), which
+ * lets us unlink in constant time without a doubly linked list.
+ *
+ * The index is built once a window has more than PROPERTY_INDEX_THRESHOLD
+ * properties and dropped again when it falls below half of that.  It's
+ * also dropped when a window ends up with several properties of the same
+ * name (SELinux polyinstantiation), since lookups then have to return the
+ * first one in list order.
+ */
+
+#define PROPERTY_INDEX_THRESHOLD 16
+
+typedef struct _PropertyIndexEntry {
+    PropertyPtr prop;
+    PropertyPtr *link;
+} PropertyIndexEntryRec, *PropertyIndexEntryPtr;
+
+typedef struct _PropertyIndex {
+    unsigned int count;
+    unsigned int mask;
+    PropertyIndexEntryRec entries[];
+} PropertyIndexRec, *PropertyIndexPtr;
+
+static inline unsigned int
+PropertyIndexHash(Atom name)
+{
+    return (unsigned int) (name * 2654435761U);
+}
+
+static PropertyIndexEntryPtr
+PropertyIndexFind(PropertyIndexPtr idx, Atom name)
+{
+    for (unsigned int i = PropertyIndexHash(name) & idx->mask;
+         idx->entries[i].prop; i = (i + 1) & idx->mask)
+        if (idx->entries[i].prop->propertyName == name)
+            return &idx->entries[i];
+    return NULL;
+}
+
+static void
+PropertyIndexInsert(PropertyIndexPtr idx, PropertyPtr pProp, PropertyPtr *link)
+{
+    unsigned int i = PropertyIndexHash(pProp->propertyName) & idx->mask;
+
+    while (idx->entries[i].prop)
+        i = (i + 1) & idx->mask;
+    idx->entries[i].prop = pProp;
+    idx->entries[i].link = link;
+    idx->count++;
+}
+
+/* backward shift deletion, keeps probe sequences intact without tombstones */
+static void
+PropertyIndexRemove(PropertyIndexPtr idx, PropertyIndexEntryPtr entry)
+{
+    unsigned int i = entry - idx->entries;
+    unsigned int j = i;
+
+    for (;;) {
+        unsigned int home;
+
+        j = (j + 1) & idx->mask;
+        if (!idx->entries[j].prop)
+            break;
+        home = PropertyIndexHash(idx->entries[j].prop->propertyName) & idx->mask;
+        /* leave entry j alone if its home slot lies cyclically in (i, j] */
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        idx->entries[i] = idx->entries[j];
+        i = j;
+    }
+    idx->entries[i].prop = NULL;
+    idx->entries[i].link = NULL;
+    idx->count--;
+}
+
+/*
+ * (Re)build the index of a window from its property list.  On allocation
+ * failure the window silently stays with the plain list.
+ */
+static void
+PropertyIndexRebuild(WindowPtr pWin)
+{
+    PropertyIndexPtr idx;
+    unsigned int count = 0;
+    unsigned int size = 2 * PROPERTY_INDEX_THRESHOLD;
+
+    for (PropertyPtr p = pWin->properties; p; p = p->next)
+        count++;
+    while (size < 2 * count)
+        size <<= 1;
+
+    free(pWin->propIndex);
+    pWin->propIndex = NULL;
+
+    idx = calloc(1, sizeof(PropertyIndexRec) +
+                    size * sizeof(PropertyIndexEntryRec));
+    if (!idx)
+        return;
+    idx->mask = size - 1;
+    for (PropertyPtr *link = &pWin->properties; *link; link = &(*link)->next) {
+        if (PropertyIndexFind(idx, (*link)->propertyName)) {
+            free(idx);
+            return;
+        }
+        PropertyIndexInsert(idx, *link, link);
+    }
+    pWin->propIndex = idx;
+}
+
+static void
+LinkProperty(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyIndexPtr idx = pWin->propIndex;
+
+    pProp->next = pWin->properties;
+    pWin->properties = pProp;
+
+    if (idx && PropertyIndexFind(idx, pProp->propertyName)) {
+        free(idx);
+        pWin->propIndex = NULL;
+    }
+    else if (idx) {
+        if (pProp->next)
+            PropertyIndexFind(idx, pProp->next->propertyName)->link =
+                &pProp->next;
+        PropertyIndexInsert(idx, pProp, &pWin->properties);
+        if (idx->count * 2 > idx->mask + 1)
+            PropertyIndexRebuild(pWin);
+    }
+    else {
+        unsigned int count = 0;
+
+        for (PropertyPtr p = pWin->properties; p; p = p->next)
+            if (++count > PROPERTY_INDEX_THRESHOLD) {
+                PropertyIndexRebuild(pWin);
+                break;
+            }
+    }
+}
+
+static void
+UnlinkProperty(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyIndexPtr idx = pWin->propIndex;
+
+    if (idx) {
+        PropertyIndexEntryPtr entry = PropertyIndexFind(idx, pProp->propertyName);
+        PropertyPtr *link = entry->link;
+
+        *link = pProp->next;
+        PropertyIndexRemove(idx, entry);
+        if (pProp->next)
+            PropertyIndexFind(idx, pProp->next->propertyName)->link = link;
+        if (idx->count < PROPERTY_INDEX_THRESHOLD / 2) {
+            free(idx);
+            pWin->propIndex = NULL;
+        }
+    }
+    else {
+        PropertyPtr *link = &pWin->properties;
+
+        while (*link != pProp)
+            link = &(*link)->next;
+        *link = pProp->next;
+    }
+
+    if (!pWin->properties)
+        CheckWindowOptionalNeed(pWin);
+}
+
 int
 dixLookupProperty(PropertyPtr *result, WindowPtr pWin, Atom propertyName,
                   ClientPtr client, Mask access_mode)
@@ -102,9 +278,16 @@ dixLookupProperty(PropertyPtr *result, WindowPtr pWin, Atom propertyName,
 
     client->errorValue = propertyName;
 
-    for (pProp = pWin->properties; pProp; pProp = pProp->next)
-        if (pProp->propertyName == propertyName)
-            break;
+    if (pWin->propIndex) {
+        PropertyIndexEntryPtr entry = PropertyIndexFind(pWin->propIndex,
+                                                        propertyName);
+        pProp = entry ? entry->prop : NULL;
+    }
+    else {
+        for (pProp = pWin->properties; pProp; pProp = pProp->next)
+            if (pProp->propertyName == propertyName)
+                break;
+    }
 
     if (pProp)
         rc = XaceHookPropertyAccess(client, pWin, &pProp, access_mode);
@@ -344,6 +527,64 @@ ProcChangeProperty(ClientPtr client)
                                    p.mode, p.len, p.value, p.sendevent);
 }
 
+/*
+ * Property values live in refcounted blocks with some slack at the end, so
+ * PropModeAppend can usually extend a value in place instead of copying
+ * the whole thing, which matters for clipboard managers and icon
+ * properties that grow to hundreds of KB piece by piece.
+ *
+ * Bytes below a value's current size are never written once set; Replace
+ * and Prepend always build a new block.  Whoever holds a reference (see
+ * dixPropertyDataRef()) thus keeps seeing the bytes as they were, while an
+ * in place append only touches bytes nobody else can have looked at.  The
+ * same rule makes rolling back after a failed XACE post-access check
+ * as simple as restoring the old size.
+ */
+
+typedef struct _PropertyData {
+    unsigned int refcnt;
+    size_t capacity;
+    unsigned char bytes[];
+} PropertyDataRec, *PropertyDataPtr;
+
+static inline PropertyDataPtr
+PropertyDataHeader(void *data)
+{
+    return (PropertyDataPtr) ((char *) data - offsetof(PropertyDataRec, bytes));
+}
+
+static unsigned char *
+PropertyDataAlloc(size_t capacity)
+{
+    PropertyDataPtr pd = malloc(sizeof(PropertyDataRec) + capacity);
+
+    if (!pd)
+        return NULL;
+    pd->refcnt = 1;
+    pd->capacity = capacity;
+    return pd->bytes;
+}
+
+void *
+dixPropertyDataRef(void *data)
+{
+    if (data)
+        PropertyDataHeader(data)->refcnt++;
+    return data;
+}
+
+void
+dixPropertyDataUnref(void *data)
+{
+    PropertyDataPtr pd;
+
+    if (!data)
+        return;
+    pd = PropertyDataHeader(data);
+    if (--pd->refcnt == 0)
+        free(pd);
+}
+
 int
 dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
                         Atom type, int format, int mode, unsigned long len,
@@ -367,14 +608,12 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
         pProp = dixAllocateObjectWithPrivates(PropertyRec, PRIVATE_PROPERTY);
         if (!pProp)
             return BadAlloc;
-        unsigned char *data = calloc(1, totalSize);
-        if (totalSize) {
-            if (!data) {
-                dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
-                return BadAlloc;
-            }
-            memcpy(data, value, totalSize);
+        unsigned char *data = PropertyDataAlloc(totalSize);
+        if (!data) {
+            dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
+            return BadAlloc;
         }
+        memcpy(data, value, totalSize);
         pProp->propertyName = property;
         pProp->type = type;
         pProp->format = format;
@@ -383,13 +622,12 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
         rc = XaceHookPropertyAccess(pClient, pWin, &pProp,
                                     DixCreateAccess | DixWriteAccess);
         if (rc != Success) {
-            free(data);
+            dixPropertyDataUnref(data);
             dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
             pClient->errorValue = property;
             return rc;
         }
-        pProp->next = pWin->properties;
-        pWin->properties = pProp;
+        LinkProperty(pWin, pProp);
     }
     else if (rc == Success) {
         /* To append or prepend to a property the request format and type
@@ -406,12 +644,10 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
         savedProp = *pProp;
 
         if (mode == PropModeReplace) {
-            unsigned char *data = calloc(1, totalSize);
-            if (totalSize) {
-                if (!data)
-                    return BadAlloc;
-                memcpy(data, value, totalSize);
-            }
+            unsigned char *data = PropertyDataAlloc(totalSize);
+            if (!data)
+                return BadAlloc;
+            memcpy(data, value, totalSize);
             pProp->data = data;
             pProp->size = len;
             pProp->type = type;
@@ -421,16 +657,25 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
             /* do nothing */
         }
         else if (mode == PropModeAppend) {
-            unsigned char *data = calloc(pProp->size + len, sizeInBytes);
-            if (!data)
-                return BadAlloc;
-            memcpy(data, pProp->data, pProp->size * sizeInBytes);
-            memcpy(data + pProp->size * sizeInBytes, value, totalSize);
+            size_t oldSize = (size_t) pProp->size * sizeInBytes;
+            unsigned char *data = pProp->data;
+
+            if (PropertyDataHeader(data)->capacity - oldSize < totalSize) {
+                /* grow by half again, keeps appends amortized linear */
+                size_t capacity = oldSize + totalSize;
+
+                data = PropertyDataAlloc(capacity + capacity / 2);
+                if (!data)
+                    return BadAlloc;
+                memcpy(data, pProp->data, oldSize);
+            }
+            memcpy(data + oldSize, value, totalSize);
             pProp->data = data;
             pProp->size += len;
         }
         else if (mode == PropModePrepend) {
-            unsigned char *data = calloc(len + pProp->size, sizeInBytes);
+            unsigned char *data =
+                PropertyDataAlloc((size_t) (len + pProp->size) * sizeInBytes);
             if (!data)
                 return BadAlloc;
             memcpy(data + totalSize, pProp->data, pProp->size * sizeInBytes);
@@ -444,11 +689,11 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
         rc = XaceHookPropertyAccess(pClient, pWin, &pProp, access_mode);
         if (rc == Success) {
             if (savedProp.data != pProp->data)
-                free(savedProp.data);
+                dixPropertyDataUnref(savedProp.data);
         }
         else {
             if (savedProp.data != pProp->data)
-                free(pProp->data);
+                dixPropertyDataUnref(pProp->data);
             *pProp = savedProp;
             return rc;
         }
@@ -467,7 +712,7 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
 int
 DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName)
 {
-    PropertyPtr pProp, prevProp;
+    PropertyPtr pProp;
     int rc;
 
     rc = dixLookupProperty(&pProp, pWin, propName, client, DixDestroyAccess);
@@ -475,22 +720,11 @@ DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName)
         return Success;         /* Succeed if property does not exist */
 
     if (rc == Success) {
-        if (pWin->properties == pProp) {
-            /* Takes care of head */
-            if (!(pWin->properties = pProp->next))
-                CheckWindowOptionalNeed(pWin);
-        }
-        else {
-            /* Need to traverse to find the previous element */
-            prevProp = pWin->properties;
-            while (prevProp->next != pProp)
-                prevProp = prevProp->next;
-            prevProp->next = pProp->next;
-        }
+        UnlinkProperty(pWin, pProp);
 
         deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp);
         notifyVRRMode(client, pWin, PropertyDelete, pProp);
-        free(pProp->data);
+        dixPropertyDataUnref(pProp->data);
         dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
     }
     return rc;
@@ -504,12 +738,14 @@ DeleteAllWindowProperties(WindowPtr pWin)
     while (pProp) {
         deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp);
         PropertyPtr pNextProp = pProp->next;
-        free(pProp->data);
+        dixPropertyDataUnref(pProp->data);
         dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
         pProp = pNextProp;
     }
 
     pWin->properties = NULL;
+    free(pWin->propIndex);
+    pWin->propIndex = NULL;
 }
 
 /*****************
@@ -536,7 +772,7 @@ ProcGetProperty(ClientPtr client)
         swapl(&stuff->longLength);
     }
 
-    PropertyPtr pProp, prevProp;
+    PropertyPtr pProp;
     unsigned long n, len, ind;
     int rc;
     Mask win_mode = DixGetPropAccess, prop_mode = DixReadAccess;
@@ -627,47 +863,29 @@ ProcGetProperty(ClientPtr client)
         .propertyType = pProp->type
     };
 
-    if (p.delete && (reply.bytesAfter == 0)) {
+    Bool remove = p.delete && (reply.bytesAfter == 0);
+
+    if (remove) {
         deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp);
         notifyVRRMode(client, pWin, PropertyDelete, pProp);
     }
 
     const char *dataptr = ((char*)pProp->data) + ind;
 
+    /* Only byte swapped clients with 16 or 32 bit data need a converted
+       copy, everybody else gets the value straight from the property. */
+    Bool direct = !client->swapped || pProp->format == 8;
+
     x_rpcbuf_t rpcbuf = { .swapped = client->swapped, .err_clear = TRUE };
-    switch (pProp->format) {
-        case 32:
+    if (!direct) {
+        if (pProp->format == 32)
             x_rpcbuf_write_CARD32s(&rpcbuf, (CARD32*)dataptr, len / 4);
-        break;
-        case 16:
+        else
             x_rpcbuf_write_CARD16s(&rpcbuf, (CARD16*)dataptr, len / 2);
-        break;
-        default:
-            x_rpcbuf_write_CARD8s(&rpcbuf, (CARD8*)dataptr, len);
-        break;
-    }
-
-    /* don't delete if there's an error */
-    if (rpcbuf.error)
-        return BadAlloc;
 
-    if (p.delete && (reply.bytesAfter == 0)) {
-        /* Delete the Property */
-        if (pWin->properties == pProp) {
-            /* Takes care of head */
-            if (!(pWin->properties = pProp->next))
-                CheckWindowOptionalNeed(pWin);
-        }
-        else {
-            /* Need to traverse to find the previous element */
-            prevProp = pWin->properties;
-            while (prevProp->next != pProp)
-                prevProp = prevProp->next;
-            prevProp->next = pProp->next;
-        }
-
-        free(pProp->data);
-        dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
+        /* don't delete if there's an error */
+        if (rpcbuf.error)
+            return BadAlloc;
     }
 
     if (client->swapped) {
@@ -676,7 +894,26 @@ ProcGetProperty(ClientPtr client)
         swapl(&reply.nItems);
     }
 
-    return X_SEND_REPLY_WITH_RPCBUF(client, reply, rpcbuf);
+    if (direct) {
+        /* the value stays put while referenced, even if the property
+           gets changed or deleted before a slow client read it all */
+        rc = X_SEND_REPLY_WITH_DATA_REF(client, reply, dataptr, len,
+                                        dixPropertyDataUnref,
+                                        dixPropertyDataRef(pProp->data));
+    }
+    else {
+        rc = X_SEND_REPLY_WITH_RPCBUF(client, reply, rpcbuf);
+    }
+
+    if (remove) {
+        /* Delete the Property */
+        UnlinkProperty(pWin, pProp);
+
+        dixPropertyDataUnref(pProp->data);
+        dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
+    }
+
+    return rc;
 }
 
 int
@@ -696,6 +933,11 @@ ProcListProperties(ClientPtr client)
 
     x_rpcbuf_t rpcbuf = { .swapped = client->swapped, .err_clear = TRUE };
 
+    /* indexed windows know their property count, size the reply up front */
+    if (pWin->propIndex &&
+        !x_rpcbuf_makeroom(&rpcbuf, pWin->propIndex->count * sizeof(CARD32)))
+        return BadAlloc;
+
     size_t numProps = 0;
     for (PropertyPtr realProp, pProp = pWin->properties; pProp; pProp = pProp->next) {
         realProp = pProp;
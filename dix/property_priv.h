@@ -101,4 +101,23 @@ void DeleteAllWindowProperties(WindowPtr pWin);
 
 int DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName);
 
+/*
+ * @brief take a reference on a property value
+ *
+ * Property values (PropertyRec->data) are refcounted and never modified
+ * below their current size once set, so a reference keeps the bytes seen
+ * now valid even if the property is changed or deleted meanwhile.
+ *
+ * @param data    the property's data pointer
+ * @return        the same pointer
+ */
+void *dixPropertyDataRef(void *data);
+
+/*
+ * @brief drop a reference on a property value, freeing it on the last one
+ *
+ * @param data    the property's data pointer (may be NULL)
+ */
+void dixPropertyDataUnref(void *data);
+
 #endif /* _XSERVER_PROPERTY_PRIV_H */
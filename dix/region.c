@@ -83,6 +83,10 @@ Equipment Corporation.
 #include "gc.h"
 #include <pixman.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #undef assert
 #ifdef REGION_DEBUG
 #define assert(expr) { \
@@ -387,6 +391,29 @@ RegionRectAlloc(RegionPtr pRgn, int n)
  *	    Generic Region Operator
  *====================================================================*/
 
+/*
+ * Whether two runs of n boxes have the same x1 and x2, as two bands need
+ * to for being merged into one. A box is x1, y1, x2, y2 as shorts, so with
+ * SSE2 that's two boxes per compare, looking at every other short.
+ */
+static inline Bool
+RegionBandsEqual(const BoxRec *a, const BoxRec *b, int n)
+{
+#ifdef __SSE2__
+    for (; n >= 2; n -= 2, a += 2, b += 2) {
+        __m128i eq = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *) a),
+                                     _mm_loadu_si128((const __m128i *) b));
+
+        if ((_mm_movemask_epi8(eq) & 0x3333) != 0x3333)
+            return FALSE;
+    }
+#endif
+    for (; n; n--, a++, b++)
+        if (a->x1 != b->x1 || a->x2 != b->x2)
+            return FALSE;
+    return TRUE;
+}
+
 /*-
  *-----------------------------------------------------------------------
  * RegionCoalesce --
@@ -439,28 +466,17 @@ RegionCoalesce(RegionPtr pReg,  /* Region to coalesce                */
      * cover the most area possible. I.e. two boxes in a band must
      * have some horizontal space between them.
      */
-    y2 = pCurBox->y2;
-
-    do {
-        if ((pPrevBox->x1 != pCurBox->x1) || (pPrevBox->x2 != pCurBox->x2)) {
-            return curStart;
-        }
-        pPrevBox++;
-        pCurBox++;
-        numRects--;
-    } while (numRects);
+    if (!RegionBandsEqual(pPrevBox, pCurBox, numRects))
+        return curStart;
 
     /*
      * The bands may be merged, so set the bottom y of each box
      * in the previous band to the bottom y of the current band.
      */
-    numRects = curStart - prevStart;
+    y2 = pCurBox->y2;
     pReg->data->numRects -= numRects;
-    do {
-        pPrevBox--;
-        pPrevBox->y2 = y2;
-        numRects--;
-    } while (numRects);
+    for (int i = 0; i < numRects; i++)
+        pPrevBox[i].y2 = y2;
     return prevStart;
 }
 
@@ -847,6 +863,127 @@ RegionSetExtents(RegionPtr pReg)
 /*======================================================================
  *	    Region Intersection
  *====================================================================*/
+/*-
+ *-----------------------------------------------------------------------
+ * RegionIntersectRect --
+ *	Intersect a region of several rectangles with a single one, as when
+ *	clipping one drawing operation to a window. Only the bands within
+ *	the rectangle are looked at, and clipped directly instead of going
+ *	through the generic operator.
+ *
+ * Results:
+ *	TRUE if successful.
+ *
+ * Side Effects:
+ *	newReg is overwritten.
+ *
+ *-----------------------------------------------------------------------
+ */
+Bool
+RegionIntersectRect(RegionPtr newReg, RegionPtr pRect, RegionPtr reg)
+{
+    BoxRec rect = pRect->extents;
+    BoxPtr r, rEnd, pNextRect;
+    RegionRec result;
+    int lo, hi, prevBand, curBand, numRects;
+
+    if (rect.x1 >= rect.x2 || rect.y1 >= rect.y2 || RegionNar(reg) ||
+        RegionNumRects(reg) < 2)
+        return pixman_region_intersect(newReg, pRect, reg);
+
+    if (!EXTENTCHECK(&rect, &reg->extents)) {
+        xfreeData(newReg);
+        newReg->extents.x2 = newReg->extents.x1;
+        newReg->extents.y2 = newReg->extents.y1;
+        newReg->data = &RegionEmptyData;
+        return TRUE;
+    }
+    if (SUBSUMES(&rect, &reg->extents))
+        return RegionCopy(newReg, reg);
+
+    /* the bands within the rectangle; y1 and y2 never decrease */
+    r = RegionRects(reg);
+    numRects = RegionNumRects(reg);
+    for (lo = 0, hi = numRects; lo < hi;) {
+        int mid = (lo + hi) / 2;
+
+        if (r[mid].y2 <= rect.y1)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    rEnd = r + numRects;
+    r += lo;
+    for (lo = 0, hi = rEnd - r; lo < hi;) {
+        int mid = (lo + hi) / 2;
+
+        if (r[mid].y1 < rect.y2)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    rEnd = r + lo;
+
+    result.extents.x1 = MAXSHORT;
+    result.extents.x2 = MINSHORT;
+    result.data = NULL;
+    if (!RegionRectAlloc(&result, rEnd - r)) {
+        RegionBreak(newReg);
+        return FALSE;
+    }
+    result.data->numRects = 0;
+    prevBand = 0;
+
+    while (r != rEnd) {
+        BoxPtr rBandEnd;
+        int ry1, y1, y2;
+
+        FindBand(r, rBandEnd, rEnd, ry1);
+        y1 = max(ry1, rect.y1);
+        y2 = min(r->y2, rect.y2);
+
+        curBand = result.data->numRects;
+        pNextRect = RegionTop(&result);
+        for (; r != rBandEnd && r->x1 < rect.x2; r++) {
+            if (r->x2 <= rect.x1)
+                continue;
+            ADDRECT(pNextRect, max(r->x1, rect.x1), y1,
+                    min(r->x2, rect.x2), y2);
+        }
+        r = rBandEnd;
+
+        result.data->numRects = pNextRect - RegionBoxptr(&result);
+        if (result.data->numRects == curBand)
+            continue;
+        if (RegionBox(&result, curBand)->x1 < result.extents.x1)
+            result.extents.x1 = RegionBox(&result, curBand)->x1;
+        if (pNextRect[-1].x2 > result.extents.x2)
+            result.extents.x2 = pNextRect[-1].x2;
+        Coalesce((&result), prevBand, curBand);
+    }
+
+    numRects = result.data->numRects;
+    xfreeData(newReg);
+    if (!numRects) {
+        free(result.data);
+        newReg->extents.x2 = newReg->extents.x1;
+        newReg->extents.y2 = newReg->extents.y1;
+        newReg->data = &RegionEmptyData;
+    }
+    else if (numRects == 1) {
+        newReg->extents = *RegionBoxptr(&result);
+        free(result.data);
+        newReg->data = NULL;
+    }
+    else {
+        result.extents.y1 = RegionBoxptr(&result)->y1;
+        result.extents.y2 = RegionEnd(&result)->y2;
+        DOWNSIZE((&result), numRects);
+        *newReg = result;
+    }
+    return TRUE;
+}
+
 /*-
  *-----------------------------------------------------------------------
  * RegionIntersectO --
@@ -945,6 +1082,51 @@ RegionUnionO(RegionPtr pReg,
     return TRUE;
 }
 
+/*-
+ *-----------------------------------------------------------------------
+ * RegionUnionRect --
+ *	Union of two single rectangles. When one contains the other, or
+ *	they line up to make a single rectangle, that is the result,
+ *	otherwise it's left to the generic operator.
+ *
+ * Results:
+ *	TRUE if successful.
+ *
+ * Side Effects:
+ *	newReg is overwritten.
+ *
+ *-----------------------------------------------------------------------
+ */
+Bool
+RegionUnionRect(RegionPtr newReg, RegionPtr reg1, RegionPtr reg2)
+{
+    BoxRec a = reg1->extents, b = reg2->extents;
+
+    if (reg1->data || reg2->data ||
+        a.x1 >= a.x2 || a.y1 >= a.y2 || b.x1 >= b.x2 || b.y1 >= b.y2)
+        return pixman_region_union(newReg, reg1, reg2);
+
+    if (SUBSUMES(&b, &a))
+        a = b;
+    else if (SUBSUMES(&a, &b))
+        ;
+    else if (a.y1 == b.y1 && a.y2 == b.y2 && a.x1 <= b.x2 && b.x1 <= a.x2) {
+        a.x1 = min(a.x1, b.x1);
+        a.x2 = max(a.x2, b.x2);
+    }
+    else if (a.x1 == b.x1 && a.x2 == b.x2 && a.y1 <= b.y2 && b.y1 <= a.y2) {
+        a.y1 = min(a.y1, b.y1);
+        a.y2 = max(a.y2, b.y2);
+    }
+    else
+        return pixman_region_union(newReg, reg1, reg2);
+
+    xfreeData(newReg);
+    newReg->extents = a;
+    newReg->data = NULL;
+    return TRUE;
+}
+
 /*======================================================================
  *	    Batch Rectangle Union
  *====================================================================*/
@@ -1104,6 +1286,77 @@ QuickSortRects(BoxRec rects[], int numRects)
     } while (numRects > 1);
 }
 
+/* below this many rectangles, quicksort beats clearing the histograms */
+#define RADIX_SORT_MIN  64
+
+/* (y1, x1) as an unsigned number, in the order RegionValidate wants */
+static inline uint32_t
+SortKey(const BoxRec *r)
+{
+    return ((uint32_t) (uint16_t) (r->y1 ^ 0x8000) << 16) |
+        (uint16_t) (r->x1 ^ 0x8000);
+}
+
+/*
+ * Sort rectangles by y1, then x1. Larger sets go through an LSD radix sort,
+ * a byte of the key per pass, skipping the passes where all keys have the
+ * same byte, which for rectangles within a screen is most of them.
+ */
+static void
+SortRects(BoxRec rects[], int numRects)
+{
+    int count[4][256];
+    BoxPtr tmp, src, dst;
+    int i;
+
+    /* clients often send them sorted already */
+    for (i = 1; i < numRects; i++)
+        if (SortKey(&rects[i]) < SortKey(&rects[i - 1]))
+            break;
+    if (i == numRects)
+        return;
+
+    if (numRects < RADIX_SORT_MIN ||
+        !(tmp = reallocarray(NULL, numRects, sizeof(BoxRec)))) {
+        QuickSortRects(rects, numRects);
+        return;
+    }
+
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < numRects; i++) {
+        uint32_t key = SortKey(&rects[i]);
+
+        count[0][key & 0xff]++;
+        count[1][(key >> 8) & 0xff]++;
+        count[2][(key >> 16) & 0xff]++;
+        count[3][key >> 24]++;
+    }
+
+    src = rects;
+    dst = tmp;
+    for (int pass = 0; pass < 4; pass++) {
+        int shift = pass * 8, offset = 0;
+        BoxPtr swap;
+
+        if (count[pass][(SortKey(&src[0]) >> shift) & 0xff] == numRects)
+            continue;
+        for (int b = 0; b < 256; b++) {
+            int n = count[pass][b];
+
+            count[pass][b] = offset;
+            offset += n;
+        }
+        for (i = 0; i < numRects; i++)
+            dst[count[pass][(SortKey(&src[i]) >> shift) & 0xff]++] = src[i];
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != rects)
+        memcpy(rects, src, numRects * sizeof(BoxRec));
+    free(tmp);
+}
+
 /*-
  *-----------------------------------------------------------------------
  * RegionValidate --
@@ -1181,7 +1434,7 @@ RegionValidate(RegionPtr badreg, Bool *pOverlap)
     }
 
     /* Step 1: Sort the rects array into ascending (y1, x1) order */
-    QuickSortRects(RegionBoxptr(badreg), numRects);
+    SortRects(RegionBoxptr(badreg), numRects);
 
     /* Step 2: Scatter the sorted array into the minimum number of regions */
 
@@ -12,21 +12,28 @@
 #include "include/dixstruct.h"
 #include "include/misc.h"    /* bytes_to_int32 */
 #include "include/os.h"      /* WriteToClient */
+#include "os/io_priv.h"      /* WriteToClientRef */
 
 /*
  * @brief write rpc buffer to client and then clear it
  *
+ * The buffer's memory is handed over to the output queue, so large
+ * payloads (eg. GetImage) are sent from there instead of being copied.
+ *
  * @param pClient the client to write buffer to
  * @param rpcbuf  the buffer whose contents will be written
- * @return the result of WriteToClient() call
+ * @return the result of WriteToClientRef() call
  */
 static inline ssize_t WriteRpcbufToClient(ClientPtr pClient,
                                           x_rpcbuf_t *rpcbuf) {
+    char *buffer = rpcbuf->buffer;
+
     /* explicitly casting between (s)size_t and int - should be safe,
        since payloads are always small enough to easily fit into int. */
-    ssize_t ret = WriteToClient(pClient,
-                                (int)rpcbuf->wpos,
-                                rpcbuf->buffer);
+    ssize_t ret = WriteToClientRef(pClient,
+                                   (int)rpcbuf->wpos,
+                                   buffer, free, buffer);
+    rpcbuf->buffer = NULL;
     x_rpcbuf_clear(rpcbuf);
     return ret;
 }
@@ -63,6 +70,30 @@ static inline int __write_reply_hdr_and_rpcbuf(
     return Success;
 }
 
+static inline int __write_reply_hdr_and_data(
+    ClientPtr pClient, void *hdrData, size_t hdrLen, const void *data,
+    size_t dataLen, OsReleaseProcPtr release, void *closure)
+{
+    xGenericReply *reply = hdrData;
+    reply->type = X_Reply;
+    reply->length = (bytes_to_int32(hdrLen - sizeof(xGenericReply)))
+                  + bytes_to_int32(dataLen);
+    reply->sequenceNumber = (CARD16)pClient->sequence; /* shouldn't go above 64k */
+
+    if (pClient->swapped) {
+         swaps(&reply->sequenceNumber);
+         swapl(&reply->length);
+    }
+
+    WriteToClient(pClient, (int)hdrLen, hdrData);
+    if (dataLen)
+        WriteToClientRef(pClient, (int)dataLen, data, release, closure);
+    else if (release)
+        release(closure);
+
+    return Success;
+}
+
 static inline int __write_reply_hdr_simple(
     ClientPtr pClient, void *hdrData, size_t hdrLen)
 {
@@ -91,6 +122,36 @@ static inline int __write_reply_hdr_simple(
 #define X_SEND_REPLY_WITH_RPCBUF(client, hdrstruct, rpcbuf) \
     __write_reply_hdr_and_rpcbuf(client, &(hdrstruct), sizeof(hdrstruct), &(rpcbuf));
 
+/*
+ * send reply with header struct (not pointer!) followed by a payload that
+ * already is in wire format, written straight from the caller's memory
+ * (padded by WriteToClient) instead of being staged in an rpcbuf first.
+ *
+ * @param client      pointer to the client (ClientPtr)
+ * @param hdrstruct   the header struct (not pointer, the struct itself!)
+ * @param data        pointer to the payload
+ * @param len         payload length in bytes
+ * return             X11 result code (=Success)
+ */
+#define X_SEND_REPLY_WITH_DATA(client, hdrstruct, data, len) \
+    __write_reply_hdr_and_data(client, &(hdrstruct), sizeof(hdrstruct), data, len, NULL, NULL)
+
+/*
+ * like X_SEND_REPLY_WITH_DATA, but the payload may stay queued by reference
+ * until the client has read it. release(closure) is called once it's no
+ * longer needed, so the payload mustn't change or go away before that.
+ *
+ * @param client      pointer to the client (ClientPtr)
+ * @param hdrstruct   the header struct (not pointer, the struct itself!)
+ * @param data        pointer to the payload
+ * @param len         payload length in bytes
+ * @param release     release callback (OsReleaseProcPtr)
+ * @param closure     argument passed to release
+ * return             X11 result code (=Success)
+ */
+#define X_SEND_REPLY_WITH_DATA_REF(client, hdrstruct, data, len, release, closure) \
+    __write_reply_hdr_and_data(client, &(hdrstruct), sizeof(hdrstruct), data, len, release, closure)
+
 /*
  * send reply with header struct (not pointer!) without any payload
  *
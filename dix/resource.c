@@ -119,6 +119,9 @@ Equipment Corporation.
 
 #include <dix-config.h>
 
+#include <limits.h>
+#include <stdint.h>
+#include <strings.h>
 #include <X11/X.h>
 
 #include "dix/colormap_priv.h"
@@ -152,14 +155,26 @@ Equipment Corporation.
 #define TypeNameString(t) LookupResourceName(t)
 #endif
 
-static void RebuildTable(int    /*client */
-    );
-
 #define SERVER_MINID 32
 
 #define INITBUCKETS 64
 #define INITHASHSIZE 6
-#define MAXHASHSIZE 16
+#define MAXHASHSIZE 20
+
+/*
+ * A client's table grows when it averages two resources per bucket. The
+ * resources are moved to the doubled table a few buckets per AddResource,
+ * so there is no stall rehashing hundreds of thousands of them at once.
+ */
+#define REHASH_STEP 2
+
+/*
+ * Server side IDs in use are tracked in a bitmap, so FakeClientID() can
+ * skip them once it wraps around. The bitmap is split into leaves that are
+ * only allocated when an ID in their range gets used.
+ */
+#define ID_LEAF_SHIFT 12
+#define ID_LEAF_SIZE (1u << ID_LEAF_SHIFT)
 
 typedef struct _Resource {
     struct _Resource *next;
@@ -173,8 +188,17 @@ typedef struct _ClientResource {
     int elements;
     int buckets;
     int hashsize;               /* log(2)(buckets) */
+    /* the table before growing, buckets from rehashPos on not moved yet */
+    ResourcePtr *oldResources;
+    int oldBuckets;
+    int oldHashsize;
+    int rehashPos;
+    int walking;                /* nested walks over the whole table */
     XID fakeID;
     XID endFakeID;
+    XID serverBase;             /* first server side ID, minus the low bits */
+    uint32_t **serverIDs;       /* bitmap leaves of server side IDs in use */
+    unsigned short *serverIDsUsed;      /* bits set per leaf */
 } ClientResourceRec;
 
 RESTYPE lastResourceType;
@@ -662,6 +686,8 @@ InitClientResources(ClientPtr client)
     clientTable[i].buckets = INITBUCKETS;
     clientTable[i].elements = 0;
     clientTable[i].hashsize = INITHASHSIZE;
+    clientTable[i].oldResources = NULL;
+    clientTable[i].walking = 0;
     /* Many IDs allocated from the server client are visible to clients,
      * so we don't use the SERVER_BIT for them, but we have to start
      * past the magic value constants used in the protocol.  For normal
@@ -670,9 +696,9 @@ InitClientResources(ClientPtr client)
     clientTable[i].fakeID = client->clientAsMask |
         (client->index ? SERVER_BIT : SERVER_MINID);
     clientTable[i].endFakeID = (clientTable[i].fakeID | RESOURCE_ID_MASK) + 1;
-    for (int j = 0; j < INITBUCKETS; j++) {
-        clientTable[i].resources[j] = NULL;
-    }
+    clientTable[i].serverBase = clientTable[i].fakeID & ~RESOURCE_ID_MASK;
+    clientTable[i].serverIDs = NULL;
+    clientTable[i].serverIDsUsed = NULL;
     return TRUE;
 }
 
@@ -689,6 +715,188 @@ HashResourceID(XID id, unsigned int numBits)
     return (id ^ (id >> numBits)) & ~((~0U) << numBits);
 }
 
+/* head of the chain holding id, in whichever table it is right now */
+static inline ResourcePtr *
+ResourceBucket(ClientResourceRec *rrec, XID id)
+{
+    if (rrec->oldResources) {
+        int bucket = HashResourceID(id, rrec->oldHashsize);
+
+        if (bucket >= rrec->rehashPos)
+            return &rrec->oldResources[bucket];
+    }
+    return &rrec->resources[HashResourceID(id, rrec->hashsize)];
+}
+
+static void
+GrowTable(ClientResourceRec *rrec)
+{
+    ResourcePtr *resources = calloc(2 * rrec->buckets, sizeof(ResourcePtr));
+
+    if (!resources)
+        return;
+    rrec->oldResources = rrec->resources;
+    rrec->oldBuckets = rrec->buckets;
+    rrec->oldHashsize = rrec->hashsize;
+    rrec->rehashPos = 0;
+    rrec->resources = resources;
+    rrec->buckets *= 2;
+    rrec->hashsize++;
+}
+
+/*
+ * Move up to count buckets of the old table over. Resources are appended,
+ * so the ones sharing an ID keep their order: some ddx layers depend on
+ * resources being freed in the opposite order they were added.
+ */
+static void
+RehashBuckets(ClientResourceRec *rrec, int count)
+{
+    while (rrec->rehashPos < rrec->oldBuckets && count-- > 0) {
+        ResourcePtr res = rrec->oldResources[rrec->rehashPos], next;
+
+        rrec->oldResources[rrec->rehashPos++] = NULL;
+        for (; res; res = next) {
+            ResourcePtr *tail = &rrec->resources[HashResourceID(res->id, rrec->hashsize)];
+
+            next = res->next;
+            res->next = NULL;
+            while (*tail)
+                tail = &(*tail)->next;
+            *tail = res;
+        }
+    }
+    if (rrec->oldResources && rrec->rehashPos == rrec->oldBuckets) {
+        free(rrec->oldResources);
+        rrec->oldResources = NULL;
+    }
+}
+
+/*
+ * Walks over all buckets call back into code that may add resources, so
+ * finish moving resources first and hold off growing until done.
+ */
+static inline void
+BeginTableWalk(ClientResourceRec *rrec)
+{
+    RehashBuckets(rrec, INT_MAX);
+    rrec->walking++;
+}
+
+static inline void
+EndTableWalk(ClientResourceRec *rrec)
+{
+    rrec->walking--;
+}
+
+static inline Bool
+IsServerID(ClientResourceRec *rrec, XID id)
+{
+    return (id & ~RESOURCE_ID_MASK) == rrec->serverBase;
+}
+
+static Bool
+ServerIDUsed(ClientResourceRec *rrec, XID id)
+{
+    unsigned int off = id & RESOURCE_ID_MASK;
+    uint32_t *leaf;
+
+    if (!IsServerID(rrec, id) || !rrec->serverIDs)
+        return FALSE;
+    leaf = rrec->serverIDs[off >> ID_LEAF_SHIFT];
+    off &= ID_LEAF_SIZE - 1;
+    return leaf && (leaf[off / 32] & (1u << (off % 32)));
+}
+
+static Bool
+MarkServerID(ClientResourceRec *rrec, XID id)
+{
+    unsigned int off = id & RESOURCE_ID_MASK;
+    unsigned int leaves = (RESOURCE_ID_MASK >> ID_LEAF_SHIFT) + 1;
+    uint32_t **leaf, bit;
+
+    if (!IsServerID(rrec, id))
+        return TRUE;
+    if (!rrec->serverIDs) {
+        rrec->serverIDs = calloc(leaves, sizeof(uint32_t *));
+        rrec->serverIDsUsed = calloc(leaves, sizeof(unsigned short));
+        if (!rrec->serverIDs || !rrec->serverIDsUsed) {
+            free(rrec->serverIDs);
+            free(rrec->serverIDsUsed);
+            rrec->serverIDs = NULL;
+            rrec->serverIDsUsed = NULL;
+            return FALSE;
+        }
+    }
+    leaf = &rrec->serverIDs[off >> ID_LEAF_SHIFT];
+    if (!*leaf) {
+        *leaf = calloc(ID_LEAF_SIZE / 32, sizeof(uint32_t));
+        if (!*leaf)
+            return FALSE;
+    }
+    bit = 1u << (off % 32);
+    if (!((*leaf)[(off & (ID_LEAF_SIZE - 1)) / 32] & bit)) {
+        (*leaf)[(off & (ID_LEAF_SIZE - 1)) / 32] |= bit;
+        rrec->serverIDsUsed[off >> ID_LEAF_SHIFT]++;
+    }
+    return TRUE;
+}
+
+/* called after unlinking a resource, the ID may still be used by others */
+static void
+ReleaseServerID(ClientResourceRec *rrec, XID id)
+{
+    unsigned int off = id & RESOURCE_ID_MASK;
+    uint32_t *leaf;
+
+    if (!ServerIDUsed(rrec, id))
+        return;
+    for (ResourcePtr res = *ResourceBucket(rrec, id); res; res = res->next)
+        if (res->id == id)
+            return;
+    leaf = rrec->serverIDs[off >> ID_LEAF_SHIFT];
+    leaf[(off & (ID_LEAF_SIZE - 1)) / 32] &= ~(1u << (off % 32));
+    rrec->serverIDsUsed[off >> ID_LEAF_SHIFT]--;
+}
+
+static void
+FreeServerIDs(ClientResourceRec *rrec)
+{
+    if (rrec->serverIDs) {
+        for (unsigned int i = 0; i <= (RESOURCE_ID_MASK >> ID_LEAF_SHIFT); i++)
+            free(rrec->serverIDs[i]);
+    }
+    free(rrec->serverIDs);
+    free(rrec->serverIDsUsed);
+    rrec->serverIDs = NULL;
+    rrec->serverIDsUsed = NULL;
+}
+
+/* first unused server side ID offset in [off, end), or end */
+static unsigned int
+FindFreeServerID(ClientResourceRec *rrec, unsigned int off, unsigned int end)
+{
+    while (off < end) {
+        unsigned int leaf = off >> ID_LEAF_SHIFT;
+        uint32_t *bits = rrec->serverIDs ? rrec->serverIDs[leaf] : NULL;
+        uint32_t free_bits;
+
+        if (!bits)
+            return off;
+        if (rrec->serverIDsUsed[leaf] == ID_LEAF_SIZE) {
+            off = (leaf + 1) << ID_LEAF_SHIFT;
+            continue;
+        }
+        free_bits = ~bits[(off & (ID_LEAF_SIZE - 1)) / 32] & (~0u << (off % 32));
+        if (free_bits) {
+            off = (off & ~31u) + ffs(free_bits) - 1;
+            return off < end ? off : end;
+        }
+        off = (off | 31) + 1;
+    }
+    return end;
+}
+
 static XID
 AvailableID(int client, XID id, XID maxid, XID goodid)
 {
@@ -697,7 +905,7 @@ AvailableID(int client, XID id, XID maxid, XID goodid)
     if ((goodid >= id) && (goodid <= maxid))
         return goodid;
     for (; id <= maxid; id++) {
-        res = clientTable[client].resources[HashResourceID(id, clientTable[client].hashsize)];
+        res = *ResourceBucket(&clientTable[client], id);
         while (res && (res->id != id))
             res = res->next;
         if (!res)
@@ -717,6 +925,7 @@ GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
         id |= client ? SERVER_BIT : SERVER_MINID;
     maxid = id | RESOURCE_ID_MASK;
     goodid = 0;
+    BeginTableWalk(&clientTable[client]);
     ResourcePtr *resp = clientTable[client].resources;
     for (int i = clientTable[client].buckets; --i >= 0;) {
         for (ResourcePtr res = *resp++; res; res = res->next) {
@@ -730,6 +939,7 @@ GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
                 id = res->id + 1;
         }
     }
+    EndTableWalk(&clientTable[client]);
     if (id > maxid)
         id = maxid = 0;
     *minp = id;
@@ -775,39 +985,50 @@ GetXIDList(ClientPtr pClient, unsigned count, XID *pids)
 /*
  * Return the next usable fake client ID.
  *
- * Normally this is just the next one in line, but if we've used the last
- * in the range, we need to find a new range of safe IDs to avoid
- * over-running another client.
+ * Normally this is just the next one in line. Once the range wrapped
+ * around, IDs still in use are skipped using the server ID bitmap.
  */
 
 XID
 FakeClientID(int client)
 {
-    XID id, maxid;
+    ClientResourceRec *rrec = &clientTable[client];
+    unsigned int off, first, end;
+    XID id;
 
-    id = clientTable[client].fakeID++;
+    id = rrec->fakeID++;
 
     // extra paranoid protection, because many places expect 0 as
     // sign for resource not existing
     if (!id)
         return FakeClientID(client);
 
-    if (id != clientTable[client].endFakeID)
+    if (id != rrec->endFakeID && !ServerIDUsed(rrec, id))
         return id;
-    GetXIDRange(client, TRUE, &id, &maxid);
-    if (!id) {
-        if (!client)
-            FatalError("FakeClientID: server internal ids exhausted\n");
-        dixMarkClientException(clients[client]);
-        id = ((Mask) client << CLIENTOFFSET) | (SERVER_BIT * 3);
-        maxid = id | RESOURCE_ID_MASK;
-    }
-    clientTable[client].fakeID = id + 1;
-    clientTable[client].endFakeID = maxid + 1;
 
-    if (!id)
-        return FakeClientID(client);
+    if (IsServerID(rrec, id) || id == rrec->endFakeID) {
+        first = client ? 0 : SERVER_MINID;
+        end = RESOURCE_ID_MASK + 1;
+        off = id == rrec->endFakeID ? first : (id & RESOURCE_ID_MASK);
+
+        off = FindFreeServerID(rrec, off, end);
+        if (off == end)
+            off = FindFreeServerID(rrec, first, end);
+        if (off != end) {
+            id = rrec->serverBase | off;
+            rrec->fakeID = id + 1;
+            rrec->endFakeID = (rrec->serverBase | RESOURCE_ID_MASK) + 1;
+            return id;
+        }
+    }
 
+    /* the whole server side range is in use */
+    if (!client)
+        FatalError("FakeClientID: server internal ids exhausted\n");
+    dixMarkClientException(clients[client]);
+    id = ((Mask) client << CLIENTOFFSET) | (SERVER_BIT * 3);
+    rrec->fakeID = id + 1;
+    rrec->endFakeID = (id | RESOURCE_ID_MASK) + 1;
     return id;
 }
 
@@ -828,11 +1049,17 @@ AddResource(XID id, RESTYPE type, void *value)
                (unsigned long) id, type, (unsigned long) value, client);
         FatalError("client not in use\n");
     }
-    if ((rrec->elements >= 4 * rrec->buckets) && (rrec->hashsize < MAXHASHSIZE))
-        RebuildTable(client);
-    head = &rrec->resources[HashResourceID(id, clientTable[client].hashsize)];
+    if (!rrec->walking) {
+        if (rrec->oldResources)
+            RehashBuckets(rrec, REHASH_STEP);
+        else if ((rrec->elements >= 2 * rrec->buckets) &&
+                 (rrec->hashsize < MAXHASHSIZE))
+            GrowTable(rrec);
+    }
+    head = ResourceBucket(rrec, id);
     ResourcePtr res = calloc(1, sizeof(ResourceRec));
-    if (!res) {
+    if (!res || !MarkServerID(rrec, id)) {
+        free(res);
         (*resourceTypes[type & TypeMask].deleteFunc) (value, id);
         return FALSE;
     }
@@ -846,47 +1073,6 @@ AddResource(XID id, RESTYPE type, void *value)
     return TRUE;
 }
 
-static void
-RebuildTable(int client)
-{
-    int j;
-    ResourcePtr **tails, *resources;
-
-    /*
-     * For now, preserve insertion order, since some ddx layers depend
-     * on resources being free in the opposite order they are added.
-     */
-
-    j = 2 * clientTable[client].buckets;
-    tails =  calloc(j, sizeof(ResourcePtr *));
-    if (!tails)
-        return;
-    resources =  calloc(j, sizeof(ResourcePtr));
-    if (!resources) {
-        free(tails);
-        return;
-    }
-    for (ResourcePtr *rptr = resources, **tptr = tails; --j >= 0; rptr++, tptr++) {
-        *rptr = NULL;
-        *tptr = rptr;
-    }
-    clientTable[client].hashsize++;
-    j = clientTable[client].buckets;
-    for (ResourcePtr *rptr = clientTable[client].resources, **tptr; --j >= 0; rptr++) {
-        for (ResourcePtr res = *rptr, next; res; res = next) {
-            next = res->next;
-            res->next = NULL;
-            tptr = &tails[HashResourceID(res->id, clientTable[client].hashsize)];
-            **tptr = res;
-            *tptr = &res->next;
-        }
-    }
-    free(tails);
-    clientTable[client].buckets *= 2;
-    free(clientTable[client].resources);
-    clientTable[client].resources = resources;
-}
-
 static void
 doFreeResource(ResourcePtr res, Bool skip)
 {
@@ -903,15 +1089,10 @@ FreeResource(XID id, RESTYPE skipDeleteFuncType)
 {
     int cid;
     ResourcePtr res;
-    ResourcePtr *prev, *head;
-    int *eltptr;
-    int elements;
+    ResourcePtr *prev;
 
     if (((cid = dixClientIdForXID(id)) < LimitClients) && clientTable[cid].buckets) {
-        head = &clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-        eltptr = &clientTable[cid].elements;
-
-        prev = head;
+        prev = ResourceBucket(&clientTable[cid], id);
         while ((res = *prev)) {
             if (res->id == id) {
                 RESTYPE rtype = res->type;
@@ -921,12 +1102,15 @@ FreeResource(XID id, RESTYPE skipDeleteFuncType)
                                       res->value, TypeNameString(res->type));
 #endif
                 *prev = res->next;
-                elements = --*eltptr;
+                clientTable[cid].elements--;
+                ReleaseServerID(&clientTable[cid], id);
 
                 doFreeResource(res, rtype == skipDeleteFuncType);
 
-                if (*eltptr != elements)
-                    prev = head;        /* prev may no longer be valid */
+                /* the delete function may have added or freed resources,
+                 * and an add may have moved the chain to the new table
+                 * and freed the old one, so start over from its head */
+                prev = ResourceBucket(&clientTable[cid], id);
             }
             else
                 prev = &res->next;
@@ -942,7 +1126,7 @@ FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
     ResourcePtr *prev, *head;
 
     if (((cid = dixClientIdForXID(id)) < LimitClients) && clientTable[cid].buckets) {
-        head = &clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
+        head = ResourceBucket(&clientTable[cid], id);
 
         prev = head;
         while ((res = *prev)) {
@@ -953,6 +1137,7 @@ FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
 #endif
                 *prev = res->next;
                 clientTable[cid].elements--;
+                ReleaseServerID(&clientTable[cid], id);
 
                 doFreeResource(res, skipFree);
 
@@ -976,7 +1161,7 @@ ChangeResourceValue(XID id, RESTYPE rtype, void *value)
     int cid;
 
     if (((cid = dixClientIdForXID(id)) < LimitClients) && clientTable[cid].buckets) {
-        for (ResourcePtr res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
+        for (ResourcePtr res = *ResourceBucket(&clientTable[cid], id);
             res; res = res->next)
             if ((res->id == id) && (res->type == rtype)) {
                 res->value = value;
@@ -1003,6 +1188,7 @@ FindClientResourcesByType(ClientPtr client,
     if (!client)
         client = serverClient;
 
+    BeginTableWalk(&clientTable[client->index]);
     resources = clientTable[client->index].resources;
     eltptr = &clientTable[client->index].elements;
     for (int i = 0; i < clientTable[client->index].buckets; i++) {
@@ -1016,6 +1202,7 @@ FindClientResourcesByType(ClientPtr client,
             }
         }
     }
+    EndTableWalk(&clientTable[client->index]);
 }
 
 void FindSubResources(void *resource,
@@ -1037,6 +1224,7 @@ FindAllClientResources(ClientPtr client, FindAllRes func, void *cdata)
     if (!client)
         client = serverClient;
 
+    BeginTableWalk(&clientTable[client->index]);
     resources = clientTable[client->index].resources;
     eltptr = &clientTable[client->index].elements;
     for (int i = 0; i < clientTable[client->index].buckets; i++) {
@@ -1048,6 +1236,7 @@ FindAllClientResources(ClientPtr client, FindAllRes func, void *cdata)
                 next = resources[i];    /* start over */
         }
     }
+    EndTableWalk(&clientTable[client->index]);
 }
 
 void *
@@ -1061,6 +1250,7 @@ LookupClientResourceComplex(ClientPtr client,
     if (!client)
         client = serverClient;
 
+    BeginTableWalk(&clientTable[client->index]);
     resources = clientTable[client->index].resources;
     for (int i = 0; i < clientTable[client->index].buckets; i++) {
         for (ResourcePtr this = resources[i], next; this; this = next) {
@@ -1068,11 +1258,14 @@ LookupClientResourceComplex(ClientPtr client,
             if (!type || this->type == type) {
                 /* workaround func freeing the type as DRI1 does */
                 value = this->value;
-                if ((*func) (value, this->id, cdata))
+                if ((*func) (value, this->id, cdata)) {
+                    EndTableWalk(&clientTable[client->index]);
                     return value;
+                }
             }
         }
     }
+    EndTableWalk(&clientTable[client->index]);
     return NULL;
 }
 
@@ -1088,6 +1281,7 @@ FreeClientNeverRetainResources(ClientPtr client)
     if (!client)
         return;
 
+    BeginTableWalk(&clientTable[client->index]);
     resources = clientTable[client->index].resources;
     eltptr = &clientTable[client->index].elements;
     for (int j = 0; j < clientTable[client->index].buckets; j++) {
@@ -1103,6 +1297,7 @@ FreeClientNeverRetainResources(ClientPtr client)
                 *prev = this->next;
                 clientTable[client->index].elements--;
                 elements = *eltptr;
+                ReleaseServerID(&clientTable[client->index], this->id);
 
                 doFreeResource(this, FALSE);
 
@@ -1113,6 +1308,7 @@ FreeClientNeverRetainResources(ClientPtr client)
                 prev = &this->next;
         }
     }
+    EndTableWalk(&clientTable[client->index]);
 }
 
 void
@@ -1128,6 +1324,7 @@ FreeClientResources(ClientPtr client)
 
     HandleSaveSet(client);
 
+    BeginTableWalk(&clientTable[client->index]);
     resources = clientTable[client->index].resources;
     for (int j = 0; j < clientTable[client->index].buckets; j++) {
         /* It may seem silly to update the head of this resource list as
@@ -1154,9 +1351,11 @@ FreeClientResources(ClientPtr client)
             doFreeResource(this, FALSE);
         }
     }
+    EndTableWalk(&clientTable[client->index]);
     free(clientTable[client->index].resources);
     clientTable[client->index].resources = NULL;
     clientTable[client->index].buckets = 0;
+    FreeServerIDs(&clientTable[client->index]);
 }
 
 void
@@ -1205,7 +1404,7 @@ dixLookupResourceByType(void **result, XID id, RESTYPE rtype,
         return BadImplementation;
 
     if ((cid < LimitClients) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
+        res = *ResourceBucket(&clientTable[cid], id);
 
         for (; res; res = res->next)
             if (res->id == id && res->type == rtype)
@@ -1240,7 +1439,7 @@ dixLookupResourceByClass(void **result, XID id, RESTYPE rclass,
     *result = NULL;
 
     if ((cid < LimitClients) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
+        res = *ResourceBucket(&clientTable[cid], id);
 
         for (; res; res = res->next)
             if (res->id == id && (res->type & rclass))
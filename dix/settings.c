@@ -15,3 +15,7 @@
 #include "dix/settings_priv.h"
 
 bool dixSettingAllowByteSwappedClients = false;
+int dixSettingRenderThreads = 1;
+int dixSettingRenderThreadPixels = 256 * 1024;
+int dixSettingRecordBufferSize = 0;
+bool dixSettingIncrementalClips = true;
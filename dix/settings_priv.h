@@ -16,4 +16,20 @@
 
 extern bool dixSettingAllowByteSwappedClients;
 
+/* threads fb composites large RENDER operations on, 1 for just the
+ * dispatch thread (-renderthreads) */
+extern int dixSettingRenderThreads;
+/* smallest operation in destination pixels worth splitting across them
+ * (-renderthreshold) */
+extern int dixSettingRenderThreadPixels;
+
+/* bytes of recorded protocol a RECORD context buffers for its client,
+ * dropping what doesn't fit; 0, the default, for the small buffer written
+ * out every 1 KiB, which never drops anything (-recordbuffer) */
+extern int dixSettingRecordBufferSize;
+
+/* let miValidateTree() skip windows whose visible area didn't change,
+ * off recomputes every marked window (-fullclips) */
+extern bool dixSettingIncrementalClips;
+
 #endif
@@ -270,6 +270,7 @@ typedef struct {
     FbBits bgand, bgxor;        /* for stipples */
     FbBits fg, bg, pm;          /* expanded and filled */
     unsigned int dashLength;    /* total of all dash elements */
+    int ropClass;               /* FB_ROP_* for alu and pm */
 } FbGCPrivRec, *FbGCPrivPtr;
 
 #define fbGetCompositeClip(pGC) ((pGC)->pCompositeClip)
@@ -34,6 +34,117 @@ static inline void fbValidateDrawable(DrawablePtr d) {}
 
 #endif /* FB_DEBUG */
 
+#ifndef FB_ACCESS_WRAPPER
+
+/* below this many FbBits, the plain loops are just as fast */
+#define FB_SIMD_MIN_WORDS   16
+
+/*
+ * @brief dst[0..n) = (dst[i] & and) ^ xor, with and == 0 a plain store
+ *
+ * Uses AVX2, SSE2 or NEON when the CPU has them.
+ */
+void fbSimdSolid(FbBits *dst, int n, FbBits and, FbBits xor);
+
+/*
+ * @brief copy n bytes like memmove(), the ranges may overlap
+ */
+void fbSimdCopy(CARD8 *dst, const CARD8 *src, size_t n);
+
+/* most threads one operation is split across */
+#define FB_MAX_THREADS      32
+
+typedef void (*FbParallelProcPtr) (void *closure, int band);
+
+/*
+ * @brief split a large operation into bands of rows for fbParallelRun()
+ *
+ * Splits the part of clip inside extents, both in the same coordinates,
+ * into up to -renderthreads bands covering about the same area. Fills
+ * ys[0..n] with the band edges and returns n. Returns 1 without touching
+ * ys when the operation is better done in one piece, because it is
+ * smaller than -renderthreshold or threads are off.
+ */
+int fbParallelSplit(RegionPtr clip, const BoxRec *extents, int *ys);
+
+/*
+ * @brief run proc(closure, band) for each band in [0, nbands)
+ *
+ * The bands are rendered by the worker threads and the calling thread,
+ * which returns once all of them are done. proc must not call into the
+ * rest of the server.
+ */
+void fbParallelRun(FbParallelProcPtr proc, void *closure, int nbands);
+
+/* object sizes a slab pool hands out, 256 bytes up to 24 KiB */
+#define FB_SLAB_CLASSES     15
+
+typedef struct _FbSlabPool *FbSlabPoolPtr;
+
+typedef struct {
+    unsigned long allocs;           /* objects handed out */
+    unsigned long tooLarge;         /* requests larger than any class */
+    unsigned long slabs;            /* slabs right now */
+    unsigned long peakSlabs;
+    unsigned long slabsAllocated;
+    unsigned long slabsFreed;
+} FbSlabStatsRec, *FbSlabStatsPtr;
+
+/*
+ * @brief create an empty pool of size class slabs
+ */
+FbSlabPoolPtr fbSlabPoolCreate(void);
+
+/*
+ * @brief give back the empty slabs and free the pool
+ *
+ * Slabs with objects still in use stay until the last of them is freed.
+ */
+void fbSlabPoolDestroy(FbSlabPoolPtr pool);
+
+/*
+ * @brief allocate size zeroed bytes on a cache line
+ *
+ * @return the object, or NULL when out of memory or size is larger than
+ *         the largest class
+ */
+void *fbSlabAlloc(FbSlabPoolPtr pool, size_t size);
+
+/*
+ * @brief free an object from fbSlabAlloc()
+ */
+void fbSlabFree(void *object);
+
+/*
+ * @brief give back all empty slabs, not just those beyond one per class
+ */
+void fbSlabTrim(FbSlabPoolPtr pool);
+
+void fbSlabGetStats(FbSlabPoolPtr pool, FbSlabStatsPtr stats);
+
+/*
+ * @brief set up the slabs small pixmaps of the screen come from
+ */
+Bool fbSlabScreenInit(ScreenPtr pScreen);
+void fbSlabScreenFini(ScreenPtr pScreen);
+
+/*
+ * @brief allocate a pixmap with privates and pixDataSize bytes from a slab
+ *
+ * @return the zeroed pixmap, or NullPixmap when it's too large for the
+ *         slabs or the screen has none
+ */
+PixmapPtr fbSlabAllocPixmap(ScreenPtr pScreen, size_t pixDataSize);
+
+/*
+ * @brief free a pixmap if it came from fbSlabAllocPixmap()
+ *
+ * @return FALSE if it didn't, and it's still to be freed
+ */
+Bool fbSlabFreePixmap(PixmapPtr pPixmap);
+
+#endif /* FB_ACCESS_WRAPPER */
+
 Bool fbAllocatePrivates(ScreenPtr pScreen);
 int  fbListInstalledColormaps(ScreenPtr pScreen, Colormap* pmaps);
 
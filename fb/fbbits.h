@@ -98,6 +98,9 @@
 #define RROP(b,a,x)	WRITE((b), FbDoRRop (READ(b), (a), (x)))
 #endif
 
+/* RROP with and all ones, see FB_ROP_XOR */
+#define RXOR(b,x)	WRITE((b), READ(b) ^ (x))
+
 #ifdef BITSUNIT
 #define UNIT BITSUNIT
 #define USE_SOLID
@@ -320,6 +323,15 @@ DOTS(FbBits * dst,
             }
         }
     }
+    else if (and == FB_ALLONES) {
+        while (npt--) {
+            pt = *pts++;
+            if (!isClipped(pt, ul, lr)) {
+                point = bits + intToY(pt) * bitsStride + intToX(pt);
+                RXOR(point, bxor);
+            }
+        }
+    }
     else {
         while (npt--) {
             pt = *pts++;
@@ -660,6 +672,7 @@ POLYLINE(DrawablePtr pDrawable,
     FbStride bitsStride;
     BITS xor = fbGetGCPrivate(pGC)->xor;
     BITS and = fbGetGCPrivate(pGC)->and;
+    int ropClass = fbGetGCPrivate(pGC)->ropClass;
     int dashoffset = 0;
 
     INT32 ul, lr;
@@ -729,6 +742,17 @@ POLYLINE(DrawablePtr pDrawable,
                         }
                     }
                 }
+                else if (ropClass == FB_ROP_XOR) {
+                    while (len--) {
+                        RXOR(bits, xor);
+                        bits += stepmajor;
+                        e += e1;
+                        if (e >= 0) {
+                            bits += stepminor;
+                            e += e3;
+                        }
+                    }
+                }
                 else {
                     while (len--) {
                         RROP(bits, and, xor);
@@ -782,6 +806,7 @@ POLYSEGMENT(DrawablePtr pDrawable, GCPtr pGC, int nseg, xSegment * pseg)
     FbBits andBits = fbGetGCPrivate(pGC)->and;
     BITS xor = xorBits;
     BITS and = andBits;
+    int ropClass = fbGetGCPrivate(pGC)->ropClass;
     int dashoffset = 0;
 
     INT32 ul, lr;
@@ -850,6 +875,11 @@ POLYSEGMENT(DrawablePtr pDrawable, GCPtr pGC, int nseg, xSegment * pseg)
                 if (!andBits)
                     while (nmiddle--)
                         WRITE(dstLine++, xorBits);
+                else if (ropClass == FB_ROP_XOR)
+                    while (nmiddle--) {
+                        RXOR(dstLine, xorBits);
+                        dstLine++;
+                    }
                 else
                     while (nmiddle--) {
                         WRITE(dstLine,
@@ -890,6 +920,17 @@ POLYSEGMENT(DrawablePtr pDrawable, GCPtr pGC, int nseg, xSegment * pseg)
                         }
                     }
                 }
+                else if (ropClass == FB_ROP_XOR) {
+                    while (len--) {
+                        RXOR(bits, xor);
+                        bits += stepmajor;
+                        e += e1;
+                        if (e >= 0) {
+                            bits += stepminor;
+                            e += e3;
+                        }
+                    }
+                }
                 else {
                     while (len--) {
                         RROP(bits, and, xor);
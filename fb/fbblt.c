@@ -23,7 +23,7 @@
 #include <dix-config.h>
 
 #include <string.h>
-#include "fb.h"
+#include "fb/fb_priv.h"
 
 #ifdef FB_ACCESS_WRAPPER
 
@@ -80,6 +80,7 @@ fbBlt(FbBits * srcLine,
     FbBits bits, bits1;
     int n, nmiddle;
     Bool destInvarient;
+    int ropClass;
     int startbyte, endbyte;
 
     FbDeclareMergeRop();
@@ -115,10 +116,28 @@ fbBlt(FbBits * srcLine,
 
             return;
         }
+#ifndef FB_ACCESS_WRAPPER
+        else {
+            int i;
+
+            /* overlapping, as when scrolling horizontally */
+            if (!upsidedown)
+                for (i = 0; i < height; i++)
+                    fbSimdCopy(dst_byte + i * dst_byte_stride,
+                               src_byte + i * src_byte_stride, width_byte);
+            else
+                for (i = height - 1; i >= 0; i--)
+                    fbSimdCopy(dst_byte + i * dst_byte_stride,
+                               src_byte + i * src_byte_stride, width_byte);
+
+            return;
+        }
+#endif
     }
 
     FbInitializeMergeRop(alu, pm);
     destInvarient = FbDestInvarientMergeRop();
+    ropClass = fbRopClass(alu, pm);
     if (upsidedown) {
         srcLine += (height - 1) * (srcStride);
         dstLine += (height - 1) * (dstStride);
@@ -152,7 +171,18 @@ fbBlt(FbBits * srcLine,
                     FbDoRightMaskByteMergeRop(dst, bits, endbyte, endmask);
                 }
                 n = nmiddle;
-                if (destInvarient) {
+                if (ropClass == FB_ROP_COPY) {
+                    while (n--)
+                        WRITE(--dst, READ(--src));
+                }
+                else if (ropClass == FB_ROP_XOR) {
+                    while (n--) {
+                        bits = READ(--src);
+                        --dst;
+                        WRITE(dst, READ(dst) ^ bits);
+                    }
+                }
+                else if (destInvarient) {
                     while (n--)
                         WRITE(--dst, FbDoDestInvarientMergeRop(READ(--src)));
                 }
@@ -176,29 +206,18 @@ fbBlt(FbBits * srcLine,
                     dst++;
                 }
                 n = nmiddle;
-                if (destInvarient) {
-#if 0
-                    /*
-                     * This provides some speedup on screen->screen blts
-                     * over the PCI bus, usually about 10%.  But fb
-                     * isn't usually used for this operation...
-                     */
-                    if (_ca2 + 1 == 0 && _cx2 == 0) {
-                        FbBits t1, t2, t3, t4;
-
-                        while (n >= 4) {
-                            t1 = *src++;
-                            t2 = *src++;
-                            t3 = *src++;
-                            t4 = *src++;
-                            *dst++ = t1;
-                            *dst++ = t2;
-                            *dst++ = t3;
-                            *dst++ = t4;
-                            n -= 4;
-                        }
+                if (ropClass == FB_ROP_COPY) {
+                    while (n--)
+                        WRITE(dst++, READ(src++));
+                }
+                else if (ropClass == FB_ROP_XOR) {
+                    while (n--) {
+                        bits = READ(src++);
+                        WRITE(dst, READ(dst) ^ bits);
+                        dst++;
                     }
-#endif
+                }
+                else if (destInvarient) {
                     while (n--)
                         WRITE(dst++, FbDoDestInvarientMergeRop(READ(src++)));
                 }
@@ -245,7 +264,24 @@ fbBlt(FbBits * srcLine,
                     FbDoRightMaskByteMergeRop(dst, bits, endbyte, endmask);
                 }
                 n = nmiddle;
-                if (destInvarient) {
+                if (ropClass == FB_ROP_COPY) {
+                    while (n--) {
+                        bits = FbScrRight(bits1, rightShift);
+                        bits1 = READ(--src);
+                        bits |= FbScrLeft(bits1, leftShift);
+                        WRITE(--dst, bits);
+                    }
+                }
+                else if (ropClass == FB_ROP_XOR) {
+                    while (n--) {
+                        bits = FbScrRight(bits1, rightShift);
+                        bits1 = READ(--src);
+                        bits |= FbScrLeft(bits1, leftShift);
+                        --dst;
+                        WRITE(dst, READ(dst) ^ bits);
+                    }
+                }
+                else if (destInvarient) {
                     while (n--) {
                         bits = FbScrRight(bits1, rightShift);
                         bits1 = READ(--src);
@@ -286,7 +322,24 @@ fbBlt(FbBits * srcLine,
                     dst++;
                 }
                 n = nmiddle;
-                if (destInvarient) {
+                if (ropClass == FB_ROP_COPY) {
+                    while (n--) {
+                        bits = FbScrLeft(bits1, leftShift);
+                        bits1 = READ(src++);
+                        bits |= FbScrRight(bits1, rightShift);
+                        WRITE(dst++, bits);
+                    }
+                }
+                else if (ropClass == FB_ROP_XOR) {
+                    while (n--) {
+                        bits = FbScrLeft(bits1, leftShift);
+                        bits1 = READ(src++);
+                        bits |= FbScrRight(bits1, rightShift);
+                        WRITE(dst, READ(dst) ^ bits);
+                        dst++;
+                    }
+                }
+                else if (destInvarient) {
                     while (n--) {
                         bits = FbScrLeft(bits1, leftShift);
                         bits1 = READ(src++);
@@ -37,6 +37,9 @@ fbCopyNtoN(DrawablePtr pSrcDrawable,
 {
     CARD8 alu = pGC ? pGC->alu : GXcopy;
     FbBits pm = pGC ? fbGetGCPrivate(pGC)->pm : FB_ALLONES;
+#ifndef FB_ACCESS_WRAPPER
+    int ropClass = pGC ? fbGetGCPrivate(pGC)->ropClass : FB_ROP_COPY;
+#endif
     FbBits *src;
     FbStride srcStride;
     int srcBpp;
@@ -51,7 +54,7 @@ fbCopyNtoN(DrawablePtr pSrcDrawable,
 
     while (nbox--) {
 #ifndef FB_ACCESS_WRAPPER       /* pixman_blt() doesn't support accessors yet */
-        if (pm == FB_ALLONES && alu == GXcopy && !reverse && !upsidedown) {
+        if (ropClass == FB_ROP_COPY && !reverse && !upsidedown) {
             if (!pixman_blt
                 ((uint32_t *) src, (uint32_t *) dst, srcStride, dstStride,
                  srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
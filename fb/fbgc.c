@@ -168,6 +168,7 @@ fbValidateGC(GCPtr pGC, unsigned long changes, DrawablePtr pDrawable)
         pPriv->xor = fbXor(pGC->alu, pPriv->fg, pPriv->pm);
         pPriv->bgand = fbAnd(pGC->alu, pPriv->bg, pPriv->pm);
         pPriv->bgxor = fbXor(pGC->alu, pPriv->bg, pPriv->pm);
+        pPriv->ropClass = fbRopClass(pGC->alu, pPriv->pm);
     }
     if (changes & GCDashList) {
         unsigned short n = pGC->numInDashList;
@@ -0,0 +1,252 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Glyph atlas for the software RENDER path
+ *
+ * Glyphs are copied once into a large A8 or ARGB image, where fbGlyphs()
+ * adds them straight into the mask of a glyph run instead of going through
+ * a pixman composite per glyph. Space is handed out in shelves: rows of
+ * glyphs of similar height, filled left to right. When the atlas is full,
+ * the least recently used shelf of about the right height is emptied, or
+ * failing that a taller one, or the top shelves are given up for one of
+ * the right height.
+ *
+ * Glyphs are keyed by their GlyphPtr, which render/glyph.c keeps unique
+ * per glyph image, and hashed by the sha1 it computed for that.
+ */
+#include <dix-config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fb/fb_priv.h"
+#include "fb/fbpict_priv.h"
+
+#ifndef FB_ACCESS_WRAPPER
+
+/* shelf heights are a multiple of this */
+#define FB_GLYPH_SHELF_UNIT     8
+
+static int
+fbGlyphAtlasBucket(GlyphPtr glyph)
+{
+    uint32_t h;
+
+    memcpy(&h, glyph->sha1, sizeof(h));
+    return h & (FB_GLYPH_ATLAS_BUCKETS - 1);
+}
+
+FbGlyphAtlasPtr
+fbGlyphAtlasCreate(pixman_format_code_t format, int width, int height)
+{
+    FbGlyphAtlasPtr atlas;
+
+    if (width < FB_GLYPH_MAX_SIZE || height < FB_GLYPH_MAX_SIZE)
+        return NULL;
+    if (!(atlas = calloc(1, sizeof(FbGlyphAtlasRec))))
+        return NULL;
+
+    atlas->format = format;
+    atlas->width = width;
+    atlas->height = height;
+    atlas->cpp = PIXMAN_FORMAT_BPP(format) / 8;
+    atlas->stride = width * atlas->cpp;
+    atlas->shelves = calloc(height / FB_GLYPH_SHELF_UNIT,
+                            sizeof(FbGlyphShelfRec));
+    atlas->bits = calloc(height, atlas->stride);
+    if (atlas->shelves && atlas->bits)
+        atlas->image = pixman_image_create_bits(format, width, height,
+                                                (uint32_t *) atlas->bits,
+                                                atlas->stride);
+    if (!atlas->image) {
+        free(atlas->shelves);
+        free(atlas->bits);
+        free(atlas);
+        return NULL;
+    }
+    return atlas;
+}
+
+static void
+fbGlyphAtlasUnhash(FbGlyphAtlasPtr atlas, FbGlyphAtlasEntryPtr entry)
+{
+    FbGlyphAtlasEntryPtr *prev = &atlas->hash[fbGlyphAtlasBucket(entry->glyph)];
+
+    while (*prev != entry)
+        prev = &(*prev)->next;
+    *prev = entry->next;
+}
+
+/* drop all glyphs of a shelf, which keeps its place and height */
+static void
+fbGlyphAtlasEmptyShelf(FbGlyphAtlasPtr atlas, FbGlyphShelfPtr shelf)
+{
+    FbGlyphAtlasEntryPtr entry, next;
+
+    for (entry = shelf->entries; entry; entry = next) {
+        next = entry->shelf_next;
+        fbGlyphAtlasUnhash(atlas, entry);
+        free(entry);
+        atlas->evictions++;
+    }
+    shelf->entries = NULL;
+    shelf->used = 0;
+}
+
+void
+fbGlyphAtlasDestroy(FbGlyphAtlasPtr atlas)
+{
+    if (!atlas)
+        return;
+    for (int i = 0; i < atlas->nshelves; i++)
+        fbGlyphAtlasEmptyShelf(atlas, &atlas->shelves[i]);
+    pixman_image_unref(atlas->image);
+    free(atlas->shelves);
+    free(atlas->bits);
+    free(atlas);
+}
+
+FbGlyphAtlasEntryPtr
+fbGlyphAtlasLookup(FbGlyphAtlasPtr atlas, GlyphPtr glyph)
+{
+    FbGlyphAtlasEntryPtr entry;
+
+    for (entry = atlas->hash[fbGlyphAtlasBucket(glyph)]; entry;
+         entry = entry->next) {
+        if (entry->glyph == glyph) {
+            atlas->shelves[entry->shelf].stamp = atlas->stamp;
+            atlas->hits++;
+            return entry;
+        }
+    }
+    atlas->misses++;
+    return NULL;
+}
+
+/* a shelf with room for a glyph of the given size */
+static FbGlyphShelfPtr
+fbGlyphAtlasShelf(FbGlyphAtlasPtr atlas, int width, int height)
+{
+    int want = (height + FB_GLYPH_SHELF_UNIT - 1) & ~(FB_GLYPH_SHELF_UNIT - 1);
+    FbGlyphShelfPtr shelf, lru = NULL, taller = NULL;
+
+    /* shelves up to twice as high as needed are fine */
+    for (int i = 0; i < atlas->nshelves; i++) {
+        shelf = &atlas->shelves[i];
+        if (shelf->height < want)
+            continue;
+        if (shelf->height > 2 * want) {
+            if (!taller || shelf->stamp < taller->stamp)
+                taller = shelf;
+            continue;
+        }
+        if (shelf->used + width <= atlas->width)
+            return shelf;
+        if (!lru || shelf->stamp < lru->stamp)
+            lru = shelf;
+    }
+
+    if (atlas->top + want <= atlas->height) {
+        shelf = &atlas->shelves[atlas->nshelves++];
+        shelf->y = atlas->top;
+        shelf->height = want;
+        atlas->top += want;
+        return shelf;
+    }
+
+    /* full, take over the least recently used shelf that's high enough */
+    if (!lru)
+        lru = taller;
+    if (lru) {
+        fbGlyphAtlasEmptyShelf(atlas, lru);
+        return lru;
+    }
+
+    /* all shelves are lower, give up as many at the top as it takes */
+    while (atlas->top + want > atlas->height) {
+        shelf = &atlas->shelves[--atlas->nshelves];
+        fbGlyphAtlasEmptyShelf(atlas, shelf);
+        atlas->top = shelf->y;
+    }
+    shelf = &atlas->shelves[atlas->nshelves++];
+    shelf->y = atlas->top;
+    shelf->height = want;
+    atlas->top += want;
+    return shelf;
+}
+
+FbGlyphAtlasEntryPtr
+fbGlyphAtlasAlloc(FbGlyphAtlasPtr atlas, GlyphPtr glyph)
+{
+    int width = glyph->info.width, height = glyph->info.height;
+    FbGlyphAtlasEntryPtr entry;
+    FbGlyphShelfPtr shelf;
+    int bucket;
+
+    if (!width || !height ||
+        width > FB_GLYPH_MAX_SIZE || height > FB_GLYPH_MAX_SIZE)
+        return NULL;
+    if (!(entry = calloc(1, sizeof(FbGlyphAtlasEntryRec))))
+        return NULL;
+
+    shelf = fbGlyphAtlasShelf(atlas, width, height);
+    shelf->stamp = atlas->stamp;
+
+    entry->glyph = glyph;
+    entry->x = shelf->used;
+    entry->y = shelf->y;
+    entry->shelf = shelf - atlas->shelves;
+    entry->shelf_next = shelf->entries;
+    shelf->entries = entry;
+    shelf->used += width;
+
+    bucket = fbGlyphAtlasBucket(glyph);
+    entry->next = atlas->hash[bucket];
+    atlas->hash[bucket] = entry;
+    return entry;
+}
+
+void
+fbGlyphAtlasRemove(FbGlyphAtlasPtr atlas, GlyphPtr glyph)
+{
+    FbGlyphAtlasEntryPtr entry, *prev;
+    FbGlyphShelfPtr shelf;
+
+    for (entry = atlas->hash[fbGlyphAtlasBucket(glyph)]; entry;
+         entry = entry->next)
+        if (entry->glyph == glyph)
+            break;
+    if (!entry)
+        return;
+
+    /* the space stays taken until the shelf is emptied */
+    shelf = &atlas->shelves[entry->shelf];
+    for (prev = &shelf->entries; *prev != entry; prev = &(*prev)->shelf_next);
+    *prev = entry->shelf_next;
+    fbGlyphAtlasUnhash(atlas, entry);
+    free(entry);
+}
+
+Bool
+fbGlyphAtlasAdd(FbGlyphAtlasPtr atlas, FbGlyphAtlasEntryPtr entry,
+                uint8_t *mask, int stride, int x, int y)
+{
+    int width = entry->glyph->info.width * atlas->cpp;
+    int height = entry->glyph->info.height;
+    const uint8_t *src = atlas->bits + entry->y * atlas->stride +
+        entry->x * atlas->cpp;
+    uint8_t *dst = mask + y * stride + x * atlas->cpp;
+    int overlap = 0;
+
+    for (; height--; src += atlas->stride, dst += stride) {
+        for (int i = 0; i < width; i++) {
+            unsigned int sum = dst[i] + src[i];
+
+            overlap |= dst[i] && src[i];
+            /* saturate like PictOpAdd */
+            dst[i] = sum | (0 - (sum >> 8));
+        }
+    }
+    return overlap;
+}
+
+#endif /* FB_ACCESS_WRAPPER */
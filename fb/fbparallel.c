@@ -0,0 +1,203 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Worker threads for large software rendering operations
+ *
+ * A full screen translucent composite on a 4K framebuffer takes tens of
+ * milliseconds in pixman, during which no other client gets served. With
+ * -renderthreads, such operations are split into horizontal bands of the
+ * destination. The caller prepares everything a band needs on the dispatch
+ * thread, then the bands are rendered by a pool of workers and the caller
+ * itself. Workers only ever run the band function, they don't touch any
+ * other server state.
+ */
+#include <dix-config.h>
+
+#include <signal.h>
+#include <stdint.h>
+
+#include "dix/settings_priv.h"
+#include "fb/fb_priv.h"
+
+#ifndef FB_ACCESS_WRAPPER       /* the wrapped accessors aren't thread safe */
+
+#if INPUTTHREAD
+#include <pthread.h>
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        /* new bands were handed out */
+    pthread_cond_t done;        /* the last band is finished */
+    FbParallelProcPtr proc;
+    void *closure;
+    int nbands;
+    int next;                   /* next band to render */
+    int pending;                /* bands not finished yet */
+} fbWorkers = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+/* only touched by the dispatch thread */
+static int fbWorkersStarted;
+static Bool fbWorkersFailed;
+
+/* render bands while there are any left, called with the lock held */
+static void
+fbParallelDrain(void)
+{
+    while (fbWorkers.next < fbWorkers.nbands) {
+        FbParallelProcPtr proc = fbWorkers.proc;
+        void *closure = fbWorkers.closure;
+        int band = fbWorkers.next++;
+
+        pthread_mutex_unlock(&fbWorkers.lock);
+        proc(closure, band);
+        pthread_mutex_lock(&fbWorkers.lock);
+        if (--fbWorkers.pending == 0)
+            pthread_cond_signal(&fbWorkers.done);
+    }
+}
+
+static void *
+fbParallelWorker(void *arg)
+{
+    sigset_t set;
+
+    /* signals are for the main thread */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+#if defined(HAVE_PTHREAD_SETNAME_NP_WITH_TID)
+    pthread_setname_np (pthread_self(), "RenderThread");
+#elif defined(HAVE_PTHREAD_SETNAME_NP_WITHOUT_TID)
+    pthread_setname_np ("RenderThread");
+#endif
+
+    pthread_mutex_lock(&fbWorkers.lock);
+    for (;;) {
+        fbParallelDrain();
+        pthread_cond_wait(&fbWorkers.work, &fbWorkers.lock);
+    }
+    return NULL;
+}
+
+/* make sure there are nworkers threads, short of the first failure */
+static void
+fbParallelStart(int nworkers)
+{
+    pthread_attr_t attr;
+
+    if (fbWorkersStarted >= nworkers || fbWorkersFailed)
+        return;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (fbWorkersStarted < nworkers) {
+        pthread_t thread;
+
+        if (pthread_create(&thread, &attr, fbParallelWorker, NULL) != 0) {
+            ErrorF("fb: could only start %d of %d render threads\n",
+                   fbWorkersStarted, nworkers);
+            fbWorkersFailed = TRUE;
+            break;
+        }
+        fbWorkersStarted++;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+void
+fbParallelRun(FbParallelProcPtr proc, void *closure, int nbands)
+{
+    fbParallelStart(min(dixSettingRenderThreads, FB_MAX_THREADS) - 1);
+
+    pthread_mutex_lock(&fbWorkers.lock);
+    fbWorkers.proc = proc;
+    fbWorkers.closure = closure;
+    fbWorkers.next = 0;
+    fbWorkers.nbands = nbands;
+    fbWorkers.pending = nbands;
+    pthread_cond_broadcast(&fbWorkers.work);
+
+    fbParallelDrain();
+    while (fbWorkers.pending)
+        pthread_cond_wait(&fbWorkers.done, &fbWorkers.lock);
+    pthread_mutex_unlock(&fbWorkers.lock);
+}
+
+#else /* INPUTTHREAD */
+
+void
+fbParallelRun(FbParallelProcPtr proc, void *closure, int nbands)
+{
+    for (int band = 0; band < nbands; band++)
+        proc(closure, band);
+}
+
+#endif /* INPUTTHREAD */
+
+int
+fbParallelSplit(RegionPtr clip, const BoxRec *extents, int *ys)
+{
+    int nthreads = min(dixSettingRenderThreads, FB_MAX_THREADS);
+    const BoxRec *box = RegionRects(clip);
+    int nbox = RegionNumRects(clip);
+    int64_t total = 0, sum = 0;
+    int split = 1, n = 0;
+
+#if !INPUTTHREAD
+    nthreads = 1;
+#endif
+    if (nthreads < 2)
+        return 1;
+
+    for (int i = 0; i < nbox; i++) {
+        int w = min(box[i].x2, extents->x2) - max(box[i].x1, extents->x1);
+        int h = min(box[i].y2, extents->y2) - max(box[i].y1, extents->y1);
+
+        if (w > 0 && h > 0)
+            total += (int64_t) w * h;
+    }
+    if (total < max(dixSettingRenderThreadPixels, 1))
+        return 1;
+
+    /* the boxes come in bands of equal y1 and y2, sorted by y */
+    for (int i = 0; i < nbox;) {
+        int y1 = max(box[i].y1, extents->y1);
+        int y2 = min(box[i].y2, extents->y2);
+        int64_t width = 0;
+        int j;
+
+        for (j = i; j < nbox && box[j].y1 == box[i].y1; j++) {
+            int w = min(box[j].x2, extents->x2) - max(box[j].x1, extents->x1);
+
+            if (w > 0)
+                width += w;
+        }
+        i = j;
+        if (y1 >= y2 || !width)
+            continue;
+
+        if (!n)
+            ys[n++] = y1;
+        /* place the edges where the area so far reaches its share */
+        for (; split < nthreads; split++) {
+            int64_t target = total * split / nthreads;
+            int y;
+
+            if (sum + width * (y2 - y1) <= target)
+                break;
+            y = y1 + (target - sum + width - 1) / width;
+            if (y > ys[n - 1])
+                ys[n++] = y;
+        }
+        sum += width * (y2 - y1);
+        ys[n] = y2;
+    }
+    if (ys[n] > ys[n - 1])
+        n++;
+    return n - 1;
+}
+
+#endif /* FB_ACCESS_WRAPPER */
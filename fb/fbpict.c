@@ -27,6 +27,7 @@
 
 #include <string.h>
 
+#include "fb/fb_priv.h"
 #include "fb/fbpict_priv.h"
 
 #include "fb.h"
@@ -34,6 +35,170 @@
 #include "picturestr.h"
 #include "mipict.h"
 
+#ifndef FB_ACCESS_WRAPPER
+
+static PixmapPtr
+fbPictPixmap(DrawablePtr pDrawable)
+{
+    if (pDrawable->type != DRAWABLE_PIXMAP)
+        return fbGetWindowPixmap(pDrawable);
+    return (PixmapPtr) pDrawable;
+}
+
+/* bands reading what other bands write would race each other */
+static Bool
+fbPictReadsPixmap(PicturePtr pict, PixmapPtr pixmap)
+{
+    for (; pict; pict = pict->alphaMap)
+        if (pict->pDrawable && fbPictPixmap(pict->pDrawable) == pixmap)
+            return TRUE;
+    return FALSE;
+}
+
+static Bool
+fbPictClipBand(PicturePtr pDst, FbPictBandPtr band)
+{
+    DrawablePtr pDrawable = pDst->pDrawable;
+    RegionPtr clip = pDst->pCompositeClip;
+    BoxRec box = {
+        .x1 = clip->extents.x1, .y1 = band->y1 + pDrawable->y,
+        .x2 = clip->extents.x2, .y2 = band->y2 + pDrawable->y,
+    };
+    RegionRec rows;
+    Bool ret;
+
+    RegionInit(&rows, &box, 1);
+    ret = RegionIntersect(&rows, &rows, clip);
+    RegionTranslate(&rows, band->dst_xoff - pDrawable->x,
+                    band->dst_yoff - pDrawable->y);
+    ret = ret && pixman_image_set_clip_region(band->dst, &rows);
+    RegionUninit(&rows);
+    return ret;
+}
+
+int
+fbPictBands(PicturePtr pSrc, PicturePtr pMask, PicturePtr pDst,
+            const pixman_box32_t *extents, FbPictBandPtr bands)
+{
+    DrawablePtr pDrawable = pDst->pDrawable;
+    RegionPtr clip = pDst->pCompositeClip;
+    PixmapPtr pixmap = fbPictPixmap(pDrawable);
+    int x1, y1, x2, y2;
+    int ys[FB_MAX_THREADS + 1];
+    BoxRec box;
+    int n;
+
+    if (fbPictReadsPixmap(pSrc, pixmap) || fbPictReadsPixmap(pMask, pixmap))
+        return 0;
+
+    /* the clip is in screen coordinates */
+    x1 = max(extents->x1 + pDrawable->x, clip->extents.x1);
+    y1 = max(extents->y1 + pDrawable->y, clip->extents.y1);
+    x2 = min(extents->x2 + pDrawable->x, clip->extents.x2);
+    y2 = min(extents->y2 + pDrawable->y, clip->extents.y2);
+    if (x1 >= x2 || y1 >= y2)
+        return 0;
+    box.x1 = x1;
+    box.y1 = y1;
+    box.x2 = x2;
+    box.y2 = y2;
+
+    n = fbParallelSplit(clip, &box, ys);
+    if (n < 2)
+        return 0;
+
+    for (int i = 0; i < n; i++) {
+        FbPictBandPtr band = &bands[i];
+
+        *band = (FbPictBandRec) {
+            .y1 = ys[i] - pDrawable->y,
+            .y2 = ys[i + 1] - pDrawable->y,
+        };
+        band->src = image_from_pict(pSrc, FALSE,
+                                    &band->src_xoff, &band->src_yoff);
+        band->mask = image_from_pict(pMask, FALSE,
+                                     &band->msk_xoff, &band->msk_yoff);
+        band->dst = image_from_pict(pDst, TRUE,
+                                    &band->dst_xoff, &band->dst_yoff);
+        if (!band->src || (pMask && !band->mask) || !band->dst ||
+            !fbPictClipBand(pDst, band)) {
+            fbPictFreeBands(pSrc, pMask, pDst, bands, i + 1);
+            return 0;
+        }
+    }
+    return n;
+}
+
+void
+fbPictFreeBands(PicturePtr pSrc, PicturePtr pMask, PicturePtr pDst,
+                FbPictBandPtr bands, int nbands)
+{
+    for (int i = 0; i < nbands; i++) {
+        free_pixman_pict(pSrc, bands[i].src);
+        free_pixman_pict(pMask, bands[i].mask);
+        free_pixman_pict(pDst, bands[i].dst);
+    }
+}
+
+typedef struct {
+    pixman_op_t op;
+    int xSrc, ySrc;
+    int xMask, yMask;
+    int xDst, yDst;
+    int width, height;
+    FbPictBandRec bands[FB_MAX_THREADS];
+} FbCompositeBandsRec;
+
+static void
+fbCompositeBand(void *closure, int i)
+{
+    FbCompositeBandsRec *c = closure;
+    FbPictBandPtr band = &c->bands[i];
+    int y1 = max(band->y1, c->yDst);
+    int y2 = min(band->y2, c->yDst + c->height);
+
+    if (y1 >= y2)
+        return;
+    pixman_image_composite(c->op, band->src, band->mask, band->dst,
+                           c->xSrc + band->src_xoff,
+                           c->ySrc + y1 - c->yDst + band->src_yoff,
+                           c->xMask + band->msk_xoff,
+                           c->yMask + y1 - c->yDst + band->msk_yoff,
+                           c->xDst + band->dst_xoff, y1 + band->dst_yoff,
+                           c->width, y2 - y1);
+}
+
+static Bool
+fbCompositeParallel(CARD8 op,
+                    PicturePtr pSrc,
+                    PicturePtr pMask,
+                    PicturePtr pDst,
+                    INT16 xSrc,
+                    INT16 ySrc,
+                    INT16 xMask,
+                    INT16 yMask,
+                    INT16 xDst, INT16 yDst, CARD16 width, CARD16 height)
+{
+    FbCompositeBandsRec c = {
+        .op = op,
+        .xSrc = xSrc, .ySrc = ySrc,
+        .xMask = xMask, .yMask = yMask,
+        .xDst = xDst, .yDst = yDst,
+        .width = width, .height = height,
+    };
+    pixman_box32_t extents = { xDst, yDst, xDst + width, yDst + height };
+    int n;
+
+    if (!(n = fbPictBands(pSrc, pMask, pDst, &extents, c.bands)))
+        return FALSE;
+
+    fbParallelRun(fbCompositeBand, &c, n);
+    fbPictFreeBands(pSrc, pMask, pDst, c.bands, n);
+    return TRUE;
+}
+
+#endif /* FB_ACCESS_WRAPPER */
+
 void
 fbComposite(CARD8 op,
             PicturePtr pSrc,
@@ -53,6 +218,12 @@ fbComposite(CARD8 op,
     if (pMask)
         miCompositeSourceValidate(pMask);
 
+#ifndef FB_ACCESS_WRAPPER
+    if (fbCompositeParallel(op, pSrc, pMask, pDst, xSrc, ySrc,
+                            xMask, yMask, xDst, yDst, width, height))
+        return;
+#endif
+
     src = image_from_pict(pSrc, FALSE, &src_xoff, &src_yoff);
     mask = image_from_pict(pMask, FALSE, &msk_xoff, &msk_yoff);
     dest = image_from_pict(pDst, TRUE, &dst_xoff, &dst_yoff);
@@ -81,14 +252,367 @@ fbDestroyGlyphCache(void)
     }
 }
 
+#ifndef FB_ACCESS_WRAPPER
+
+/* A8 glyph atlas, 1MB; the ARGB one is as large in bytes */
+#define FB_GLYPH_ATLAS_SIZE     1024
+/* larger glyph runs aren't worth building a mask of our own for */
+#define FB_GLYPH_MASK_MAX       (2048 * 2048)
+/* nor are ones where the glyphs cover less than this part of the mask */
+#define FB_GLYPH_MASK_SPARSE    4
+
+typedef struct {
+    FbGlyphAtlasPtr a8;
+    FbGlyphAtlasPtr argb;
+} FbGlyphAtlasScreenRec, *FbGlyphAtlasScreenPtr;
+
+static DevPrivateKeyRec fbGlyphAtlasScreenKeyRec;
+
+static FbGlyphAtlasScreenPtr
+fbGlyphAtlasScreen(ScreenPtr pScreen)
+{
+    if (!dixPrivateKeyRegistered(&fbGlyphAtlasScreenKeyRec))
+        return NULL;
+    return dixGetPrivateAddr(&pScreen->devPrivates, &fbGlyphAtlasScreenKeyRec);
+}
+
+static void
+fbGlyphAtlasLog(const char *name, FbGlyphAtlasPtr atlas)
+{
+    unsigned long lookups;
+
+    if (!atlas)
+        return;
+    lookups = atlas->hits + atlas->misses;
+    LogMessageVerb(X_INFO, 3,
+                   "fb: %s glyph atlas: %lu lookups, %.1f%% hits, "
+                   "%lu glyphs evicted\n", name, lookups,
+                   lookups ? 100.0 * atlas->hits / lookups : 0.0,
+                   atlas->evictions);
+}
+
+void
+fbGlyphAtlasFini(ScreenPtr pScreen)
+{
+    FbGlyphAtlasScreenPtr priv = fbGlyphAtlasScreen(pScreen);
+
+    if (!priv)
+        return;
+    fbGlyphAtlasLog("A8", priv->a8);
+    fbGlyphAtlasLog("ARGB", priv->argb);
+    fbGlyphAtlasDestroy(priv->a8);
+    fbGlyphAtlasDestroy(priv->argb);
+    priv->a8 = priv->argb = NULL;
+}
+
+#endif /* FB_ACCESS_WRAPPER */
+
 static void
 fbUnrealizeGlyph(ScreenPtr pScreen,
 		 GlyphPtr pGlyph)
 {
+#ifndef FB_ACCESS_WRAPPER
+    FbGlyphAtlasScreenPtr priv = fbGlyphAtlasScreen(pScreen);
+
+    if (priv && priv->a8)
+        fbGlyphAtlasRemove(priv->a8, pGlyph);
+    if (priv && priv->argb)
+        fbGlyphAtlasRemove(priv->argb, pGlyph);
+#endif
+
     if (glyphCache)
 	pixman_glyph_cache_remove (glyphCache, pGlyph, NULL);
 }
 
+#ifndef FB_ACCESS_WRAPPER
+
+typedef struct {
+    pixman_op_t op;
+    Bool has_mask;
+    pixman_format_code_t format;        /* of the mask */
+    int xSrc, ySrc;                     /* source offset from the glyphs */
+    pixman_box32_t extents;
+    int n_glyphs;
+    const pixman_glyph_t *glyphs;
+    FbPictBandRec bands[FB_MAX_THREADS];
+} FbGlyphBandsRec;
+
+static void
+fbGlyphsBand(void *closure, int i)
+{
+    FbGlyphBandsRec *c = closure;
+    FbPictBandPtr band = &c->bands[i];
+    int y1 = max(band->y1, c->extents.y1);
+    int y2 = min(band->y2, c->extents.y2);
+
+    if (!c->has_mask) {
+        pixman_composite_glyphs_no_mask(c->op, band->src, band->dst,
+                                        c->xSrc + band->src_xoff,
+                                        c->ySrc + band->src_yoff,
+                                        band->dst_xoff, band->dst_yoff,
+                                        glyphCache, c->n_glyphs, c->glyphs);
+    }
+    else if (y1 < y2) {
+        /* only the rows of the mask under this band */
+        pixman_composite_glyphs(c->op, band->src, band->dst, c->format,
+                                c->xSrc + band->src_xoff + c->extents.x1,
+                                c->ySrc + band->src_yoff + y1,
+                                c->extents.x1, y1,
+                                c->extents.x1 + band->dst_xoff,
+                                y1 + band->dst_yoff,
+                                c->extents.x2 - c->extents.x1, y2 - y1,
+                                glyphCache, c->n_glyphs, c->glyphs);
+    }
+}
+
+static Bool
+fbGlyphsParallel(CARD8 op,
+                 PicturePtr pSrc,
+                 PicturePtr pDst,
+                 PictFormatPtr maskFormat,
+                 int xSrc, int ySrc,
+                 int n_glyphs, const pixman_glyph_t *glyphs)
+{
+    FbGlyphBandsRec c = {
+        .op = op,
+        .has_mask = maskFormat != NULL,
+        .xSrc = xSrc, .ySrc = ySrc,
+        .n_glyphs = n_glyphs,
+        .glyphs = glyphs,
+    };
+    int n;
+
+    if (maskFormat)
+        c.format = maskFormat->format | (maskFormat->depth << 24);
+    pixman_glyph_get_extents(glyphCache, n_glyphs,
+                             (pixman_glyph_t *) glyphs, &c.extents);
+
+    if (!(n = fbPictBands(pSrc, NULL, pDst, &c.extents, c.bands)))
+        return FALSE;
+
+    fbParallelRun(fbGlyphsBand, &c, n);
+    fbPictFreeBands(pSrc, NULL, pDst, c.bands, n);
+    return TRUE;
+}
+
+/* composite through a mask built from the atlas */
+static Bool
+fbGlyphsMaskComposite(CARD8 op,
+                      PicturePtr pSrc,
+                      PicturePtr pDst,
+                      pixman_format_code_t format,
+                      uint8_t *bits, int stride,
+                      const pixman_box32_t *extents,
+                      int xSrc, int ySrc)
+{
+    int width = extents->x2 - extents->x1;
+    int height = extents->y2 - extents->y1;
+    FbCompositeBandsRec c = {
+        .op = op,
+        .xSrc = xSrc + extents->x1, .ySrc = ySrc + extents->y1,
+        .xDst = extents->x1, .yDst = extents->y1,
+        .width = width, .height = height,
+    };
+    Bool ret = TRUE;
+    int n;
+
+    if (!(n = fbPictBands(pSrc, NULL, pDst, extents, c.bands))) {
+        /* a single band, with the images of the whole picture */
+        FbPictBandPtr band = &c.bands[0];
+
+        *band = (FbPictBandRec) { .y1 = extents->y1, .y2 = extents->y2 };
+        band->src = image_from_pict(pSrc, FALSE,
+                                    &band->src_xoff, &band->src_yoff);
+        band->dst = image_from_pict(pDst, TRUE,
+                                    &band->dst_xoff, &band->dst_yoff);
+        n = 1;
+    }
+
+    /* images are not shared between threads, the mask bits are */
+    for (int i = 0; i < n; i++) {
+        FbPictBandPtr band = &c.bands[i];
+
+        band->mask = pixman_image_create_bits(format, width, height,
+                                              (uint32_t *) bits, stride);
+        if (!band->src || !band->mask || !band->dst) {
+            ret = FALSE;
+            continue;
+        }
+        if (PIXMAN_FORMAT_RGB(format))
+            pixman_image_set_component_alpha(band->mask, TRUE);
+    }
+
+    if (ret) {
+        if (n > 1)
+            fbParallelRun(fbCompositeBand, &c, n);
+        else
+            fbCompositeBand(&c, 0);
+    }
+    fbPictFreeBands(pSrc, NULL, pDst, c.bands, n);
+    return ret;
+}
+
+static FbGlyphAtlasPtr
+fbGlyphAtlasFor(ScreenPtr pScreen, pixman_format_code_t format)
+{
+    FbGlyphAtlasScreenPtr priv = fbGlyphAtlasScreen(pScreen);
+
+    if (!priv)
+        return NULL;
+    if (format == PIXMAN_a8) {
+        if (!priv->a8)
+            priv->a8 = fbGlyphAtlasCreate(format, FB_GLYPH_ATLAS_SIZE,
+                                          FB_GLYPH_ATLAS_SIZE);
+        return priv->a8;
+    }
+    if (!priv->argb)
+        priv->argb = fbGlyphAtlasCreate(format, FB_GLYPH_ATLAS_SIZE / 2,
+                                        FB_GLYPH_ATLAS_SIZE / 2);
+    return priv->argb;
+}
+
+/* the atlas a glyph goes into, 0 for none */
+static pixman_format_code_t
+fbGlyphAtlasFormat(GlyphPtr glyph, PicturePtr pPicture)
+{
+    if (glyph->info.width > FB_GLYPH_MAX_SIZE ||
+        glyph->info.height > FB_GLYPH_MAX_SIZE)
+        return 0;
+
+    switch (pPicture->format) {
+    case PICT_a1:
+    case PICT_a8:
+        return PIXMAN_a8;
+    case PICT_a8r8g8b8:
+        /* the mask gets component alpha, as with pixman_composite_glyphs() */
+        return pPicture->componentAlpha ? PIXMAN_a8r8g8b8 : 0;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Add the glyphs up into one mask from the atlas and composite that once.
+ * Without a mask format, that gives the same as compositing them one by
+ * one as long as they don't overlap and the operator leaves the
+ * destination alone where the mask is empty.
+ */
+static Bool
+fbGlyphsAtlas(CARD8 op,
+              PicturePtr pSrc,
+              PicturePtr pDst,
+              PictFormatPtr maskFormat,
+              INT16 xSrc,
+              INT16 ySrc, int nlist, GlyphListPtr list, GlyphPtr *glyphs)
+{
+    ScreenPtr pScreen = pDst->pDrawable->pScreen;
+    pixman_box32_t extents = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+    pixman_format_code_t format = 0;
+    int xDst = list->xOff, yDst = list->yOff;
+    FbGlyphAtlasPtr atlas;
+    GlyphPtr *g;
+    GlyphListPtr l;
+    uint8_t *bits;
+    int stride, x, y;
+    int64_t area = 0;
+    Bool overlap = FALSE, ret = FALSE;
+
+    if (!maskFormat && op != PictOpOver && op != PictOpAdd)
+        return FALSE;
+
+    /* all glyphs have to go into the same atlas */
+    x = y = 0;
+    for (l = list, g = glyphs; l < list + nlist; l++) {
+        x += l->xOff;
+        y += l->yOff;
+        for (int i = 0; i < l->len; i++) {
+            GlyphPtr glyph = *g++;
+            PicturePtr pPicture;
+
+            if (glyph->info.width && glyph->info.height &&
+                (pPicture = GetGlyphPicture(glyph, pScreen))) {
+                pixman_format_code_t f = fbGlyphAtlasFormat(glyph, pPicture);
+
+                if (!f || (format && f != format))
+                    return FALSE;
+                format = f;
+                area += glyph->info.width * glyph->info.height;
+                extents.x1 = min(extents.x1, x - glyph->info.x);
+                extents.y1 = min(extents.y1, y - glyph->info.y);
+                extents.x2 = max(extents.x2,
+                                 x - glyph->info.x + glyph->info.width);
+                extents.y2 = max(extents.y2,
+                                 y - glyph->info.y + glyph->info.height);
+            }
+            x += glyph->info.xOff;
+            y += glyph->info.yOff;
+        }
+    }
+    if (!format || (maskFormat && maskFormat->format != format))
+        return FALSE;
+    /* a few glyphs far apart are cheaper for pixman than a mask */
+    if ((int64_t) (extents.x2 - extents.x1) * (extents.y2 - extents.y1) >
+        min(FB_GLYPH_MASK_MAX, area * FB_GLYPH_MASK_SPARSE))
+        return FALSE;
+    if (!(atlas = fbGlyphAtlasFor(pScreen, format)))
+        return FALSE;
+
+    stride = ((extents.x2 - extents.x1) * atlas->cpp + 3) & ~3;
+    if (!(bits = calloc(extents.y2 - extents.y1, stride)))
+        return FALSE;
+
+    atlas->stamp++;
+    x = y = 0;
+    for (l = list, g = glyphs; l < list + nlist; l++) {
+        x += l->xOff;
+        y += l->yOff;
+        for (int i = 0; i < l->len; i++) {
+            GlyphPtr glyph = *g++;
+            FbGlyphAtlasEntryPtr entry;
+            PicturePtr pPicture;
+
+            if (!glyph->info.width || !glyph->info.height ||
+                !(pPicture = GetGlyphPicture(glyph, pScreen)))
+                goto next;
+
+            if (!(entry = fbGlyphAtlasLookup(atlas, glyph))) {
+                pixman_image_t *image;
+                int xoff, yoff;
+
+                if (!(entry = fbGlyphAtlasAlloc(atlas, glyph)))
+                    goto out;
+                if (!(image = image_from_pict(pPicture, FALSE, &xoff, &yoff))) {
+                    fbGlyphAtlasRemove(atlas, glyph);
+                    goto out;
+                }
+                pixman_image_composite32(PIXMAN_OP_SRC, image, NULL,
+                                         atlas->image, xoff, yoff, 0, 0,
+                                         entry->x, entry->y,
+                                         glyph->info.width,
+                                         glyph->info.height);
+                free_pixman_pict(pPicture, image);
+            }
+
+            overlap |= fbGlyphAtlasAdd(atlas, entry, bits, stride,
+                                       x - glyph->info.x - extents.x1,
+                                       y - glyph->info.y - extents.y1);
+            if (overlap && !maskFormat)
+                goto out;
+        next:
+            x += glyph->info.xOff;
+            y += glyph->info.yOff;
+        }
+    }
+
+    ret = fbGlyphsMaskComposite(op, pSrc, pDst, format, bits, stride,
+                                &extents, xSrc - xDst, ySrc - yDst);
+out:
+    free(bits);
+    return ret;
+}
+
+#endif /* FB_ACCESS_WRAPPER */
+
 static void
 fbGlyphs(CARD8 op,
 	 PicturePtr pSrc,
@@ -110,9 +634,17 @@ fbGlyphs(CARD8 op,
     int x, y;
     int i, n;
     int xDst = list->xOff, yDst = list->yOff;
+    /* pixman validates a new glyph's image when it's first used */
+    Bool freshGlyphs = FALSE;
 
     miCompositeSourceValidate(pSrc);
 
+#ifndef FB_ACCESS_WRAPPER
+    if (fbGlyphsAtlas(op, pSrc, pDst, maskFormat, xSrc, ySrc,
+                      nlist, list, glyphs))
+        return;
+#endif
+
     n_glyphs = 0;
     for (i = 0; i < nlist; ++i)
 	n_glyphs += list[i].len;
@@ -161,6 +693,7 @@ fbGlyphs(CARD8 op,
 
 		if (!g)
 		    goto out;
+		freshGlyphs = TRUE;
 	    }
 
 	    pglyphs[i].x = x;
@@ -175,6 +708,14 @@ fbGlyphs(CARD8 op,
 	list++;
     }
 
+#ifndef FB_ACCESS_WRAPPER
+    /* so not on several threads at once, runs with new glyphs stay here */
+    if (!freshGlyphs &&
+        fbGlyphsParallel(op, pSrc, pDst, maskFormat, xSrc - xDst, ySrc - yDst,
+                         n_glyphs, pglyphs))
+        goto out;
+#endif
+
     if (!(srcImage = image_from_pict(pSrc, FALSE, &srcXoff, &srcYoff)))
 	goto out;
 
@@ -491,6 +1032,12 @@ fbPictureInit(ScreenPtr pScreen, PictFormatPtr formats, int nformats)
 
     if (!miPictureInit(pScreen, formats, nformats))
         return FALSE;
+#ifndef FB_ACCESS_WRAPPER
+    if (!dixRegisterPrivateKey(&fbGlyphAtlasScreenKeyRec, PRIVATE_SCREEN,
+                               sizeof(FbGlyphAtlasScreenRec)))
+        return FALSE;
+#endif
+
     ps = GetPictureScreen(pScreen);
     ps->Composite = fbComposite;
     ps->Glyphs = fbGlyphs;
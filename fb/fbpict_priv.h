@@ -8,6 +8,7 @@
 #include <X11/extensions/renderproto.h>
 
 #include "fb/fbpict.h"
+#include "render/glyphstr.h"
 #include "render/picture.h"
 
 void fbRasterizeTrapezoid(PicturePtr alpha, xTrapezoid *trap,
@@ -25,4 +26,97 @@ void fbTriangles(CARD8 op, PicturePtr pSrc, PicturePtr pDst,
                  PictFormatPtr maskFormat, INT16 xSrc, INT16 ySrc,
                  int ntris, xTriangle *tris);
 
+#ifndef FB_ACCESS_WRAPPER
+
+/* one band of a RENDER operation split with fbPictBands() */
+typedef struct {
+    int y1, y2;                         /* rows, in pDst coordinates */
+    pixman_image_t *src, *mask, *dst;   /* dst is clipped to the rows */
+    int src_xoff, src_yoff;
+    int msk_xoff, msk_yoff;
+    int dst_xoff, dst_yoff;
+} FbPictBandRec, *FbPictBandPtr;
+
+/*
+ * @brief split an operation on pDst for fbParallelRun()
+ *
+ * Splits the part of the composite clip of pDst inside extents, given in
+ * pDst coordinates, into bands of rows. Every band gets pixman images of
+ * its own for the pictures, pMask may be NULL. Returns the number of
+ * bands, or 0 when the operation should be done in one piece.
+ */
+int fbPictBands(PicturePtr pSrc, PicturePtr pMask, PicturePtr pDst,
+                const pixman_box32_t *extents, FbPictBandPtr bands);
+
+void fbPictFreeBands(PicturePtr pSrc, PicturePtr pMask, PicturePtr pDst,
+                     FbPictBandPtr bands, int nbands);
+
+/* glyphs larger than this in either direction don't go into the atlas */
+#define FB_GLYPH_MAX_SIZE       128
+#define FB_GLYPH_ATLAS_BUCKETS  4096
+
+typedef struct _FbGlyphAtlasEntry {
+    GlyphPtr glyph;
+    struct _FbGlyphAtlasEntry *next;        /* in the hash bucket */
+    struct _FbGlyphAtlasEntry *shelf_next;  /* on the same shelf */
+    int x, y;                               /* in the atlas */
+    int shelf;
+} FbGlyphAtlasEntryRec, *FbGlyphAtlasEntryPtr;
+
+typedef struct {
+    int y, height;
+    int used;                   /* width taken from the left */
+    unsigned int stamp;         /* last glyph run using it */
+    FbGlyphAtlasEntryPtr entries;
+} FbGlyphShelfRec, *FbGlyphShelfPtr;
+
+typedef struct {
+    pixman_format_code_t format;        /* PIXMAN_a8 or PIXMAN_a8r8g8b8 */
+    pixman_image_t *image;              /* of bits, for filling it */
+    uint8_t *bits;
+    int width, height, stride, cpp;
+    FbGlyphShelfPtr shelves;
+    int nshelves;
+    int top;                            /* rows given to shelves */
+    unsigned int stamp;                 /* current glyph run */
+    FbGlyphAtlasEntryPtr hash[FB_GLYPH_ATLAS_BUCKETS];
+    unsigned long hits, misses, evictions;
+} FbGlyphAtlasRec, *FbGlyphAtlasPtr;
+
+FbGlyphAtlasPtr fbGlyphAtlasCreate(pixman_format_code_t format,
+                                   int width, int height);
+
+void fbGlyphAtlasDestroy(FbGlyphAtlasPtr atlas);
+
+/*
+ * @brief find a glyph, counting hits and misses
+ *
+ * Marks its shelf as used by the current glyph run, bump atlas->stamp
+ * at the start of each run.
+ */
+FbGlyphAtlasEntryPtr fbGlyphAtlasLookup(FbGlyphAtlasPtr atlas, GlyphPtr glyph);
+
+/*
+ * @brief make room for a glyph, the caller copies its image in
+ *
+ * May evict other glyphs, including ones looked up in the current run.
+ * Returns NULL for glyphs larger than FB_GLYPH_MAX_SIZE.
+ */
+FbGlyphAtlasEntryPtr fbGlyphAtlasAlloc(FbGlyphAtlasPtr atlas, GlyphPtr glyph);
+
+void fbGlyphAtlasRemove(FbGlyphAtlasPtr atlas, GlyphPtr glyph);
+
+/*
+ * @brief add a glyph into a mask of the atlas format at x, y, saturating
+ *
+ * Returns TRUE when it covered pixels the mask had coverage for already.
+ */
+Bool fbGlyphAtlasAdd(FbGlyphAtlasPtr atlas, FbGlyphAtlasEntryPtr entry,
+                     uint8_t *mask, int stride, int x, int y);
+
+/* log the hit rate and free the atlases of a screen */
+void fbGlyphAtlasFini(ScreenPtr pScreen);
+
+#endif /* FB_ACCESS_WRAPPER */
+
 #endif /* XORG_FBPICT_PRIV_H */
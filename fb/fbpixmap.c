@@ -34,7 +34,7 @@ PixmapPtr
 fbCreatePixmap(ScreenPtr pScreen, int width, int height, int depth,
                unsigned usage_hint)
 {
-    PixmapPtr pPixmap;
+    PixmapPtr pPixmap = NullPixmap;
     size_t datasize;
     size_t paddedWidth;
     int adjust;
@@ -46,16 +46,26 @@ fbCreatePixmap(ScreenPtr pScreen, int width, int height, int depth,
         return NullPixmap;
     datasize = height * paddedWidth;
     base = pScreen->totalPixmapSize;
-    adjust = 0;
-    if (base & 7)
-        adjust = 8 - (base & 7);
-    datasize += adjust;
+#if !defined(FB_ACCESS_WRAPPER) && !defined(FB_DEBUG)
+    /* small ones come from the screen's slabs, with the bits on a cache
+     * line; headers for ModifyPixmapHeader() may be freed with FreePixmap() */
+    if (width > 0 && height > 0) {
+        adjust = -base & 63;
+        pPixmap = fbSlabAllocPixmap(pScreen, adjust + datasize);
+    }
+#endif
+    if (!pPixmap) {
+        adjust = 0;
+        if (base & 7)
+            adjust = 8 - (base & 7);
+        datasize += adjust;
 #ifdef FB_DEBUG
-    datasize += 2 * paddedWidth;
+        datasize += 2 * paddedWidth;
 #endif
-    pPixmap = AllocatePixmap(pScreen, datasize);
-    if (!pPixmap)
-        return NullPixmap;
+        pPixmap = AllocatePixmap(pScreen, datasize);
+        if (!pPixmap)
+            return NullPixmap;
+    }
     pPixmap->drawable.type = DRAWABLE_PIXMAP;
     pPixmap->drawable.pScreen = pScreen;
     pPixmap->drawable.depth = depth;
@@ -84,6 +94,10 @@ fbDestroyPixmap(PixmapPtr pPixmap)
 {
     if (--pPixmap->refcnt)
         return TRUE;
+#ifndef FB_ACCESS_WRAPPER
+    if (fbSlabFreePixmap(pPixmap))
+        return TRUE;
+#endif
     FreePixmap(pPixmap);
     return TRUE;
 }
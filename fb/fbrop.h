@@ -71,6 +71,19 @@ extern _X_EXPORT const FbMergeRopRec FbMergeRopBits[16];
 #define FbDoMaskRRop(dst, and, xor, mask) \
     (((dst) & ((and) | ~(mask))) ^ (xor & mask))
 
+/*
+ * Raster op classes with their own inner loops: GXcopy and GXxor with
+ * all planes written are plain stores and dst ^= src, anything else
+ * takes the merge rop or reduced rop math above.
+ */
+#define FB_ROP_COPY     0
+#define FB_ROP_XOR      1
+#define FB_ROP_GENERIC  2
+
+#define fbRopClass(alu,pm)  ((pm) != FB_ALLONES ? FB_ROP_GENERIC : \
+			     (alu) == GXcopy ? FB_ROP_COPY : \
+			     (alu) == GXxor ? FB_ROP_XOR : FB_ROP_GENERIC)
+
 /*
  * Take a single bit (0 or 1) and generate a full mask
  */
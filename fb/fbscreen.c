@@ -23,6 +23,7 @@
 #include <dix-config.h>
 
 #include "fb/fb_priv.h"
+#include "fb/fbpict_priv.h"
 #include "os/osdep.h"
 
 #undef CreateWindow
@@ -34,12 +35,18 @@ fbCloseScreen(ScreenPtr pScreen)
     DepthPtr depths = pScreen->allowedDepths;
 
     fbDestroyGlyphCache();
+#ifndef FB_ACCESS_WRAPPER
+    fbGlyphAtlasFini(pScreen);
+#endif
     for (d = 0; d < pScreen->numDepths; d++)
         free(depths[d].vids);
     free(depths);
     free(pScreen->visuals);
     if (pScreen->devPrivate)
         FreePixmap((PixmapPtr)pScreen->devPrivate);
+#ifndef FB_ACCESS_WRAPPER
+    fbSlabScreenFini(pScreen);
+#endif
     return TRUE;
 }
 
@@ -100,6 +107,10 @@ fbSetupScreen(ScreenPtr pScreen, void *pbits, /* pointer to screen bitmap */
 {                               /* bits per pixel for screen */
     if (!fbAllocatePrivates(pScreen))
         return FALSE;
+#ifndef FB_ACCESS_WRAPPER
+    if (!fbSlabScreenInit(pScreen))
+        return FALSE;
+#endif
     pScreen->defColormap = dixAllocServerXID();
     if (bpp > 1) {
 	/* let CreateDefColormap do whatever it wants for pixels */
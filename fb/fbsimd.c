@@ -0,0 +1,318 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Vectorized inner loops for the common fb cases
+ *
+ * Without a GPU (Xvfb, VNC, fbdev) nearly all rendering ends up in the
+ * word loops of fbSolid(), fbEvenTile() and fbBlt(). For GXcopy with all
+ * planes, and for solid fills, the middle of every scanline is a plain
+ * run of FbBits that can be done 16 or 32 bytes at a time. The edges
+ * keep going through the byte mask macros.
+ *
+ * The variant is picked at the first call from what the CPU supports:
+ * AVX2 or SSE2 on x86, NEON on ARM, plain C otherwise.
+ */
+#include <dix-config.h>
+
+#include <string.h>
+
+#include "fb/fb_priv.h"
+
+#ifndef FB_ACCESS_WRAPPER       /* the wrapped accessors need every word */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FB_SIMD_X86
+#include <immintrin.h>
+#define FB_TARGET(t) __attribute__((target(t)))
+#elif defined(__ARM_NEON)
+#define FB_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+typedef void (*fbSimdSolidProcPtr) (FbBits *dst, int n, FbBits and, FbBits xor);
+typedef void (*fbSimdCopyProcPtr) (CARD8 *dst, const CARD8 *src, size_t n);
+
+static void fbSimdSolidSelect(FbBits *dst, int n, FbBits and, FbBits xor);
+static void fbSimdCopySelect(CARD8 *dst, const CARD8 *src, size_t n);
+
+static fbSimdSolidProcPtr fbSimdSolidProc = fbSimdSolidSelect;
+static fbSimdCopyProcPtr fbSimdCopyProc = fbSimdCopySelect;
+
+static void
+fbSimdSolidC(FbBits *dst, int n, FbBits and, FbBits xor)
+{
+    if (!and)
+        while (n--)
+            *dst++ = xor;
+    else
+        while (n--) {
+            *dst = FbDoRRop(*dst, and, xor);
+            dst++;
+        }
+}
+
+static void
+fbSimdCopyC(CARD8 *dst, const CARD8 *src, size_t n)
+{
+    memmove(dst, src, n);
+}
+
+#ifdef FB_SIMD_X86
+
+FB_TARGET("sse2") static void
+fbSimdSolidSSE2(FbBits *dst, int n, FbBits and, FbBits xor)
+{
+    __m128i x = _mm_set1_epi32(xor);
+
+    /* the scanlines are FbBits aligned, so this ends 16 byte aligned */
+    for (; n && ((uintptr_t) dst & 15); n--, dst++)
+        *dst = FbDoRRop(*dst, and, xor);
+
+    if (!and) {
+        for (; n >= 16; n -= 16, dst += 16) {
+            _mm_store_si128((__m128i *) dst, x);
+            _mm_store_si128((__m128i *) (dst + 4), x);
+            _mm_store_si128((__m128i *) (dst + 8), x);
+            _mm_store_si128((__m128i *) (dst + 12), x);
+        }
+        for (; n >= 4; n -= 4, dst += 4)
+            _mm_store_si128((__m128i *) dst, x);
+    }
+    else {
+        __m128i a = _mm_set1_epi32(and);
+
+        for (; n >= 4; n -= 4, dst += 4) {
+            __m128i d = _mm_load_si128((__m128i *) dst);
+
+            _mm_store_si128((__m128i *) dst,
+                            _mm_xor_si128(_mm_and_si128(d, a), x));
+        }
+    }
+    fbSimdSolidC(dst, n, and, xor);
+}
+
+FB_TARGET("avx2") static void
+fbSimdSolidAVX2(FbBits *dst, int n, FbBits and, FbBits xor)
+{
+    __m256i x = _mm256_set1_epi32(xor);
+
+    for (; n && ((uintptr_t) dst & 31); n--, dst++)
+        *dst = FbDoRRop(*dst, and, xor);
+
+    if (!and) {
+        for (; n >= 32; n -= 32, dst += 32) {
+            _mm256_store_si256((__m256i *) dst, x);
+            _mm256_store_si256((__m256i *) (dst + 8), x);
+            _mm256_store_si256((__m256i *) (dst + 16), x);
+            _mm256_store_si256((__m256i *) (dst + 24), x);
+        }
+        for (; n >= 8; n -= 8, dst += 8)
+            _mm256_store_si256((__m256i *) dst, x);
+    }
+    else {
+        __m256i a = _mm256_set1_epi32(and);
+
+        for (; n >= 8; n -= 8, dst += 8) {
+            __m256i d = _mm256_load_si256((__m256i *) dst);
+
+            _mm256_store_si256((__m256i *) dst,
+                               _mm256_xor_si256(_mm256_and_si256(d, a), x));
+        }
+    }
+    fbSimdSolidC(dst, n, and, xor);
+}
+
+/*
+ * The copies may overlap, as for scrolling within a window. Going
+ * forwards when dst is below src and backwards otherwise, a vector
+ * store only ever hits bytes that already were loaded.
+ */
+FB_TARGET("sse2") static void
+fbSimdCopySSE2(CARD8 *dst, const CARD8 *src, size_t n)
+{
+    if (dst <= src || dst >= src + n) {
+        for (; n >= 64; n -= 64, src += 64, dst += 64) {
+            __m128i s0 = _mm_loadu_si128((const __m128i *) src);
+            __m128i s1 = _mm_loadu_si128((const __m128i *) (src + 16));
+            __m128i s2 = _mm_loadu_si128((const __m128i *) (src + 32));
+            __m128i s3 = _mm_loadu_si128((const __m128i *) (src + 48));
+
+            _mm_storeu_si128((__m128i *) dst, s0);
+            _mm_storeu_si128((__m128i *) (dst + 16), s1);
+            _mm_storeu_si128((__m128i *) (dst + 32), s2);
+            _mm_storeu_si128((__m128i *) (dst + 48), s3);
+        }
+        for (; n >= 16; n -= 16, src += 16, dst += 16)
+            _mm_storeu_si128((__m128i *) dst,
+                             _mm_loadu_si128((const __m128i *) src));
+    }
+    else {
+        for (; n >= 64; n -= 64) {
+            __m128i s0 = _mm_loadu_si128((const __m128i *) (src + n - 16));
+            __m128i s1 = _mm_loadu_si128((const __m128i *) (src + n - 32));
+            __m128i s2 = _mm_loadu_si128((const __m128i *) (src + n - 48));
+            __m128i s3 = _mm_loadu_si128((const __m128i *) (src + n - 64));
+
+            _mm_storeu_si128((__m128i *) (dst + n - 16), s0);
+            _mm_storeu_si128((__m128i *) (dst + n - 32), s1);
+            _mm_storeu_si128((__m128i *) (dst + n - 48), s2);
+            _mm_storeu_si128((__m128i *) (dst + n - 64), s3);
+        }
+        for (; n >= 16; n -= 16)
+            _mm_storeu_si128((__m128i *) (dst + n - 16),
+                             _mm_loadu_si128((const __m128i *) (src + n - 16)));
+    }
+    memmove(dst, src, n);
+}
+
+FB_TARGET("avx2") static void
+fbSimdCopyAVX2(CARD8 *dst, const CARD8 *src, size_t n)
+{
+    if (dst <= src || dst >= src + n) {
+        for (; n >= 128; n -= 128, src += 128, dst += 128) {
+            __m256i s0 = _mm256_loadu_si256((const __m256i *) src);
+            __m256i s1 = _mm256_loadu_si256((const __m256i *) (src + 32));
+            __m256i s2 = _mm256_loadu_si256((const __m256i *) (src + 64));
+            __m256i s3 = _mm256_loadu_si256((const __m256i *) (src + 96));
+
+            _mm256_storeu_si256((__m256i *) dst, s0);
+            _mm256_storeu_si256((__m256i *) (dst + 32), s1);
+            _mm256_storeu_si256((__m256i *) (dst + 64), s2);
+            _mm256_storeu_si256((__m256i *) (dst + 96), s3);
+        }
+        for (; n >= 32; n -= 32, src += 32, dst += 32)
+            _mm256_storeu_si256((__m256i *) dst,
+                                _mm256_loadu_si256((const __m256i *) src));
+    }
+    else {
+        for (; n >= 128; n -= 128) {
+            __m256i s0 = _mm256_loadu_si256((const __m256i *) (src + n - 32));
+            __m256i s1 = _mm256_loadu_si256((const __m256i *) (src + n - 64));
+            __m256i s2 = _mm256_loadu_si256((const __m256i *) (src + n - 96));
+            __m256i s3 = _mm256_loadu_si256((const __m256i *) (src + n - 128));
+
+            _mm256_storeu_si256((__m256i *) (dst + n - 32), s0);
+            _mm256_storeu_si256((__m256i *) (dst + n - 64), s1);
+            _mm256_storeu_si256((__m256i *) (dst + n - 96), s2);
+            _mm256_storeu_si256((__m256i *) (dst + n - 128), s3);
+        }
+        for (; n >= 32; n -= 32)
+            _mm256_storeu_si256((__m256i *) (dst + n - 32),
+                                _mm256_loadu_si256((const __m256i *) (src + n - 32)));
+    }
+    memmove(dst, src, n);
+}
+
+#endif /* FB_SIMD_X86 */
+
+#ifdef FB_SIMD_NEON
+
+static void
+fbSimdSolidNEON(FbBits *dst, int n, FbBits and, FbBits xor)
+{
+    uint32x4_t x = vdupq_n_u32(xor);
+
+    if (!and) {
+        for (; n >= 16; n -= 16, dst += 16) {
+            vst1q_u32(dst, x);
+            vst1q_u32(dst + 4, x);
+            vst1q_u32(dst + 8, x);
+            vst1q_u32(dst + 12, x);
+        }
+        for (; n >= 4; n -= 4, dst += 4)
+            vst1q_u32(dst, x);
+    }
+    else {
+        uint32x4_t a = vdupq_n_u32(and);
+
+        for (; n >= 4; n -= 4, dst += 4)
+            vst1q_u32(dst, veorq_u32(vandq_u32(vld1q_u32(dst), a), x));
+    }
+    fbSimdSolidC(dst, n, and, xor);
+}
+
+static void
+fbSimdCopyNEON(CARD8 *dst, const CARD8 *src, size_t n)
+{
+    if (dst <= src || dst >= src + n) {
+        for (; n >= 64; n -= 64, src += 64, dst += 64) {
+            uint8x16_t s0 = vld1q_u8(src);
+            uint8x16_t s1 = vld1q_u8(src + 16);
+            uint8x16_t s2 = vld1q_u8(src + 32);
+            uint8x16_t s3 = vld1q_u8(src + 48);
+
+            vst1q_u8(dst, s0);
+            vst1q_u8(dst + 16, s1);
+            vst1q_u8(dst + 32, s2);
+            vst1q_u8(dst + 48, s3);
+        }
+        for (; n >= 16; n -= 16, src += 16, dst += 16)
+            vst1q_u8(dst, vld1q_u8(src));
+    }
+    else {
+        for (; n >= 64; n -= 64) {
+            uint8x16_t s0 = vld1q_u8(src + n - 16);
+            uint8x16_t s1 = vld1q_u8(src + n - 32);
+            uint8x16_t s2 = vld1q_u8(src + n - 48);
+            uint8x16_t s3 = vld1q_u8(src + n - 64);
+
+            vst1q_u8(dst + n - 16, s0);
+            vst1q_u8(dst + n - 32, s1);
+            vst1q_u8(dst + n - 48, s2);
+            vst1q_u8(dst + n - 64, s3);
+        }
+        for (; n >= 16; n -= 16)
+            vst1q_u8(dst + n - 16, vld1q_u8(src + n - 16));
+    }
+    memmove(dst, src, n);
+}
+
+#endif /* FB_SIMD_NEON */
+
+static void
+fbSimdSelect(void)
+{
+    fbSimdSolidProc = fbSimdSolidC;
+    fbSimdCopyProc = fbSimdCopyC;
+#if defined(FB_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fbSimdSolidProc = fbSimdSolidAVX2;
+        fbSimdCopyProc = fbSimdCopyAVX2;
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        fbSimdSolidProc = fbSimdSolidSSE2;
+        fbSimdCopyProc = fbSimdCopySSE2;
+    }
+#elif defined(FB_SIMD_NEON)
+    fbSimdSolidProc = fbSimdSolidNEON;
+    fbSimdCopyProc = fbSimdCopyNEON;
+#endif
+}
+
+static void
+fbSimdSolidSelect(FbBits *dst, int n, FbBits and, FbBits xor)
+{
+    fbSimdSelect();
+    fbSimdSolidProc(dst, n, and, xor);
+}
+
+static void
+fbSimdCopySelect(CARD8 *dst, const CARD8 *src, size_t n)
+{
+    fbSimdSelect();
+    fbSimdCopyProc(dst, src, n);
+}
+
+void
+fbSimdSolid(FbBits *dst, int n, FbBits and, FbBits xor)
+{
+    fbSimdSolidProc(dst, n, and, xor);
+}
+
+void
+fbSimdCopy(CARD8 *dst, const CARD8 *src, size_t n)
+{
+    fbSimdCopyProc(dst, src, n);
+}
+
+#endif /* FB_ACCESS_WRAPPER */
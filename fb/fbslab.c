@@ -0,0 +1,364 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Slab allocator for small pixmaps
+ *
+ * Toolkits and RENDER clients create and destroy tens of thousands of tiny
+ * pixmaps a second, for glyphs, icons and temporary masks. Each of them
+ * used to be a calloc() of the pixmap header, its privates and the bits
+ * together, and a free() soon after.
+ *
+ * Small pixmaps now come from 128 KiB slabs, one set per screen, each slab
+ * holding objects of one size class. Objects start on a cache line, and
+ * the bits inside them do too. A slab that runs empty is kept while it's
+ * the only empty one of its class, so a burst of creates and destroys
+ * doesn't allocate and free whole slabs each time; more are given back
+ * right away.
+ *
+ * Every slab is a resource of the server client, so X-Resource clients
+ * like xrestop see how many there are and the memory they take.
+ */
+#include <dix-config.h>
+
+#ifndef FB_ACCESS_WRAPPER       /* wfb drivers get their pixmaps the plain way */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dix/dix_priv.h"
+#include "fb/fb_priv.h"
+#include "os/log_priv.h"
+
+#include "list.h"
+#include "resource.h"
+
+#define FB_SLAB_SIZE            (128 * 1024)
+/* the slab header, objects start after it */
+#define FB_SLAB_HEADER          64
+/* the largest class holds a 64x64 ARGB pixmap with a big set of privates */
+static const unsigned fbSlabClassSizes[FB_SLAB_CLASSES] = {
+    256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096,
+    6144, 8192, 12288, 16384, 20480, 24576,
+};
+
+typedef struct _FbSlabClass FbSlabClassRec, *FbSlabClassPtr;
+
+typedef struct _FbSlab {
+    struct xorg_list link;      /* in the class's partial, full or empty list */
+    FbSlabClassPtr cls;
+    void *free;                 /* objects freed since, linked through them */
+    char *fresh;                /* never handed out, up to the end */
+    unsigned used;
+    XID id;                     /* the resource, 0 after the reset freed it */
+} FbSlabRec, *FbSlabPtr;
+
+struct _FbSlabClass {
+    FbSlabPoolPtr pool;
+    unsigned size;
+    unsigned perSlab;
+    struct xorg_list partial;   /* slabs with free objects and used ones */
+    struct xorg_list full;
+    struct xorg_list empty;
+    unsigned nempty;
+};
+
+struct _FbSlabPool {
+    FbSlabClassRec classes[FB_SLAB_CLASSES];
+    unsigned long live;         /* objects handed out and not freed yet */
+    Bool closed;                /* the screen is gone, free with the last one */
+    FbSlabStatsRec stats;
+};
+
+static DevPrivateKeyRec fbSlabScreenKeyRec;
+/* set on pixmaps that live in a slab */
+static DevPrivateKeyRec fbSlabPixmapKeyRec;
+
+static RESTYPE fbSlabResType;
+static unsigned long fbSlabGeneration;
+
+static int
+fbSlabDeleteResource(void *value, XID id)
+{
+    /* only a handle for X-Resource, the slab itself lives on */
+    ((FbSlabPtr) value)->id = 0;
+    return Success;
+}
+
+static void
+fbSlabResourceSize(void *value, XID id, ResourceSizePtr size)
+{
+    size->resourceSize = FB_SLAB_SIZE;
+    size->pixmapRefSize = 0;
+    size->refCnt = 1;
+}
+
+static FbSlabClassPtr
+fbSlabClass(FbSlabPoolPtr pool, size_t size)
+{
+    for (int i = 0; i < FB_SLAB_CLASSES; i++)
+        if (size <= pool->classes[i].size)
+            return &pool->classes[i];
+    return NULL;
+}
+
+/* a new slab, aligned to its size so objects find it */
+static FbSlabPtr
+fbSlabNew(void)
+{
+#ifdef WIN32
+    /* no posix_memalign(), pixmaps are allocated the plain way */
+    return NULL;
+#else
+    void *slab;
+
+    if (posix_memalign(&slab, FB_SLAB_SIZE, FB_SLAB_SIZE))
+        return NULL;
+    return slab;
+#endif
+}
+
+static FbSlabPtr
+fbSlabOf(void *object)
+{
+    return (FbSlabPtr) ((uintptr_t) object & ~(uintptr_t) (FB_SLAB_SIZE - 1));
+}
+
+FbSlabPoolPtr
+fbSlabPoolCreate(void)
+{
+    FbSlabPoolPtr pool;
+
+    _Static_assert(sizeof(FbSlabRec) <= FB_SLAB_HEADER,
+                   "slab header doesn't fit");
+
+    if (!(pool = calloc(1, sizeof(struct _FbSlabPool))))
+        return NULL;
+    for (int i = 0; i < FB_SLAB_CLASSES; i++) {
+        FbSlabClassPtr cls = &pool->classes[i];
+
+        cls->pool = pool;
+        cls->size = fbSlabClassSizes[i];
+        cls->perSlab = (FB_SLAB_SIZE - FB_SLAB_HEADER) / cls->size;
+        xorg_list_init(&cls->partial);
+        xorg_list_init(&cls->full);
+        xorg_list_init(&cls->empty);
+    }
+    return pool;
+}
+
+static void
+fbSlabRelease(FbSlabPtr slab)
+{
+    FbSlabPoolPtr pool = slab->cls->pool;
+
+    xorg_list_del(&slab->link);
+    if (slab->id)
+        FreeResource(slab->id, X11_RESTYPE_NONE);
+    free(slab);
+    pool->stats.slabs--;
+    pool->stats.slabsFreed++;
+}
+
+static void
+fbSlabPoolFree(FbSlabPoolPtr pool)
+{
+    LogMessageVerb(X_INFO, 3,
+                   "fb: pixmap slabs: %lu pixmaps from slabs, %lu too "
+                   "large, %lu slabs allocated, at most %lu at once\n",
+                   pool->stats.allocs, pool->stats.tooLarge,
+                   pool->stats.slabsAllocated, pool->stats.peakSlabs);
+    free(pool);
+}
+
+void
+fbSlabTrim(FbSlabPoolPtr pool)
+{
+    for (int i = 0; i < FB_SLAB_CLASSES; i++) {
+        FbSlabClassPtr cls = &pool->classes[i];
+        FbSlabPtr slab, tmp;
+
+        xorg_list_for_each_entry_safe(slab, tmp, &cls->empty, link)
+            fbSlabRelease(slab);
+        cls->nempty = 0;
+    }
+}
+
+void
+fbSlabPoolDestroy(FbSlabPoolPtr pool)
+{
+    if (!pool)
+        return;
+    fbSlabTrim(pool);
+    /* pixmaps still around keep their slabs, and the pool for them */
+    pool->closed = TRUE;
+    if (!pool->live)
+        fbSlabPoolFree(pool);
+}
+
+void *
+fbSlabAlloc(FbSlabPoolPtr pool, size_t size)
+{
+    FbSlabClassPtr cls = fbSlabClass(pool, size);
+    FbSlabPtr slab;
+    void *object;
+
+    if (!cls) {
+        pool->stats.tooLarge++;
+        return NULL;
+    }
+
+    if (!xorg_list_is_empty(&cls->partial))
+        slab = xorg_list_first_entry(&cls->partial, FbSlabRec, link);
+    else if (!xorg_list_is_empty(&cls->empty)) {
+        slab = xorg_list_first_entry(&cls->empty, FbSlabRec, link);
+        xorg_list_del(&slab->link);
+        xorg_list_add(&slab->link, &cls->partial);
+        cls->nempty--;
+    }
+    else {
+        if (!(slab = fbSlabNew()))
+            return NULL;
+        slab->cls = cls;
+        slab->free = NULL;
+        slab->fresh = (char *) slab + FB_SLAB_HEADER;
+        slab->used = 0;
+        slab->id = 0;
+        if (fbSlabResType) {
+            slab->id = FakeClientID(0);
+            if (!AddResource(slab->id, fbSlabResType, slab))
+                slab->id = 0;
+        }
+        xorg_list_add(&slab->link, &cls->partial);
+        pool->stats.slabsAllocated++;
+        if (++pool->stats.slabs > pool->stats.peakSlabs)
+            pool->stats.peakSlabs = pool->stats.slabs;
+    }
+
+    if (slab->free) {
+        object = slab->free;
+        slab->free = *(void **) object;
+    }
+    else {
+        object = slab->fresh;
+        slab->fresh += cls->size;
+    }
+    if (++slab->used == cls->perSlab) {
+        xorg_list_del(&slab->link);
+        xorg_list_add(&slab->link, &cls->full);
+    }
+
+    pool->live++;
+    pool->stats.allocs++;
+    memset(object, 0, size);
+    return object;
+}
+
+void
+fbSlabFree(void *object)
+{
+    FbSlabPtr slab = fbSlabOf(object);
+    FbSlabClassPtr cls = slab->cls;
+    FbSlabPoolPtr pool = cls->pool;
+
+    *(void **) object = slab->free;
+    slab->free = object;
+
+    if (slab->used-- == cls->perSlab) {
+        xorg_list_del(&slab->link);
+        xorg_list_add(&slab->link, &cls->partial);
+    }
+    if (!slab->used) {
+        /* keep one around for the next burst, give back the rest */
+        if (cls->nempty || pool->closed)
+            fbSlabRelease(slab);
+        else {
+            xorg_list_del(&slab->link);
+            xorg_list_add(&slab->link, &cls->empty);
+            cls->nempty++;
+        }
+    }
+
+    if (!--pool->live && pool->closed)
+        fbSlabPoolFree(pool);
+}
+
+void
+fbSlabGetStats(FbSlabPoolPtr pool, FbSlabStatsPtr stats)
+{
+    *stats = pool->stats;
+}
+
+/***====================================================================***/
+
+static FbSlabPoolPtr
+fbSlabScreenPool(ScreenPtr pScreen)
+{
+    if (!dixPrivateKeyRegistered(&fbSlabScreenKeyRec))
+        return NULL;
+    return dixLookupPrivate(&pScreen->devPrivates, &fbSlabScreenKeyRec);
+}
+
+Bool
+fbSlabScreenInit(ScreenPtr pScreen)
+{
+    FbSlabPoolPtr pool;
+
+    if (fbSlabGeneration != serverGeneration) {
+        fbSlabResType = CreateNewResourceType(fbSlabDeleteResource,
+                                              "PIXMAP_SLAB");
+        if (!fbSlabResType)
+            return FALSE;
+        SetResourceTypeSizeFunc(fbSlabResType, fbSlabResourceSize);
+        fbSlabGeneration = serverGeneration;
+    }
+    if (!dixRegisterPrivateKey(&fbSlabScreenKeyRec, PRIVATE_SCREEN, 0) ||
+        !dixRegisterPrivateKey(&fbSlabPixmapKeyRec, PRIVATE_PIXMAP, 0))
+        return FALSE;
+
+    /* without one, pixmaps are allocated the plain way */
+    pool = fbSlabPoolCreate();
+    dixSetPrivate(&pScreen->devPrivates, &fbSlabScreenKeyRec, pool);
+    return TRUE;
+}
+
+void
+fbSlabScreenFini(ScreenPtr pScreen)
+{
+    FbSlabPoolPtr pool = fbSlabScreenPool(pScreen);
+
+    if (!pool)
+        return;
+    fbSlabPoolDestroy(pool);
+    dixSetPrivate(&pScreen->devPrivates, &fbSlabScreenKeyRec, NULL);
+}
+
+PixmapPtr
+fbSlabAllocPixmap(ScreenPtr pScreen, size_t pixDataSize)
+{
+    FbSlabPoolPtr pool = fbSlabScreenPool(pScreen);
+    PixmapPtr pPixmap;
+
+    if (!pool)
+        return NullPixmap;
+    pPixmap = fbSlabAlloc(pool, pScreen->totalPixmapSize + pixDataSize);
+    if (!pPixmap)
+        return NullPixmap;
+
+    dixInitScreenPrivates(pScreen, pPixmap, pPixmap + 1, PRIVATE_PIXMAP);
+    dixSetPrivate(&pPixmap->devPrivates, &fbSlabPixmapKeyRec, pool);
+    return pPixmap;
+}
+
+Bool
+fbSlabFreePixmap(PixmapPtr pPixmap)
+{
+    if (!dixPrivateKeyRegistered(&fbSlabPixmapKeyRec) ||
+        !dixLookupPrivate(&pPixmap->devPrivates, &fbSlabPixmapKeyRec))
+        return FALSE;
+
+    dixFiniPrivates(pPixmap, PRIVATE_PIXMAP);
+    fbSlabFree(pPixmap);
+    return TRUE;
+}
+
+#endif /* FB_ACCESS_WRAPPER */
@@ -24,7 +24,7 @@
 
 #include <dix-config.h>
 
-#include "fb.h"
+#include "fb/fb_priv.h"
 
 void
 fbSolid(FbBits * dst,
@@ -48,6 +48,13 @@ fbSolid(FbBits * dst,
             dst++;
         }
         n = nmiddle;
+#ifndef FB_ACCESS_WRAPPER
+        if (n >= FB_SIMD_MIN_WORDS) {
+            fbSimdSolid(dst, n, and, xor);
+            dst += n;
+        }
+        else
+#endif
         if (!and)
             while (n--)
                 WRITE(dst++, xor);
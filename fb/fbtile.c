@@ -22,7 +22,7 @@
 
 #include <dix-config.h>
 
-#include "fb.h"
+#include "fb/fb_priv.h"
 
 /*
  * Accelerated tile fill -- tile width is a power of two not greater
@@ -82,6 +82,13 @@ fbEvenTile(FbBits * dst,
             dst++;
         }
         n = nmiddle;
+#ifndef FB_ACCESS_WRAPPER
+        if (n >= FB_SIMD_MIN_WORDS) {
+            fbSimdSolid(dst, n, and, xor);
+            dst += n;
+        }
+        else
+#endif
         if (!and)
             while (n--)
                 WRITE(dst++, xor);
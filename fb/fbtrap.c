@@ -22,6 +22,10 @@
 
 #include <dix-config.h>
 
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "fb/fb_priv.h"
 #include "fb/fbpict_priv.h"
 
 #include "fb.h"
@@ -87,6 +91,25 @@ typedef void (*CompositeShapesFunc) (pixman_op_t op,
                                      int x_dst, int y_dst,
                                      int n_shapes, const uint8_t * shapes);
 
+static pixman_format_code_t
+fbShapesMaskFormat(PicturePtr pDst, PictFormatPtr maskFormat)
+{
+    if (!maskFormat)
+        return pDst->polyEdge == PolyEdgeSharp ? PIXMAN_a1 : PIXMAN_a8;
+
+    switch (PIXMAN_FORMAT_A(maskFormat->format)) {
+    case 1:
+        return PIXMAN_a1;
+
+    case 4:
+        return PIXMAN_a4;
+
+    default:
+    case 8:
+        return PIXMAN_a8;
+    }
+}
+
 static void
 fbShapes(CompositeShapesFunc composite,
          pixman_op_t op,
@@ -106,18 +129,13 @@ fbShapes(CompositeShapesFunc composite,
     dst = image_from_pict(pDst, TRUE, &dst_xoff, &dst_yoff);
 
     if (src && dst) {
-        pixman_format_code_t format;
+        pixman_format_code_t format = fbShapesMaskFormat(pDst, maskFormat);
 
         DamageRegionAppend(pDst->pDrawable, pDst->pCompositeClip);
 
         if (!maskFormat) {
             int i;
 
-            if (pDst->polyEdge == PolyEdgeSharp)
-                format = PIXMAN_a1;
-            else
-                format = PIXMAN_a8;
-
             for (i = 0; i < nshapes; ++i) {
                 composite(op, src, dst, format,
                           xSrc + src_xoff,
@@ -126,21 +144,6 @@ fbShapes(CompositeShapesFunc composite,
             }
         }
         else {
-            switch (PIXMAN_FORMAT_A(maskFormat->format)) {
-            case 1:
-                format = PIXMAN_a1;
-                break;
-
-            case 4:
-                format = PIXMAN_a4;
-                break;
-
-            default:
-            case 8:
-                format = PIXMAN_a8;
-                break;
-            }
-
             composite(op, src, dst, format,
                       xSrc + src_xoff,
                       ySrc + src_yoff, dst_xoff, dst_yoff, nshapes, shapes);
@@ -153,6 +156,129 @@ fbShapes(CompositeShapesFunc composite,
     free_pixman_pict(pDst, dst);
 }
 
+#ifndef FB_ACCESS_WRAPPER
+
+typedef struct {
+    pixman_op_t op;
+    pixman_format_code_t format;
+    Bool one_by_one;            /* no mask format, each shape on its own */
+    int xSrc, ySrc;
+    FbPictBandRec bands[FB_MAX_THREADS];
+    /* the trapezoids cut to each band */
+    xTrapezoid *bandTraps[FB_MAX_THREADS];
+    int bandNtrap[FB_MAX_THREADS];
+} FbTrapBandsRec;
+
+/* cut at pixel rows, which leaves the sample rows inside as they were */
+static Bool
+fbTrapezoidsCut(FbTrapBandsRec *c, int i, int ntrap, const xTrapezoid *traps)
+{
+    FbPictBandPtr band = &c->bands[i];
+    xFixed top = IntToxFixed(band->y1), bottom = IntToxFixed(band->y2);
+    int n = 0;
+
+    c->bandTraps[i] = NULL;
+    for (int t = 0; t < ntrap; t++)
+        if (traps[t].top < bottom && traps[t].bottom > top)
+            n++;
+    c->bandNtrap[i] = n;
+    if (!n)
+        return TRUE;
+    if (!(c->bandTraps[i] = calloc(n, sizeof(xTrapezoid))))
+        return FALSE;
+
+    n = 0;
+    for (int t = 0; t < ntrap; t++) {
+        xTrapezoid *trap = &c->bandTraps[i][n];
+
+        if (traps[t].top >= bottom || traps[t].bottom <= top)
+            continue;
+        *trap = traps[t];
+        trap->top = max(trap->top, top);
+        trap->bottom = min(trap->bottom, bottom);
+        n++;
+    }
+    return TRUE;
+}
+
+static void
+fbTrapezoidsBand(void *closure, int i)
+{
+    FbTrapBandsRec *c = closure;
+    FbPictBandPtr band = &c->bands[i];
+    xTrapezoid *traps = c->bandTraps[i];
+    int n = c->bandNtrap[i];
+
+    if (!n)
+        return;
+    if (c->one_by_one) {
+        for (int t = 0; t < n; t++)
+            pixman_composite_trapezoids(c->op, band->src, band->dst, c->format,
+                                        c->xSrc + band->src_xoff,
+                                        c->ySrc + band->src_yoff,
+                                        band->dst_xoff, band->dst_yoff, 1,
+                                        (pixman_trapezoid_t *) &traps[t]);
+    }
+    else {
+        pixman_composite_trapezoids(c->op, band->src, band->dst, c->format,
+                                    c->xSrc + band->src_xoff,
+                                    c->ySrc + band->src_yoff,
+                                    band->dst_xoff, band->dst_yoff, n,
+                                    (pixman_trapezoid_t *) traps);
+    }
+}
+
+static Bool
+fbTrapezoidsParallel(CARD8 op,
+                     PicturePtr pSrc,
+                     PicturePtr pDst,
+                     PictFormatPtr maskFormat,
+                     INT16 xSrc, INT16 ySrc, int ntrap, xTrapezoid * traps)
+{
+    FbTrapBandsRec c = {
+        .op = op,
+        .format = fbShapesMaskFormat(pDst, maskFormat),
+        .one_by_one = !maskFormat,
+        .xSrc = xSrc, .ySrc = ySrc,
+    };
+    BoxPtr clip = &pDst->pCompositeClip->extents;
+    pixman_box32_t extents = {
+        .x1 = clip->x1 - pDst->pDrawable->x, .y1 = INT32_MAX,
+        .x2 = clip->x2 - pDst->pDrawable->x, .y2 = INT32_MIN,
+    };
+    Bool cut = TRUE;
+    int n, i;
+
+    /* other operators change the whole destination, the masks with it */
+    if (op != PictOpOver && op != PictOpAdd)
+        return FALSE;
+
+    for (int t = 0; t < ntrap; t++) {
+        extents.y1 = min(extents.y1, xFixedToInt(traps[t].top));
+        extents.y2 = max(extents.y2, xFixedToInt(traps[t].bottom - 1) + 1);
+    }
+
+    miCompositeSourceValidate(pSrc);
+    if (!(n = fbPictBands(pSrc, NULL, pDst, &extents, c.bands)))
+        return FALSE;
+
+    /* all or nothing, a band can't be left out once they're split */
+    for (i = 0; i < n && cut; i++)
+        cut = fbTrapezoidsCut(&c, i, ntrap, traps);
+    if (cut) {
+        DamageRegionAppend(pDst->pDrawable, pDst->pCompositeClip);
+        fbParallelRun(fbTrapezoidsBand, &c, n);
+        DamageRegionProcessPending(pDst->pDrawable);
+    }
+
+    while (i--)
+        free(c.bandTraps[i]);
+    fbPictFreeBands(pSrc, NULL, pDst, c.bands, n);
+    return cut;
+}
+
+#endif /* FB_ACCESS_WRAPPER */
+
 void
 fbTrapezoids(CARD8 op,
              PicturePtr pSrc,
@@ -163,6 +289,12 @@ fbTrapezoids(CARD8 op,
     xSrc -= (traps[0].left.p1.x >> 16);
     ySrc -= (traps[0].left.p1.y >> 16);
 
+#ifndef FB_ACCESS_WRAPPER
+    if (fbTrapezoidsParallel(op, pSrc, pDst, maskFormat,
+                             xSrc, ySrc, ntrap, traps))
+        return;
+#endif
+
     fbShapes((CompositeShapesFunc) pixman_composite_trapezoids,
              op, pSrc, pDst, maskFormat,
              xSrc, ySrc, ntrap, sizeof(xTrapezoid), (const uint8_t *) traps);
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * DISPATCH-PROFILE: read the per-client request profile
+ *
+ * The extension is only there when the server runs with +dispatchprofile.
+ * DispatchProfileGetClientProfile returns the counters of one client (any
+ * XID it owns) or of all clients the requestor may read (None), as a list
+ * of xDispatchProfileEntry after the reply. With DispatchProfileResetMask in
+ * flags, the counters are cleared afterwards, which needs DixManageAccess
+ * on the clients.
+ *
+ * The request asking for the profile is accounted after the reply is
+ * generated, so it shows up in the next one.
+ */
+#ifndef _DISPATCHPROFILEPROTO_H_
+#define _DISPATCHPROFILEPROTO_H_
+
+#include <X11/Xmd.h>
+
+#define DISPATCHPROFILE_NAME            "DISPATCH-PROFILE"
+#define DISPATCHPROFILE_MAJOR_VERSION   1
+#define DISPATCHPROFILE_MINOR_VERSION   0
+
+#define X_DispatchProfileQueryVersion       0
+#define X_DispatchProfileGetClientProfile   1
+
+#define DispatchProfileResetMask        (1 << 0)
+
+typedef struct {
+    CARD8   reqType;
+    CARD8   dispatchProfileReqType;
+    CARD16  length;
+    CARD32  majorVersion;
+    CARD32  minorVersion;
+} xDispatchProfileQueryVersionReq;
+#define sz_xDispatchProfileQueryVersionReq 12
+
+typedef struct {
+    BYTE    type;                       /* X_Reply */
+    CARD8   pad0;
+    CARD16  sequenceNumber;
+    CARD32  length;
+    CARD32  majorVersion;
+    CARD32  minorVersion;
+    CARD32  pad1;
+    CARD32  pad2;
+    CARD32  pad3;
+    CARD32  pad4;
+} xDispatchProfileQueryVersionReply;
+#define sz_xDispatchProfileQueryVersionReply 32
+
+typedef struct {
+    CARD8   reqType;
+    CARD8   dispatchProfileReqType;
+    CARD16  length;
+    CARD32  client;                     /* XID of the client, or None */
+    CARD32  flags;
+} xDispatchProfileGetClientProfileReq;
+#define sz_xDispatchProfileGetClientProfileReq 12
+
+typedef struct {
+    BYTE    type;                       /* X_Reply */
+    CARD8   pad0;
+    CARD16  sequenceNumber;
+    CARD32  length;
+    CARD32  numEntries;
+    CARD32  pad1;
+    CARD32  pad2;
+    CARD32  pad3;
+    CARD32  pad4;
+    CARD32  pad5;
+} xDispatchProfileGetClientProfileReply;
+#define sz_xDispatchProfileGetClientProfileReply 32
+
+/* one request type of one client, times in ns */
+typedef struct {
+    CARD32  client;                     /* resource base of the client */
+    CARD16  majorOpcode;
+    CARD16  minorOpcode;                /* 0 for core requests */
+    CARD64  count;
+    CARD64  errors;                     /* ... of the requests that failed */
+    CARD64  time;                       /* total handler time */
+    CARD64  maxTime;                    /* longest single request */
+    CARD64  bytesIn;                    /* request bytes */
+    CARD64  bytesOut;                   /* queued while the handler ran */
+} xDispatchProfileEntry;
+#define sz_xDispatchProfileEntry 56
+
+#endif /* _DISPATCHPROFILEPROTO_H_ */
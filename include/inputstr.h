@@ -599,6 +599,8 @@ typedef struct _DeviceIntRec {
     struct _SyncCounter *idle_counter;
 
     Bool ignoreXkbActionsBehaviors; /* TRUE if keys don't trigger behaviors and actions */
+
+    Bool coalesceMotion;        /* merge queued motion, see XI_PROP_COALESCE_MOTION */
 } DeviceIntRec;
 
 typedef struct {
@@ -116,6 +116,17 @@ typedef struct _DevScreenPrivateKeyRec {
  */
 _X_EXPORT Bool  dixRegisterPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size);
 
+/*
+ * @brief Register a private index that is looked up on most uses of the object.
+ *
+ * Like dixRegisterPrivateKey(), but the private is placed among the first
+ * ones of the object, next to the other hot ones, once the first object
+ * of the type is created. Only privates of types that have no objects
+ * before all keys are registered are moved, which leaves out screens,
+ * clients, extensions, colormaps and devices.
+ */
+_X_EXPORT Bool  dixRegisterHotPrivateKey(DevPrivateKey key, DevPrivateType type, unsigned size);
+
 /*
  * Check whether a private key has been registered
  */
@@ -259,6 +270,11 @@ extern _X_EXPORT Bool
 dixRegisterScreenSpecificPrivateKey(ScreenPtr pScreen, DevPrivateKey key,
                                     DevPrivateType type, unsigned size);
 
+/* Like dixRegisterHotPrivateKey(), for a screen-specific private */
+extern _X_EXPORT Bool
+dixRegisterHotScreenSpecificPrivateKey(ScreenPtr pScreen, DevPrivateKey key,
+                                       DevPrivateType type, unsigned size);
+
 /* Clean up screen-specific privates before CloseScreen */
 extern void
 dixFreeScreenSpecificPrivates(ScreenPtr pScreen);
@@ -351,6 +367,12 @@ extern _X_EXPORT int
 extern void
  dixPrivateUsage(void);
 
+/*
+ * Log the offsets and sizes of all privates at verbosity 5
+ */
+extern void
+ dixPrivateLayout(void);
+
 /*
  * Resets the privates subsystem.  dixResetPrivates is called from the main loop
  * before each server generation.  This function must only be called by main().
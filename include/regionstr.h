@@ -226,11 +226,24 @@ RegionCopy(RegionPtr dst, RegionPtr src)
     return pixman_region_copy(dst, src);
 }
 
+extern _X_EXPORT Bool RegionIntersectRect(RegionPtr /*newReg */ ,
+                                          RegionPtr /*pRect */ ,
+                                          RegionPtr /*reg */ );
+
+extern _X_EXPORT Bool RegionUnionRect(RegionPtr /*newReg */ ,
+                                      RegionPtr /*reg1 */ ,
+                                      RegionPtr /*reg2 */ );
+
 static inline Bool
 RegionIntersect(RegionPtr newReg,       /* destination Region */
                 RegionPtr reg1, RegionPtr reg2  /* source regions     */
     )
 {
+    /* a rectangle and a region of several */
+    if (!reg1->data && reg2->data && reg2->data->numRects > 1)
+        return RegionIntersectRect(newReg, reg1, reg2);
+    if (!reg2->data && reg1->data && reg1->data->numRects > 1)
+        return RegionIntersectRect(newReg, reg2, reg1);
     return pixman_region_intersect(newReg, reg1, reg2);
 }
 
@@ -239,6 +252,8 @@ RegionUnion(RegionPtr newReg,   /* destination Region */
             RegionPtr reg1, RegionPtr reg2      /* source regions     */
     )
 {
+    if (!reg1->data && !reg2->data)
+        return RegionUnionRect(newReg, reg1, reg2);
     return pixman_region_union(newReg, reg1, reg2);
 }
 
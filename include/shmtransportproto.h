@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * SHM-TRANSPORT: requests and replies through shared memory
+ *
+ * A local client asks for the transport with ShmTransportAttach on its
+ * socket and gets three file descriptors with the reply: a memfd holding
+ * the rings, an eventfd to wake the server and one the server uses to wake
+ * the client. The memfd is sealed against resizing.
+ *
+ * From the reply on, the client writes its requests into the request ring
+ * and reads replies, events and errors from the reply ring. The socket
+ * stays open for noticing the other side going away, nothing else must be
+ * written to it. Output queued before the switch still arrives on the
+ * socket, and all of it has been written there before the first byte goes
+ * into the reply ring, so once the reply ring has data the client drains
+ * the socket up to EAGAIN, and then never reads it again.
+ *
+ * Requests that pass file descriptors (DRI3, MIT-SHM fd requests, ...)
+ * can't be used on an attached connection.
+ */
+#ifndef _SHMTRANSPORTPROTO_H_
+#define _SHMTRANSPORTPROTO_H_
+
+#include <stdint.h>
+#include <X11/Xmd.h>
+
+#define SHMTRANSPORT_NAME               "SHM-TRANSPORT"
+#define SHMTRANSPORT_MAJOR_VERSION      1
+#define SHMTRANSPORT_MINOR_VERSION      0
+
+#define X_ShmTransportQueryVersion      0
+#define X_ShmTransportAttach            1
+
+/* ring sizes, in bytes and powers of two */
+#define SHMTRANSPORT_MIN_RING           (64 * 1024)
+#define SHMTRANSPORT_MAX_RING           (16 * 1024 * 1024)
+#define SHMTRANSPORT_REQUEST_RING       (1024 * 1024)
+#define SHMTRANSPORT_REPLY_RING         (256 * 1024)
+
+/*
+ * Control block of one ring, at the start of the shared memory for the
+ * request ring and right after it for the reply ring. head and tail count
+ * the bytes written and read, modulo 2^32; byte n lives at
+ * offset + (n & (size - 1)). The producer only writes head and clears
+ * wakeProducer, the consumer only writes tail and clears wakeConsumer,
+ * the lines they write most are kept apart.
+ *
+ * A consumer finding the ring empty sets wakeConsumer and checks head
+ * again before going to sleep; a producer that published data and finds
+ * wakeConsumer set clears it and signals the other side's eventfd. The
+ * same goes for a producer waiting for room, with wakeProducer and tail.
+ */
+typedef struct {
+    uint32_t head;              /* written by the producer */
+    uint32_t wakeProducer;      /* producer waits for room */
+    uint8_t  pad0[56];
+    uint32_t tail;              /* written by the consumer */
+    uint32_t wakeConsumer;      /* consumer waits for data */
+    uint8_t  pad1[56];
+} xShmTransportRing;
+
+#define SHMTRANSPORT_REQUEST_CONTROL    0
+#define SHMTRANSPORT_REPLY_CONTROL      sizeof(xShmTransportRing)
+/* where the data of the first ring starts */
+#define SHMTRANSPORT_DATA_OFFSET        4096
+
+typedef struct {
+    CARD8   reqType;
+    CARD8   shmTransportReqType;
+    CARD16  length;
+    CARD32  majorVersion;
+    CARD32  minorVersion;
+} xShmTransportQueryVersionReq;
+#define sz_xShmTransportQueryVersionReq 12
+
+typedef struct {
+    BYTE    type;                       /* X_Reply */
+    CARD8   pad0;
+    CARD16  sequenceNumber;
+    CARD32  length;
+    CARD32  majorVersion;
+    CARD32  minorVersion;
+    CARD32  pad1;
+    CARD32  pad2;
+    CARD32  pad3;
+    CARD32  pad4;
+} xShmTransportQueryVersionReply;
+#define sz_xShmTransportQueryVersionReply 32
+
+typedef struct {
+    CARD8   reqType;
+    CARD8   shmTransportReqType;
+    CARD16  length;
+    CARD32  requestSize;        /* wanted ring sizes, 0 for the default */
+    CARD32  replySize;
+} xShmTransportAttachReq;
+#define sz_xShmTransportAttachReq 12
+
+typedef struct {
+    BYTE    type;                       /* X_Reply */
+    CARD8   nfd;                        /* memfd, server and client eventfd */
+    CARD16  sequenceNumber;
+    CARD32  length;
+    CARD32  size;                       /* of the shared memory */
+    CARD32  requestOffset;
+    CARD32  requestSize;
+    CARD32  replyOffset;
+    CARD32  replySize;
+    CARD32  pad1;
+} xShmTransportAttachReply;
+#define sz_xShmTransportAttachReply 32
+
+#endif /* _SHMTRANSPORTPROTO_H_ */
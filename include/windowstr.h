@@ -154,6 +154,7 @@ typedef struct _Window {
     unsigned inhibitBGPaint:1;  /* paint the background? */
 
     PropertyPtr properties;     /* default: NULL */
+    struct _PropertyIndex *propIndex;   /* default: NULL */
 } WindowRec;
 
 extern _X_EXPORT Mask DontPropagateMasks[];
@@ -49,6 +49,10 @@
  * [c6 c7 c8]   [1] */
 #define XI_PROP_TRANSFORM "Coordinate Transformation Matrix"
 
+/* BOOL. 1 - motion events that piled up in the event queue are merged
+ * into the last one before they're processed. Raw events are kept. */
+#define XI_PROP_COALESCE_MOTION "Coalesce Motion Events"
+
 /* STRING. Device node path of device */
 #define XI_PROP_DEVICE_NODE "Device Node"
 
@@ -5,6 +5,7 @@
 #ifndef _XSERVER_MI_PRIV_H
 #define _XSERVER_MI_PRIV_H
 
+#include <stdint.h>
 #include <X11/Xdefs.h>
 #include <X11/Xproto.h>
 #include <X11/Xprotostr.h>
@@ -45,6 +46,31 @@ void mieqProcessInputEvents(void);
 void mieqAddCallbackOnDrained(CallbackProcPtr callback, void *param);
 void mieqRemoveCallbackOnDrained(CallbackProcPtr callback, void *param);
 
+#define MIEQ_LATENCY_BUCKETS 32
+
+typedef struct {
+    uint64_t enqueued;          /* events put into the queue */
+    uint64_t coalesced;         /* motion events merged into a queued one */
+    uint64_t dropped;           /* events lost because the queue was full */
+    uint64_t delivered;         /* events taken off by the main thread */
+    uint64_t merged;            /* motion events merged before dispatch */
+    unsigned int size;          /* slots in the ring being filled */
+    /* enqueue->dequeue latency, bucket i counts events below 2^i us */
+    uint64_t latency[MIEQ_LATENCY_BUCKETS];
+} mieqStatsRec;
+
+/*
+ * @brief get the event queue counters and latency histogram
+ *
+ * Must be called from the main thread.
+ */
+void mieqGetStats(mieqStatsRec *stats);
+
+/*
+ * @brief log the event queue counters and latency percentiles
+ */
+void mieqLogStats(void);
+
 /**
  * Custom input event handler. If you need to process input events in some
  * other way than the default path, register an input event handler for the
@@ -86,6 +112,28 @@ void miMarkUnrealizedWindow(WindowPtr pChild, WindowPtr pWin, Bool fromConfigure
 WindowPtr miSpriteTrace(SpritePtr pSprite, int x, int y);
 WindowPtr miXYToWindow(ScreenPtr pScreen, SpritePtr pSprite, int x, int y);
 
+Bool miWindowIndexInit(ScreenPtr pScreen);
+
+typedef Bool (*miWindowIndexHitProcPtr) (WindowPtr pWin, int x, int y);
+
+/*
+ * @brief find the topmost child of pParent at x/y
+ *
+ * hit does the exact test of one child (mapped, border box, shape, ...).
+ * Parents with many children keep a spatial index that skips the children
+ * not covering x/y, the others are walked in stacking order.
+ */
+WindowPtr miWindowIndexFindChild(WindowPtr pParent, int x, int y,
+                                 miWindowIndexHitProcPtr hit);
+
+/*
+ * @brief drop all window indexes
+ *
+ * Must be called whenever child windows are mapped, unmapped, moved,
+ * resized, restacked or destroyed.
+ */
+void miWindowIndexInvalidate(void);
+
 _X_EXPORT /* used by in-tree libwfb.so module */
 int miExpandDirectColors(ColormapPtr, int, xColorItem *, xColorItem *);
 
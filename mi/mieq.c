@@ -66,7 +66,6 @@ in this Software without prior written authorization from The Open Group.
 
 /* Maximum size should be initial size multiplied by a power of 2 */
 #define QUEUE_INITIAL_SIZE                 512
-#define QUEUE_RESERVED_SIZE                 64
 #define QUEUE_MAXIMUM_SIZE                4096
 #define QUEUE_DROP_BACKTRACE_FREQUENCY     100
 #define QUEUE_DROP_BACKTRACE_MAX            10
@@ -74,19 +73,66 @@ in this Software without prior written authorization from The Open Group.
 #define EnqueueScreen(dev) dev->spriteInfo->sprite->pEnqueueScreen
 #define DequeueScreen(dev) dev->spriteInfo->sprite->pDequeueScreen
 
+/*
+ * The queue is a single-producer/single-consumer ring. Producers (the input
+ * thread, or the main thread for eg. XTest and barrier events) are still
+ * serialised by input_lock(), but the consumer in mieqProcessInputEvents()
+ * doesn't take it: head and tail are free running counters, published with
+ * release stores and read with acquire loads.
+ *
+ * Instead of reallocating under the consumer's feet, a full ring is
+ * replaced by one twice as big that is chained behind it. The producer
+ * carries on in the new ring, the consumer switches over (and frees the old
+ * one) once it has drained everything up to the new ring's start.
+ *
+ * Each slot has a state so the producer can still merge a motion event
+ * into the previous one as long as the consumer hasn't picked it up yet:
+ * whoever wins the compare-and-swap on a QUEUED slot owns it, the consumer
+ * only ever waits for a producer that is halfway through such a rewrite.
+ */
+enum {
+    SLOT_CONSUMED = 0,          /* free, or already picked up */
+    SLOT_QUEUED,                /* published, waiting for the consumer */
+    SLOT_WRITING,               /* producer is merging a motion event */
+};
+
+#define mieq_load_acquire(p)    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define mieq_store(p, v)        __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define mieq_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define mieq_claim(p, from, to) \
+    __extension__ ({ int __from = (from); \
+        __atomic_compare_exchange_n(p, &__from, to, FALSE, \
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED); })
+
 typedef struct _Event {
-    InternalEvent *events;
+    InternalEvent event;
     ScreenPtr pScreen;
     DeviceIntPtr pDev;          /* device this event _originated_ from */
+    CARD64 enqueued;            /* GetTimeInMicros() when first queued */
+    int state;                  /* SLOT_* */
 } EventRec, *EventPtr;
 
+typedef struct _EventRing {
+    struct _EventRing *next;    /* successor, once this one filled up */
+    unsigned int start;         /* counter value of the first event in here */
+    unsigned int mask;          /* number of slots - 1 */
+    EventRec events[];
+} EventRingRec, *EventRingPtr;
+
 typedef struct _EventQueue {
-    HWEventQueueType head, tail;        /* long for SetInputCheck */
+    /* free running event counters, int-sized for SetInputCheck */
+    unsigned int head;          /* written by the consumer only */
+    unsigned int tail;          /* written by the producer only */
+    /* producer side, under input_lock */
+    EventRingPtr ringIn;        /* ring being written to */
     CARD32 lastEventTime;       /* to avoid time running backwards */
     int lastMotion;             /* device ID if last event motion? */
-    EventRec *events;           /* our queue as an array */
-    size_t nevents;             /* the number of buckets in our queue */
     size_t dropped;             /* counter for number of consecutive dropped events */
+    uint64_t enqueued, coalesced, droppedTotal;
+    /* consumer side, main thread */
+    EventRingPtr ringOut;       /* ring being read from */
+    uint64_t delivered, merged;
+    uint64_t latency[MIEQ_LATENCY_BUCKETS];
     mieqHandler handlers[128];  /* custom event handler */
 } EventQueueRec, *EventQueuePtr;
 
@@ -94,75 +140,56 @@ static EventQueueRec miEventQueue;
 
 static CallbackListPtr miCallbacksWhenDrained = NULL;
 
-static size_t
-mieqNumEnqueued(EventQueuePtr eventQueue)
+static EventRingPtr
+mieqAllocRing(size_t nevents, unsigned int start)
 {
-    size_t n_enqueued = 0;
+    EventRingPtr ring;
 
-    if (eventQueue->nevents) {
-        /* % is not well-defined with negative numbers... sigh */
-        n_enqueued = eventQueue->tail - eventQueue->head + eventQueue->nevents;
-        if (n_enqueued >= eventQueue->nevents)
-            n_enqueued -= eventQueue->nevents;
+    ring = calloc(1, sizeof(EventRingRec) + nevents * sizeof(EventRec));
+    if (!ring) {
+        ErrorF("[mi] mieq memory allocation error.\n");
+        return NULL;
     }
-    return n_enqueued;
+    ring->start = start;
+    ring->mask = nevents - 1;
+    return ring;
 }
 
 /* Pre-condition: Called with input_lock held */
 static Bool
-mieqGrowQueue(EventQueuePtr eventQueue, size_t new_nevents)
+mieqRingFull(EventQueuePtr eventQueue, EventRingPtr ring)
 {
-    size_t i, n_enqueued, first_hunk;
-    EventRec *new_events;
+    unsigned int head = mieq_load_acquire(&eventQueue->head);
+    unsigned int first = ring->start;
 
-    if (!eventQueue) {
-        ErrorF("[mi] mieqGrowQueue called with a NULL eventQueue\n");
-        return FALSE;
-    }
+    /* events in older rings don't take up room in this one */
+    if ((int) (head - first) > 0)
+        first = head;
+    return eventQueue->tail - first > ring->mask;
+}
 
-    if (new_nevents <= eventQueue->nevents)
-        return FALSE;
+/*
+ * Pre-condition: Called with input_lock held
+ *
+ * Chain a bigger ring behind the one being written to, unless that already
+ * has the maximum size.
+ */
+static Bool
+mieqGrowQueue(EventQueuePtr eventQueue)
+{
+    EventRingPtr ring = eventQueue->ringIn;
+    size_t nevents = (size_t) ring->mask + 1;
+    EventRingPtr next;
 
-    new_events = calloc(new_nevents, sizeof(EventRec));
-    if (new_events == NULL) {
-        ErrorF("[mi] mieqGrowQueue memory allocation error.\n");
+    if (nevents >= QUEUE_MAXIMUM_SIZE)
         return FALSE;
-    }
-
-    n_enqueued = mieqNumEnqueued(eventQueue);
-
-    /* First copy the existing events */
-    first_hunk = eventQueue->nevents - eventQueue->head;
-    if (eventQueue->events) {
-        memcpy(new_events,
-               &eventQueue->events[eventQueue->head],
-               first_hunk * sizeof(EventRec));
-        memcpy(&new_events[first_hunk],
-               eventQueue->events, eventQueue->head * sizeof(EventRec));
-    }
-
-    /* Initialize the new portion */
-    for (i = eventQueue->nevents; i < new_nevents; i++) {
-        InternalEvent *evlist = InitEventList(1);
-
-        if (!evlist) {
-            size_t j;
 
-            for (j = 0; j < i; j++)
-                FreeEventList(new_events[j].events, 1);
-            free(new_events);
-            return FALSE;
-        }
-        new_events[i].events = evlist;
-    }
-
-    /* And update our record */
-    eventQueue->tail = n_enqueued;
-    eventQueue->head = 0;
-    eventQueue->nevents = new_nevents;
-    free(eventQueue->events);
-    eventQueue->events = new_events;
+    next = mieqAllocRing(nevents << 1, eventQueue->tail);
+    if (!next)
+        return FALSE;
 
+    mieq_store_release(&ring->next, next);
+    eventQueue->ringIn = next;
     return TRUE;
 }
 
@@ -173,26 +200,64 @@ mieqInit(void)
     miEventQueue.lastEventTime = GetTimeInMillis();
 
     input_lock();
-    if (!mieqGrowQueue(&miEventQueue, QUEUE_INITIAL_SIZE))
+    miEventQueue.ringIn = mieqAllocRing(QUEUE_INITIAL_SIZE, 0);
+    if (!miEventQueue.ringIn)
         FatalError("Could not allocate event queue.\n");
+    miEventQueue.ringOut = miEventQueue.ringIn;
     input_unlock();
 
-    SetInputCheck(&miEventQueue.head, &miEventQueue.tail);
+    SetInputCheck((HWEventQueuePtr) &miEventQueue.head,
+                  (HWEventQueuePtr) &miEventQueue.tail);
     return TRUE;
 }
 
 void
 mieqFini(void)
 {
-    int i;
+    EventRingPtr ring, next;
+
+    mieqLogStats();
+
+    for (ring = miEventQueue.ringOut; ring; ring = next) {
+        next = ring->next;
+        free(ring);
+    }
+    miEventQueue.ringIn = miEventQueue.ringOut = NULL;
+}
+
+/* Pre-condition: Called with input_lock held */
+static void
+mieqReportDropped(EventQueuePtr eventQueue)
+{
+    /* the consumer resets this when it catches up again */
+    size_t dropped = __atomic_add_fetch(&eventQueue->dropped, 1,
+                                        __ATOMIC_RELAXED);
 
-    for (i = 0; i < miEventQueue.nevents; i++) {
-        if (miEventQueue.events[i].events != NULL) {
-            FreeEventList(miEventQueue.events[i].events, 1);
-            miEventQueue.events[i].events = NULL;
+    eventQueue->droppedTotal++;
+
+    /* Toss events which come in late.  Usually this means your server's
+     * stuck in an infinite loop in the main thread.
+     */
+    if (dropped == 1) {
+        ErrorF("[mi] EQ overflowing.  Additional events will be "
+               "discarded until existing events are processed.\n");
+        xorg_backtrace();
+        ErrorF("[mi] These backtraces from mieqEnqueue may point to "
+               "a culprit higher up the stack.\n");
+        ErrorF("[mi] mieq is *NOT* the cause.  It is a victim.\n");
+    }
+    else if (dropped % QUEUE_DROP_BACKTRACE_FREQUENCY == 0 &&
+             dropped / QUEUE_DROP_BACKTRACE_FREQUENCY <=
+             QUEUE_DROP_BACKTRACE_MAX) {
+        ErrorF("[mi] EQ overflow continuing. %lu events have been "
+               "dropped.\n", (unsigned long)dropped);
+        if (dropped / QUEUE_DROP_BACKTRACE_FREQUENCY ==
+            QUEUE_DROP_BACKTRACE_MAX) {
+            ErrorF("[mi] No further overflow reports will be "
+                   "reported until the clog is cleared.\n");
         }
+        xorg_backtrace();
     }
-    free(miEventQueue.events);
 }
 
 /*
@@ -203,58 +268,47 @@ mieqFini(void)
 void
 mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
 {
+    EventRingPtr ring = miEventQueue.ringIn;
     unsigned int oldtail = miEventQueue.tail;
+    EventPtr slot = NULL;
     InternalEvent *evt;
+    Bool merged = FALSE;
     int isMotion = 0;
     int evlen;
     Time time;
-    size_t n_enqueued;
 
     verify_internal_event(e);
 
-    n_enqueued = mieqNumEnqueued(&miEventQueue);
-
     /* avoid merging events from different devices */
     if (e->any.type == ET_Motion)
         isMotion = pDev->id;
 
+    /* merge into the previous event, unless the consumer got there first */
     if (isMotion && isMotion == miEventQueue.lastMotion &&
-        oldtail != miEventQueue.head) {
-        oldtail = (oldtail - 1) % miEventQueue.nevents;
+        oldtail != ring->start) {
+        slot = &ring->events[(oldtail - 1) & ring->mask];
+        merged = mieq_claim(&slot->state, SLOT_QUEUED, SLOT_WRITING);
+        if (merged)
+            miEventQueue.coalesced++;
+        else
+            slot = NULL;
     }
-    else if (n_enqueued + 1 == miEventQueue.nevents) {
-        if (!mieqGrowQueue(&miEventQueue, miEventQueue.nevents << 1)) {
-            /* Toss events which come in late.  Usually this means your server's
-             * stuck in an infinite loop in the main thread.
-             */
-            miEventQueue.dropped++;
-            if (miEventQueue.dropped == 1) {
-                ErrorF("[mi] EQ overflowing.  Additional events will be "
-                       "discarded until existing events are processed.\n");
-                xorg_backtrace();
-                ErrorF("[mi] These backtraces from mieqEnqueue may point to "
-                       "a culprit higher up the stack.\n");
-                ErrorF("[mi] mieq is *NOT* the cause.  It is a victim.\n");
-            }
-            else if (miEventQueue.dropped % QUEUE_DROP_BACKTRACE_FREQUENCY == 0 &&
-                     miEventQueue.dropped / QUEUE_DROP_BACKTRACE_FREQUENCY <=
-                     QUEUE_DROP_BACKTRACE_MAX) {
-                ErrorF("[mi] EQ overflow continuing. %lu events have been "
-                       "dropped.\n", (unsigned long)miEventQueue.dropped);
-                if (miEventQueue.dropped / QUEUE_DROP_BACKTRACE_FREQUENCY ==
-                    QUEUE_DROP_BACKTRACE_MAX) {
-                    ErrorF("[mi] No further overflow reports will be "
-                           "reported until the clog is cleared.\n");
-                }
-                xorg_backtrace();
+
+    if (!slot) {
+        if (mieqRingFull(&miEventQueue, ring)) {
+            if (!mieqGrowQueue(&miEventQueue)) {
+                mieqReportDropped(&miEventQueue);
+                return;
             }
-            return;
+            ring = miEventQueue.ringIn;
         }
-        oldtail = miEventQueue.tail;
+        slot = &ring->events[oldtail & ring->mask];
+        slot->enqueued = GetTimeInMicros();
+        miEventQueue.enqueued++;
     }
 
     evlen = e->any.length;
-    evt = miEventQueue.events[oldtail].events;
+    evt = &slot->event;
     memcpy(evt, e, evlen);
 
     time = e->any.time;
@@ -265,11 +319,119 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
         e->any.time = miEventQueue.lastEventTime;
 
     miEventQueue.lastEventTime = evt->any.time;
-    miEventQueue.events[oldtail].pScreen = pDev ? EnqueueScreen(pDev) : NULL;
-    miEventQueue.events[oldtail].pDev = pDev;
+    slot->pScreen = pDev ? EnqueueScreen(pDev) : NULL;
+    slot->pDev = pDev;
 
     miEventQueue.lastMotion = isMotion;
-    miEventQueue.tail = (oldtail + 1) % miEventQueue.nevents;
+
+    if (merged) {
+        mieq_store_release(&slot->state, SLOT_QUEUED);
+    }
+    else {
+        mieq_store(&slot->state, SLOT_QUEUED);
+        mieq_store_release(&miEventQueue.tail, oldtail + 1);
+    }
+}
+
+/*
+ * Consumer side: take the next event off the queue, copying it to @event.
+ * Returns FALSE if the queue is empty.
+ */
+static Bool
+mieqDequeue(EventQueuePtr eventQueue, InternalEvent *event,
+            DeviceIntPtr *dev, ScreenPtr *screen)
+{
+    unsigned int head = eventQueue->head;
+    EventRingPtr ring, next;
+    EventPtr slot;
+    CARD64 latency;
+    int bucket;
+
+    if (head == mieq_load_acquire(&eventQueue->tail))
+        return FALSE;
+
+    /* everything in front of the next ring has been consumed */
+    ring = eventQueue->ringOut;
+    while ((next = mieq_load_acquire(&ring->next)) && head == next->start) {
+        eventQueue->ringOut = next;
+        free(ring);
+        ring = next;
+    }
+
+    slot = &ring->events[head & ring->mask];
+    /* a merge is a bounded memcpy in the producer, so just wait for it */
+    while (!mieq_claim(&slot->state, SLOT_QUEUED, SLOT_CONSUMED))
+        ;
+
+    *event = slot->event;
+    *dev = slot->pDev;
+    *screen = slot->pScreen;
+    latency = GetTimeInMicros() - slot->enqueued;
+
+    mieq_store_release(&eventQueue->head, head + 1);
+
+    for (bucket = 0; latency && bucket < MIEQ_LATENCY_BUCKETS - 1; bucket++)
+        latency >>= 1;
+    eventQueue->latency[bucket]++;
+    eventQueue->delivered++;
+    return TRUE;
+}
+
+void
+mieqGetStats(mieqStatsRec *stats)
+{
+    EventRingPtr ring;
+
+    input_lock();
+    stats->enqueued = miEventQueue.enqueued;
+    stats->coalesced = miEventQueue.coalesced;
+    stats->dropped = miEventQueue.droppedTotal;
+    ring = miEventQueue.ringIn;
+    stats->size = ring ? ring->mask + 1 : 0;
+    input_unlock();
+
+    stats->delivered = miEventQueue.delivered;
+    stats->merged = miEventQueue.merged;
+    memcpy(stats->latency, miEventQueue.latency, sizeof(stats->latency));
+}
+
+void
+mieqLogStats(void)
+{
+    mieqStatsRec stats;
+    uint64_t sum = 0;
+    int i, p50 = -1, p99 = -1, max = 0;
+
+    mieqGetStats(&stats);
+    if (!stats.delivered)
+        return;
+
+    for (i = 0; i < MIEQ_LATENCY_BUCKETS; i++) {
+        sum += stats.latency[i];
+        if (p50 < 0 && sum * 2 >= stats.delivered)
+            p50 = i;
+        if (p99 < 0 && sum * 100 >= stats.delivered * 99)
+            p99 = i;
+        if (stats.latency[i])
+            max = i;
+    }
+
+    LogMessageVerb(X_INFO, 4,
+                   "input queue: %llu events queued, %llu merged on enqueue, "
+                   "%llu dropped, %llu delivered, %llu motion merged "
+                   "before dispatch, %u slots\n",
+                   (unsigned long long) stats.enqueued,
+                   (unsigned long long) stats.coalesced,
+                   (unsigned long long) stats.dropped,
+                   (unsigned long long) stats.delivered,
+                   (unsigned long long) stats.merged, stats.size);
+    LogMessageVerb(X_INFO, 4,
+                   "input queue latency: p50 < %lluus, p99 < %lluus, "
+                   "max < %lluus\n",
+                   1ULL << p50, 1ULL << p99, 1ULL << max);
+    for (i = 0; i <= max; i++)
+        LogMessageVerb(X_INFO, 5, "  < %10lluus: %llu\n", 1ULL << i,
+                       (unsigned long long) stats.latency[i]);
 }
 
 /**
@@ -517,17 +679,78 @@ mieqProcessDeviceEvent(DeviceIntPtr dev, InternalEvent *event, ScreenPtr screen)
     }
 }
 
+/*
+ * Motion events of devices with the XI_PROP_COALESCE_MOTION property set
+ * are held back while the queue is being drained, so a run of them can be
+ * merged into the last one. Raw events of the same device don't end the
+ * run: they're delivered right away, so XI2 raw clients still see every
+ * valuator change. Anything else, including touch events and motion that
+ * is emulated from a touch, delivers the pending motion first.
+ */
+static Bool
+mieqCanMergeMotion(DeviceIntPtr dev, const InternalEvent *event)
+{
+    return dev && dev->coalesceMotion &&
+        event->any.type == ET_Motion &&
+        !(event->device_event.flags & TOUCH_POINTER_EMULATED);
+}
+
+/* Fold @from into the later @to: valuators only @from has are carried over */
+static void
+mieqMergeMotion(const DeviceEvent *from, DeviceEvent *to)
+{
+    int i;
+
+    for (i = 0; i < MAX_VALUATORS; i++) {
+        if (!BitIsOn(from->valuators.mask, i) ||
+            BitIsOn(to->valuators.mask, i))
+            continue;
+        SetBit(to->valuators.mask, i);
+        if (BitIsOn(from->valuators.mode, i))
+            SetBit(to->valuators.mode, i);
+        else
+            ClearBit(to->valuators.mode, i);
+        to->valuators.data[i] = from->valuators.data[i];
+    }
+}
+
+static void
+mieqDeliverEvent(DeviceIntPtr dev, InternalEvent *event, ScreenPtr screen)
+{
+    DeviceIntPtr master = (dev) ? GetMaster(dev, MASTER_ATTACHED) : NULL;
+
+    if (screenIsSaved == SCREEN_SAVER_ON)
+        dixSaveScreens(serverClient, SCREEN_SAVER_OFF, ScreenSaverReset);
+#ifdef DPMSExtension
+    else if (DPMSPowerLevel != DPMSModeOn)
+        SetScreenSaverTimer();
+
+    if (DPMSPowerLevel != DPMSModeOn)
+        DPMSSet(serverClient, DPMSModeOn);
+#endif
+
+    mieqProcessDeviceEvent(dev, event, screen);
+
+    /* Update the sprite now. Next event may be from different device. */
+    if (master &&
+        (event->any.type == ET_Motion ||
+         ((event->any.type == ET_TouchBegin ||
+           event->any.type == ET_TouchUpdate) &&
+          event->device_event.flags & TOUCH_POINTER_EMULATED)))
+        miPointerUpdateSprite(dev);
+}
+
 /* Call this from ProcessInputEvents(). */
 void
 mieqProcessInputEvents(void)
 {
-    EventRec *e = NULL;
-    ScreenPtr screen;
-    InternalEvent event;
-    DeviceIntPtr dev = NULL, master = NULL;
+    ScreenPtr screen, motionScreen = NULL;
+    InternalEvent events[2];
+    InternalEvent *event = &events[0], *motion = &events[1], *tmp;
+    DeviceIntPtr dev = NULL, motionDev = NULL;
     static Bool inProcessInputEvents = FALSE;
-
-    input_lock();
+    size_t dropped;
+    Bool more;
 
     /*
      * report an error if mieqProcessInputEvents() is called recursively;
@@ -537,50 +760,54 @@ mieqProcessInputEvents(void)
     BUG_WARN_MSG(inProcessInputEvents, "[mi] mieqProcessInputEvents() called recursively.\n");
     inProcessInputEvents = TRUE;
 
-    if (miEventQueue.dropped) {
+    dropped = __atomic_exchange_n(&miEventQueue.dropped, 0, __ATOMIC_RELAXED);
+    if (dropped) {
         ErrorF("[mi] EQ processing has resumed after %lu dropped events.\n",
-               (unsigned long) miEventQueue.dropped);
+               (unsigned long) dropped);
         ErrorF
             ("[mi] This may be caused by a misbehaving driver monopolizing the server's resources.\n");
-        miEventQueue.dropped = 0;
     }
 
-    while (miEventQueue.head != miEventQueue.tail) {
-        e = &miEventQueue.events[miEventQueue.head];
-
-        event = *e->events;
-        dev = e->pDev;
-        screen = e->pScreen;
-
-        miEventQueue.head = (miEventQueue.head + 1) % miEventQueue.nevents;
-
-        input_unlock();
-
-        master = (dev) ? GetMaster(dev, MASTER_ATTACHED) : NULL;
-
-        if (screenIsSaved == SCREEN_SAVER_ON)
-            dixSaveScreens(serverClient, SCREEN_SAVER_OFF, ScreenSaverReset);
-#ifdef DPMSExtension
-        else if (DPMSPowerLevel != DPMSModeOn)
-            SetScreenSaverTimer();
-
-        if (DPMSPowerLevel != DPMSModeOn)
-            DPMSSet(serverClient, DPMSModeOn);
-#endif
+    do {
+        more = mieqDequeue(&miEventQueue, event, &dev, &screen);
+
+        if (motionDev) {
+            if (more && dev == motionDev) {
+                if (mieqCanMergeMotion(dev, event)) {
+                    mieqMergeMotion(&motion->device_event,
+                                    &event->device_event);
+                    tmp = motion;
+                    motion = event;
+                    event = tmp;
+                    motionScreen = screen;
+                    miEventQueue.merged++;
+                    continue;
+                }
+                if (event->any.type == ET_RawMotion) {
+                    mieqDeliverEvent(dev, event, screen);
+                    continue;
+                }
+            }
+            mieqDeliverEvent(motionDev, motion, motionScreen);
+            motionDev = NULL;
+        }
 
-        mieqProcessDeviceEvent(dev, &event, screen);
+        if (!more)
+            break;
 
-        /* Update the sprite now. Next event may be from different device. */
-        if (master &&
-            (event.any.type == ET_Motion ||
-             ((event.any.type == ET_TouchBegin ||
-               event.any.type == ET_TouchUpdate) &&
-              event.device_event.flags & TOUCH_POINTER_EMULATED)))
-            miPointerUpdateSprite(dev);
+        if (mieqCanMergeMotion(dev, event)) {
+            tmp = motion;
+            motion = event;
+            event = tmp;
+            motionDev = dev;
+            motionScreen = screen;
+            continue;
+        }
 
-        input_lock();
-    }
+        mieqDeliverEvent(dev, event, screen);
+    } while (more);
 
+    input_lock();
     inProcessInputEvents = FALSE;
 
     CallCallbacks(&miCallbacksWhenDrained, NULL);
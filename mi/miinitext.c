@@ -105,6 +105,9 @@ static const ExtensionModule staticExtensions[] = {
 #ifdef CONFIG_MITSHM
     {ShmExtensionInit, "MIT-SHM", &noMITShmExtension},
 #endif /* CONFIG_MITSHM */
+#ifdef SHMTRANSPORT
+    {ShmTransportExtensionInit, "SHM-TRANSPORT", &noShmTransportExtension},
+#endif
     {XInputExtensionInit, "XInputExtension", NULL},
 #ifdef XTEST
     {XTestExtensionInit, "XTEST", &noTestExtensions},
@@ -157,6 +160,7 @@ static const ExtensionModule staticExtensions[] = {
 #endif
 #ifdef RES
     {ResExtensionInit, "X-Resource", &noResExtension},
+    {DispatchProfileExtensionInit, "DISPATCH-PROFILE", NULL},
 #endif
 #ifdef XV
     {XvExtensionInit, "XVideo", &noXvExtension},
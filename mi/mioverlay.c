@@ -733,6 +733,8 @@ miOverlayValidateTree(WindowPtr pParent, WindowPtr pChild,      /* first child e
     Bool overlap;
     WindowPtr newParent;
 
+    miWindowIndexInvalidate();
+
     if (!pPriv->underlayMarked)
         goto SKIP_UNDERLAY;
 
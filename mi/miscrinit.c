@@ -294,6 +294,9 @@ miScreenInit(ScreenPtr pScreen, void *pbits,  /* pointer to screen bits */
     pScreen->MarkUnrealizedWindow = miMarkUnrealizedWindow;
     pScreen->XYToWindow = miXYToWindow;
 
+    if (!miWindowIndexInit(pScreen))
+        return FALSE;
+
     miSetZeroLineBias(pScreen, DEFAULTZEROLINEBIAS);
 
     return miScreenDevPrivateInit(pScreen, width, pbits, xsize, ysize);
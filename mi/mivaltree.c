@@ -92,6 +92,7 @@ Equipment Corporation.
 
 #include    <X11/X.h>
 
+#include "dix/settings_priv.h"
 #include "dix/window_priv.h"
 #include "mi/mi_priv.h"
 
@@ -172,12 +173,56 @@ miShapedWindowIn(RegionPtr universe, RegionPtr bounding,
 				    HasBorder(w) && \
 				    (w)->backgroundState == ParentRelative)
 
+/*
+ * A marked window that stayed in place and kept its size, and is given
+ * exactly the area it had before, keeps its clips: the old borderClip sums
+ * up everything obscuring it, and its clipList and those of its inferiors
+ * follow from that and their geometry, which didn't change either.
+ */
+static Bool
+miClipsUnchanged(WindowPtr pWin, RegionPtr universe, int dx, int dy)
+{
+    return !dx && !dy &&
+        !pWin->valdata->before.resized &&
+        !pWin->valdata->before.borderVisible &&
+        !RegionBroken(&pWin->clipList) &&
+        RegionEqual(universe, &pWin->borderClip);
+}
+
+/* nothing got exposed in pParent or its marked inferiors */
+static void
+miKeepClips(WindowPtr pParent)
+{
+    WindowPtr pChild = pParent;
+
+    while (1) {
+        if (pChild->viewable) {
+            if (pChild->valdata) {
+                if (pChild->valdata->before.borderVisible)
+                    RegionDestroy(pChild->valdata->before.borderVisible);
+                RegionNull(&pChild->valdata->after.borderExposed);
+                RegionNull(&pChild->valdata->after.exposed);
+            }
+            if (pChild->firstChild) {
+                pChild = pChild->firstChild;
+                continue;
+            }
+        }
+        while (!pChild->nextSib && (pChild != pParent))
+            pChild = pChild->parent;
+        if (pChild == pParent)
+            break;
+        pChild = pChild->nextSib;
+    }
+}
+
 /*
  *-----------------------------------------------------------------------
  * miComputeClips --
  *	Recompute the clipList, borderClip, exposed and borderExposed
  *	regions for pParent and its children. Only viewable windows are
- *	taken into account.
+ *	taken into account. With incremental set, windows that keep
+ *	their clips are skipped along with their inferiors.
  *
  * Results:
  *	None.
@@ -191,9 +236,11 @@ miShapedWindowIn(RegionPtr universe, RegionPtr bounding,
 static void
 miComputeClips(WindowPtr pParent,
                ScreenPtr pScreen,
-               RegionPtr universe, VTKind kind, RegionPtr exposed)
+               RegionPtr universe, VTKind kind, RegionPtr exposed,
+               Bool incremental)
 {                               /* for intermediate calculations */
     int dx, dy;
+    Bool resized;
     RegionRec childUniverse;
     WindowPtr pChild;
     int oldVis, newVis;
@@ -270,6 +317,13 @@ miComputeClips(WindowPtr pParent,
 
     dx = pParent->drawable.x - pParent->valdata->before.oldAbsCorner.x;
     dy = pParent->drawable.y - pParent->valdata->before.oldAbsCorner.y;
+    resized = pParent->valdata->before.resized;
+
+    if (incremental && oldVis != VisibilityNotViewable &&
+        miClipsUnchanged(pParent, universe, dx, dy)) {
+        miKeepClips(pParent);
+        return;
+    }
 
     /*
      * avoid computations when dealing with simple operations
@@ -419,7 +473,7 @@ miComputeClips(WindowPtr pParent,
                     RegionIntersect(&childUniverse,
                                     universe, &pChild->borderSize);
                     miComputeClips(pChild, pScreen, &childUniverse, kind,
-                                   exposed);
+                                   exposed, incremental && !resized);
                 }
                 /*
                  * Once the child has been processed, we remove its extents
@@ -557,11 +611,15 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
     Bool overlap;
     int viewvals;
     Bool forward;
+    Bool incremental;
 
     pScreen = pParent->drawable.pScreen;
     if (pChild == NullWindow)
         pChild = pParent->firstChild;
 
+    /* children of pParent changed, the pointer lookup grids are stale */
+    miWindowIndexInvalidate();
+
     RegionNull(&childClip);
     RegionNull(&exposed);
 
@@ -623,6 +681,13 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
         RegionValidate(&totalClip, &overlap);
     }
 
+    /*
+     * a resized parent may have clipped its children differently, they
+     * can't keep their clips then
+     */
+    incremental = dixSettingIncrementalClips && kind != VTBroken &&
+        !pParent->valdata->before.resized;
+
     /*
      * Now go through the children of the root and figure their new
      * borderClips from the totalClip, passing that off to miComputeClips
@@ -669,7 +734,8 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
         if (pWin->viewable) {
             if (pWin->valdata) {
                 RegionIntersect(&childClip, &totalClip, &pWin->borderSize);
-                miComputeClips(pWin, pScreen, &childClip, kind, &exposed);
+                miComputeClips(pWin, pScreen, &childClip, kind, &exposed,
+                               incremental);
                 if (overlap && !TreatAsTransparent(pWin)) {
                     RegionSubtract(&totalClip, &totalClip, &pWin->borderSize);
                 }
@@ -0,0 +1,333 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Spatial index over the mapped children of a window
+ *
+ * miSpriteTrace() has to find the topmost child containing the pointer at
+ * every level of the tree on each motion event. With thousands of
+ * toplevels (override-redirect popups, input-only windows of a compositing
+ * manager, ...) walking the sibling list gets expensive, so windows with
+ * many mapped children get a uniform grid over the children's border boxes.
+ * Each cell lists the children overlapping it in stacking order, topmost
+ * first; the caller still does the exact (shape, input shape) test on them.
+ *
+ * The grids are thrown away as a whole whenever the window tree is
+ * restructured: WindowsRestructured(), ValidateTree and window destruction
+ * bump a generation counter. Stale grids are rebuilt lazily, only for the
+ * parents the pointer actually descends through, and only once the tree
+ * has been stable for long enough to pay off.
+ */
+#include <dix-config.h>
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+
+#include "dix/screen_hooks_priv.h"
+#include "mi/mi_priv.h"
+
+#include "privates.h"
+#include "scrnintstr.h"
+#include "windowstr.h"
+
+/* with fewer mapped children than this, walking them is just as fast */
+#define MI_WINDOW_INDEX_MIN_CHILDREN    32
+/* grid size limit, in cells per dimension */
+#define MI_WINDOW_INDEX_MAX_DIM         64
+/* coarsen the grid while children are listed more often than this on average */
+#define MI_WINDOW_INDEX_MAX_REFS        8
+/* rebuild cost, in children walked per mapped child */
+#define MI_WINDOW_INDEX_REBUILD_COST    4
+
+typedef struct {
+    int x1, y1, x2, y2;
+} miWindowIndexBoxRec;
+
+typedef struct {
+    miWindowIndexBoxRec box;
+    WindowPtr pWin;
+} miWindowIndexChildRec;
+
+typedef struct {
+    uint64_t generation;        /* matches miWindowIndexGeneration if valid */
+    int numChildren;            /* mapped children when last built */
+    /* children walked linearly since the grid went stale */
+    uint64_t staleGeneration;
+    int staleWalked;
+    miWindowIndexBoxRec extents;        /* union of the children's boxes */
+    int cols, rows;             /* grid size, 0 if not indexed */
+    int shiftX, shiftY;         /* log2 of the cell size */
+    int *cells;                 /* cols * rows + 1 offsets into wins */
+    WindowPtr *wins;
+    int winsSize;
+    /* scratch space for building: mapped children in stacking order */
+    miWindowIndexChildRec *children;
+    int childrenSize;
+} miWindowIndexRec, *miWindowIndexPtr;
+
+static DevPrivateKeyRec miWindowIndexKeyRec;
+
+#define miWindowIndexKey (&miWindowIndexKeyRec)
+
+static uint64_t miWindowIndexGeneration = 1;
+
+/* the cells a box covers, as inclusive ranges */
+static inline void
+miWindowIndexCells(miWindowIndexPtr index, const miWindowIndexBoxRec *box,
+                   int *c1, int *r1, int *c2, int *r2)
+{
+    *c1 = (box->x1 - index->extents.x1) >> index->shiftX;
+    *r1 = (box->y1 - index->extents.y1) >> index->shiftY;
+    *c2 = (box->x2 - 1 - index->extents.x1) >> index->shiftX;
+    *r2 = (box->y2 - 1 - index->extents.y1) >> index->shiftY;
+}
+
+/* power of two cells, so that at most dim of them cover the extents */
+static void
+miWindowIndexSetDim(miWindowIndexPtr index, int dim)
+{
+    int width = index->extents.x2 - index->extents.x1;
+    int height = index->extents.y2 - index->extents.y1;
+
+    for (index->shiftX = 0; (width - 1) >> index->shiftX >= dim; index->shiftX++);
+    for (index->shiftY = 0; (height - 1) >> index->shiftY >= dim; index->shiftY++);
+    index->cols = ((width - 1) >> index->shiftX) + 1;
+    index->rows = ((height - 1) >> index->shiftY) + 1;
+}
+
+/* what is only needed while there's a grid */
+static void
+miWindowIndexFreeGrid(miWindowIndexPtr index)
+{
+    free(index->cells);
+    free(index->wins);
+    free(index->children);
+    index->cells = NULL;
+    index->wins = NULL;
+    index->children = NULL;
+    index->winsSize = index->childrenSize = 0;
+    index->cols = index->rows = 0;
+}
+
+static void
+miWindowIndexFree(miWindowIndexPtr index)
+{
+    miWindowIndexFreeGrid(index);
+    free(index);
+}
+
+/* snapshot the mapped children, so the passes below don't chase pointers */
+static int
+miWindowIndexGatherChildren(miWindowIndexPtr index, WindowPtr pParent)
+{
+    miWindowIndexChildRec *child;
+    WindowPtr pWin;
+    int num = 0;
+
+    index->extents = (miWindowIndexBoxRec) { INT_MAX, INT_MAX, INT_MIN, INT_MIN };
+    for (pWin = pParent->firstChild; pWin; pWin = pWin->nextSib) {
+        int bw = wBorderWidth(pWin);
+
+        if (!pWin->mapped)
+            continue;
+        if (num == index->childrenSize) {
+            int size = num ? num * 2 : MI_WINDOW_INDEX_MIN_CHILDREN;
+
+            child = reallocarray(index->children, size, sizeof(*child));
+            if (!child)
+                return 0;
+            index->children = child;
+            index->childrenSize = size;
+        }
+        child = &index->children[num++];
+        child->pWin = pWin;
+        child->box.x1 = pWin->drawable.x - bw;
+        child->box.y1 = pWin->drawable.y - bw;
+        child->box.x2 = pWin->drawable.x + (int) pWin->drawable.width + bw;
+        child->box.y2 = pWin->drawable.y + (int) pWin->drawable.height + bw;
+        if (child->box.x1 < index->extents.x1)
+            index->extents.x1 = child->box.x1;
+        if (child->box.y1 < index->extents.y1)
+            index->extents.y1 = child->box.y1;
+        if (child->box.x2 > index->extents.x2)
+            index->extents.x2 = child->box.x2;
+        if (child->box.y2 > index->extents.y2)
+            index->extents.y2 = child->box.y2;
+    }
+    return num;
+}
+
+static void
+miWindowIndexBuild(miWindowIndexPtr index, WindowPtr pParent)
+{
+    int num = 0, refs, dim, cells, c1, r1, c2, r2;
+    WindowPtr pWin;
+
+    index->generation = miWindowIndexGeneration;
+    index->cols = index->rows = 0;
+
+    for (pWin = pParent->firstChild; pWin; pWin = pWin->nextSib)
+        num += pWin->mapped;
+    index->numChildren = num;
+    if (num < MI_WINDOW_INDEX_MIN_CHILDREN ||
+        miWindowIndexGatherChildren(index, pParent) != num) {
+        miWindowIndexFreeGrid(index);
+        return;
+    }
+
+    /* about one child per cell, fewer cells if most children are large */
+    for (dim = 1; dim * dim < num && dim < MI_WINDOW_INDEX_MAX_DIM; dim *= 2);
+    for (;; dim /= 2) {
+        miWindowIndexSetDim(index, dim);
+        refs = 0;
+        for (int i = 0; i < num; i++) {
+            miWindowIndexCells(index, &index->children[i].box,
+                               &c1, &r1, &c2, &r2);
+            refs += (c2 - c1 + 1) * (r2 - r1 + 1);
+        }
+        if (dim == 1 || refs <= num * MI_WINDOW_INDEX_MAX_REFS)
+            break;
+    }
+
+    cells = index->cols * index->rows;
+    free(index->cells);
+    index->cells = calloc(cells + 1, sizeof(int));
+    if (refs > index->winsSize) {
+        free(index->wins);
+        index->wins = calloc(refs, sizeof(WindowPtr));
+        index->winsSize = index->wins ? refs : 0;
+    }
+    if (!index->cells || !index->wins) {
+        index->cols = index->rows = 0;
+        return;
+    }
+
+    /* count per cell, turn into end offsets, then fill back to front so
+     * every cell ends up in stacking order */
+    for (int i = 0; i < num; i++) {
+        miWindowIndexCells(index, &index->children[i].box, &c1, &r1, &c2, &r2);
+        for (int r = r1; r <= r2; r++)
+            for (int c = c1; c <= c2; c++)
+                index->cells[r * index->cols + c + 1]++;
+    }
+    for (int i = 1; i <= cells; i++)
+        index->cells[i] += index->cells[i - 1];
+    for (int i = num - 1; i >= 0; i--) {
+        miWindowIndexCells(index, &index->children[i].box, &c1, &r1, &c2, &r2);
+        for (int r = r1; r <= r2; r++)
+            for (int c = c1; c <= c2; c++)
+                index->wins[--index->cells[r * index->cols + c + 1]] =
+                    index->children[i].pWin;
+    }
+    /* cells[i + 1] now is the start of cell i, shift back by one */
+    memmove(index->cells, index->cells + 1, cells * sizeof(int));
+    index->cells[cells] = refs;
+}
+
+static WindowPtr
+miWindowIndexWalk(WindowPtr pParent, int x, int y,
+                  miWindowIndexHitProcPtr hit, int *walked)
+{
+    WindowPtr pWin;
+
+    for (pWin = pParent->firstChild; pWin; pWin = pWin->nextSib) {
+        (*walked)++;
+        if (hit(pWin, x, y))
+            break;
+    }
+    return pWin;
+}
+
+WindowPtr
+miWindowIndexFindChild(WindowPtr pParent, int x, int y,
+                       miWindowIndexHitProcPtr hit)
+{
+    miWindowIndexPtr index;
+    WindowPtr pWin, *wins;
+    int walked = 0, cell, num;
+
+    if (!pParent->firstChild || !dixPrivateKeyRegistered(miWindowIndexKey))
+        return miWindowIndexWalk(pParent, x, y, hit, &walked);
+
+    index = dixLookupPrivate(&pParent->devPrivates, miWindowIndexKey);
+    if (!index) {
+        /* most parents have few children, keep nothing for them */
+        pWin = miWindowIndexWalk(pParent, x, y, hit, &walked);
+        if (walked < MI_WINDOW_INDEX_MIN_CHILDREN)
+            return pWin;
+        index = calloc(1, sizeof(miWindowIndexRec));
+        if (!index)
+            return pWin;
+        dixSetPrivate(&pParent->devPrivates, miWindowIndexKey, index);
+        /* stale, built once the walks pay for it like below */
+        index->staleGeneration = miWindowIndexGeneration;
+        index->staleWalked = walked;
+        index->numChildren = walked;
+        return pWin;
+    }
+
+    if (index->generation != miWindowIndexGeneration) {
+        /*
+         * Rebuilding costs about as much as walking all children a few
+         * times. Only do it once the walks since the last restructure
+         * got that far, so a tree that keeps changing between motion
+         * events costs at most a small factor more than without an index.
+         */
+        if (index->staleGeneration != miWindowIndexGeneration) {
+            index->staleGeneration = miWindowIndexGeneration;
+            index->staleWalked = 0;
+        }
+        pWin = miWindowIndexWalk(pParent, x, y, hit, &walked);
+        index->staleWalked += walked;
+        if (index->staleWalked >= index->numChildren * MI_WINDOW_INDEX_REBUILD_COST)
+            miWindowIndexBuild(index, pParent);
+        return pWin;
+    }
+    if (!index->cols)
+        return miWindowIndexWalk(pParent, x, y, hit, &walked);
+
+    if (x < index->extents.x1 || x >= index->extents.x2 ||
+        y < index->extents.y1 || y >= index->extents.y2)
+        return NullWindow;
+
+    cell = ((y - index->extents.y1) >> index->shiftY) * index->cols +
+        ((x - index->extents.x1) >> index->shiftX);
+    wins = index->wins + index->cells[cell];
+    num = index->cells[cell + 1] - index->cells[cell];
+    for (int i = 0; i < num; i++)
+        if (hit(wins[i], x, y))
+            return wins[i];
+    return NullWindow;
+}
+
+void
+miWindowIndexInvalidate(void)
+{
+    miWindowIndexGeneration++;
+}
+
+static void
+miWindowIndexWindowDestroy(CallbackListPtr *pcbl, ScreenPtr pScreen,
+                           WindowPtr pWin)
+{
+    miWindowIndexPtr index = dixLookupPrivate(&pWin->devPrivates,
+                                              miWindowIndexKey);
+
+    /* the parent's grid may still list it */
+    miWindowIndexInvalidate();
+
+    if (index) {
+        miWindowIndexFree(index);
+        dixSetPrivate(&pWin->devPrivates, miWindowIndexKey, NULL);
+    }
+}
+
+Bool
+miWindowIndexInit(ScreenPtr pScreen)
+{
+    if (!dixRegisterPrivateKey(miWindowIndexKey, PRIVATE_WINDOW, 0))
+        return FALSE;
+    dixScreenHookWindowDestroy(pScreen, miWindowIndexWindowDestroy);
+    return TRUE;
+}
@@ -123,6 +123,148 @@ getDrawableDamageRef(DrawablePtr pDrawable)
     DamagePtr	*pPrev = (DamagePtr *) \
 	dixLookupPrivateAddr(&(pWindow)->devPrivates, damageWinPrivateKey)
 
+/*
+ * Batching of damage
+ *
+ * Adding every small drawing operation to the damage region of every
+ * listener costs a region union each, which adds up for clients doing
+ * thousands of small fills or glyphs against compositor, shadow and
+ * DAMAGE extension listeners at the same time. Where the union wouldn't
+ * be reported right away, the boxes are only collected, and added to the
+ * region in one go when someone looks at it, and at the latest in the
+ * block handler.
+ */
+
+/* boxes collected per damage before they have to be added */
+#define DAMAGE_BATCH_BOXES      128
+
+/*
+ * Whether adding pRegion to pDamage can wait: the owner only ever looks at
+ * the accumulated region, or wouldn't be told about this part of it.
+ */
+static Bool
+damageCanBatch(DamagePtr pDamage, RegionPtr pRegion)
+{
+    BoxPtr pExtents, pBox;
+
+    if (RegionNumRects(pRegion) > DAMAGE_BATCH_BOXES / 4)
+        return FALSE;
+    if (!pDamage->damageReport)
+        return TRUE;
+
+    switch (pDamage->damageLevel) {
+    case DamageReportNone:
+        return TRUE;
+    case DamageReportNonEmpty:
+        return RegionNotEmpty(&pDamage->damage);
+    case DamageReportBoundingBox:
+        /* batched boxes never grow the extents */
+        if (!RegionNotEmpty(&pDamage->damage))
+            return FALSE;
+        pExtents = RegionExtents(&pDamage->damage);
+        pBox = RegionExtents(pRegion);
+        return (pBox->x1 >= pExtents->x1 && pBox->y1 >= pExtents->y1 &&
+                pBox->x2 <= pExtents->x2 && pBox->y2 <= pExtents->y2);
+    default:
+        return FALSE;
+    }
+}
+
+static void
+damageBatchFlush(DamagePtr pDamage)
+{
+    RegionRec region;
+
+    if (!pDamage->nbatch)
+        return;
+
+    if (!RegionInitBoxes(&region, pDamage->batch, pDamage->nbatch)) {
+        RegionUninit(&region);
+        RegionInit(&region, &pDamage->batchExtents, 1);
+    }
+    RegionUnion(&pDamage->damage, &pDamage->damage, &region);
+    RegionUninit(&region);
+
+    pDamage->nbatch = 0;
+    xorg_list_del(&pDamage->batchEntry);
+}
+
+static void
+damageBatchRegion(DamagePtr pDamage, RegionPtr pRegion)
+{
+    BoxPtr pBox = RegionRects(pRegion);
+    int nBox = RegionNumRects(pRegion);
+
+    if (!pDamage->batch) {
+        pDamage->batch = calloc(DAMAGE_BATCH_BOXES, sizeof(BoxRec));
+        if (!pDamage->batch) {
+            RegionUnion(&pDamage->damage, &pDamage->damage, pRegion);
+            return;
+        }
+    }
+
+    if (pDamage->nbatch + nBox > DAMAGE_BATCH_BOXES) {
+        BoxPtr pExtents = &pDamage->batchExtents;
+        int64_t area = (int64_t) (pExtents->x2 - pExtents->x1) *
+            (pExtents->y2 - pExtents->y1);
+        int64_t covered = 0;
+        RegionRec region;
+        BoxPtr pRect;
+
+        /* the batched boxes may overlap, the region's don't */
+        if (!RegionInitBoxes(&region, pDamage->batch, pDamage->nbatch)) {
+            RegionUninit(&region);
+            RegionInit(&region, pExtents, 1);
+        }
+        pRect = RegionRects(&region);
+        for (int i = RegionNumRects(&region); i--; pRect++)
+            covered += (int64_t) (pRect->x2 - pRect->x1) *
+                (pRect->y2 - pRect->y1);
+
+        /* mostly covered anyway, make it a single box */
+        if (area <= 2 * covered) {
+            pDamage->batch[0] = *pExtents;
+            pDamage->nbatch = 1;
+        }
+        else {
+            RegionUnion(&pDamage->damage, &pDamage->damage, &region);
+            pDamage->nbatch = 0;
+            xorg_list_del(&pDamage->batchEntry);
+        }
+        RegionUninit(&region);
+    }
+
+    if (!pDamage->nbatch) {
+        damageScrPriv(pDamage->pScreen);
+
+        xorg_list_append(&pDamage->batchEntry, &pScrPriv->batched);
+        pDamage->batchExtents = *pBox;
+    }
+
+    for (; nBox--; pBox++) {
+        BoxPtr pExtents = &pDamage->batchExtents;
+
+        pDamage->batch[pDamage->nbatch++] = *pBox;
+        pExtents->x1 = min(pExtents->x1, pBox->x1);
+        pExtents->y1 = min(pExtents->y1, pBox->y1);
+        pExtents->x2 = max(pExtents->x2, pBox->x2);
+        pExtents->y2 = max(pExtents->y2, pBox->y2);
+    }
+}
+
+static void
+damageBlockHandler(void *blockData, void *timeout)
+{
+    ScreenPtr pScreen = blockData;
+    DamagePtr pDamage, pNext;
+
+    damageScrPriv(pScreen);
+
+    xorg_list_for_each_entry_safe(pDamage, pNext, &pScrPriv->batched,
+                                  batchEntry)
+        damageBatchFlush(pDamage);
+}
+
 #if DAMAGE_DEBUG_ENABLE
 static void
 _damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
@@ -258,7 +400,9 @@ damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
 
         /* Report damage now, if desired. */
         if (!pDamage->reportAfter) {
-            if (pDamage->damageReport)
+            if (damageCanBatch(pDamage, pDamageRegion))
+                damageBatchRegion(pDamage, pDamageRegion);
+            else if (pDamage->damageReport)
                 DamageReportDamage(pDamage, pDamageRegion);
             else
                 RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
@@ -1577,6 +1721,10 @@ static void damageCloseScreen(CallbackListPtr *pcbl, ScreenPtr pScreen, void *un
     if (!pScrPriv)
         return;
 
+    damageBlockHandler(pScreen, NULL);
+    RemoveBlockAndWakeupHandlers(damageBlockHandler,
+                                 (ServerWakeupHandlerProcPtr) NoopDDA, pScreen);
+
     unwrap(pScrPriv, pScreen, CreateGC);
     unwrap(pScrPriv, pScreen, CopyWindow);
 
@@ -1650,14 +1798,15 @@ DamageSetup(ScreenPtr pScreen)
     if (dixLookupPrivate(&pScreen->devPrivates, damageScrPrivateKey))
         return TRUE;
 
-    if (!dixRegisterPrivateKey
+    /* looked up by every drawing operation */
+    if (!dixRegisterHotPrivateKey
         (&damageGCPrivateKeyRec, PRIVATE_GC, sizeof(DamageGCPrivRec)))
         return FALSE;
 
-    if (!dixRegisterPrivateKey(&damagePixPrivateKeyRec, PRIVATE_PIXMAP, 0))
+    if (!dixRegisterHotPrivateKey(&damagePixPrivateKeyRec, PRIVATE_PIXMAP, 0))
         return FALSE;
 
-    if (!dixRegisterPrivateKey(&damageWinPrivateKeyRec, PRIVATE_WINDOW, 0))
+    if (!dixRegisterHotPrivateKey(&damageWinPrivateKeyRec, PRIVATE_WINDOW, 0))
         return FALSE;
 
     DamageScrPrivPtr pScrPriv = calloc(1, sizeof(DamageScrPrivRec));
@@ -1666,6 +1815,14 @@ DamageSetup(ScreenPtr pScreen)
 
     pScrPriv->internalLevel = 0;
     pScrPriv->pScreenDamage = 0;
+    xorg_list_init(&pScrPriv->batched);
+
+    if (!RegisterBlockAndWakeupHandlers(damageBlockHandler,
+                                        (ServerWakeupHandlerProcPtr) NoopDDA,
+                                        pScreen)) {
+        free(pScrPriv);
+        return FALSE;
+    }
 
     dixScreenHookPostClose(pScreen, damageCloseScreen);
     dixScreenHookWindowDestroy(pScreen, damageWindowDestroy);
@@ -1713,6 +1870,7 @@ DamageCreate(DamageReportFunc damageReport,
     pDamage->damageReport = damageReport;
     pDamage->damageDestroy = damageDestroy;
     pDamage->pScreen = pScreen;
+    xorg_list_init(&pDamage->batchEntry);
 
     if (pScrPriv->funcs.Create)
         pScrPriv->funcs.Create (pDamage);
@@ -1824,6 +1982,8 @@ DamageDestroy(DamagePtr pDamage)
     if (pScrPriv->funcs.Destroy)
         pScrPriv->funcs.Destroy (pDamage);
 
+    xorg_list_del(&pDamage->batchEntry);
+    free(pDamage->batch);
     RegionUninit(&pDamage->damage);
     RegionUninit(&pDamage->pendingDamage);
     free(pDamage);
@@ -1836,6 +1996,7 @@ DamageSubtract(DamagePtr pDamage, const RegionPtr pRegion)
     RegionRec pixmapClip;
     DrawablePtr pDrawable = pDamage->pDrawable;
 
+    damageBatchFlush(pDamage);
     RegionSubtract(&pDamage->damage, &pDamage->damage, pRegion);
     if (pDrawable) {
         if (pDrawable->type == DRAWABLE_WINDOW)
@@ -1862,12 +2023,15 @@ DamageSubtract(DamagePtr pDamage, const RegionPtr pRegion)
 void
 DamageEmpty(DamagePtr pDamage)
 {
+    pDamage->nbatch = 0;
+    xorg_list_del(&pDamage->batchEntry);
     RegionEmpty(&pDamage->damage);
 }
 
 RegionPtr
 DamageRegion(DamagePtr pDamage)
 {
+    damageBatchFlush(pDamage);
     return &pDamage->damage;
 }
 
@@ -1922,6 +2086,8 @@ DamageReportDamage(DamagePtr pDamage, RegionPtr pDamageRegion)
     RegionRec tmpRegion;
     Bool was_empty;
 
+    damageBatchFlush(pDamage);
+
     switch (pDamage->damageLevel) {
     case DamageReportRawRegion:
         RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
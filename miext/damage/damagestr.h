@@ -28,6 +28,7 @@
 #endif
 
 #include "damage.h"
+#include "list.h"
 #include "gcstruct.h"
 #include "privates.h"
 #include "picturestr.h"
@@ -49,6 +50,12 @@ typedef struct _damage {
     Bool reportAfter;
     RegionRec pendingDamage;    /* will be flushed post submission at the latest */
     ScreenPtr pScreen;
+
+    /* boxes not yet added to damage, see damageBatchRegion() */
+    BoxPtr batch;
+    int nbatch;
+    BoxRec batchExtents;
+    struct xorg_list batchEntry;    /* on pScrPriv->batched while nbatch */
 } DamageRec;
 
 typedef struct _damageScrPriv {
@@ -72,6 +79,9 @@ typedef struct _damageScrPriv {
 
     /* Table of wrappable function pointers */
     DamageScreenFuncsRec funcs;
+
+    /* damages with batched boxes, flushed in the block handler */
+    struct xorg_list batched;
 } DamageScrPrivRec, *DamageScrPrivPtr;
 
 typedef struct _damageGCPriv {
@@ -22,6 +22,7 @@ extern Bool noScreenSaverExtension;
 extern Bool noSecurityExtension;
 extern Bool noSELinuxExtension;
 extern Bool noShapeExtension;
+extern Bool noShmTransportExtension;
 extern Bool noTestExtensions;
 extern Bool noXFixesExtension;
 extern Bool noXFree86BigfontExtension;
@@ -36,6 +37,7 @@ extern char *namespaceConfigFile;
 void CompositeExtensionInit(void);
 void DamageExtensionInit(void);
 void DbeExtensionInit(void);
+void DispatchProfileExtensionInit(void);
 void DPMSExtensionInit(void);
 void GEExtensionInit(void);
 void GlxExtensionInit(void);
@@ -47,6 +49,7 @@ void ResExtensionInit(void);
 void ScreenSaverExtensionInit(void);
 void ShapeExtensionInit(void);
 void ShmExtensionInit(void);
+void ShmTransportExtensionInit(void);
 void SyncExtensionInit(void);
 void XCMiscExtensionInit(void);
 void SecurityExtensionInit(void);
@@ -98,8 +98,16 @@ SOFTWARE.
 #include <X11/extensions/dpmsconst.h>
 #endif
 
+/*
+ * Armed timers live in a binary min-heap ordered by expiry time, so arming
+ * and cancelling are O(log n) no matter how many timers are pending.  Ties
+ * are broken by arming order, timers expiring at the same time run first
+ * come first served like they always did.  All of it is protected by the
+ * input lock, since input drivers arm timers from the input thread.
+ */
 struct _OsTimerRec {
-    struct xorg_list list;
+    int index;                  /* position in timer heap, -1 if not armed */
+    CARD32 seq;
     CARD32 expires;
     CARD32 delta;
     OsTimerCallback callback;
@@ -108,15 +116,90 @@ struct _OsTimerRec {
 
 static void DoTimer(OsTimerPtr timer, CARD32 now);
 static void CheckAllTimers(void);
-static volatile struct xorg_list timers;
+static OsTimerPtr *timerHeap;
+static int numTimers;
+static int sizeTimers;
+static CARD32 timerSeq;
+
+static inline Bool
+timer_before(OsTimerPtr a, OsTimerPtr b)
+{
+    int d = (int) (a->expires - b->expires);
+
+    return d < 0 || (d == 0 && (int) (a->seq - b->seq) < 0);
+}
+
+static inline void
+timer_heap_place(OsTimerPtr timer, int i)
+{
+    timerHeap[i] = timer;
+    timer->index = i;
+}
+
+static void
+timer_heap_up(OsTimerPtr timer, int i)
+{
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+
+        if (!timer_before(timer, timerHeap[parent]))
+            break;
+        timer_heap_place(timerHeap[parent], i);
+        i = parent;
+    }
+    timer_heap_place(timer, i);
+}
+
+static void
+timer_heap_down(OsTimerPtr timer, int i)
+{
+    for (;;) {
+        int child = 2 * i + 1;
+
+        if (child >= numTimers)
+            break;
+        if (child + 1 < numTimers &&
+            timer_before(timerHeap[child + 1], timerHeap[child]))
+            child++;
+        if (!timer_before(timerHeap[child], timer))
+            break;
+        timer_heap_place(timerHeap[child], i);
+        i = child;
+    }
+    timer_heap_place(timer, i);
+}
+
+static void
+timer_heap_insert(OsTimerPtr timer)
+{
+    if (numTimers == sizeTimers) {
+        sizeTimers = sizeTimers ? sizeTimers * 2 : 64;
+        timerHeap = XNFreallocarray(timerHeap, sizeTimers, sizeof(OsTimerPtr));
+    }
+    timer->seq = timerSeq++;
+    timer_heap_up(timer, numTimers++);
+}
+
+static void
+timer_heap_remove(OsTimerPtr timer)
+{
+    int i = timer->index;
+    OsTimerPtr last;
+
+    timer->index = -1;
+    last = timerHeap[--numTimers];
+    if (last == timer)
+        return;
+    if (i > 0 && timer_before(last, timerHeap[(i - 1) / 2]))
+        timer_heap_up(last, i);
+    else
+        timer_heap_down(last, i);
+}
 
 static inline OsTimerPtr
 first_timer(void)
 {
-    /* inline xorg_list_is_empty which can't handle volatile */
-    if (timers.next == &timers)
-        return NULL;
-    return xorg_list_first_entry(&timers, struct _OsTimerRec, list);
+    return numTimers ? timerHeap[0] : NULL;
 }
 
 /*
@@ -127,16 +210,25 @@ static int
 check_timers(void)
 {
     OsTimerPtr timer;
+    CARD32 expires, delta;
+
+    input_lock();
+    timer = first_timer();
+    if (timer) {
+        expires = timer->expires;
+        delta = timer->delta;
+    }
+    input_unlock();
 
-    if ((timer = first_timer()) != NULL) {
+    if (timer) {
         CARD32 now = GetTimeInMillis();
-        int timeout = timer->expires - now;
+        int timeout = expires - now;
 
         if (timeout <= 0) {
             DoTimers(now);
         } else {
             /* Make sure the timeout is sane */
-            if (timeout < timer->delta + 250)
+            if (timeout < delta + 250)
                 return timeout;
 
             /* time has rewound.  reset the timers. */
@@ -242,11 +334,11 @@ AdjustWaitForDelay(void *waitTime, int newdelay)
 }
 
 static inline Bool timer_pending(OsTimerPtr timer) {
-    return !xorg_list_is_empty(&timer->list);
+    return timer->index >= 0;
 }
 
 /* If time has rewound, re-run every affected timer.
- * Timers might drop out of the list, so we have to restart every time. */
+ * Timers might drop out of the heap, so we have to restart every time. */
 static void
 CheckAllTimers(void)
 {
@@ -257,7 +349,8 @@ CheckAllTimers(void)
  start:
     now = GetTimeInMillis();
 
-    xorg_list_for_each_entry(timer, &timers, list) {
+    for (int i = 0; i < numTimers; i++) {
+        timer = timerHeap[i];
         if (timer->expires - now > timer->delta + 250) {
             DoTimer(timer, now);
             goto start;
@@ -271,7 +364,7 @@ DoTimer(OsTimerPtr timer, CARD32 now)
 {
     CARD32 newTime;
 
-    xorg_list_del(&timer->list);
+    timer_heap_remove(timer);
     newTime = (*timer->callback) (timer, now, timer->arg);
     if (newTime)
         TimerSet(timer, 0, newTime, timer->callback, timer->arg);
@@ -294,19 +387,18 @@ OsTimerPtr
 TimerSet(OsTimerPtr timer, int flags, CARD32 millis,
          OsTimerCallback func, void *arg)
 {
-    OsTimerPtr existing;
     CARD32 now = GetTimeInMillis();
 
     if (!timer) {
         timer = calloc(1, sizeof(struct _OsTimerRec));
         if (!timer)
             return NULL;
-        xorg_list_init(&timer->list);
+        timer->index = -1;
     }
     else {
         input_lock();
         if (timer_pending(timer)) {
-            xorg_list_del(&timer->list);
+            timer_heap_remove(timer);
             if (flags & TimerForceOld)
                 (void) (*timer->callback) (timer, now, timer->arg);
         }
@@ -326,12 +418,7 @@ TimerSet(OsTimerPtr timer, int flags, CARD32 millis,
     timer->arg = arg;
     input_lock();
 
-    /* Sort into list */
-    xorg_list_for_each_entry(existing, &timers, list)
-        if ((int) (existing->expires - millis) > 0)
-            break;
-    /* This even works at the end of the list -- existing->list will be timers */
-    xorg_list_append(&timer->list, &existing->list);
+    timer_heap_insert(timer);
 
     /* Check to see if the timer is ready to run now */
     if ((int) (millis - now) <= 0)
@@ -360,7 +447,8 @@ TimerCancel(OsTimerPtr timer)
     if (!timer)
         return;
     input_lock();
-    xorg_list_del(&timer->list);
+    if (timer_pending(timer))
+        timer_heap_remove(timer);
     input_unlock();
 }
 
@@ -376,16 +464,10 @@ TimerFree(OsTimerPtr timer)
 void
 TimerInit(void)
 {
-    static Bool been_here;
-    OsTimerPtr timer, tmp;
-
-    if (!been_here) {
-        been_here = TRUE;
-        xorg_list_init((struct xorg_list*) &timers);
-    }
+    while (numTimers) {
+        OsTimerPtr timer = timerHeap[--numTimers];
 
-    xorg_list_for_each_entry_safe(timer, tmp, &timers, list) {
-        xorg_list_del(&timer->list);
+        timer->index = -1;
         free(timer);
     }
 }
@@ -1296,10 +1296,10 @@ static int _XSERVTransSocketRead (
 #endif /* WIN32 */
 }
 
-static ssize_t _XSERVTransSocketWrite (
-    XtransConnInfo ciptr, const char *buf, size_t size)
+static ssize_t _XSERVTransSocketWritev (
+    XtransConnInfo ciptr, struct iovec *iov, int iovcnt)
 {
-    prmsg (2,"SocketWrite(%d,%p,%lu)\n", ciptr->fd, (void *) buf, (unsigned long)size);
+    prmsg (2,"SocketWritev(%d,%p,%d)\n", ciptr->fd, (void *) iov, iovcnt);
 
 #if XTRANS_SEND_FDS
     if (ciptr->send_fds)
@@ -1307,15 +1307,11 @@ static ssize_t _XSERVTransSocketWrite (
         union fd_pass           cmsgbuf;
         int                     nfd = nFd(&ciptr->send_fds);
         struct _XtransConnFd    *cf = ciptr->send_fds;
-        struct iovec iov = {
-            .iov_len = size,
-            .iov_base = (char*)buf,
-        };
         struct msghdr           msg = {
             .msg_name = NULL,
             .msg_namelen = 0,
-            .msg_iov = &iov,
-            .msg_iovlen = 1,
+            .msg_iov = iov,
+            .msg_iovlen = iovcnt,
             .msg_control = cmsgbuf.buf,
             .msg_controllen = CMSG_LEN(nfd * sizeof(int))
         };
@@ -1342,14 +1338,26 @@ static ssize_t _XSERVTransSocketWrite (
 #endif
 
 #ifdef WIN32
-    int ret = send ((SOCKET)ciptr->fd, buf, size, 0);
+    /* no gather write here, a short write of the first chunk will do */
+    int ret = send ((SOCKET)ciptr->fd, iov[0].iov_base, iov[0].iov_len, 0);
     if (ret == SOCKET_ERROR) errno = WSAGetLastError();
     return ret;
 #else
-    return write (ciptr->fd, buf, size);
+    return writev (ciptr->fd, iov, iovcnt);
 #endif
 }
 
+static ssize_t _XSERVTransSocketWrite (
+    XtransConnInfo ciptr, const char *buf, size_t size)
+{
+    struct iovec iov = {
+        .iov_len = size,
+        .iov_base = (char*)buf,
+    };
+
+    return _XSERVTransSocketWritev(ciptr, &iov, 1);
+}
+
 static int _XSERVTransSocketDisconnect (XtransConnInfo ciptr)
 {
     prmsg (2,"SocketDisconnect(%p,%d)\n", (void *) ciptr, ciptr->fd);
@@ -1439,6 +1447,7 @@ static Xtransport _XSERVTransSocketTCPFuncs = {
 	_XSERVTransSocketINETAccept,
 	_XSERVTransSocketRead,
 	_XSERVTransSocketWrite,
+	_XSERVTransSocketWritev,
 #if XTRANS_SEND_FDS
 	_XSERVTransSocketSendFdInvalid,
 	_XSERVTransSocketRecvFdInvalid,
@@ -1461,6 +1470,7 @@ static Xtransport _XSERVTransSocketINETFuncs = {
 	_XSERVTransSocketINETAccept,
 	_XSERVTransSocketRead,
 	_XSERVTransSocketWrite,
+	_XSERVTransSocketWritev,
 #if XTRANS_SEND_FDS
 	_XSERVTransSocketSendFdInvalid,
 	_XSERVTransSocketRecvFdInvalid,
@@ -1484,6 +1494,7 @@ static Xtransport _XSERVTransSocketINET6Funcs = {
 	_XSERVTransSocketINETAccept,
 	_XSERVTransSocketRead,
 	_XSERVTransSocketWrite,
+	_XSERVTransSocketWritev,
 #if XTRANS_SEND_FDS
 	_XSERVTransSocketSendFdInvalid,
 	_XSERVTransSocketRecvFdInvalid,
@@ -1512,6 +1523,7 @@ static Xtransport _XSERVTransSocketLocalFuncs = {
 	_XSERVTransSocketUNIXAccept,
 	_XSERVTransSocketRead,
 	_XSERVTransSocketWrite,
+	_XSERVTransSocketWritev,
 #if XTRANS_SEND_FDS
 	_XSERVTransSocketSendFd,
 	_XSERVTransSocketRecvFd,
@@ -1540,6 +1552,7 @@ static Xtransport _XSERVTransSocketUNIXFuncs = {
 	_XSERVTransSocketUNIXAccept,
 	_XSERVTransSocketRead,
 	_XSERVTransSocketWrite,
+	_XSERVTransSocketWritev,
 #if XTRANS_SEND_FDS
 	_XSERVTransSocketSendFd,
 	_XSERVTransSocketRecvFd,
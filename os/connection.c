@@ -101,6 +101,7 @@ SOFTWARE.
 #include "os/log_priv.h"
 #include "os/osdep.h"
 #include "os/probes_priv.h"
+#include "os/shmring_priv.h"
 
 #include "misc.h"               /* for typedef of pointer */
 #include "dixstruct_priv.h"
@@ -563,8 +564,15 @@ ClientReady(int fd, int xevents, void *data)
         CloseDownClient(client);
         return;
     }
-    if (xevents & X_NOTIFY_READ)
+    if (xevents & X_NOTIFY_READ) {
+#ifdef SHMTRANSPORT
+        OsCommPtr oc = client->osPrivate;
+
+        if (oc->ring)
+            OsShmRingSocketReadable(oc);
+#endif
         mark_client_ready(client);
+    }
     if (xevents & X_NOTIFY_WRITE) {
         ospoll_mute(server_poll, fd, X_NOTIFY_WRITE);
         NewOutputPending = TRUE;
@@ -713,6 +721,9 @@ CloseDownFileDescriptor(OsCommPtr oc)
         XdmcpCloseDisplay(connection);
 #endif
         ospoll_remove(server_poll, connection);
+#ifdef SHMTRANSPORT
+        OsShmRingDetach(oc);
+#endif
         _XSERVTransDisconnect(oc->trans_conn);
         _XSERVTransClose(oc->trans_conn);
         oc->trans_conn = NULL;
@@ -1056,8 +1067,14 @@ set_poll_client(ClientPtr client)
     OsCommPtr oc = (OsCommPtr) client->osPrivate;
 
     if (oc->trans_conn) {
-        if (listen_to_client(client))
+        if (listen_to_client(client)) {
             ospoll_listen(server_poll, oc->trans_conn->fd, X_NOTIFY_READ);
+#ifdef SHMTRANSPORT
+            /* wakeups from the rings aren't kept while not listening */
+            if (oc->ring && OsShmRingPending(oc))
+                mark_client_ready(client);
+#endif
+        }
         else
             ospoll_mute(server_poll, oc->trans_conn->fd, X_NOTIFY_READ);
     }
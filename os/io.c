@@ -78,6 +78,7 @@ SOFTWARE.
 #include "os/io_priv.h"
 #include "os/osdep.h"
 #include "os/ossock.h"
+#include "os/shmring_priv.h"
 
 #include "os.h"
 #include "opaque.h"
@@ -97,11 +98,30 @@ typedef struct _connectionInput {
     unsigned int ignoreBytes;   /* bytes to ignore before the next request */
 } ConnectionInput;
 
+/*
+ * Large payloads can be queued by reference instead of being copied into
+ * the output buffer: each OutputRef is written out after the first bufpos
+ * bytes of buf still pending, so buffered and referenced data keep their
+ * order.  FlushClient() gathers both into one writev().
+ */
+typedef struct _outputRef {
+    const char *data;
+    size_t size;
+    size_t pad;
+    size_t sent;                /* bytes of data + pad already written */
+    int bufpos;
+    OsReleaseProcPtr release;   /* NULL: borrowed until WriteToClient returns */
+    void *closure;
+} OutputRef;
+
 typedef struct _connectionOutput {
     struct _connectionOutput *next;
     unsigned char *buf;
     int size;
     int count;
+    OutputRef *refs;
+    int numRefs;
+    int sizeRefs;
 } ConnectionOutput;
 
 static ConnectionInputPtr AllocateInputBuffer(void);
@@ -125,6 +145,22 @@ static OsCommPtr AvailableInput = (OsCommPtr) NULL;
 #define BUFSIZE 16384
 #define BUFWATERMARK 32768
 
+/*
+ * Input buffers adapt to the client: a read that fills all free space
+ * means more is waiting, so the next buffer is doubled (up to
+ * INPUT_BUFSIZE_MAX) and streaming clients need fewer read() calls.
+ * After INPUT_SHRINK_READS reads in a row that used less than a quarter
+ * of it, the size is halved again.
+ */
+#define INPUT_BUFSIZE_MAX (16 * BUFSIZE)
+#define INPUT_SHRINK_READS 16
+
+/* writes at least this big are sent from the caller's memory if possible */
+#define OUTPUT_REF_MIN 4096
+#define OUTPUT_IOV_MAX 64
+
+static OsIOStatsRec ioStats;
+
 /*
  *   A lot of the code in this file manipulates a ConnectionInputPtr:
  *
@@ -229,6 +265,54 @@ NextAvailableInput(OsCommPtr oc)
     }
 }
 
+/* the SHM-TRANSPORT rings take over from the socket once attached */
+static inline int
+ClientRead(OsCommPtr oc, char *buf, int size)
+{
+#ifdef SHMTRANSPORT
+    if (oc->ring)
+        return OsShmRingRead(oc, buf, size);
+#endif
+    return _XSERVTransRead(oc->trans_conn, buf, size);
+}
+
+static inline ssize_t
+ClientWritev(OsCommPtr oc, struct iovec *iov, int iovcnt)
+{
+#ifdef SHMTRANSPORT
+    if (oc->ring)
+        return OsShmRingWritev(oc, iov, iovcnt);
+#endif
+    return _XSERVTransWritev(oc->trans_conn, iov, iovcnt);
+}
+
+static inline int
+InputBufferSize(OsCommPtr oc)
+{
+    return oc->input_size ? oc->input_size : BUFSIZE;
+}
+
+/* adjust the client's input buffer size to what the last read got */
+static void
+InputBufferAdapt(OsCommPtr oc, int got, int avail)
+{
+    int size = InputBufferSize(oc);
+
+    if (got == avail && got >= size / 2) {
+        oc->input_small_reads = 0;
+        if (size < INPUT_BUFSIZE_MAX)
+            oc->input_size = size * 2;
+    }
+    else if (got < size / 4 && size > BUFSIZE) {
+        if (++oc->input_small_reads >= INPUT_SHRINK_READS) {
+            oc->input_small_reads = 0;
+            oc->input_size = size / 2;
+        }
+    }
+    else
+        oc->input_small_reads = 0;
+}
+
 int
 ReadRequestFromClient(ClientPtr client)
 {
@@ -332,16 +416,18 @@ ReadRequestFromClient(ClientPtr client)
             if ((gotnow > 0) && (oci->bufptr != oci->buffer))
                 /* save the data we've already read */
                 memmove(oci->buffer, oci->bufptr, gotnow);
-            if (needed > oci->size) {
-                /* make buffer bigger to accommodate request */
+            if (needed > oci->size || oci->size < InputBufferSize(oc)) {
+                /* make buffer bigger to accommodate request, or to read
+                   more at once from a client that's streaming */
+                int newsize = max(needed, InputBufferSize(oc));
                 char *ibuf;
 
-                ibuf = (char *) realloc(oci->buffer, needed);
+                ibuf = (char *) realloc(oci->buffer, newsize);
                 if (!ibuf) {
                     YieldControlDeath();
                     return -1;
                 }
-                oci->size = needed;
+                oci->size = newsize;
                 oci->buffer = ibuf;
             }
             oci->bufptr = oci->buffer;
@@ -359,10 +445,13 @@ ReadRequestFromClient(ClientPtr client)
             YieldControlDeath();
             return -1;
         }
-        result = _XSERVTransRead(oc->trans_conn, oci->buffer + oci->bufcnt,
-                                 oci->size - oci->bufcnt);
+        int avail = oci->size - oci->bufcnt;
+
+        ioStats.reads++;
+        result = ClientRead(oc, oci->buffer + oci->bufcnt, avail);
         if (result <= 0) {
             if ((result < 0) && ossock_wouldblock(errno)) {
+                ioStats.readsWouldBlock++;
                 mark_client_not_ready(client);
                 YieldControlNoInput(client);
                 return 0;
@@ -370,16 +459,19 @@ ReadRequestFromClient(ClientPtr client)
             YieldControlDeath();
             return -1;
         }
+        ioStats.bytesRead += result;
+        InputBufferAdapt(oc, result, avail);
         oci->bufcnt += result;
         gotnow += result;
         /* free up some space after huge requests */
-        if ((oci->size > BUFWATERMARK) &&
-            (oci->bufcnt < BUFSIZE) && (needed < BUFSIZE)) {
+        int keep = max(BUFSIZE, InputBufferSize(oc));
+        if ((oci->size > max(BUFWATERMARK, keep)) &&
+            (oci->bufcnt < keep) && (needed < keep)) {
             char *ibuf;
 
-            ibuf = (char *) realloc(oci->buffer, BUFSIZE);
+            ibuf = (char *) realloc(oci->buffer, keep);
             if (ibuf) {
-                oci->size = BUFSIZE;
+                oci->size = keep;
                 oci->buffer = ibuf;
                 oci->bufptr = ibuf + oci->bufcnt - gotnow;
             }
@@ -460,6 +552,7 @@ ReadRequestFromClient(ClientPtr client)
         client->req_len -= bytes_to_int32(sizeof(xBigReq) - sizeof(xReq));
     }
     client->requestBuffer = (void *) oci->bufptr;
+    ioStats.requests++;
 #ifdef DEBUG_COMMUNICATION
     {
         xReq *req = client->requestBuffer;
@@ -495,6 +588,9 @@ WriteFdToClient(ClientPtr client, int fd, Bool do_close)
 #if XTRANS_SEND_FDS
     OsCommPtr oc = (OsCommPtr) client->osPrivate;
 
+    /* they'd need data on the socket to go along with */
+    if (oc->ring)
+        return -1;
     return _XSERVTransSendFd(oc->trans_conn, fd, do_close);
 #else
     return -1;
@@ -703,6 +799,7 @@ memcpy_and_flush(ClientPtr who, OsCommPtr oc, const void* extra_buf, size_t extr
     oco->count += extra_size;
     memset(oco->buf + oco->count, 0, padsize);
     oco->count += padsize;
+    ioStats.bytesCopied += extra_size;
     return (FlushClient(who, oc) == -1) ? -1 : extra_size; /* return the requested size, or fail */
 }
 
@@ -759,6 +856,252 @@ OutputBufferMakeRoomAndFlush(ClientPtr who, OsCommPtr oc, const void* extra_buf,
     return memcpy_and_flush(who, oc, extra_buf, extra_size, padsize);
 }
 
+static void
+CallReplyCallback(ClientPtr who, const char *buf, int count, int padBytes)
+{
+    ReplyInfoRec replyinfo;
+
+    replyinfo.client = who;
+    replyinfo.replyData = buf;
+    replyinfo.dataLenBytes = count + padBytes;
+    replyinfo.padBytes = padBytes;
+    if (who->replyBytesRemaining) { /* still sending data of an earlier reply */
+        who->replyBytesRemaining -= count + padBytes;
+        replyinfo.startOfReply = FALSE;
+        replyinfo.bytesRemaining = who->replyBytesRemaining;
+        CallCallbacks((&ReplyCallback), (void *) &replyinfo);
+    }
+    else if (who->clientState == ClientStateRunning && buf[0] == X_Reply) { /* start of new reply */
+        CARD32 replylen;
+        unsigned long bytesleft;
+
+        replylen = ((const xGenericReply *) buf)->length;
+        if (who->swapped)
+            swapl(&replylen);
+        bytesleft = (replylen * 4) + SIZEOF(xReply) - count - padBytes;
+        replyinfo.startOfReply = TRUE;
+        replyinfo.bytesRemaining = who->replyBytesRemaining = bytesleft;
+        CallCallbacks((&ReplyCallback), (void *) &replyinfo);
+    }
+}
+
+static void
+OutputReleaseRefs(ConnectionOutputPtr oco, int num)
+{
+    if (!num)
+        return;
+    for (int i = 0; i < num; i++)
+        if (oco->refs[i].release)
+            oco->refs[i].release(oco->refs[i].closure);
+    oco->numRefs -= num;
+    memmove(oco->refs, oco->refs + num, oco->numRefs * sizeof(OutputRef));
+}
+
+static Bool
+OutputQueueRef(ConnectionOutputPtr oco, const void *data, size_t size,
+               OsReleaseProcPtr release, void *closure)
+{
+    if (oco->numRefs == oco->sizeRefs) {
+        int newsize = oco->sizeRefs ? oco->sizeRefs * 2 : 8;
+        OutputRef *refs = reallocarray(oco->refs, newsize, sizeof(OutputRef));
+
+        if (!refs)
+            return FALSE;
+        oco->refs = refs;
+        oco->sizeRefs = newsize;
+    }
+    oco->refs[oco->numRefs++] = (OutputRef) {
+        .data = data,
+        .size = size,
+        .pad = padding_for_int32(size),
+        .bufpos = oco->count,
+        .release = release,
+        .closure = closure,
+    };
+    return TRUE;
+}
+
+/*
+ * Account for len bytes written out: drop them from the buffer and
+ * release the references that have been sent completely.
+ */
+static void
+OutputConsume(ConnectionOutputPtr oco, size_t len)
+{
+    int bufDone = 0;
+    int done = 0;
+
+    while (len) {
+        int next = (done < oco->numRefs) ? oco->refs[done].bufpos : oco->count;
+        size_t n;
+
+        if (next > bufDone) {
+            n = min(len, (size_t) (next - bufDone));
+            bufDone += n;
+        }
+        else {
+            OutputRef *ref = &oco->refs[done];
+
+            n = min(len, ref->size + ref->pad - ref->sent);
+            if (ref->sent < ref->size)
+                ioStats.bytesByRef += min(n, ref->size - ref->sent);
+            ref->sent += n;
+            if (ref->sent == ref->size + ref->pad)
+                done++;
+        }
+        len -= n;
+    }
+
+    if (bufDone) {
+        oco->count -= bufDone;
+        memmove(oco->buf, oco->buf + bufDone, oco->count);
+        for (int i = done; i < oco->numRefs; i++)
+            oco->refs[i].bufpos -= bufDone;
+    }
+    OutputReleaseRefs(oco, done);
+}
+
+/*
+ * Copy what's left of a borrowed reference (always the last one queued)
+ * into the output buffer, since the caller's memory is about to go away.
+ */
+static Bool
+OutputCopyBorrowedRef(ConnectionOutputPtr oco)
+{
+    OutputRef *ref = &oco->refs[oco->numRefs - 1];
+    size_t left = ref->size + ref->pad - ref->sent;
+
+    if (oco->count + left > oco->size) {
+        int newsize = oco->count + (((left / BUFSIZE) + 1) * BUFSIZE);
+        void *newbuf = realloc(oco->buf, newsize);
+
+        if (!newbuf)
+            return FALSE;
+        oco->buf = newbuf;
+        oco->size = newsize;
+    }
+    if (ref->sent < ref->size) {
+        memcpy(oco->buf + oco->count, ref->data + ref->sent,
+               ref->size - ref->sent);
+        ioStats.bytesCopied += ref->size - ref->sent;
+        oco->count += ref->size - ref->sent;
+        left -= ref->size - ref->sent;
+    }
+    memset(oco->buf + oco->count, 0, left);
+    oco->count += left;
+    oco->numRefs--;
+    return TRUE;
+}
+
+/*
+ * Queue a large write by reference and try to send it right away, along
+ * with everything buffered before it.
+ */
+static int
+OutputWriteRef(ClientPtr who, OsCommPtr oc, const void *buf, int count,
+               OsReleaseProcPtr release, void *closure)
+{
+    ConnectionOutputPtr oco;
+
+    if (!OutputEnsureBuffer(who, oc)) {
+        if (release)
+            release(closure);
+        return -1;
+    }
+    oco = oc->output;
+
+    if (!OutputQueueRef(oco, buf, count, release, closure)) {
+        int ret = OutputBufferMakeRoomAndFlush(who, oc, buf, count);
+
+        if (release)
+            release(closure);
+        return ret;
+    }
+
+    output_pending_clear(who);
+    if (!any_output_pending()) {
+        CriticalOutputPending = FALSE;
+        NewOutputPending = FALSE;
+    }
+    if (FlushClient(who, oc) == -1)
+        return -1;
+
+    /* not everything went out, keep the rest of a borrowed buffer */
+    oco = oc->output;
+    if (!release && oco && oco->numRefs &&
+        !oco->refs[oco->numRefs - 1].release &&
+        oco->refs[oco->numRefs - 1].data == buf &&
+        !OutputCopyBorrowedRef(oco)) {
+        AbortClient(who);
+        dixMarkClientException(who);
+        oco->count = 0;
+        OutputReleaseRefs(oco, oco->numRefs);
+        return -1;
+    }
+    return count;
+}
+
+int
+WriteToClientRef(ClientPtr who, int count, const void *buf,
+                 OsReleaseProcPtr release, void *closure)
+{
+    OsCommPtr oc;
+
+    /* not released either, the owner's state belongs to the main thread */
+    BUG_RETURN_VAL_MSG(in_input_thread(), 0,
+                       "******** %s called from input thread *********\n", __func__);
+
+    if (!count || !who || who == serverClient || who->clientGone) {
+        if (release)
+            release(closure);
+        return 0;
+    }
+    if (count < OUTPUT_REF_MIN) {
+        int ret = WriteToClient(who, count, buf);
+
+        if (release)
+            release(closure);
+        return ret;
+    }
+
+    oc = who->osPrivate;
+    if (oc->trans_conn == NULL) {
+        if (release)
+            release(closure);
+        return -1;
+    }
+    oc->bytes_out += count + padding_for_int32(count);
+    if (ReplyCallback)
+        CallReplyCallback(who, buf, count, padding_for_int32(count));
+    return OutputWriteRef(who, oc, buf, count, release, closure);
+}
+
+void
+OsGetIOStats(OsIOStatsRec *stats)
+{
+    *stats = ioStats;
+}
+
+void
+OsLogIOStats(void)
+{
+    double reqs = ioStats.requests ? ioStats.requests : 1;
+
+    if (!ioStats.requests)
+        return;
+    LogMessageVerb(X_INFO, 4,
+                   "client I/O: %llu requests, %.3f reads/req "
+                   "(%llu would block), %.3f writes/req, "
+                   "%.1f bytes read/call, %llu bytes copied, %llu by ref\n",
+                   (unsigned long long) ioStats.requests,
+                   ioStats.reads / reqs,
+                   (unsigned long long) ioStats.readsWouldBlock,
+                   ioStats.writes / reqs,
+                   ioStats.reads ? (double) ioStats.bytesRead / ioStats.reads : 0.0,
+                   (unsigned long long) ioStats.bytesCopied,
+                   (unsigned long long) ioStats.bytesByRef);
+}
+
 /*****************
  * WriteToClient
  *    Copies buf into ClientPtr.buf if it fits (with padding), else
@@ -828,33 +1171,10 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
 #endif
 
     padBytes = padding_for_int32(count);
+    oc->bytes_out += count + padBytes;
 
-    if (ReplyCallback) {
-        ReplyInfoRec replyinfo;
-
-        replyinfo.client = who;
-        replyinfo.replyData = buf;
-        replyinfo.dataLenBytes = count + padBytes;
-        replyinfo.padBytes = padBytes;
-        if (who->replyBytesRemaining) { /* still sending data of an earlier reply */
-            who->replyBytesRemaining -= count + padBytes;
-            replyinfo.startOfReply = FALSE;
-            replyinfo.bytesRemaining = who->replyBytesRemaining;
-            CallCallbacks((&ReplyCallback), (void *) &replyinfo);
-        }
-        else if (who->clientState == ClientStateRunning && buf[0] == X_Reply) { /* start of new reply */
-            CARD32 replylen;
-            unsigned long bytesleft;
-
-            replylen = ((const xGenericReply *) buf)->length;
-            if (who->swapped)
-                swapl(&replylen);
-            bytesleft = (replylen * 4) + SIZEOF(xReply) - count - padBytes;
-            replyinfo.startOfReply = TRUE;
-            replyinfo.bytesRemaining = who->replyBytesRemaining = bytesleft;
-            CallCallbacks((&ReplyCallback), (void *) &replyinfo);
-        }
-    }
+    if (ReplyCallback)
+        CallReplyCallback(who, buf, count, padBytes);
 #ifdef DEBUG_COMMUNICATION
     else if (multicount) {
         if (who->replyBytesRemaining) {
@@ -870,6 +1190,9 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
     }
 #endif
 
+    if (count >= OUTPUT_REF_MIN)
+        return OutputWriteRef(who, oc, buf, count, NULL, NULL);
+
     if (!OutputEnsureBuffer(who, oc))
         return -1;
 
@@ -888,6 +1211,7 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
     output_pending_mark(who);
     memmove((char *) oco->buf + oco->count, buf, count);
     oco->count += count;
+    ioStats.bytesCopied += count;
     if (padBytes) {
         memset(oco->buf + oco->count, '\0', padBytes);
         oco->count += padBytes;
@@ -908,6 +1232,7 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
 int
 FlushClient(ClientPtr who, OsCommPtr oc)
 {
+    static const char zeros[3];
     ConnectionOutputPtr oco = oc->output;
     XtransConnInfo trans_conn = oc->trans_conn;
 
@@ -920,40 +1245,70 @@ FlushClient(ClientPtr who, OsCommPtr oc)
         goto abortClient;
     }
 
-    size_t written = 0;
-    size_t notWritten = oco->count;
-
     /* do nothing if we haven't anything to write */
-    if (!notWritten)
+    if (!oco->count && !oco->numRefs)
         return 0;
 
     if (FlushCallback)
         CallCallbacks(&FlushCallback, who);
 
-    size_t todo = notWritten; /* trying to write that much this time */
-    while (notWritten) {
+    size_t limit = SIZE_MAX; /* trying to write at most that much this time */
+    while (oco->count || oco->numRefs) {
+        struct iovec iov[OUTPUT_IOV_MAX];
+        int iovcnt = 0;
+        int bufpos = 0;
+        size_t todo = 0;
+
+        /* gather buffered bytes and referenced segments, in order */
+        for (int i = 0; i <= oco->numRefs && iovcnt < OUTPUT_IOV_MAX - 2 &&
+                 todo < limit; i++) {
+            int next = (i < oco->numRefs) ? oco->refs[i].bufpos : oco->count;
+
+            if (next > bufpos) {
+                iov[iovcnt].iov_base = oco->buf + bufpos;
+                iov[iovcnt++].iov_len = next - bufpos;
+                todo += next - bufpos;
+                bufpos = next;
+            }
+            if (i == oco->numRefs)
+                break;
+
+            OutputRef *ref = &oco->refs[i];
+            if (ref->sent < ref->size) {
+                iov[iovcnt].iov_base = (char *) ref->data + ref->sent;
+                iov[iovcnt++].iov_len = ref->size - ref->sent;
+                todo += ref->size - ref->sent;
+            }
+            size_t pad = ref->size + ref->pad - max(ref->sent, ref->size);
+            if (pad) {
+                iov[iovcnt].iov_base = (char *) zeros;
+                iov[iovcnt++].iov_len = pad;
+                todo += pad;
+            }
+        }
+        if (todo > limit) {
+            /* trim the tail so we don't offer more than limit bytes */
+            size_t excess = todo - limit;
+
+            while (excess >= iov[iovcnt - 1].iov_len)
+                excess -= iov[--iovcnt].iov_len;
+            iov[iovcnt - 1].iov_len -= excess;
+        }
+
         errno = 0;
-        ssize_t len = _XSERVTransWrite(trans_conn, ((const char*)oco->buf) + written, todo);
+        ioStats.writes++;
+        ssize_t len = ClientWritev(oc, iov, iovcnt);
         if (len >= 0) {
-            written += len;
-            notWritten -= len;
-            todo = notWritten;
+            OutputConsume(oco, len);
         }
         else if (ossock_wouldblock(errno)) {
             /* If we've arrived here, then the client is stuffed to the gills
                and not ready to accept more.  Make a note of it and buffer
                the rest. */
             output_pending_mark(who);
-
-            if (written > 0) {
-                oco->count -= written;
-                memmove((char *) oco->buf,
-                        (char *) oco->buf + written, oco->count);
-                written = 0;
-            }
-
-            oco->count = notWritten;
-            ospoll_listen(server_poll, oc->fd, X_NOTIFY_WRITE);
+            /* the rings arrange for their wakeup themselves */
+            if (!oc->ring)
+                ospoll_listen(server_poll, oc->fd, X_NOTIFY_WRITE);
 
             /* return only the amount explicitly requested */
             return 0;
@@ -961,7 +1316,9 @@ FlushClient(ClientPtr who, OsCommPtr oc)
 #ifdef EMSGSIZE                 /* check for another brain-damaged OS bug */
         else if (errno == EMSGSIZE) {
             /* making separate try with half of the size */
-            todo /= 2;
+            limit = min(limit, todo) / 2;
+            if (!limit)
+                goto abortClient;
         }
 #endif
         else {
@@ -974,6 +1331,7 @@ FlushClient(ClientPtr who, OsCommPtr oc)
     output_pending_clear(who);
 
     if (oco->size > BUFWATERMARK) {
+        free(oco->refs);
         free(oco->buf);
         free(oco);
     }
@@ -988,6 +1346,7 @@ abortClient:
     AbortClient(who);
     dixMarkClientException(who);
     oco->count = 0;
+    OutputReleaseRefs(oco, oco->numRefs);
     return -1;
 }
 
@@ -1049,7 +1408,9 @@ FreeOsBuffers(OsCommPtr oc)
         }
     }
     if ((oco = oc->output)) {
+        OutputReleaseRefs(oco, oco->numRefs);
         if (FreeOutputs) {
+            free(oco->refs);
             free(oco->buf);
             free(oco);
         }
@@ -1074,6 +1435,7 @@ ResetOsBuffers(void)
     }
     while ((oco = FreeOutputs)) {
         FreeOutputs = oco->next;
+        free(oco->refs);
         free(oco->buf);
         free(oco);
     }
@@ -5,11 +5,13 @@
 #ifndef __XORG_OS_IO_H
 #define __XORG_OS_IO_H
 
+#include <stdint.h>
 #include <X11/Xdefs.h>
 
 #include "include/dix.h" /* ClientPtr */
 
 struct _XtransConnInfo;
+struct _OsShmRing;
 
 typedef struct _connectionInput *ConnectionInputPtr;
 typedef struct _connectionOutput *ConnectionOutputPtr;
@@ -22,9 +24,57 @@ typedef struct {
     CARD32 conn_time;
     struct _XtransConnInfo *trans_conn;
     int flags;
+    int input_size;         /* adaptive input buffer size, 0 = default */
+    int input_small_reads;  /* consecutive reads far below input_size */
+    uint64_t bytes_out;     /* bytes queued for the client, with padding */
+    struct _OsShmRing *ring; /* SHM-TRANSPORT rings, once attached */
 } OsCommRec, *OsCommPtr;
 
+typedef void (*OsReleaseProcPtr)(void *closure);
+
+typedef struct {
+    uint64_t requests;      /* requests handed to the dispatcher */
+    uint64_t reads;         /* read calls on client connections */
+    uint64_t readsWouldBlock; /* ... of which found nothing to read */
+    uint64_t bytesRead;
+    uint64_t writes;        /* (vectored) write calls */
+    uint64_t bytesCopied;   /* payload bytes staged in output buffers */
+    uint64_t bytesByRef;    /* payload bytes written from caller's memory */
+} OsIOStatsRec;
+
 int FlushClient(ClientPtr who, OsCommPtr oc);
+
+/*
+ * @brief write data to client without copying it into the output buffer
+ *
+ * Like WriteToClient(), but large payloads are queued by reference and
+ * handed to the transport with a single vectored write, together with
+ * whatever is buffered in front of them. The caller must keep the data
+ * valid and unchanged until release(closure) is called, which may happen
+ * before this function returns or much later when a slow client finally
+ * drained its socket. Small payloads are copied and released immediately.
+ *
+ * @param who      client to write to
+ * @param count    number of bytes (padded to 4 by this function)
+ * @param buf      the payload
+ * @param release  called once the data isn't needed anymore (may be NULL)
+ * @param closure  argument for release
+ * @return         count, or -1 if the client had to be aborted
+ */
+_X_EXPORT /* used by request_priv.h helpers in loadable modules, eg. glx */
+int WriteToClientRef(ClientPtr who, int count, const void *buf,
+                     OsReleaseProcPtr release, void *closure);
+
+/*
+ * @brief get the client I/O counters (syscalls, bytes, copied vs. by-ref)
+ */
+void OsGetIOStats(OsIOStatsRec *stats);
+
+/*
+ * @brief log the client I/O counters, per dispatched request
+ */
+void OsLogIOStats(void);
+
 void FreeOsBuffers(OsCommPtr oc);
 void CloseDownFileDescriptor(OsCommPtr oc);
 
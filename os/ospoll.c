@@ -56,6 +56,16 @@
 #define HAVE_OSPOLL     1
 #endif
 
+/* io_uring is a runtime alternative to epoll, which stays the fallback */
+#if EPOLL && defined(HAVE_LIBURING)
+#include <errno.h>
+#include <poll.h>
+#include <liburing.h>
+#define URING           1
+#endif
+
+bool ospoll_use_io_uring;
+
 #if !HAVE_OSPOLL
 #include "xserver_poll.h"
 #define POLL            1
@@ -93,6 +103,9 @@ struct ospollfd {
     void                (*callback)(int fd, int xevents, void *data);
     void                *data;
     struct xorg_list    deleted;
+#if URING
+    bool                armed;          /* poll request in flight */
+#endif
 };
 
 struct ospoll {
@@ -101,6 +114,11 @@ struct ospoll {
     int                 num;
     int                 size;
     struct xorg_list    deleted;
+#if URING
+    bool                uring;
+    struct io_uring     ring;
+    struct xorg_list    cancelled;      /* removed, poll still in flight */
+#endif
 };
 
 #endif
@@ -169,6 +187,195 @@ ospoll_clean_deleted(struct ospoll *ospoll)
 }
 #endif
 
+#if URING
+
+/*
+ * io_uring variant of the epoll backend.
+ *
+ * Every fd with events to listen for has one poll request in the ring,
+ * tagged with its ospollfd: multishot for edge triggered fds, single shot
+ * (re-armed after each callback) for level triggered ones. Changing the
+ * events only queues an update, which is submitted together with the
+ * next wait, so listen/mute toggling costs no extra system calls.
+ *
+ * An ospollfd removed while its request is still in flight is kept on
+ * the cancelled list until its final completion has been reaped.
+ */
+
+#define URING_ENTRIES           256
+#define URING_CQ_ENTRIES        8192
+
+static bool
+uring_init(struct ospoll *ospoll)
+{
+    struct io_uring_params params = {
+        .flags = IORING_SETUP_CQSIZE,
+        .cq_entries = URING_CQ_ENTRIES,
+    };
+
+    if (io_uring_queue_init_params(URING_ENTRIES, &ospoll->ring, &params) < 0)
+        return false;
+
+    /* multishot poll and poll updates came with 5.13, like rsrc tags */
+    if (!(params.features & IORING_FEAT_RSRC_TAGS)) {
+        io_uring_queue_exit(&ospoll->ring);
+        return false;
+    }
+    ospoll->uring = true;
+    xorg_list_init(&ospoll->cancelled);
+    return true;
+}
+
+static struct io_uring_sqe *
+uring_get_sqe(struct ospoll *ospoll)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&ospoll->ring);
+
+    /* submission queue is full, hand it to the kernel and retry */
+    if (!sqe) {
+        io_uring_submit(&ospoll->ring);
+        sqe = io_uring_get_sqe(&ospoll->ring);
+    }
+    return sqe;
+}
+
+static unsigned
+uring_poll_mask(struct ospollfd *osfd)
+{
+    unsigned mask = 0;
+
+    if (osfd->xevents & X_NOTIFY_READ)
+        mask |= POLLIN;
+    if (osfd->xevents & X_NOTIFY_WRITE)
+        mask |= POLLOUT;
+    return mask;
+}
+
+static void
+uring_arm(struct ospoll *ospoll, struct ospollfd *osfd)
+{
+    struct io_uring_sqe *sqe;
+
+    if (osfd->armed || !osfd->xevents || !osfd->callback)
+        return;
+
+    sqe = uring_get_sqe(ospoll);
+    if (!sqe)
+        return;
+    if (osfd->trigger == ospoll_trigger_edge)
+        io_uring_prep_poll_multishot(sqe, osfd->fd, uring_poll_mask(osfd));
+    else
+        io_uring_prep_poll_add(sqe, osfd->fd, uring_poll_mask(osfd));
+    io_uring_sqe_set_data(sqe, osfd);
+    osfd->armed = true;
+}
+
+/* Cancel the poll request in flight; its final completion re-arms it if
+ * the fd is still wanted.
+ */
+static void
+uring_cancel(struct ospoll *ospoll, struct ospollfd *osfd)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ospoll);
+
+    if (!sqe)
+        return;
+    io_uring_prep_poll_remove(sqe, (uintptr_t) osfd);
+    io_uring_sqe_set_data(sqe, NULL);
+}
+
+static void
+uring_mod(struct ospoll *ospoll, struct ospollfd *osfd)
+{
+    struct io_uring_sqe *sqe;
+
+    if (!osfd->armed) {
+        uring_arm(ospoll, osfd);
+        return;
+    }
+    if (!osfd->xevents) {
+        uring_cancel(ospoll, osfd);
+        return;
+    }
+
+    sqe = uring_get_sqe(ospoll);
+    if (!sqe)
+        return;
+    io_uring_prep_poll_update(sqe, (uintptr_t) osfd, 0,
+                              uring_poll_mask(osfd), IORING_POLL_UPDATE_EVENTS);
+    io_uring_sqe_set_data(sqe, NULL);
+}
+
+static int
+uring_wait(struct ospoll *ospoll, int timeout)
+{
+    struct __kernel_timespec ts = {
+        .tv_sec = timeout / 1000,
+        .tv_nsec = (timeout % 1000) * 1000000
+    };
+    struct io_uring_cqe *cqe;
+    unsigned head, seen = 0;
+    int nready = 0;
+    int ret;
+
+    if (timeout == 0)
+        ret = io_uring_submit(&ospoll->ring);
+    else
+        ret = io_uring_submit_and_wait_timeout(&ospoll->ring, &cqe, 1,
+                                               timeout > 0 ? &ts : NULL, NULL);
+    if (ret < 0 && ret != -ETIME) {
+        errno = -ret;
+        return -1;
+    }
+
+    io_uring_for_each_cqe(&ospoll->ring, head, cqe) {
+        struct ospollfd *osfd = io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+
+        seen++;
+        /* completions of updates and cancellations aren't interesting */
+        if (!osfd)
+            continue;
+
+        if (osfd->callback && res != -ECANCELED) {
+            int xevents = 0;
+
+            if (res < 0)
+                xevents |= X_NOTIFY_ERROR;
+            else {
+                if (res & POLLIN)
+                    xevents |= X_NOTIFY_READ;
+                if (res & POLLOUT)
+                    xevents |= X_NOTIFY_WRITE;
+                if (res & (~(POLLIN|POLLOUT)))
+                    xevents |= X_NOTIFY_ERROR;
+            }
+            /* muting only takes effect with the next submission,
+               drop what was reported before that */
+            xevents &= osfd->xevents | X_NOTIFY_ERROR;
+            if (xevents) {
+                osfd->callback(osfd->fd, xevents, osfd->data);
+                nready++;
+            }
+        }
+
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            osfd->armed = false;
+            if (!osfd->callback) {
+                xorg_list_del(&osfd->deleted);
+                free(osfd);
+            }
+            else
+                uring_arm(ospoll, osfd);
+        }
+    }
+    io_uring_cq_advance(&ospoll->ring, seen);
+    ospoll_clean_deleted(ospoll);
+    return nready;
+}
+
+#endif /* URING */
+
 /* Insert an element into an array
  *
  * base: base address of array
@@ -231,6 +438,13 @@ ospoll_create(void)
     struct ospoll *ospoll = calloc(1, sizeof (struct ospoll));
     if (ospoll == NULL)
         return NULL;
+#if URING
+    if (ospoll_use_io_uring && uring_init(ospoll)) {
+        ospoll->epoll_fd = -1;
+        xorg_list_init(&ospoll->deleted);
+        return ospoll;
+    }
+#endif
     ospoll->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
     if (ospoll->epoll_fd < 0) {
         free (ospoll);
@@ -258,6 +472,18 @@ ospoll_destroy(struct ospoll *ospoll)
 #if EPOLL || PORT
     if (ospoll) {
         assert (ospoll->num == 0);
+#if URING
+        if (ospoll->uring) {
+            struct ospollfd *osfd, *tmp;
+
+            io_uring_queue_exit(&ospoll->ring);
+            xorg_list_for_each_entry_safe(osfd, tmp, &ospoll->cancelled, deleted) {
+                xorg_list_del(&osfd->deleted);
+                free(osfd);
+            }
+        }
+        else
+#endif
         close(ospoll->epoll_fd);
         ospoll_clean_deleted(ospoll);
         free(ospoll->fds);
@@ -368,6 +594,9 @@ ospoll_add(struct ospoll *ospoll, int fd,
         ev.data.ptr = osfd;
         if (trigger == ospoll_trigger_edge)
             ev.events |= EPOLLET;
+#if URING
+        if (!ospoll->uring)
+#endif
         if (epoll_ctl(ospoll->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
             free(osfd);
             return false;
@@ -381,6 +610,11 @@ ospoll_add(struct ospoll *ospoll, int fd,
         ospoll->num++;
     } else {
         osfd = ospoll->fds[pos];
+#if URING
+        /* poll request of the old kind gets replaced once it's gone */
+        if (ospoll->uring && osfd->armed && osfd->trigger != trigger)
+            uring_cancel(ospoll, osfd);
+#endif
     }
     osfd->data = data;
     osfd->callback = callback;
@@ -451,12 +685,22 @@ ospoll_remove(struct ospoll *ospoll, int fd)
         struct epoll_event ev;
         ev.events = 0;
         ev.data.ptr = osfd;
+#if URING
+        if (!ospoll->uring)
+#endif
         (void) epoll_ctl(ospoll->epoll_fd, EPOLL_CTL_DEL, fd, &ev);
 
         array_delete(ospoll->fds, ospoll->num, sizeof (ospoll->fds[0]), pos);
         ospoll->num--;
         osfd->callback = NULL;
         osfd->data = NULL;
+#if URING
+        if (ospoll->uring && osfd->armed) {
+            uring_cancel(ospoll, osfd);
+            xorg_list_add(&osfd->deleted, &ospoll->cancelled);
+        }
+        else
+#endif
         xorg_list_add(&osfd->deleted, &ospoll->deleted);
 #endif
 #if POLL
@@ -485,6 +729,12 @@ epoll_mod(struct ospoll *ospoll, struct ospollfd *osfd)
 static void
 epoll_mod(struct ospoll *ospoll, struct ospollfd *osfd)
 {
+#if URING
+    if (ospoll->uring) {
+        uring_mod(ospoll, osfd);
+        return;
+    }
+#endif
     struct epoll_event ev;
     ev.events = 0;
     if (osfd->xevents & X_NOTIFY_READ)
@@ -645,6 +895,10 @@ ospoll_wait(struct ospoll *ospoll, int timeout)
     struct epoll_event events[MAX_EVENTS];
     int i;
 
+#if URING
+    if (ospoll->uring)
+        return uring_wait(ospoll, timeout);
+#endif
     nready = epoll_wait(ospoll->epoll_fd, events, MAX_EVENTS, timeout);
     for (i = 0; i < nready; i++) {
         struct epoll_event *ev = &events[i];
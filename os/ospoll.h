@@ -43,6 +43,15 @@ enum ospoll_trigger {
     ospoll_trigger_level
 };
 
+/**
+ * Whether ospoll_create should use io_uring instead of epoll.
+ *
+ * Only honoured when built with liburing; ospoll_create silently falls
+ * back to epoll if the kernel lacks multishot poll (< 5.13) or io_uring
+ * is disabled. Set from the command line (+iouring), default off.
+ */
+extern bool ospoll_use_io_uring;
+
 /**
  * Create a new ospoll structure
  */
@@ -0,0 +1,317 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Shared memory request and reply rings for local clients (SHM-TRANSPORT)
+ *
+ * Once a client attached, ReadRequestFromClient() copies its requests out
+ * of the request ring and FlushClient() copies output into the reply ring,
+ * instead of a read() and writev() on the socket each. The eventfds are
+ * only signalled when the other side said it's going to sleep, so a busy
+ * client streaming requests makes no system calls at all.
+ *
+ * Everything in the shared memory can be changed by the client at any
+ * time: the server keeps its own copy of the indices it advances, checks
+ * the client's against the ring size and copies requests out before
+ * looking at them.
+ */
+#include <dix-config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <X11/X.h>
+
+#include "dix/dixstruct_priv.h"
+#include "include/shmtransportproto.h"
+#include "os/Xtrans.h"
+#include "os/osdep.h"
+#include "os/ossock.h"
+#include "os/shmring_priv.h"
+
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+
+#define ring_load(p)            __atomic_load_n(p, __ATOMIC_RELAXED)
+#define ring_load_acquire(p)    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ring_store(p, v)        __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define ring_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define ring_exchange(p, v)     __atomic_exchange_n(p, v, __ATOMIC_RELAXED)
+/* between publishing an index and looking at the other side's wake flag */
+#define ring_fence()            __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+typedef struct _OsShmRing {
+    char *map;
+    size_t mapSize;
+    xShmTransportRing *request;
+    xShmTransportRing *reply;
+    char *requestData;
+    char *replyData;
+    uint32_t requestSize;
+    uint32_t replySize;
+    uint32_t requestTail;       /* our copies of what the server advances */
+    uint32_t replyHead;
+    int serverFd;
+    int clientFd;
+    Bool socketOutput;          /* output queued before attaching goes out */
+    Bool socketReadable;        /* the client may have closed the socket */
+} OsShmRingRec;
+
+static uint32_t
+OsShmRingSize(uint32_t size, uint32_t dflt)
+{
+    uint32_t s = SHMTRANSPORT_MIN_RING;
+
+    if (!size)
+        return dflt;
+    while (s < size && s < SHMTRANSPORT_MAX_RING)
+        s <<= 1;
+    return s;
+}
+
+static void
+OsShmRingSignal(int fd)
+{
+    uint64_t one = 1;
+
+    /* only fails when the counter is about to overflow, then it's set */
+    (void) write(fd, &one, sizeof(one));
+}
+
+OsShmRingPtr
+OsShmRingCreate(uint32_t requestSize, uint32_t replySize,
+                OsShmRingInfoPtr info)
+{
+    OsShmRingPtr ring = calloc(1, sizeof(OsShmRingRec));
+    int fd;
+
+    if (!ring)
+        return NULL;
+    ring->requestSize = OsShmRingSize(requestSize, SHMTRANSPORT_REQUEST_RING);
+    ring->replySize = OsShmRingSize(replySize, SHMTRANSPORT_REPLY_RING);
+    ring->mapSize = SHMTRANSPORT_DATA_OFFSET + ring->requestSize +
+        ring->replySize;
+    ring->map = MAP_FAILED;
+    ring->serverFd = -1;
+    ring->clientFd = -1;
+    ring->socketOutput = TRUE;
+
+    fd = memfd_create("xserver-shmtransport", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        goto fail;
+    /* a client shrinking it would make us fault on the mapping */
+    if (ftruncate(fd, ring->mapSize) < 0 ||
+        fcntl(fd, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+        goto fail;
+    ring->map = mmap(NULL, ring->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    if (ring->map == MAP_FAILED)
+        goto fail;
+
+    ring->serverFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    ring->clientFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ring->serverFd < 0 || ring->clientFd < 0)
+        goto fail;
+
+    ring->request = (xShmTransportRing *)
+        (ring->map + SHMTRANSPORT_REQUEST_CONTROL);
+    ring->reply = (xShmTransportRing *)
+        (ring->map + SHMTRANSPORT_REPLY_CONTROL);
+    ring->requestData = ring->map + SHMTRANSPORT_DATA_OFFSET;
+    ring->replyData = ring->requestData + ring->requestSize;
+
+    info->memFd = fd;
+    info->serverFd = ring->serverFd;
+    info->clientFd = ring->clientFd;
+    info->size = ring->mapSize;
+    info->requestOffset = SHMTRANSPORT_DATA_OFFSET;
+    info->requestSize = ring->requestSize;
+    info->replyOffset = SHMTRANSPORT_DATA_OFFSET + ring->requestSize;
+    info->replySize = ring->replySize;
+    return ring;
+
+fail:
+    if (fd >= 0)
+        close(fd);
+    OsShmRingFree(ring);
+    return NULL;
+}
+
+void
+OsShmRingFree(OsShmRingPtr ring)
+{
+    if (ring->map != MAP_FAILED)
+        munmap(ring->map, ring->mapSize);
+    if (ring->serverFd >= 0)
+        close(ring->serverFd);
+    if (ring->clientFd >= 0)
+        close(ring->clientFd);
+    free(ring);
+}
+
+Bool
+OsShmRingPending(OsCommPtr oc)
+{
+    OsShmRingPtr ring = oc->ring;
+
+    return ring_load_acquire(&ring->request->head) != ring->requestTail;
+}
+
+void
+OsShmRingSocketReadable(OsCommPtr oc)
+{
+    oc->ring->socketReadable = TRUE;
+}
+
+/* the client posted requests, or made room in the reply ring */
+static void
+OsShmRingNotify(int fd, int xevents, void *data)
+{
+    ClientPtr client = data;
+    uint64_t count;
+
+    /* one read takes all signals so far */
+    (void) read(fd, &count, sizeof(count));
+
+    NewOutputPending = TRUE;
+    /* else set_poll_client() marks it ready when it's listened to again */
+    if (listen_to_client(client) && OsShmRingPending(client->osPrivate))
+        mark_client_ready(client);
+}
+
+void
+OsShmRingAttach(ClientPtr client, OsShmRingPtr ring)
+{
+    OsCommPtr oc = client->osPrivate;
+
+    oc->ring = ring;
+    ospoll_add(server_poll, ring->serverFd, ospoll_trigger_level,
+               OsShmRingNotify, client);
+    ospoll_listen(server_poll, ring->serverFd, X_NOTIFY_READ);
+}
+
+void
+OsShmRingDetach(OsCommPtr oc)
+{
+    if (!oc->ring)
+        return;
+    ospoll_remove(server_poll, oc->ring->serverFd);
+    OsShmRingFree(oc->ring);
+    oc->ring = NULL;
+}
+
+int
+OsShmRingRead(OsCommPtr oc, char *buf, int size)
+{
+    OsShmRingPtr ring = oc->ring;
+    xShmTransportRing *ctl = ring->request;
+    uint32_t mask = ring->requestSize - 1;
+    uint32_t avail, offset, first;
+    char c;
+    int n;
+
+    avail = ring_load_acquire(&ctl->head) - ring->requestTail;
+    if (!avail) {
+        /* going to sleep, look again after telling the client */
+        ring_store(&ctl->wakeConsumer, 1);
+        ring_fence();
+        avail = ring_load_acquire(&ctl->head) - ring->requestTail;
+        if (!avail) {
+            if (!ring->socketReadable) {
+                errno = EAGAIN;
+                return -1;
+            }
+            /* nothing must come through the socket anymore, but the
+             * client closing it is how we learn it's gone */
+            ring->socketReadable = FALSE;
+            n = _XSERVTransRead(oc->trans_conn, &c, 1);
+            if (n > 0) {
+                errno = EPROTO;
+                return -1;
+            }
+            return n;
+        }
+        ring_store(&ctl->wakeConsumer, 0);
+    }
+    if (avail > ring->requestSize) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    n = min(avail, (uint32_t) size);
+    offset = ring->requestTail & mask;
+    first = min(n, ring->requestSize - offset);
+    memcpy(buf, ring->requestData + offset, first);
+    memcpy(buf + first, ring->requestData, n - first);
+
+    ring->requestTail += n;
+    ring_store_release(&ctl->tail, ring->requestTail);
+    ring_fence();
+    if (ring_load(&ctl->wakeProducer) && ring_exchange(&ctl->wakeProducer, 0))
+        OsShmRingSignal(ring->clientFd);
+    return n;
+}
+
+ssize_t
+OsShmRingWritev(OsCommPtr oc, const struct iovec *iov, int iovcnt)
+{
+    OsShmRingPtr ring = oc->ring;
+    xShmTransportRing *ctl = ring->reply;
+    uint32_t mask = ring->replySize - 1;
+    uint32_t used, room;
+    size_t done = 0;
+
+    if (ring->socketOutput) {
+        /* until the socket took all output queued before attaching */
+        size_t todo = 0;
+        ssize_t len;
+
+        for (int i = 0; i < iovcnt; i++)
+            todo += iov[i].iov_len;
+        len = _XSERVTransWritev(oc->trans_conn, (struct iovec *) iov, iovcnt);
+        if (len >= 0 && (size_t) len == todo)
+            ring->socketOutput = FALSE;
+        else if (len < 0 && ossock_wouldblock(errno))
+            ospoll_listen(server_poll, oc->fd, X_NOTIFY_WRITE);
+        return len;
+    }
+
+    used = ring->replyHead - ring_load_acquire(&ctl->tail);
+    if (used == ring->replySize) {
+        ring_store(&ctl->wakeProducer, 1);
+        ring_fence();
+        used = ring->replyHead - ring_load_acquire(&ctl->tail);
+        if (used == ring->replySize) {
+            errno = EAGAIN;
+            return -1;
+        }
+        ring_store(&ctl->wakeProducer, 0);
+    }
+    if (used > ring->replySize) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    room = ring->replySize - used;
+    for (int i = 0; i < iovcnt && room; i++) {
+        uint32_t n = min(iov[i].iov_len, (size_t) room);
+        uint32_t offset = (ring->replyHead + done) & mask;
+        uint32_t first = min(n, ring->replySize - offset);
+
+        memcpy(ring->replyData + offset, iov[i].iov_base, first);
+        memcpy(ring->replyData, (char *) iov[i].iov_base + first, n - first);
+        done += n;
+        room -= n;
+    }
+
+    ring->replyHead += done;
+    ring_store_release(&ctl->head, ring->replyHead);
+    ring_fence();
+    if (ring_load(&ctl->wakeConsumer) && ring_exchange(&ctl->wakeConsumer, 0))
+        OsShmRingSignal(ring->clientFd);
+    return done;
+}
@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Shared memory request and reply rings for local clients (SHM-TRANSPORT)
+ */
+#ifndef _XSERVER_OS_SHMRING_PRIV_H
+#define _XSERVER_OS_SHMRING_PRIV_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <X11/Xdefs.h>
+
+#include "include/dix.h"
+#include "os/io_priv.h"
+
+typedef struct _OsShmRing *OsShmRingPtr;
+
+/* what the client needs to map the rings, see shmtransportproto.h */
+typedef struct {
+    int memFd;                  /* the caller's to send or close */
+    int serverFd;               /* eventfd the client signals, the ring's */
+    int clientFd;               /* eventfd the server signals, the ring's */
+    uint32_t size;
+    uint32_t requestOffset;
+    uint32_t requestSize;
+    uint32_t replyOffset;
+    uint32_t replySize;
+} OsShmRingInfoRec, *OsShmRingInfoPtr;
+
+/*
+ * @brief set up the shared memory and eventfds for a pair of rings
+ *
+ * Ring sizes are rounded up to a power of two and clamped, 0 picks the
+ * default.
+ *
+ * @return  the rings, or NULL when out of memory or file descriptors
+ */
+OsShmRingPtr OsShmRingCreate(uint32_t requestSize, uint32_t replySize,
+                             OsShmRingInfoPtr info);
+
+/*
+ * @brief free rings that never got attached
+ */
+void OsShmRingFree(OsShmRingPtr ring);
+
+/*
+ * @brief switch the client's connection over to the rings
+ *
+ * Requests are read from the request ring once the input already read
+ * from the socket is used up. Output goes to the socket until everything
+ * queued so far has been written there, and to the reply ring after that.
+ */
+void OsShmRingAttach(ClientPtr client, OsShmRingPtr ring);
+
+/*
+ * @brief tear down the rings when the connection goes away
+ */
+void OsShmRingDetach(OsCommPtr oc);
+
+/*
+ * @brief whether the request ring has data that wasn't read yet
+ */
+Bool OsShmRingPending(OsCommPtr oc);
+
+/*
+ * @brief note that the socket polled readable, the client may be gone
+ */
+void OsShmRingSocketReadable(OsCommPtr oc);
+
+/*
+ * @brief read requests, like _XSERVTransRead() does from the socket
+ *
+ * An empty ring fails with EAGAIN, after arranging for the client to
+ * signal new data. Only then, and only when the socket polled readable
+ * since, it's read from: a client that closed it reads as end of file.
+ */
+int OsShmRingRead(OsCommPtr oc, char *buf, int size);
+
+/*
+ * @brief write output, like _XSERVTransWritev() does to the socket
+ *
+ * Writes what fits. A full ring fails with EAGAIN, the client signals once
+ * it made room, so there's no need to poll for writing. Fails with EPROTO
+ * when the client broke the ring.
+ */
+ssize_t OsShmRingWritev(OsCommPtr oc, const struct iovec *iov, int iovcnt);
+
+#endif /* _XSERVER_OS_SHMRING_PRIV_H */
@@ -104,6 +104,7 @@ __stdcall unsigned long GetTickCount(void);
 
 #include "dix/dix_priv.h"
 #include "dix/input_priv.h"
+#include "dix/profile_priv.h"
 #include "dix/settings_priv.h"
 #include "dix/screensaver_priv.h"
 #include "miext/extinit_priv.h"
@@ -115,6 +116,7 @@ __stdcall unsigned long GetTickCount(void);
 #include "os/ddx_priv.h"
 #include "os/log_priv.h"
 #include "os/osdep.h"
+#include "os/ospoll.h"
 #include "os/serverlock.h"
 #include "os/xhostname.h"
 #include "present/present_priv.h"
@@ -289,6 +291,7 @@ UseMsg(void)
     ErrorF("-f #                   bell base (0-100)\n");
     ErrorF("-fakescreenfps #       fake screen default fps (1-600)\n");
     ErrorF("-fp string             default font path\n");
+    ErrorF("-fullclips             recompute the clip of every affected window\n");
     ErrorF("-help                  prints message with these options\n");
     ErrorF("+iglx                  Allow creating indirect GLX contexts\n");
     ErrorF("-iglx                  Prohibit creating indirect GLX contexts (default)\n");
@@ -306,7 +309,10 @@ UseMsg(void)
     ErrorF("-nopn                  reject failure to listen on all ports\n");
     ErrorF("-r                     turns off auto-repeat\n");
     ErrorF("r                      turns on auto-repeat \n");
+    ErrorF("-recordbuffer n        buffer n KiB of RECORD data per context\n");
     ErrorF("-render [default|mono|gray|color] set render color alloc policy\n");
+    ErrorF("-renderthreads n       composite large RENDER requests on n threads\n");
+    ErrorF("-renderthreshold n     split RENDER requests of at least n pixels\n");
     ErrorF("-retro                 start with classic stipple and cursor\n");
     ErrorF("-s #                   screen-saver timeout (minutes)\n");
     ErrorF("-seat string           seat to run on\n");
@@ -323,6 +329,11 @@ UseMsg(void)
     ErrorF("-xinerama              Disable XINERAMA extension\n");
 #endif /* XINERAMA */
     ErrorF("-dumbSched             Disable smart scheduling and threaded input, enable old behavior\n");
+    ErrorF("+dispatchprofile       Profile requests per client, for DISPATCH-PROFILE and SIGUSR2\n");
+#ifdef HAVE_LIBURING
+    ErrorF("+iouring               Use io_uring instead of epoll for the event loop\n");
+    ErrorF("-iouring               Use epoll for the event loop (default)\n");
+#endif
     ErrorF("-schedInterval int     Set scheduler interval in msec\n");
     ErrorF("+extension name        Enable extension\n");
     ErrorF("-extension name        Disable extension\n");
@@ -549,6 +560,9 @@ ProcessCommandLine(int argc, char *argv[])
             else
                 UseMsg();
         }
+        else if (strcmp(argv[i], "-fullclips") == 0) {
+            dixSettingIncrementalClips = false;
+        }
         else if (strcmp(argv[i], "-help") == 0) {
             UseMsg();
             exit(0);
@@ -731,6 +745,17 @@ ProcessCommandLine(int argc, char *argv[])
             SmartScheduleSignalEnable = FALSE;
 #endif
         }
+        else if (strcmp(argv[i], "+dispatchprofile") == 0) {
+            dispatchProfileEnabled = TRUE;
+        }
+#ifdef HAVE_LIBURING
+        else if (strcmp(argv[i], "+iouring") == 0) {
+            ospoll_use_io_uring = TRUE;
+        }
+        else if (strcmp(argv[i], "-iouring") == 0) {
+            ospoll_use_io_uring = FALSE;
+        }
+#endif
         else if (strcmp(argv[i], "-schedInterval") == 0) {
             if (++i < argc) {
                 SmartScheduleInterval = atoi(argv[i]);
@@ -758,6 +783,25 @@ ProcessCommandLine(int argc, char *argv[])
             else
                 UseMsg();
         }
+        else if (strcmp(argv[i], "-renderthreads") == 0) {
+            if (++i < argc && atoi(argv[i]) > 0)
+                dixSettingRenderThreads = atoi(argv[i]);
+            else
+                UseMsg();
+        }
+        else if (strcmp(argv[i], "-renderthreshold") == 0) {
+            if (++i < argc && atoi(argv[i]) > 0)
+                dixSettingRenderThreadPixels = atoi(argv[i]);
+            else
+                UseMsg();
+        }
+        else if (strcmp(argv[i], "-recordbuffer") == 0) {
+            if (++i < argc && atoi(argv[i]) >= 0 &&
+                atoi(argv[i]) <= INT_MAX / 1024)
+                dixSettingRecordBufferSize = atoi(argv[i]) * 1024;
+            else
+                UseMsg();
+        }
         else if (strcmp(argv[i], "+extension") == 0) {
             if (++i < argc) {
                 if (!EnableDisableExtension(argv[i], TRUE))
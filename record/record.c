@@ -45,8 +45,11 @@ and Jim Haggerty of Metheus.
 #include "dix/request_priv.h"
 #include "dix/resource_priv.h"
 #include "dix/screenint_priv.h"
+#include "dix/settings_priv.h"
 #include "miext/extinit_priv.h"
 #include "os/client_priv.h"
+#include "os/io_priv.h"
+#include "os/log_priv.h"
 #include "os/osdep.h"
 #include "Xext/panoramiX.h"
 #include "Xext/panoramiXsrv.h"
@@ -69,6 +72,36 @@ static RESTYPE RTContext;       /* internal resource type for Record contexts */
  */
 #define REPLY_BUF_SIZE 1024
 
+/* With -recordbuffer, a context gathers recorded protocol in a
+ * ring of chunks instead of replyBuffer.  Elements of different clients
+ * and categories go into the same chunk, each run of them behind its own
+ * reply header, and what was recorded is handed to the recording client
+ * by reference, not copied, when a chunk is full and once per pass of the
+ * dispatch loop.  A
+ * recording client that falls behind by the whole ring loses the elements
+ * that don't fit, rather than the server buffering them without limit,
+ * except for StartOfData, EndOfData and ClientDied.
+ * All of this happens on the main thread, so there is no locking.
+ */
+#define RECORD_CHUNK_SIZE (64 * 1024)
+
+typedef struct _RecordRing *RecordRingPtr;
+
+typedef struct {
+    RecordRingPtr ring;
+    size_t fill;                /* bytes recorded into the chunk */
+    size_t queued;              /* ... of which written to the client */
+    int refs;                   /* writes the client hasn't taken yet */
+} RecordChunkRec, *RecordChunkPtr;
+
+typedef struct _RecordRing {
+    int refcnt;                 /* the context's, and one per write */
+    int numChunks;
+    int cur;                    /* chunk being filled */
+    char *data;
+    RecordChunkRec chunks[];
+} RecordRingRec;
+
 /* Record Context structure */
 
 typedef struct {
@@ -82,6 +115,12 @@ typedef struct {
     int numBufBytes;            /* number of bytes in replyBuffer */
     char replyBuffer[REPLY_BUF_SIZE];   /* buffered recorded protocol */
     int inFlush;                /*  are we inside RecordFlushReplyBuffer */
+    RecordRingPtr ring;         /* if set, used instead of replyBuffer */
+    size_t batch;               /* offset of the open reply in the ring's chunk */
+    unsigned int inBatch:1;     /* is there an open reply in the ring? */
+    unsigned int dropping:1;    /* dropping the rest of a protocol element */
+    uint64_t bytesRecorded;     /* since the context was enabled */
+    uint64_t bytesDropped;
 } RecordContextRec, *RecordContextPtr;
 
 /*  RecordMinorOpRec - to hold minor opcode selections for extension requests
@@ -97,6 +136,14 @@ typedef union {
     } major;
 } RecordMinorOpRec, *RecordMinorOpPtr;
 
+/*  RecordBitmapRec - a set of numbers up to 255 as bits, compiled from a
+ *  RecordSet for the checks made on every request, reply and event
+ */
+
+typedef struct {
+    CARD32 bits[8];
+} RecordBitmapRec;
+
 /*  RecordClientsAndProtocolRec, nicknamed RCAP - holds all the client and
  *  protocol selections passed in a single CreateContext or RegisterClients.
  *  Generally, a context will have one of these from the create and an
@@ -114,6 +161,11 @@ typedef struct _RecordClientsAndProtocolRec {
     RecordSetPtr pDeviceEventSet;       /* device events to record */
     RecordSetPtr pDeliveredEventSet;    /* delivered events to record */
     RecordSetPtr pErrorSet;     /* errors to record */
+    RecordBitmapRec requestMajors;      /* the sets above as bitmaps */
+    RecordBitmapRec replyMajors;
+    RecordBitmapRec deviceEvents;
+    RecordBitmapRec deliveredEvents;
+    RecordBitmapRec errors;
     XID *pClientIDs;            /* array of clients to record */
     short numClients;           /* number of clients in pClientIDs */
     short sizeClients;          /* size of pClientIDs array */
@@ -217,6 +269,134 @@ RecordFindContextOnAllContexts(RecordContextPtr pContext)
 
 /***************************************************************************/
 
+/* RecordInBitmap
+ *
+ * Returns: non-zero if m, which must be at most 255, is in the bitmap.
+ */
+static inline CARD32
+RecordInBitmap(const RecordBitmapRec * pMap, int m)
+{
+    return pMap->bits[m >> 5] & (1U << (m & 31));
+}
+
+/* RecordCompileSet
+ *
+ * Arguments:
+ *	pSet is the set to compile, or NULL for the empty set.
+ *	pMap is the bitmap to fill in.
+ *
+ * Returns: nothing.
+ *
+ * Side Effects:
+ *	pMap holds the members of pSet up to 255.
+ */
+static void
+RecordCompileSet(RecordSetPtr pSet, RecordBitmapRec * pMap)
+{
+    RecordSetIteratePtr pIter = NULL;
+    RecordSetInterval interval;
+
+    memset(pMap, 0, sizeof(*pMap));
+    if (!pSet)
+        return;
+    while ((pIter = RecordIterateSet(pSet, pIter, &interval))) {
+        unsigned int m;
+
+        for (m = interval.first; m <= interval.last && m <= 255; m++)
+            pMap->bits[m >> 5] |= 1U << (m & 31);
+    }
+}                               /* RecordCompileSet */
+
+/***************************************************************************/
+
+/* RecordRingCreate
+ *
+ * Arguments:
+ *	size is the number of bytes to buffer.
+ *
+ * Returns: a ring of at least two chunks, or NULL if out of memory.
+ */
+static RecordRingPtr
+RecordRingCreate(int size)
+{
+    int numChunks = max(size / RECORD_CHUNK_SIZE, 2);
+    RecordRingPtr ring;
+    int i;
+
+    ring = calloc(1, sizeof(RecordRingRec) + numChunks * sizeof(RecordChunkRec));
+    if (!ring)
+        return NULL;
+    ring->data = malloc((size_t) numChunks * RECORD_CHUNK_SIZE);
+    if (!ring->data) {
+        free(ring);
+        return NULL;
+    }
+    ring->refcnt = 1;
+    ring->numChunks = numChunks;
+    for (i = 0; i < numChunks; i++)
+        ring->chunks[i].ring = ring;
+    return ring;
+}                               /* RecordRingCreate */
+
+static void
+RecordRingUnref(RecordRingPtr ring)
+{
+    if (--ring->refcnt)
+        return;
+    free(ring->data);
+    free(ring);
+}                               /* RecordRingUnref */
+
+/* RecordRingRelease
+ *
+ * Called by the OS layer once a write out of a chunk went to the
+ * recording client, or the client went away.
+ */
+static void
+RecordRingRelease(void *closure)
+{
+    RecordChunkPtr chunk = closure;
+
+    chunk->refs--;
+    RecordRingUnref(chunk->ring);
+}                               /* RecordRingRelease */
+
+static char *
+RecordChunkData(RecordChunkPtr chunk)
+{
+    return chunk->ring->data +
+        (chunk - chunk->ring->chunks) * (size_t) RECORD_CHUNK_SIZE;
+}
+
+/* RecordRingQueue
+ *
+ * Arguments:
+ *	pContext is an enabled context with a ring.
+ *
+ * Returns: nothing.
+ *
+ * Side Effects:
+ *	What was recorded into the current chunk since the last time is
+ *	written to the recording client by reference, and the open reply,
+ *	if any, is closed.
+ */
+static void
+RecordRingQueue(RecordContextPtr pContext)
+{
+    RecordRingPtr ring = pContext->ring;
+    RecordChunkPtr chunk = &ring->chunks[ring->cur];
+    size_t start = chunk->queued;
+
+    pContext->inBatch = 0;
+    if (chunk->fill == start)
+        return;
+    ring->refcnt++;
+    chunk->refs++;
+    chunk->queued = chunk->fill;
+    WriteToClientRef(pContext->pRecordingClient, chunk->fill - start,
+                     RecordChunkData(chunk) + start, RecordRingRelease, chunk);
+}                               /* RecordRingQueue */
+
 /* RecordFlushReplyBuffer
  *
  * Arguments:
@@ -241,6 +421,8 @@ RecordFlushReplyBuffer(RecordContextPtr pContext,
         pContext->inFlush)
         return;
     ++pContext->inFlush;
+    if (pContext->ring)
+        RecordRingQueue(pContext);
     if (pContext->numBufBytes)
         WriteToClient(pContext->pRecordingClient, pContext->numBufBytes,
                       pContext->replyBuffer);
@@ -252,6 +434,249 @@ RecordFlushReplyBuffer(RecordContextPtr pContext,
     --pContext->inFlush;
 }                               /* RecordFlushReplyBuffer */
 
+/* RecordRingAdvance
+ *
+ * Arguments:
+ *	pContext is an enabled context with a ring.
+ *
+ * Returns: FALSE if the recording client hasn't taken the next chunk yet.
+ *
+ * Side Effects:
+ *	The current chunk is flushed, and recording continues in the next
+ *	one, if it is free.
+ */
+static Bool
+RecordRingAdvance(RecordContextPtr pContext)
+{
+    RecordRingPtr ring = pContext->ring;
+    RecordChunkPtr chunk;
+
+    RecordFlushReplyBuffer(pContext, NULL, 0, NULL, 0);
+    chunk = &ring->chunks[ring->cur];
+    if (chunk->queued != chunk->fill)
+        return FALSE;           /* in a flush already, or the client's gone */
+    chunk = &ring->chunks[(ring->cur + 1) % ring->numChunks];
+    if (chunk->refs)
+        return FALSE;
+    ring->cur = chunk - ring->chunks;
+    chunk->fill = chunk->queued = 0;
+    return TRUE;
+}                               /* RecordRingAdvance */
+
+/* RecordInitReplyHeader
+ *
+ * Fills in the header of the reply that recorded protocol elements
+ * of pClient, or the server if NULL, in category are sent in.
+ */
+static void
+RecordInitReplyHeader(RecordContextPtr pContext, ClientPtr pClient,
+                      int category, CARD32 serverTime,
+                      xRecordEnableContextReply * pRep)
+{
+    Bool recordingClientSwapped = pContext->pRecordingClient->swapped;
+
+    pRep->type = X_Reply;
+    pRep->category = category;
+    pRep->sequenceNumber = pContext->pRecordingClient->sequence;
+    pRep->length = 0;
+    pRep->elementHeader = pContext->elemHeaders;
+    pRep->serverTime = serverTime;
+    if (pClient) {
+        pRep->clientSwapped =
+            (pClient->swapped != recordingClientSwapped);
+        pRep->idBase = pClient->clientAsMask;
+        pRep->recordedSequenceNumber = pClient->sequence;
+    }
+    else {                      /* it's a device event, StartOfData, or EndOfData */
+
+        pRep->clientSwapped = (category != XRecordFromServer) &&
+            recordingClientSwapped;
+        pRep->idBase = 0;
+        pRep->recordedSequenceNumber = 0;
+    }
+
+    if (recordingClientSwapped) {
+        swaps(&pRep->sequenceNumber);
+        swapl(&pRep->length);
+        swapl(&pRep->idBase);
+        swapl(&pRep->serverTime);
+        swapl(&pRep->recordedSequenceNumber);
+    }
+}                               /* RecordInitReplyHeader */
+
+/* RecordElementHeaders
+ *
+ * Fills in pElemHeaderData with the element headers the context wants
+ * in front of a protocol element, and returns how many there are.
+ */
+static int
+RecordElementHeaders(RecordContextPtr pContext, ClientPtr pClient,
+                     int category, CARD32 serverTime,
+                     CARD32 *pElemHeaderData)
+{
+    Bool recordingClientSwapped = pContext->pRecordingClient->swapped;
+    int numElemHeaders = 0;
+
+    if (((pContext->elemHeaders & XRecordFromClientTime)
+         && category == XRecordFromClient)
+        || ((pContext->elemHeaders & XRecordFromServerTime)
+            && category == XRecordFromServer)) {
+        pElemHeaderData[numElemHeaders] = serverTime;
+        if (recordingClientSwapped)
+            swapl(&pElemHeaderData[numElemHeaders]);
+        numElemHeaders++;
+    }
+
+    if ((pContext->elemHeaders & XRecordFromClientSequence)
+        && (category == XRecordFromClient || category == XRecordClientDied)) {
+        pElemHeaderData[numElemHeaders] = pClient->sequence;
+        if (recordingClientSwapped)
+            swapl(&pElemHeaderData[numElemHeaders]);
+        numElemHeaders++;
+    }
+    return numElemHeaders;
+}                               /* RecordElementHeaders */
+
+/* RecordAddReplyLength
+ *
+ * Adds len 4 byte units to the length of the reply at pRep.
+ */
+static void
+RecordAddReplyLength(RecordContextPtr pContext,
+                     xRecordEnableContextReply * pRep, int len)
+{
+    Bool recordingClientSwapped = pContext->pRecordingClient->swapped;
+    int replylen;
+
+    replylen = pRep->length;
+    if (recordingClientSwapped)
+        swapl(&replylen);
+    replylen += len;
+    if (recordingClientSwapped)
+        swapl(&replylen);
+    pRep->length = replylen;
+}                               /* RecordAddReplyLength */
+
+/* RecordWriteElement
+ *
+ * Writes a protocol element without data, in a reply of its own, directly
+ * to the recording client after what is in the ring.
+ */
+static void
+RecordWriteElement(RecordContextPtr pContext, ClientPtr pClient,
+                   int category, CARD32 serverTime, CARD32 *pElemHeaderData,
+                   int numElemHeaders)
+{
+    xRecordEnableContextReply rep;
+
+    RecordInitReplyHeader(pContext, pClient, category, serverTime, &rep);
+    RecordAddReplyLength(pContext, &rep, numElemHeaders);
+    RecordFlushReplyBuffer(pContext, &rep, SIZEOF(xRecordEnableContextReply),
+                           pElemHeaderData, numElemHeaders * 4);
+}                               /* RecordWriteElement */
+
+/* RecordRingProtocolElement
+ *
+ * Like RecordAProtocolElement, for contexts with a ring.  An element is
+ * dropped as a whole, with all its continuations, when it doesn't fit in
+ * what the recording client has taken of the ring, unless it's one the
+ * recording client must see.  Elements too large for a chunk are written
+ * directly after what is in the ring.
+ */
+static void
+RecordRingProtocolElement(RecordContextPtr pContext, ClientPtr pClient,
+                          int category, void *data, int datalen, int padlen,
+                          int futurelen)
+{
+    RecordRingPtr ring = pContext->ring;
+    RecordChunkPtr chunk = &ring->chunks[ring->cur];
+    CARD32 elemHeaderData[2];
+    int numElemHeaders = 0;
+    char *p;
+
+    if (futurelen >= 0) {       /* start of new protocol element */
+        CARD32 serverTime = GetTimeInMillis();
+        Bool newReply = !pContext->inBatch ||
+            pContext->pBufClient != pClient ||
+            pContext->bufCategory != category;
+        size_t need, room;
+
+        pContext->dropping = 0;
+        numElemHeaders = RecordElementHeaders(pContext, pClient, category,
+                                              serverTime, elemHeaderData);
+        need = numElemHeaders * 4 + datalen + futurelen;
+
+        /* too large for any chunk, only its reply goes into the ring */
+        if (need > RECORD_CHUNK_SIZE - SIZEOF(xRecordEnableContextReply)) {
+            room = SIZEOF(xRecordEnableContextReply);
+            newReply = TRUE;
+        }
+        else
+            room = need + (newReply ? SIZEOF(xRecordEnableContextReply) : 0);
+
+        if (chunk->fill + room > RECORD_CHUNK_SIZE) {
+            if (!RecordRingAdvance(pContext)) {
+                /* the recording client can't do without these */
+                if (category == XRecordStartOfData ||
+                    category == XRecordEndOfData ||
+                    category == XRecordClientDied) {
+                    RecordWriteElement(pContext, pClient, category,
+                                       serverTime, elemHeaderData,
+                                       numElemHeaders);
+                    pContext->bytesRecorded += need;
+                    return;
+                }
+                pContext->dropping = 1;
+                pContext->bytesDropped += need;
+                return;
+            }
+            chunk = &ring->chunks[ring->cur];
+            if (!newReply) {
+                newReply = TRUE;
+                room += SIZEOF(xRecordEnableContextReply);
+            }
+        }
+
+        if (newReply) {
+            pContext->batch = chunk->fill;
+            pContext->inBatch = 1;
+            pContext->pBufClient = pClient;
+            pContext->bufCategory = category;
+            RecordInitReplyHeader(pContext, pClient, category, serverTime,
+                                  (xRecordEnableContextReply *)
+                                  (RecordChunkData(chunk) + chunk->fill));
+            chunk->fill += SIZEOF(xRecordEnableContextReply);
+        }
+        RecordAddReplyLength(pContext, (xRecordEnableContextReply *)
+                             (RecordChunkData(chunk) + pContext->batch),
+                             numElemHeaders + bytes_to_int32(datalen) +
+                             bytes_to_int32(futurelen));
+        pContext->bytesRecorded += need;
+    }
+    else if (pContext->dropping) {
+        pContext->bytesDropped += datalen;
+        return;
+    }
+
+    numElemHeaders *= 4;
+
+    if (RECORD_CHUNK_SIZE - chunk->fill < datalen + numElemHeaders) {
+        RecordFlushReplyBuffer(pContext, (void *) elemHeaderData,
+                               numElemHeaders, (void *) data,
+                               datalen - padlen);
+        return;
+    }
+
+    p = RecordChunkData(chunk) + chunk->fill;
+    memcpy(p, elemHeaderData, numElemHeaders);
+    p += numElemHeaders;
+    if (datalen) {
+        memcpy(p, data, datalen - padlen);
+        memset(p + datalen - padlen, 0, padlen);
+    }
+    chunk->fill += numElemHeaders + datalen;
+}                               /* RecordRingProtocolElement */
+
 /* RecordAProtocolElement
  *
  * Arguments:
@@ -287,14 +712,17 @@ RecordAProtocolElement(RecordContextPtr pContext, ClientPtr pClient,
 {
     CARD32 elemHeaderData[2];
     int numElemHeaders = 0;
-    Bool recordingClientSwapped = pContext->pRecordingClient->swapped;
-    CARD32 serverTime = 0;
-    Bool gotServerTime = FALSE;
-    int replylen;
+
+    if (pContext->ring) {
+        RecordRingProtocolElement(pContext, pClient, category, data,
+                                  datalen, padlen, futurelen);
+        return;
+    }
 
     if (futurelen >= 0) {       /* start of new protocol element */
         xRecordEnableContextReply *pRep = (xRecordEnableContextReply *)
             pContext->replyBuffer;
+        CARD32 serverTime = GetTimeInMillis();
 
         if (pContext->pBufClient != pClient ||
             pContext->bufCategory != category) {
@@ -304,71 +732,22 @@ RecordAProtocolElement(RecordContextPtr pContext, ClientPtr pClient,
         }
 
         if (!pContext->numBufBytes) {
-            serverTime = GetTimeInMillis();
-            gotServerTime = TRUE;
-            pRep->type = X_Reply;
-            pRep->category = category;
-            pRep->sequenceNumber = pContext->pRecordingClient->sequence;
-            pRep->length = 0;
-            pRep->elementHeader = pContext->elemHeaders;
-            pRep->serverTime = serverTime;
-            if (pClient) {
-                pRep->clientSwapped =
-                    (pClient->swapped != recordingClientSwapped);
-                pRep->idBase = pClient->clientAsMask;
-                pRep->recordedSequenceNumber = pClient->sequence;
-            }
-            else {              /* it's a device event, StartOfData, or EndOfData */
-
-                pRep->clientSwapped = (category != XRecordFromServer) &&
-                    recordingClientSwapped;
-                pRep->idBase = 0;
-                pRep->recordedSequenceNumber = 0;
-            }
-
-            if (recordingClientSwapped) {
-                swaps(&pRep->sequenceNumber);
-                swapl(&pRep->length);
-                swapl(&pRep->idBase);
-                swapl(&pRep->serverTime);
-                swapl(&pRep->recordedSequenceNumber);
-            }
+            RecordInitReplyHeader(pContext, pClient, category, serverTime,
+                                  pRep);
             pContext->numBufBytes = SIZEOF(xRecordEnableContextReply);
         }
 
         /* generate element headers if needed */
 
-        if (((pContext->elemHeaders & XRecordFromClientTime)
-             && category == XRecordFromClient)
-            || ((pContext->elemHeaders & XRecordFromServerTime)
-                && category == XRecordFromServer)) {
-            if (gotServerTime)
-                elemHeaderData[numElemHeaders] = serverTime;
-            else
-                elemHeaderData[numElemHeaders] = GetTimeInMillis();
-            if (recordingClientSwapped)
-                swapl(&elemHeaderData[numElemHeaders]);
-            numElemHeaders++;
-        }
-
-        if ((pContext->elemHeaders & XRecordFromClientSequence)
-            && (category == XRecordFromClient || category == XRecordClientDied)) {
-            elemHeaderData[numElemHeaders] = pClient->sequence;
-            if (recordingClientSwapped)
-                swapl(&elemHeaderData[numElemHeaders]);
-            numElemHeaders++;
-        }
+        numElemHeaders = RecordElementHeaders(pContext, pClient, category,
+                                              serverTime, elemHeaderData);
 
         /* adjust reply length */
 
-        replylen = pRep->length;
-        if (recordingClientSwapped)
-            swapl(&replylen);
-        replylen += numElemHeaders + bytes_to_int32(datalen) +
-            bytes_to_int32(futurelen);
-        if (recordingClientSwapped)
-            swapl(&replylen);
-        pRep->length = replylen;
+        RecordAddReplyLength(pContext, pRep,
+                             numElemHeaders + bytes_to_int32(datalen) +
+                             bytes_to_int32(futurelen));
+        pContext->bytesRecorded += numElemHeaders * 4 + datalen + futurelen;
     }                           /* end if not continued reply */
 
     numElemHeaders *= 4;
@@ -516,7 +895,7 @@ RecordARequest(ClientPtr client)
         pContext = ppAllContexts[i];
         pRCAP = RecordFindClientOnContext(pContext, client->clientAsMask, NULL);
         if (pRCAP && pRCAP->pRequestMajorOpSet &&
-            RecordIsMemberOfSet(pRCAP->pRequestMajorOpSet, majorop)) {
+            RecordInBitmap(&pRCAP->requestMajors, majorop)) {
             if (majorop <= 127) {       /* core request */
 
                 if (client->req_len == 0)
@@ -602,7 +981,7 @@ RecordAReply(CallbackListPtr *pcbl, void *nulldata, void *calldata)
                     pContext->continuedReply = 0;
             }
             else if (pri->startOfReply && pRCAP->pReplyMajorOpSet &&
-                     RecordIsMemberOfSet(pRCAP->pReplyMajorOpSet, majorop)) {
+                     RecordInBitmap(&pRCAP->replyMajors, majorop)) {
                 if (majorop <= 127) {   /* core reply */
                     RecordAProtocolElement(pContext, client, XRecordFromServer,
                                            (void *) pri->replyData,
@@ -679,13 +1058,13 @@ RecordADeliveredEventOrError(CallbackListPtr *pcbl, void *nulldata,
                 int recordit = 0;
 
                 if (pRCAP->pErrorSet) {
-                    recordit = RecordIsMemberOfSet(pRCAP->pErrorSet,
-                                                   ((xError *) (pev))->
-                                                   errorCode);
+                    recordit = RecordInBitmap(&pRCAP->errors,
+                                              ((xError *) (pev))->
+                                              errorCode);
                 }
                 else if (pRCAP->pDeliveredEventSet) {
-                    recordit = RecordIsMemberOfSet(pRCAP->pDeliveredEventSet,
-                                                   pev->u.u.type & 0177);
+                    recordit = RecordInBitmap(&pRCAP->deliveredEvents,
+                                              pev->u.u.type & 0177);
                 }
                 if (recordit) {
                     xEvent swappedEvent;
@@ -713,7 +1092,7 @@ RecordSendProtocolEvents(RecordClientsAndProtocolPtr pRCAP,
     int ev;                     /* event index */
 
     for (ev = 0; ev < count; ev++, pev++) {
-        if (RecordIsMemberOfSet(pRCAP->pDeviceEventSet, pev->u.u.type & 0177)) {
+        if (RecordInBitmap(&pRCAP->deviceEvents, pev->u.u.type & 0177)) {
             xEvent swappedEvent;
             xEvent *pEvToRecord = pev;
 
@@ -834,6 +1213,31 @@ RecordFlushAllContexts(CallbackListPtr *pcbl,
     }
 }                               /* RecordFlushAllContexts */
 
+/* RecordBlockHandler
+ *
+ * Arguments:
+ *	blockData and timeout are unused.
+ *
+ * Returns: nothing.
+ *
+ * Side Effects:
+ *	What was recorded into the rings of enabled contexts since the
+ *	last time is queued to the recording clients, once for all the
+ *	requests dispatched in between, before their output is flushed.
+ */
+static void
+RecordBlockHandler(void *blockData, void *timeout)
+{
+    int eci;                    /* enabled context index */
+    RecordContextPtr pContext;
+
+    for (eci = 0; eci < numEnabledContexts; eci++) {
+        pContext = ppAllContexts[eci];
+        if (pContext->ring)
+            RecordFlushReplyBuffer(pContext, NULL, 0, NULL, 0);
+    }
+}                               /* RecordBlockHandler */
+
 /* RecordInstallHooks
  *
  * Arguments:
@@ -911,6 +1315,11 @@ RecordInstallHooks(RecordClientsAndProtocolPtr pRCAP, XID oneclient)
             return BadAlloc;
         if (!AddCallback(&FlushCallback, RecordFlushAllContexts, NULL))
             return BadAlloc;
+        /* contexts with a ring are flushed once per dispatch loop */
+        if (!RegisterBlockAndWakeupHandlers(RecordBlockHandler,
+                                            (ServerWakeupHandlerProcPtr)
+                                            NoopDDA, NULL))
+            return BadAlloc;
         /* Alternate context flushing scheme: delete the line above
          * and call RegisterBlockAndWakeupHandlers here passing
          * RecordFlushAllContexts.  Is this any better?
@@ -1011,6 +1420,10 @@ RecordUninstallHooks(RecordClientsAndProtocolPtr pRCAP, XID oneclient)
          */
         /* Having deleted the callback, call it one last time. -gildea */
         RecordFlushAllContexts(&FlushCallback, NULL, NULL);
+        RemoveBlockAndWakeupHandlers(RecordBlockHandler,
+                                     (ServerWakeupHandlerProcPtr) NoopDDA,
+                                     NULL);
+        RecordBlockHandler(NULL, NULL);
     }
 }                               /* RecordUninstallHooks */
 
@@ -1757,6 +2170,12 @@ RecordRegisterClients(RecordContextPtr pContext, ClientPtr client,
     else
         pRCAP->pDeliveredEventSet = NULL;
 
+    RecordCompileSet(pRCAP->pRequestMajorOpSet, &pRCAP->requestMajors);
+    RecordCompileSet(pRCAP->pReplyMajorOpSet, &pRCAP->replyMajors);
+    RecordCompileSet(pRCAP->pErrorSet, &pRCAP->errors);
+    RecordCompileSet(pRCAP->pDeviceEventSet, &pRCAP->deviceEvents);
+    RecordCompileSet(pRCAP->pDeliveredEventSet, &pRCAP->deliveredEvents);
+
     if (nExtReqSets) {
         pRCAP->pRequestMinOpInfo = (RecordMinorOpPtr)
             ((char *) pRCAP + extReqSetsOffset);
@@ -1884,6 +2303,9 @@ ProcRecordCreateContext(ClientPtr client)
     pContext->pBufClient = NULL;
     pContext->continuedReply = 0;
     pContext->inFlush = 0;
+    pContext->ring = NULL;
+    pContext->inBatch = 0;
+    pContext->dropping = 0;
 
     err = RecordRegisterClients(pContext, client,
                                 (xRecordRegisterClientsReq *) stuff);
@@ -2340,6 +2762,14 @@ ProcRecordEnableContext(ClientPtr client)
         }
     }
 
+    /* without a ring, fall back to the small buffer flushed every 1 KiB */
+    if (dixSettingRecordBufferSize)
+        pContext->ring = RecordRingCreate(dixSettingRecordBufferSize);
+    pContext->inBatch = 0;
+    pContext->dropping = 0;
+    pContext->bytesRecorded = 0;
+    pContext->bytesDropped = 0;
+
     /* Disallow further request processing on this connection until
      * the context is disabled.
      */
@@ -2404,6 +2834,16 @@ RecordDisableContext(RecordContextPtr pContext)
         RecordUninstallHooks(pRCAP, 0);
     }
 
+    LogMessageVerb(X_INFO, 3,
+                   "RECORD: context 0x%x recorded %llu bytes, dropped %llu\n",
+                   (unsigned) pContext->id,
+                   (unsigned long long) pContext->bytesRecorded,
+                   (unsigned long long) pContext->bytesDropped);
+    /* writes still queued hold the ring until they're done */
+    if (pContext->ring) {
+        RecordRingUnref(pContext->ring);
+        pContext->ring = NULL;
+    }
     pContext->pRecordingClient = NULL;
 
     /* move the newly disabled context to the rear part of ppAllContexts,
@@ -26,7 +26,7 @@
 
 #include "dix/screenint_priv.h"
 #include "os/bug_priv.h"
-#include "os/xsha1.h"
+#include "os/osdep.h"
 
 #include "misc.h"
 #include "scrnintstr.h"
@@ -44,57 +44,259 @@
 #include "glyphstr_priv.h"
 #include "mipict.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /*
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
+ * Glyphs live in open addressing tables with linear probing: one per
+ * glyph set keyed on the glyph id, and one per depth keyed on the content
+ * hash, through which glyph sets share identical glyphs. The tables are a
+ * power of two in size and at most three quarters full. Removing an entry
+ * moves the ones after it back, so there are no tombstones.
  */
-static GlyphHashSetRec glyphHashSets[] = {
-    {32, 43, 41},
-    {64, 73, 71},
-    {128, 151, 149},
-    {256, 283, 281},
-    {512, 571, 569},
-    {1024, 1153, 1151},
-    {2048, 2269, 2267},
-    {4096, 4519, 4517},
-    {8192, 9013, 9011},
-    {16384, 18043, 18041},
-    {32768, 36109, 36107},
-    {65536, 72091, 72089},
-    {131072, 144409, 144407},
-    {262144, 288361, 288359},
-    {524288, 576883, 576881},
-    {1048576, 1153459, 1153457},
-    {2097152, 2307163, 2307161},
-    {4194304, 4613893, 4613891},
-    {8388608, 9227641, 9227639},
-    {16777216, 18455029, 18455027},
-    {33554432, 36911011, 36911009},
-    {67108864, 73819861, 73819859},
-    {134217728, 147639589, 147639587},
-    {268435456, 295279081, 295279079},
-    {536870912, 590559793, 590559791}
-};
-
-#define NGLYPHHASHSETS	ARRAY_SIZE(glyphHashSets)
+#define GLYPH_HASH_MIN_SIZE     32
 
 static GlyphHashRec globalGlyphs[GlyphFormatNum];
 
+/*
+ * 128 bit content hash, not a cryptographic one: equal hashes are checked
+ * byte by byte. Four 64 bit lanes take 32 bytes of bits at a time, adding
+ * the data to the neighbouring lane and the product of the two halves of
+ * the data xor a secret to its own, two lanes per SSE2 multiply. The
+ * lanes are scrambled every 8 such stripes, and the secret is random so
+ * clients can't pick glyphs that collide.
+ */
+#define GLYPH_HASH_LANES        4
+#define GLYPH_HASH_STRIPE       (GLYPH_HASH_LANES * 8)
+#define GLYPH_HASH_BLOCK        8       /* stripes between scrambles */
+
+static uint64_t glyphHashSecret[GLYPH_HASH_LANES + GLYPH_HASH_BLOCK +
+                                GLYPH_HASH_LANES];
+static Bool glyphHashSeeded;
+
+static inline uint64_t
+GlyphHashRead64(const void *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* the murmur3 finalizer */
+static inline uint64_t
+GlyphHashMix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* n stripes, the secret moving one lane along with each */
+static inline void
+GlyphHashStripes(uint64_t *acc, const CARD8 *p, const uint64_t *secret, int n)
+{
+#ifdef __SSE2__
+    __m128i acc01 = _mm_loadu_si128((const __m128i *) acc);
+    __m128i acc23 = _mm_loadu_si128((const __m128i *) (acc + 2));
+
+    for (; n; n--, p += GLYPH_HASH_STRIPE, secret++) {
+        __m128i data01 = _mm_loadu_si128((const __m128i *) p);
+        __m128i data23 = _mm_loadu_si128((const __m128i *) (p + 16));
+        __m128i key01 = _mm_xor_si128(data01,
+                                      _mm_loadu_si128((const __m128i *) secret));
+        __m128i key23 = _mm_xor_si128(data23,
+                                      _mm_loadu_si128((const __m128i *)
+                                                      (secret + 2)));
+
+        acc01 = _mm_add_epi64(acc01, _mm_shuffle_epi32(data01, 0x4e));
+        acc23 = _mm_add_epi64(acc23, _mm_shuffle_epi32(data23, 0x4e));
+        acc01 = _mm_add_epi64(acc01,
+                              _mm_mul_epu32(key01, _mm_srli_epi64(key01, 32)));
+        acc23 = _mm_add_epi64(acc23,
+                              _mm_mul_epu32(key23, _mm_srli_epi64(key23, 32)));
+    }
+    _mm_storeu_si128((__m128i *) acc, acc01);
+    _mm_storeu_si128((__m128i *) (acc + 2), acc23);
+#else
+    uint64_t a0 = acc[0], a1 = acc[1], a2 = acc[2], a3 = acc[3];
+
+    for (; n; n--, p += GLYPH_HASH_STRIPE, secret++) {
+        uint64_t d0 = GlyphHashRead64(p), d1 = GlyphHashRead64(p + 8);
+        uint64_t d2 = GlyphHashRead64(p + 16), d3 = GlyphHashRead64(p + 24);
+        uint64_t k0 = d0 ^ secret[0], k1 = d1 ^ secret[1];
+        uint64_t k2 = d2 ^ secret[2], k3 = d3 ^ secret[3];
+
+        a0 += d1 + (k0 & 0xffffffff) * (k0 >> 32);
+        a1 += d0 + (k1 & 0xffffffff) * (k1 >> 32);
+        a2 += d3 + (k2 & 0xffffffff) * (k2 >> 32);
+        a3 += d2 + (k3 & 0xffffffff) * (k3 >> 32);
+    }
+    acc[0] = a0;
+    acc[1] = a1;
+    acc[2] = a2;
+    acc[3] = a3;
+#endif
+}
+
+static inline void
+GlyphHashScramble(uint64_t *acc)
+{
+    const uint64_t *secret = glyphHashSecret + GLYPH_HASH_LANES +
+        GLYPH_HASH_BLOCK;
+
+    for (int i = 0; i < GLYPH_HASH_LANES; i++) {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= secret[i];
+        acc[i] *= 0x9e3779b1;
+    }
+}
+
+int
+HashGlyph(xGlyphInfo * gi,
+          CARD8 *bits, unsigned long size, unsigned char sha1[20])
+{
+    uint64_t acc[GLYPH_HASH_LANES], info[2] = { 0, 0 }, lo, hi;
+    CARD8 tail[GLYPH_HASH_STRIPE];
+    unsigned long stripes = size ? (size - 1) / GLYPH_HASH_STRIPE : 0;
+    unsigned long left = size - stripes * GLYPH_HASH_STRIPE;
+    CARD32 len = size;
+
+    if (!glyphHashSeeded) {
+        arc4random_buf(glyphHashSecret, sizeof(glyphHashSecret));
+        glyphHashSeeded = TRUE;
+    }
+
+    memcpy(info, gi, sizeof(xGlyphInfo));
+    acc[0] = info[0] ^ 0x9e3779b97f4a7c15ULL;
+    acc[1] = info[1] ^ 0xc2b2ae3d27d4eb4fULL;
+    acc[2] = 0x165667b19e3779f9ULL;
+    acc[3] = 0x85ebca77c2b2ae63ULL;
+
+    for (; stripes >= GLYPH_HASH_BLOCK; stripes -= GLYPH_HASH_BLOCK) {
+        GlyphHashStripes(acc, bits, glyphHashSecret, GLYPH_HASH_BLOCK);
+        GlyphHashScramble(acc);
+        bits += GLYPH_HASH_BLOCK * GLYPH_HASH_STRIPE;
+    }
+    GlyphHashStripes(acc, bits, glyphHashSecret, stripes);
+    bits += stripes * GLYPH_HASH_STRIPE;
+    /* the last 1 to 32 bytes, padded with zeros */
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, bits, left);
+    GlyphHashStripes(acc, tail, glyphHashSecret + stripes, 1);
+
+    lo = size * 0x9e3779b185ebca87ULL;
+    hi = ~lo;
+    for (int i = 0; i < GLYPH_HASH_LANES; i++) {
+        lo = GlyphHashMix(lo ^ acc[i]);
+        hi = GlyphHashMix(hi + (acc[i] ^ glyphHashSecret[i]));
+    }
+
+    /* the size too, glyphs of different sizes never look alike */
+    memcpy(sha1, &lo, 8);
+    memcpy(sha1 + 8, &hi, 8);
+    memcpy(sha1 + 16, &len, 4);
+    return Success;
+}
+
+/*
+ * Glyphs don't keep the bits they were made from, to tell glyphs with the
+ * same hash apart they're read back from the picture on the first screen.
+ * Only glyphs whose hash matched get that far, nearly always they're the
+ * same. The image is padded like the client sends it, text sized ones go
+ * in buf, larger ones are allocated.
+ */
+#define GLYPH_IMAGE_BUF         1024
+
+static CARD8 *
+GlyphReadImage(GlyphPtr glyph, CARD8 buf[GLYPH_IMAGE_BUF])
+{
+    ScreenPtr pScreen = screenInfo.screens[0];
+    PicturePtr pPicture = GetGlyphPicture(glyph, pScreen);
+    DrawablePtr pDrawable;
+    size_t size;
+    CARD8 *image;
+
+    if (!pPicture || !(pDrawable = pPicture->pDrawable))
+        return NULL;
+    size = (size_t) PixmapBytePad(glyph->info.width, pDrawable->depth) *
+        glyph->info.height;
+    image = size <= GLYPH_IMAGE_BUF ? buf : malloc(size);
+    if (image)
+        (*pScreen->GetImage) (pDrawable, 0, 0,
+                              glyph->info.width, glyph->info.height,
+                              ZPixmap, ~0, (char *) image);
+    return image;
+}
+
+/* the padding at the end of each row doesn't count */
+static Bool
+GlyphImageEqual(GlyphPtr glyph, const CARD8 *bits)
+{
+    CARD8 buf[GLYPH_IMAGE_BUF];
+    CARD8 *image = GlyphReadImage(glyph, buf);
+    int depth, stride, rowBits, left;
+    Bool equal = FALSE;
+
+    if (!image)
+        return FALSE;
+    depth = GetGlyphPicture(glyph, screenInfo.screens[0])->pDrawable->depth;
+    stride = PixmapBytePad(glyph->info.width, depth);
+    rowBits = glyph->info.width * BitsPerPixel(depth);
+    left = rowBits & 7;
+    for (int y = 0; y < glyph->info.height; y++) {
+        const CARD8 *a = image + y * stride, *b = bits + y * stride;
+        CARD8 mask = BITMAP_BIT_ORDER == LSBFirst ?
+            (1 << left) - 1 : 0xff << (8 - left);
+
+        if (memcmp(a, b, rowBits >> 3) != 0 ||
+            (left && ((a[rowBits >> 3] ^ b[rowBits >> 3]) & mask)))
+            goto out;
+    }
+    equal = TRUE;
+out:
+    if (image != buf)
+        free(image);
+    return equal;
+}
+
+static inline CARD32
+GlyphSignature(const unsigned char sha1[20])
+{
+    CARD32 signature;
+
+    memcpy(&signature, sha1, sizeof(signature));
+    return signature;
+}
+
+/* glyph ids are often sequential, spread them over the table */
+static inline CARD32
+GlyphRefSlot(GlyphHashPtr hash, CARD32 signature)
+{
+    signature ^= signature >> 16;
+    signature *= 0x85ebca6b;
+    signature ^= signature >> 13;
+    return signature & hash->mask;
+}
+
 void
 GlyphUninit(ScreenPtr pScreen)
 {
     PictureScreenPtr ps = GetPictureScreen(pScreen);
     GlyphPtr glyph;
-    int fdepth, i;
+    int fdepth;
 
     for (fdepth = 0; fdepth < GlyphFormatNum; fdepth++) {
-        if (!globalGlyphs[fdepth].hashSet)
+        if (!globalGlyphs[fdepth].table)
             continue;
 
-        for (i = 0; i < globalGlyphs[fdepth].hashSet->size; i++) {
+        for (CARD32 i = 0; i <= globalGlyphs[fdepth].mask; i++) {
             glyph = globalGlyphs[fdepth].table[i].glyph;
-            if (glyph && glyph != DeletedGlyph) {
+            if (glyph) {
                 if (GetGlyphPicture(glyph, pScreen)) {
                     FreePicture((void *) GetGlyphPicture(glyph, pScreen), 0);
                     SetGlyphPicture(glyph, pScreen, NULL);
@@ -105,102 +307,94 @@ GlyphUninit(ScreenPtr pScreen)
     }
 }
 
-static GlyphHashSetPtr
-FindGlyphHashSet(CARD32 filled)
+/*
+ * The entry for id in a glyph set's table, or the empty one it goes in.
+ */
+static GlyphRefPtr
+FindGlyphRef(GlyphHashPtr hash, CARD32 id)
 {
-    int i;
+    GlyphRefPtr gr;
 
-    for (i = 0; i < NGLYPHHASHSETS; i++)
-        if (glyphHashSets[i].entries >= filled)
-            return &glyphHashSets[i];
-    return 0;
+    for (CARD32 elt = GlyphRefSlot(hash, id);; elt = (elt + 1) & hash->mask) {
+        gr = &hash->table[elt];
+        if (!gr->glyph || gr->signature == id)
+            return gr;
+    }
 }
 
+/*
+ * The entry for a glyph looking like gi and bits in the global table, or
+ * the empty one it goes in. Without bits, they're self's.
+ */
 static GlyphRefPtr
-FindGlyphRef(GlyphHashPtr hash,
-             CARD32 signature, Bool match, unsigned char sha1[20])
+FindGlyphContentRef(GlyphHashPtr hash, const unsigned char sha1[20],
+                    const xGlyphInfo * gi, const CARD8 *bits, GlyphPtr self)
 {
-    CARD32 elt, step, s;
-    GlyphPtr glyph;
-    GlyphRefPtr table, gr, del;
-
-    if ((hash == NULL) || (hash->hashSet == NULL))
-        return NULL;
+    CARD32 signature = GlyphSignature(sha1);
+    CARD8 buf[GLYPH_IMAGE_BUF];
+    CARD8 *image = NULL;
+    GlyphRefPtr gr;
 
-    CARD32 tableSize = hash->hashSet->size;
+    for (CARD32 elt = GlyphRefSlot(hash, signature);;
+         elt = (elt + 1) & hash->mask) {
+        GlyphPtr glyph;
 
-    table = hash->table;
-    elt = signature % tableSize;
-    step = 0;
-    del = 0;
-    for (;;) {
-        gr = &table[elt];
-        s = gr->signature;
+        gr = &hash->table[elt];
         glyph = gr->glyph;
-        if (!glyph) {
-            if (del)
-                gr = del;
+        if (!glyph || glyph == self)
             break;
-        }
-        if (glyph == DeletedGlyph) {
-            if (!del)
-                del = gr;
-            else if (gr == del)
-                break;
-        }
-        else if (s == signature &&
-                 (!match || memcmp(glyph->sha1, sha1, 20) == 0)) {
+        if (gr->signature != signature ||
+            memcmp(glyph->sha1, sha1, 20) != 0 ||
+            memcmp(&glyph->info, gi, sizeof(xGlyphInfo)) != 0)
+            continue;
+        /* nothing to look at */
+        if (!gi->width || !gi->height)
+            break;
+        /* if that fails, they're kept apart */
+        if (!bits && !(bits = image = GlyphReadImage(self, buf)))
+            continue;
+        if (GlyphImageEqual(glyph, bits))
             break;
-        }
-        if (!step) {
-            step = signature % hash->hashSet->rehash;
-            if (!step)
-                step = 1;
-        }
-        elt += step;
-        if (elt >= tableSize)
-            elt -= tableSize;
     }
+    if (image != buf)
+        free(image);
     return gr;
 }
 
-int
-HashGlyph(xGlyphInfo * gi,
-          CARD8 *bits, unsigned long size, unsigned char sha1[20])
+/* take out an entry, moving back those that would have gone in its place */
+static void
+RemoveGlyphRef(GlyphHashPtr hash, GlyphRefPtr gr)
 {
-    void *ctx = x_sha1_init();
-    int success;
-
-    if (!ctx)
-        return BadAlloc;
-
-    success = x_sha1_update(ctx, gi, sizeof(xGlyphInfo));
-    if (!success)
-        return BadAlloc;
-    success = x_sha1_update(ctx, bits, size);
-    if (!success)
-        return BadAlloc;
-    success = x_sha1_final(ctx, sha1);
-    if (!success)
-        return BadAlloc;
-    return Success;
+    GlyphRefPtr table = hash->table;
+    CARD32 hole = gr - table, elt = hole;
+
+    for (;;) {
+        CARD32 slot;
+
+        elt = (elt + 1) & hash->mask;
+        if (!table[elt].glyph)
+            break;
+        slot = GlyphRefSlot(hash, table[elt].signature);
+        /* stays unless its slot is outside (hole, elt] */
+        if (((elt - slot) & hash->mask) >= ((elt - hole) & hash->mask)) {
+            table[hole] = table[elt];
+            hole = elt;
+        }
+    }
+    table[hole].glyph = NULL;
+    table[hole].signature = 0;
+    hash->tableEntries--;
 }
 
 GlyphPtr
-FindGlyphByHash(unsigned char sha1[20], int format)
+FindGlyphByHash(unsigned char sha1[20], xGlyphInfo * gi, CARD8 *bits,
+                int format)
 {
-    GlyphRefPtr gr;
-    CARD32 signature = *(CARD32 *) sha1;
-
-    if (!globalGlyphs[format].hashSet)
+    if (!globalGlyphs[format].table)
         return NULL;
 
-    gr = FindGlyphRef(&globalGlyphs[format], signature, TRUE, sha1);
-
-    if (gr->glyph && gr->glyph != DeletedGlyph)
-        return gr->glyph;
-    else
-        return NULL;
+    return FindGlyphContentRef(&globalGlyphs[format], sha1, gi, bits,
+                               NULL)->glyph;
 }
 
 #ifdef CHECK_DUPLICATES
@@ -214,13 +408,13 @@ void
 CheckDuplicates(GlyphHashPtr hash, char *where)
 {
     GlyphPtr g;
-    int i, j;
+    CARD32 i, j;
 
-    for (i = 0; i < hash->hashSet->size; i++) {
+    for (i = 0; i <= hash->mask; i++) {
         g = hash->table[i].glyph;
-        if (!g || g == DeletedGlyph)
+        if (!g)
             continue;
-        for (j = i + 1; j < hash->hashSet->size; j++)
+        for (j = i + 1; j <= hash->mask; j++)
             if (hash->table[j].glyph == g)
                 DuplicateRef(g, where);
     }
@@ -249,27 +443,17 @@ FreeGlyph(GlyphPtr glyph, int format)
     CheckDuplicates(&globalGlyphs[format], "FreeGlyph");
     BUG_RETURN(glyph->refcnt == 0);
     if (--glyph->refcnt == 0) {
-        GlyphRefPtr gr;
-        int i;
-        int first;
-        CARD32 signature;
-
-        first = -1;
-        for (i = 0; i < globalGlyphs[format].hashSet->size; i++)
-            if (globalGlyphs[format].table[i].glyph == glyph) {
-                if (first != -1)
-                    DuplicateRef(glyph, "FreeGlyph check");
-                first = i;
+        GlyphHashPtr hash = &globalGlyphs[format];
+
+        /* this very glyph, a copy that lost to another one isn't in it */
+        if (hash->table) {
+            for (CARD32 elt = GlyphRefSlot(hash, GlyphSignature(glyph->sha1));
+                 hash->table[elt].glyph; elt = (elt + 1) & hash->mask) {
+                if (hash->table[elt].glyph == glyph) {
+                    RemoveGlyphRef(hash, &hash->table[elt]);
+                    break;
+                }
             }
-
-        signature = *(CARD32 *) glyph->sha1;
-        gr = FindGlyphRef(&globalGlyphs[format], signature, TRUE, glyph->sha1);
-        if (gr - globalGlyphs[format].table != first)
-            DuplicateRef(glyph, "Found wrong one");
-        if (gr && gr->glyph && gr->glyph != DeletedGlyph) {
-            gr->glyph = DeletedGlyph;
-            gr->signature = 0;
-            globalGlyphs[format].tableEntries--;
         }
 
         FreeGlyphPicture(glyph);
@@ -280,33 +464,31 @@ FreeGlyph(GlyphPtr glyph, int format)
 void
 AddGlyph(GlyphSetPtr glyphSet, GlyphPtr glyph, Glyph id)
 {
+    GlyphHashPtr global = &globalGlyphs[glyphSet->fdepth];
     GlyphRefPtr gr;
-    CARD32 signature;
 
-    CheckDuplicates(&globalGlyphs[glyphSet->fdepth], "AddGlyph top global");
+    CheckDuplicates(global, "AddGlyph top global");
     /* Locate existing matching glyph */
-    signature = *(CARD32 *) glyph->sha1;
-    gr = FindGlyphRef(&globalGlyphs[glyphSet->fdepth], signature,
-                      TRUE, glyph->sha1);
-    if (gr->glyph && gr->glyph != DeletedGlyph && gr->glyph != glyph) {
+    gr = FindGlyphContentRef(global, glyph->sha1, &glyph->info, NULL, glyph);
+    if (gr->glyph && gr->glyph != glyph) {
         glyph = gr->glyph;
     }
-    else if (gr->glyph != glyph) {
+    else if (!gr->glyph) {
         gr->glyph = glyph;
-        gr->signature = signature;
-        globalGlyphs[glyphSet->fdepth].tableEntries++;
+        gr->signature = GlyphSignature(glyph->sha1);
+        global->tableEntries++;
     }
 
     /* Insert/replace glyphset value */
-    gr = FindGlyphRef(&glyphSet->hash, id, FALSE, 0);
+    gr = FindGlyphRef(&glyphSet->hash, id);
     ++glyph->refcnt;
-    if (gr->glyph && gr->glyph != DeletedGlyph)
+    if (gr->glyph)
         FreeGlyph(gr->glyph, glyphSet->fdepth);
     else
         glyphSet->hash.tableEntries++;
     gr->glyph = glyph;
     gr->signature = id;
-    CheckDuplicates(&globalGlyphs[glyphSet->fdepth], "AddGlyph bottom");
+    CheckDuplicates(global, "AddGlyph bottom");
 }
 
 Bool
@@ -315,11 +497,10 @@ DeleteGlyph(GlyphSetPtr glyphSet, Glyph id)
     GlyphRefPtr gr;
     GlyphPtr glyph;
 
-    gr = FindGlyphRef(&glyphSet->hash, id, FALSE, 0);
+    gr = FindGlyphRef(&glyphSet->hash, id);
     glyph = gr->glyph;
-    if (glyph && glyph != DeletedGlyph) {
-        gr->glyph = DeletedGlyph;
-        glyphSet->hash.tableEntries--;
+    if (glyph) {
+        RemoveGlyphRef(&glyphSet->hash, gr);
         FreeGlyph(glyph, glyphSet->fdepth);
         return TRUE;
     }
@@ -329,12 +510,7 @@ DeleteGlyph(GlyphSetPtr glyphSet, Glyph id)
 GlyphPtr
 FindGlyph(GlyphSetPtr glyphSet, Glyph id)
 {
-    GlyphPtr glyph;
-
-    glyph = FindGlyphRef(&glyphSet->hash, id, FALSE, 0)->glyph;
-    if (glyph == DeletedGlyph)
-        glyph = 0;
-    return glyph;
+    return FindGlyphRef(&glyphSet->hash, id)->glyph;
 }
 
 GlyphPtr
@@ -380,63 +556,59 @@ AllocateGlyph(xGlyphInfo * gi, int fdepth)
 }
 
 static Bool
-AllocateGlyphHash(GlyphHashPtr hash, GlyphHashSetPtr hashSet)
+AllocateGlyphHash(GlyphHashPtr hash, CARD32 size)
 {
-    assert(hashSet);
-    hash->table = calloc(hashSet->size, sizeof(GlyphRefRec));
+    hash->table = calloc(size, sizeof(GlyphRefRec));
     if (!hash->table)
         return FALSE;
-    hash->hashSet = hashSet;
+    hash->mask = size - 1;
     hash->tableEntries = 0;
     return TRUE;
 }
 
+/*
+ * Make room for change more entries, or give back space when the table
+ * is mostly empty.
+ */
 static Bool
-ResizeGlyphHash(GlyphHashPtr hash, CARD32 change, Bool global)
+ResizeGlyphHash(GlyphHashPtr hash, CARD32 change)
 {
-    CARD32 tableEntries;
-    GlyphHashSetPtr hashSet;
+    CARD32 tableEntries, size, oldSize;
     GlyphHashRec newHash;
-    GlyphRefPtr gr;
-    GlyphPtr glyph;
-    int i;
-    int oldSize;
-    CARD32 s;
 
+    if (change > UINT32_MAX / 4 - hash->tableEntries)
+        return FALSE;
     tableEntries = hash->tableEntries + change;
-    hashSet = FindGlyphHashSet(tableEntries);
-    if (hashSet == hash->hashSet)
+    for (size = GLYPH_HASH_MIN_SIZE; size / 4 * 3 < tableEntries; size *= 2);
+    oldSize = hash->table ? hash->mask + 1 : 0;
+    /* shrink only to a quarter, so a few glyphs more or less don't */
+    if (size <= oldSize && size * 4 > oldSize)
         return TRUE;
-    if (global)
-        CheckDuplicates(hash, "ResizeGlyphHash top");
-    if (!AllocateGlyphHash(&newHash, hashSet))
+    CheckDuplicates(hash, "ResizeGlyphHash top");
+    if (!AllocateGlyphHash(&newHash, size))
         return FALSE;
-    if (hash->table) {
-        oldSize = hash->hashSet->size;
-        for (i = 0; i < oldSize; i++) {
-            glyph = hash->table[i].glyph;
-            if (glyph && glyph != DeletedGlyph) {
-                s = hash->table[i].signature;
-                if ((gr = FindGlyphRef(&newHash, s, global, glyph->sha1))) {
-                    gr->signature = s;
-                    gr->glyph = glyph;
-                }
-                ++newHash.tableEntries;
-            }
-        }
-        free(hash->table);
+    for (CARD32 i = 0; i < oldSize; i++) {
+        GlyphRefPtr gr = &hash->table[i];
+        CARD32 elt;
+
+        if (!gr->glyph)
+            continue;
+        for (elt = GlyphRefSlot(&newHash, gr->signature);
+             newHash.table[elt].glyph; elt = (elt + 1) & newHash.mask);
+        newHash.table[elt] = *gr;
+        ++newHash.tableEntries;
     }
+    free(hash->table);
     *hash = newHash;
-    if (global)
-        CheckDuplicates(hash, "ResizeGlyphHash bottom");
+    CheckDuplicates(hash, "ResizeGlyphHash bottom");
     return TRUE;
 }
 
 Bool
 ResizeGlyphSet(GlyphSetPtr glyphSet, CARD32 change)
 {
-    return (ResizeGlyphHash(&glyphSet->hash, change, FALSE) &&
-            ResizeGlyphHash(&globalGlyphs[glyphSet->fdepth], change, TRUE));
+    return (ResizeGlyphHash(&glyphSet->hash, change) &&
+            ResizeGlyphHash(&globalGlyphs[glyphSet->fdepth], change));
 }
 
 GlyphSetPtr
@@ -444,8 +616,8 @@ AllocateGlyphSet(int fdepth, PictFormatPtr format)
 {
     GlyphSetPtr glyphSet;
 
-    if (!globalGlyphs[fdepth].hashSet) {
-        if (!AllocateGlyphHash(&globalGlyphs[fdepth], &glyphHashSets[0]))
+    if (!globalGlyphs[fdepth].table) {
+        if (!AllocateGlyphHash(&globalGlyphs[fdepth], GLYPH_HASH_MIN_SIZE))
             return FALSE;
     }
 
@@ -453,7 +625,7 @@ AllocateGlyphSet(int fdepth, PictFormatPtr format)
     if (!glyphSet)
         return FALSE;
 
-    if (!AllocateGlyphHash(&glyphSet->hash, &glyphHashSets[0])) {
+    if (!AllocateGlyphHash(&glyphSet->hash, GLYPH_HASH_MIN_SIZE)) {
         free(glyphSet);
         return FALSE;
     }
@@ -469,22 +641,23 @@ FreeGlyphSet(void *value, XID gid)
     GlyphSetPtr glyphSet = (GlyphSetPtr) value;
 
     if (--glyphSet->refcnt == 0) {
-        CARD32 i, tableSize = glyphSet->hash.hashSet->size;
+        CARD32 i, tableSize = glyphSet->hash.mask + 1;
         GlyphRefPtr table = glyphSet->hash.table;
+        GlyphHashPtr global = &globalGlyphs[glyphSet->fdepth];
         GlyphPtr glyph;
 
         for (i = 0; i < tableSize; i++) {
             glyph = table[i].glyph;
-            if (glyph && glyph != DeletedGlyph)
+            if (glyph)
                 FreeGlyph(glyph, glyphSet->fdepth);
         }
-        if (!globalGlyphs[glyphSet->fdepth].tableEntries) {
-            free(globalGlyphs[glyphSet->fdepth].table);
-            globalGlyphs[glyphSet->fdepth].table = 0;
-            globalGlyphs[glyphSet->fdepth].hashSet = 0;
+        if (!global->tableEntries) {
+            free(global->table);
+            global->table = NULL;
+            global->mask = 0;
         }
         else
-            ResizeGlyphHash(&globalGlyphs[glyphSet->fdepth], 0, TRUE);
+            ResizeGlyphHash(global, 0);
         free(table);
         dixFreeObjectWithPrivates(glyphSet, PRIVATE_GLYPHSET);
     }
@@ -21,17 +21,9 @@ typedef struct {
     GlyphPtr glyph;
 } GlyphRefRec, *GlyphRefPtr;
 
-#define DeletedGlyph	((GlyphPtr) 1)
-
-typedef struct {
-    CARD32 entries;
-    CARD32 size;
-    CARD32 rehash;
-} GlyphHashSetRec, *GlyphHashSetPtr;
-
 typedef struct {
-    GlyphRefPtr table;
-    GlyphHashSetPtr hashSet;
+    GlyphRefPtr table;          /* a power of two in size, NULL if none yet */
+    CARD32 mask;
     CARD32 tableEntries;
 } GlyphHashRec, *GlyphHashPtr;
 
@@ -50,7 +42,8 @@ typedef struct {
     dixSetPrivate(&(pGlyphSet)->devPrivates, k, ptr)
 
 void GlyphUninit(ScreenPtr pScreen);
-GlyphPtr FindGlyphByHash(unsigned char sha1[20], int format);
+GlyphPtr FindGlyphByHash(unsigned char sha1[20], xGlyphInfo * gi, CARD8 *bits,
+                         int format);
 int HashGlyph(xGlyphInfo * gi, CARD8 *bits, unsigned long size, unsigned char sha1[20]);
 void AddGlyph(GlyphSetPtr glyphSet, GlyphPtr glyph, Glyph id);
 Bool DeleteGlyph(GlyphSetPtr glyphSet, Glyph id);
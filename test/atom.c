@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Tests for the atom table in dix/atom.c
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <X11/X.h>
+#include <X11/Xatom.h>
+
+#include "dix/atom_priv.h"
+#include "dix/dix_priv.h"
+
+#include "misc.h"
+#include "dix.h"
+#include "tests-common.h"
+
+static void
+atom_predefined(void)
+{
+    InitAtoms();
+
+    assert(MakeAtom("PRIMARY", 7, FALSE) == XA_PRIMARY);
+    assert(MakeAtom("WM_TRANSIENT_FOR", 16, FALSE) == XA_WM_TRANSIENT_FOR);
+    assert(strcmp(NameForAtom(XA_WM_NAME), "WM_NAME") == 0);
+    assert(NameForAtom(XA_LAST_PREDEFINED + 1) == NULL);
+    assert(ValidAtom(XA_LAST_PREDEFINED));
+    assert(!ValidAtom(XA_LAST_PREDEFINED + 1));
+    assert(!ValidAtom(None));
+}
+
+static void
+atom_intern(void)
+{
+    char name[32];
+    Atom first;
+
+    InitAtoms();
+
+    assert(MakeAtom("_TEST_ATOM", 10, FALSE) == None);
+    first = MakeAtom("_TEST_ATOM", 10, TRUE);
+    assert(first == XA_LAST_PREDEFINED + 1);
+    assert(MakeAtom("_TEST_ATOM", 10, TRUE) == first);
+    assert(strcmp(NameForAtom(first), "_TEST_ATOM") == 0);
+
+    /* only the first len bytes take part in the lookup */
+    assert(MakeAtom("_TEST_ATOM_AND_MORE", 10, FALSE) == first);
+    assert(MakeAtom("_TEST_ATO", 9, FALSE) == None);
+
+    /* atoms are numbered sequentially across table growth */
+    for (int i = 0; i < 5000; i++) {
+        snprintf(name, sizeof(name), "_TEST_%d", i);
+        assert(MakeAtom(name, strlen(name), TRUE) == first + 1 + i);
+    }
+    for (int i = 0; i < 5000; i++) {
+        snprintf(name, sizeof(name), "_TEST_%d", i);
+        assert(MakeAtom(name, strlen(name), FALSE) == first + 1 + i);
+        assert(strcmp(NameForAtom(first + 1 + i), name) == 0);
+    }
+    assert(MakeAtom("PRIMARY", 7, FALSE) == XA_PRIMARY);
+
+    /* a reset forgets everything but the predefined atoms */
+    InitAtoms();
+    assert(MakeAtom("_TEST_ATOM", 10, FALSE) == None);
+    assert(MakeAtom("_TEST_42", 8, TRUE) == XA_LAST_PREDEFINED + 1);
+}
+
+const testfunc_t*
+atom_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        atom_predefined,
+        atom_intern,
+        NULL,
+    };
+    return testfuncs;
+}
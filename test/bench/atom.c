@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Interning and lookup cost of the atom table, with toolkit-like names.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <X11/X.h>
+#include <X11/Xatom.h>
+
+#include "dix/atom_priv.h"
+
+#include "misc.h"
+#include "dix.h"
+#include "bench.h"
+
+#define NUM_ATOMS 100000
+
+static void
+atom_name(char *buf, size_t size, const char *prefix, int i)
+{
+    snprintf(buf, size, "%s_NET_WM_STATE_SYNTHETIC_%d", prefix, i);
+}
+
+void
+atom_bench(void)
+{
+    char name[64];
+    uint64_t start;
+    Atom a = None;
+
+    InitAtoms();
+
+    start = bench_now_ns();
+    for (int i = 0; i < NUM_ATOMS; i++) {
+        atom_name(name, sizeof(name), "", i);
+        a = MakeAtom(name, strlen(name), TRUE);
+    }
+    bench_report("intern (new)", NUM_ATOMS, bench_now_ns() - start);
+    if (a == BAD_RESOURCE)
+        printf("  interning failed\n");
+
+    start = bench_now_ns();
+    for (int i = 0; i < NUM_ATOMS; i++) {
+        atom_name(name, sizeof(name), "", i);
+        a |= MakeAtom(name, strlen(name), FALSE);
+    }
+    bench_report("lookup (hit)", NUM_ATOMS, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < NUM_ATOMS; i++) {
+        atom_name(name, sizeof(name), "_MISS", i);
+        a |= MakeAtom(name, strlen(name), FALSE);
+    }
+    bench_report("lookup (miss)", NUM_ATOMS, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < NUM_ATOMS; i++)
+        a |= (NameForAtom(XA_LAST_PREDEFINED + 1 + i) != NULL);
+    bench_report("NameForAtom", NUM_ATOMS, bench_now_ns() - start);
+
+    FreeAllAtoms();
+}
@@ -0,0 +1,53 @@
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define ARRAY_SIZE(a)  (sizeof((a)) / sizeof((a)[0]))
+
+static const struct {
+    const char *name;
+    benchfunc_t func;
+} benchmarks[] = {
+    { "atom", atom_bench },
+    { "property", property_bench },
+    { "ospoll", ospoll_bench },
+    { "mieq", mieq_bench },
+    { "xytowindow", xytowindow_bench },
+    { "resource", resource_bench },
+    { "fb", fb_bench },
+    { "composite", composite_bench },
+    { "damage", damage_bench },
+    { "region", region_bench },
+    { "pixmap", pixmap_bench },
+    { "privates", privates_bench },
+    { "glyph", glyph_bench },
+};
+
+void
+bench_report(const char *what, unsigned long ops, uint64_t ns)
+{
+    printf("  %-40s %10lu ops %10.3f ms %10.1f ns/op\n",
+           what, ops, ns / 1e6, ops ? (double) ns / ops : 0.0);
+}
+
+int
+main(int argc, char **argv)
+{
+    for (unsigned i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+        if (argc > 1) {
+            int wanted = 0;
+
+            for (int j = 1; j < argc; j++)
+                if (strcmp(argv[j], benchmarks[i].name) == 0)
+                    wanted = 1;
+            if (!wanted)
+                continue;
+        }
+        printf("\n---------------------\n%s\n", benchmarks[i].name);
+        benchmarks[i].func();
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Microbenchmarks for server internals.  They're not part of the unit
+ * tests, run them with `meson test --benchmark` or directly as
+ * `bench [name...]`.
+ */
+
+typedef void (*benchfunc_t)(void);
+
+static inline uint64_t
+bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* print ops, total time and ns/op for one measured loop */
+void bench_report(const char *what, unsigned long ops, uint64_t ns);
+
+void atom_bench(void);
+void property_bench(void);
+void ospoll_bench(void);
+void mieq_bench(void);
+void xytowindow_bench(void);
+void resource_bench(void);
+void fb_bench(void);
+void composite_bench(void);
+void damage_bench(void);
+void region_bench(void);
+void pixmap_bench(void);
+void privates_bench(void);
+void glyph_bench(void);
+
+#endif /* BENCH_H */
@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Throughput of full screen RENDER composites on a 3840x2160 frame by
+ * number of render threads: a translucent ARGB window, and a solid color
+ * through an a8 mask as for antialiased shapes. The frame is split the
+ * way fbComposite() does with -renderthreads, into bands of rows with
+ * pixman images of their own.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/X.h>
+
+#include "dix/settings_priv.h"
+#include "fb/fb_priv.h"
+
+#include "bench.h"
+
+#define FRAME_WIDTH     3840
+#define FRAME_HEIGHT    2160
+#define FRAME_REPS      20
+
+typedef struct {
+    pixman_op_t op;
+    pixman_image_t *src[FB_MAX_THREADS];
+    pixman_image_t *mask[FB_MAX_THREADS];
+    pixman_image_t *dst[FB_MAX_THREADS];
+    int ys[FB_MAX_THREADS + 1];
+} BenchBandsRec;
+
+static void
+bench_band(void *closure, int i)
+{
+    BenchBandsRec *c = closure;
+    int y = c->ys[i];
+
+    pixman_image_composite32(c->op, c->src[i], c->mask[i], c->dst[i],
+                             0, y, 0, y, 0, y,
+                             FRAME_WIDTH, c->ys[i + 1] - y);
+}
+
+static pixman_image_t *
+bench_image(pixman_format_code_t format, uint32_t *bits)
+{
+    return pixman_image_create_bits(format, FRAME_WIDTH, FRAME_HEIGHT, bits,
+                                    FRAME_WIDTH * PIXMAN_FORMAT_BPP(format) / 8);
+}
+
+static void
+bench_composite(const char *name, pixman_op_t op, uint32_t *src_bits,
+                const pixman_color_t *color, uint8_t *mask_bits,
+                uint32_t *dst_bits, int nthreads)
+{
+    BoxRec frame = { 0, 0, FRAME_WIDTH, FRAME_HEIGHT };
+    BenchBandsRec c = { .op = op };
+    RegionRec clip;
+    char what[64];
+    uint64_t start;
+    int n;
+
+    dixSettingRenderThreads = nthreads;
+    RegionInit(&clip, &frame, 1);
+    n = fbParallelSplit(&clip, &frame, c.ys);
+    if (n < 2) {
+        c.ys[0] = 0;
+        c.ys[1] = FRAME_HEIGHT;
+    }
+
+    for (int i = 0; i < n; i++) {
+        c.src[i] = src_bits ? bench_image(PIXMAN_a8r8g8b8, src_bits) :
+            pixman_image_create_solid_fill(color);
+        c.mask[i] = mask_bits ?
+            bench_image(PIXMAN_a8, (uint32_t *) mask_bits) : NULL;
+        c.dst[i] = bench_image(PIXMAN_x8r8g8b8, dst_bits);
+    }
+
+    /* warm up, workers get started at the first split operation */
+    fbParallelRun(bench_band, &c, n);
+
+    start = bench_now_ns();
+    for (int r = 0; r < FRAME_REPS; r++)
+        fbParallelRun(bench_band, &c, n);
+    snprintf(what, sizeof(what), "%s, %d thread%s", name, nthreads,
+             nthreads > 1 ? "s" : "");
+    bench_report(what, FRAME_REPS, bench_now_ns() - start);
+
+    for (int i = 0; i < n; i++) {
+        pixman_image_unref(c.src[i]);
+        if (c.mask[i])
+            pixman_image_unref(c.mask[i]);
+        pixman_image_unref(c.dst[i]);
+    }
+    RegionUninit(&clip);
+}
+
+void
+composite_bench(void)
+{
+    static const int threads[] = { 1, 2, 4, 8 };
+    static const pixman_color_t red = { 0xc000, 0x2000, 0x2000, 0xc000 };
+    const int saved_threads = dixSettingRenderThreads;
+    const int saved_pixels = dixSettingRenderThreadPixels;
+    uint32_t *src = malloc(FRAME_WIDTH * FRAME_HEIGHT * sizeof(uint32_t));
+    uint32_t *dst = malloc(FRAME_WIDTH * FRAME_HEIGHT * sizeof(uint32_t));
+    uint8_t *mask = malloc(FRAME_WIDTH * FRAME_HEIGHT);
+
+    if (!src || !dst || !mask) {
+        printf("  out of memory\n");
+        goto out;
+    }
+    for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) {
+        /* half transparent, premultiplied */
+        src[i] = 0x80000000 | ((i * 2654435761u) & 0x007f7f7f);
+        dst[i] = i * 40503u;
+        mask[i] = i * 7;
+    }
+
+    dixSettingRenderThreadPixels = 1;
+    for (int t = 0; t < ARRAY_SIZE(threads); t++)
+        bench_composite("over argb 3840x2160", PIXMAN_OP_OVER, src, NULL,
+                        NULL, dst, threads[t]);
+    for (int t = 0; t < ARRAY_SIZE(threads); t++)
+        bench_composite("over solid, a8 mask 3840x2160", PIXMAN_OP_OVER,
+                        NULL, &red, mask, dst, threads[t]);
+
+out:
+    dixSettingRenderThreads = saved_threads;
+    dixSettingRenderThreadPixels = saved_pixels;
+    free(src);
+    free(dst);
+    free(mask);
+}
@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Damage accumulation for many small drawing operations, as from a
+ * client doing thousands of small fills or glyphs per frame: 8x8 boxes
+ * scattered over a 1920x1080 pixmap with three listeners attached, the
+ * way a compositor, shadow framebuffer and DAMAGE extension client would
+ * be. The listeners' regions are read and emptied every frame. Listeners
+ * wanting every box reported can't batch, and show what each operation
+ * costs without it.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <X11/X.h>
+
+#include "dix/screenint_priv.h"
+
+#include "misc.h"
+#include "pixmapstr.h"
+#include "privates.h"
+#include "regionstr.h"
+#include "scrnintstr.h"
+#include "damage.h"
+#include "bench.h"
+
+#define FRAME_WIDTH     1920
+#define FRAME_HEIGHT    1080
+#define BOX_SIZE        8
+#define NUM_OPS         1000000
+
+static ScreenRec screen;
+
+static void
+bench_report_damage(DamagePtr pDamage, RegionPtr pRegion, void *closure)
+{
+    (*(unsigned long *) closure)++;
+}
+
+static void
+bench_damage(const char *name, const DamageReportLevel levels[3],
+             PixmapPtr pPixmap, int ops_per_frame)
+{
+    DamagePtr listeners[3];
+    unsigned long reports = 0;
+    unsigned seed = 1;
+    uint64_t start;
+    char what[64];
+
+    for (int i = 0; i < 3; i++) {
+        listeners[i] = DamageCreate(bench_report_damage, NULL, levels[i],
+                                    FALSE, &screen, &reports);
+        DamageRegister(&pPixmap->drawable, listeners[i]);
+    }
+
+    start = bench_now_ns();
+    for (int op = 0; op < NUM_OPS; op++) {
+        RegionRec region;
+        BoxRec box;
+
+        seed = seed * 1103515245 + 12345;
+        box.x1 = (seed >> 8) % (FRAME_WIDTH - BOX_SIZE);
+        box.y1 = (seed >> 16) % (FRAME_HEIGHT - BOX_SIZE);
+        box.x2 = box.x1 + BOX_SIZE;
+        box.y2 = box.y1 + BOX_SIZE;
+
+        RegionInit(&region, &box, 1);
+        DamageRegionAppend(&pPixmap->drawable, &region);
+        DamageRegionProcessPending(&pPixmap->drawable);
+        RegionUninit(&region);
+
+        /* repaint */
+        if ((op + 1) % ops_per_frame == 0) {
+            for (int i = 0; i < 3; i++) {
+                if (RegionNotEmpty(DamageRegion(listeners[i])))
+                    DamageEmpty(listeners[i]);
+            }
+        }
+    }
+    snprintf(what, sizeof(what), "%s, %d ops/frame", name, ops_per_frame);
+    bench_report(what, NUM_OPS, bench_now_ns() - start);
+
+    for (int i = 0; i < 3; i++)
+        DamageDestroy(listeners[i]);
+}
+
+void
+damage_bench(void)
+{
+    static const DamageReportLevel batched[3] = {
+        DamageReportNonEmpty, DamageReportNone, DamageReportBoundingBox
+    };
+    static const DamageReportLevel raw[3] = {
+        DamageReportRawRegion, DamageReportRawRegion, DamageReportRawRegion
+    };
+    static const int frames[] = { 100, 1000, 10000 };
+    PixmapPtr pPixmap;
+
+    screenInfo.numScreens = 1;
+    screenInfo.screens[0] = &screen;
+    if (!DamageSetup(&screen)) {
+        printf("  failed to set up damage\n");
+        return;
+    }
+    dixInitScreenSpecificPrivates(&screen);
+
+    pPixmap = dixAllocateScreenObjectWithPrivates(&screen, PixmapRec,
+                                                  PRIVATE_PIXMAP);
+    pPixmap->drawable.type = DRAWABLE_PIXMAP;
+    pPixmap->drawable.pScreen = &screen;
+    pPixmap->drawable.width = FRAME_WIDTH;
+    pPixmap->drawable.height = FRAME_HEIGHT;
+
+    for (int f = 0; f < ARRAY_SIZE(frames); f++) {
+        bench_damage("compositor, shadow, damage ext", batched, pPixmap,
+                     frames[f]);
+        bench_damage("3 raw region listeners", raw, pPixmap, frames[f]);
+    }
+
+    dixFreeObjectWithPrivates(pPixmap, PRIVATE_PIXMAP);
+}
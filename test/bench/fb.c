@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * x11perf style copyarea and fillrect on fb, without a screen: fbBlt()
+ * and fbSolid() on a 1920x1080 frame, for a few rectangle sizes at 16
+ * and 32bpp. Covers plain copies, horizontal and vertical scrolling
+ * within one pixmap, solid fills, and GXxor copies, fills and points as
+ * used for rubber band outlines. Bitmap copies at odd bit offsets go
+ * through the shifting loops of fbBlt().
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/X.h>
+
+#include "fb/fb_priv.h"
+
+#include "bench.h"
+
+#define FRAME_WIDTH     1920
+#define FRAME_HEIGHT    1080
+/* pixels touched per measured loop, so the sizes take similar time */
+#define PIXELS_PER_RUN  (256 * 1024 * 1024)
+
+typedef struct {
+    FbBits *bits;
+    FbStride stride;            /* in FbBits */
+    int bpp;
+} BenchFrameRec;
+
+static void
+bench_frame_init(BenchFrameRec *frame, int bpp)
+{
+    frame->bpp = bpp;
+    frame->stride = (FRAME_WIDTH * bpp + FB_MASK) >> FB_SHIFT;
+    frame->bits = calloc(frame->stride * FRAME_HEIGHT, sizeof(FbBits));
+    for (int i = 0; i < frame->stride * FRAME_HEIGHT; i++)
+        frame->bits[i] = i * 2654435761u;
+}
+
+static void
+bench_copy(BenchFrameRec *frame, const char *name, int size, int dx, int dy,
+           int alu)
+{
+    int reps = PIXELS_PER_RUN / (size * size);
+    int x = FRAME_WIDTH / 4, y = FRAME_HEIGHT / 4;
+    FbBits *bits = frame->bits;
+    FbStride stride = frame->stride;
+    int bpp = frame->bpp;
+    char what[64];
+    uint64_t start;
+
+    start = bench_now_ns();
+    for (int i = 0; i < reps; i++)
+        fbBlt(bits + (y + dy) * stride, stride, (x + dx) * bpp,
+              bits + y * stride, stride, x * bpp,
+              size * bpp, size, alu, FB_ALLONES, bpp,
+              dx < 0, dy < 0);
+    snprintf(what, sizeof(what), "%s %dx%d %dbpp", name, size, size, bpp);
+    bench_report(what, reps, bench_now_ns() - start);
+}
+
+static void
+bench_fill(BenchFrameRec *frame, const char *name, int size, int alu)
+{
+    int reps = PIXELS_PER_RUN / (size * size);
+    int x = FRAME_WIDTH / 4 + 1, y = FRAME_HEIGHT / 4;
+    FbBits fg = fbReplicatePixel(0x5a5a5a5a, frame->bpp);
+    FbStride stride = frame->stride;
+    int bpp = frame->bpp;
+    char what[64];
+    uint64_t start;
+
+    start = bench_now_ns();
+    for (int i = 0; i < reps; i++)
+        fbSolid(frame->bits + y * stride, stride, x * bpp, bpp,
+                size * bpp, size, fbAnd(alu, fg, FB_ALLONES),
+                fbXor(alu, fg, FB_ALLONES));
+    snprintf(what, sizeof(what), "%s %dx%d %dbpp", name, size, size, bpp);
+    bench_report(what, reps, bench_now_ns() - start);
+}
+
+static void
+bench_dots(BenchFrameRec *frame)
+{
+    FbBits fg = fbReplicatePixel(0x5a5a5a5a, frame->bpp);
+    BoxRec box = { 0, 0, FRAME_WIDTH, FRAME_HEIGHT };
+    int npt = 4096, reps = PIXELS_PER_RUN / 256 / npt;
+    xPoint *pts = calloc(npt, sizeof(xPoint));
+    unsigned seed = 1;
+    char what[64];
+    FbBits and = fbAnd(GXxor, fg, FB_ALLONES);
+    FbBits xor = fbXor(GXxor, fg, FB_ALLONES);
+    uint64_t start;
+
+    for (int i = 0; i < npt; i++) {
+        seed = seed * 1103515245 + 12345;
+        pts[i].x = (seed >> 8) % FRAME_WIDTH;
+        pts[i].y = (seed >> 16) % FRAME_HEIGHT;
+    }
+
+    start = bench_now_ns();
+    for (int i = 0; i < reps; i++) {
+        if (frame->bpp == 16)
+            fbDots16(frame->bits, frame->stride, frame->bpp, &box, pts, npt,
+                     0, 0, 0, 0, and, xor);
+        else
+            fbDots32(frame->bits, frame->stride, frame->bpp, &box, pts, npt,
+                     0, 0, 0, 0, and, xor);
+    }
+    snprintf(what, sizeof(what), "polypoint GXxor %dbpp", frame->bpp);
+    bench_report(what, (unsigned long) reps * npt, bench_now_ns() - start);
+    free(pts);
+}
+
+void
+fb_bench(void)
+{
+    static const int bpps[] = { 16, 32 };
+    static const int sizes[] = { 10, 100, 500 };
+
+    for (int b = 0; b < ARRAY_SIZE(bpps); b++) {
+        BenchFrameRec frame;
+
+        bench_frame_init(&frame, bpps[b]);
+        for (int s = 0; s < ARRAY_SIZE(sizes); s++) {
+            int size = sizes[s];
+
+            bench_copy(&frame, "copyarea", size, size + 10, 0, GXcopy);
+            bench_copy(&frame, "copyarea GXxor", size, size + 10, 0, GXxor);
+            bench_copy(&frame, "scroll left", size, 8, 0, GXcopy);
+            bench_copy(&frame, "scroll right", size, -8, 0, GXcopy);
+            bench_copy(&frame, "scroll up", size, 0, 8, GXcopy);
+            bench_fill(&frame, "fillrect", size, GXcopy);
+            bench_fill(&frame, "fillrect GXxor", size, GXxor);
+        }
+        bench_dots(&frame);
+        free(frame.bits);
+    }
+
+    /* bitmaps, copied to an odd bit offset */
+    {
+        BenchFrameRec frame;
+
+        bench_frame_init(&frame, 1);
+        for (int s = 0; s < ARRAY_SIZE(sizes); s++) {
+            bench_copy(&frame, "copyplane", sizes[s], sizes[s] + 3, 0,
+                       GXcopy);
+            bench_copy(&frame, "copyplane GXxor", sizes[s], sizes[s] + 3, 0,
+                       GXxor);
+        }
+        free(frame.bits);
+    }
+}
@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * RENDER glyph uploads as from clients loading their fonts: the content
+ * hash of glyph images of text, icon and emoji sizes, once with SHA1 as
+ * it used to be and once with the glyph cache's own hash, and the whole
+ * of AddGlyphs for several clients uploading the same font, where all but
+ * the first find the glyphs already there, and read them back from their
+ * pictures to make sure.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+
+#include "dix/screenint_priv.h"
+#include "os/xsha1.h"
+#include "render/glyphstr_priv.h"
+
+#include "picturestr.h"
+#include "pixmapstr.h"
+#include "servermd.h"
+#include "bench.h"
+
+#define NUM_HASHES      1000000
+#define FONT_GLYPHS     2000
+#define NUM_CLIENTS     8
+#define NUM_ROUNDS      10
+
+static ScreenRec screen;
+/* so the hashes aren't optimized away */
+static volatile unsigned char bench_sink;
+
+/* the font's glyph pictures, in memory like fb has them */
+static PictureRec pictures[FONT_GLYPHS];
+static PixmapRec pixmaps[FONT_GLYPHS];
+
+static const struct {
+    const char *name;
+    int width, height, bpp;
+} sizes[] = {
+    { "text, 10x16 a8", 10, 16, 8 },
+    { "large text, 24x32 a8", 24, 32, 8 },
+    { "emoji, 48x48 argb", 48, 48, 32 },
+};
+
+static unsigned long
+bench_image(xGlyphInfo *gi, CARD8 *bits, int s, unsigned seed)
+{
+    unsigned long size;
+
+    memset(gi, 0, sizeof(*gi));
+    gi->width = sizes[s].width;
+    gi->height = sizes[s].height;
+    gi->xOff = sizes[s].width;
+    size = (unsigned long) ((sizes[s].width * sizes[s].bpp / 8 + 3) & ~3) *
+        sizes[s].height;
+    for (unsigned long i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        bits[i] = seed >> 24;
+    }
+    return size;
+}
+
+static void
+bench_get_image(DrawablePtr pDrawable, int sx, int sy, int w, int h,
+                unsigned int format, unsigned long planeMask, char *pdstLine)
+{
+    PixmapPtr pPixmap = (PixmapPtr) pDrawable;
+
+    memcpy(pdstLine, pPixmap->devPrivate.ptr, pPixmap->devKind * h);
+}
+
+static void
+bench_picture(int i, xGlyphInfo *gi, CARD8 *bits, int bpp)
+{
+    pixmaps[i].drawable.depth = bpp;
+    pixmaps[i].drawable.bitsPerPixel = bpp;
+    pixmaps[i].drawable.width = gi->width;
+    pixmaps[i].drawable.height = gi->height;
+    pixmaps[i].drawable.pScreen = &screen;
+    pixmaps[i].devKind = PixmapBytePad(gi->width, bpp);
+    pixmaps[i].devPrivate.ptr = bits;
+    pictures[i].pDrawable = &pixmaps[i].drawable;
+    /* ours, FreePicture() never gets to free it */
+    pictures[i].refcnt = 1;
+}
+
+static void
+bench_sha1(xGlyphInfo *gi, CARD8 *bits, unsigned long size,
+           unsigned char sha1[20])
+{
+    void *ctx = x_sha1_init();
+
+    x_sha1_update(ctx, gi, sizeof(xGlyphInfo));
+    x_sha1_update(ctx, bits, size);
+    x_sha1_final(ctx, sha1);
+}
+
+static void
+bench_hashes(int s)
+{
+    static CARD8 bits[48 * 48 * 4];
+    unsigned char sha1[20];
+    unsigned long size;
+    xGlyphInfo gi;
+    uint64_t start;
+    char what[64];
+
+    size = bench_image(&gi, bits, s, s);
+
+    start = bench_now_ns();
+    for (int i = 0; i < NUM_HASHES; i++) {
+        bits[0] = i;
+        bench_sha1(&gi, bits, size, sha1);
+    }
+    snprintf(what, sizeof(what), "SHA1, %s", sizes[s].name);
+    bench_report(what, NUM_HASHES, bench_now_ns() - start);
+    bench_sink = sha1[0];
+
+    start = bench_now_ns();
+    for (int i = 0; i < NUM_HASHES; i++) {
+        bits[0] = i;
+        HashGlyph(&gi, bits, size, sha1);
+    }
+    snprintf(what, sizeof(what), "glyph hash, %s", sizes[s].name);
+    bench_report(what, NUM_HASHES, bench_now_ns() - start);
+    bench_sink = sha1[0];
+}
+
+/* what ProcRenderAddGlyphs() does for one glyph, but for the upload */
+static Bool
+bench_add_glyph(GlyphSetPtr glyphSet, Glyph id, xGlyphInfo *gi, CARD8 *bits,
+                unsigned long size)
+{
+    unsigned char sha1[20];
+    GlyphPtr glyph;
+
+    HashGlyph(gi, bits, size, sha1);
+    glyph = FindGlyphByHash(sha1, gi, bits, glyphSet->fdepth);
+    if (glyph)
+        ++glyph->refcnt;
+    else {
+        glyph = AllocateGlyph(gi, glyphSet->fdepth);
+        if (!glyph)
+            return FALSE;
+        pictures[id].refcnt++;
+        SetGlyphPicture(glyph, &screen, &pictures[id]);
+        memcpy(glyph->sha1, sha1, 20);
+    }
+    if (!ResizeGlyphSet(glyphSet, 1)) {
+        FreeGlyph(glyph, glyphSet->fdepth);
+        return FALSE;
+    }
+    AddGlyph(glyphSet, glyph, id);
+    FreeGlyph(glyph, glyphSet->fdepth);
+    return TRUE;
+}
+
+static void
+bench_add_glyphs(void)
+{
+    static CARD8 font[FONT_GLYPHS][48 * 48 * 4];
+    static xGlyphInfo gi[FONT_GLYPHS];
+    static unsigned long size[FONT_GLYPHS];
+    GlyphSetPtr sets[NUM_CLIENTS];
+    uint64_t start;
+
+    /* mostly text, some emoji */
+    for (int i = 0; i < FONT_GLYPHS; i++) {
+        int s = i % 16 ? i % 2 : 2;
+
+        size[i] = bench_image(&gi[i], font[i], s, i);
+        bench_picture(i, &gi[i], font[i], sizes[s].bpp);
+    }
+
+    start = bench_now_ns();
+    for (int round = 0; round < NUM_ROUNDS; round++) {
+        for (int c = 0; c < NUM_CLIENTS; c++) {
+            sets[c] = AllocateGlyphSet(GlyphFormat8, NULL);
+            if (!sets[c]) {
+                printf("  failed to create a glyph set\n");
+                return;
+            }
+            for (int i = 0; i < FONT_GLYPHS; i++) {
+                if (!bench_add_glyph(sets[c], i, &gi[i], font[i], size[i])) {
+                    printf("  failed to add a glyph\n");
+                    return;
+                }
+            }
+        }
+        for (int c = 0; c < NUM_CLIENTS; c++)
+            FreeGlyphSet(sets[c], 0);
+    }
+    bench_report("AddGlyphs, one font from 8 clients",
+                 NUM_ROUNDS * NUM_CLIENTS * FONT_GLYPHS,
+                 bench_now_ns() - start);
+}
+
+void
+glyph_bench(void)
+{
+    /* rows padded to 32 bits */
+    for (int depth = 8; depth <= 32; depth += 24) {
+        PixmapWidthPaddingInfo[depth].padPixelsLog2 = depth == 8 ? 2 : 0;
+        PixmapWidthPaddingInfo[depth].padRoundUp = depth == 8 ? 3 : 0;
+        PixmapWidthPaddingInfo[depth].padBytesLog2 = 2;
+        PixmapWidthPaddingInfo[depth].bitsPerPixel = depth;
+    }
+    screen.GetImage = bench_get_image;
+    screenInfo.numScreens = 1;
+    screenInfo.screens[0] = &screen;
+
+    for (int s = 0; s < ARRAY_SIZE(sizes); s++)
+        bench_hashes(s);
+    bench_add_glyphs();
+}
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Cost of draining a backlog of pointer motion from the event queue, with
+ * and without motion coalescing. Each motion is enqueued as the raw/motion
+ * pair GetPointerEvents() generates, the way a 1000 Hz mouse piles up
+ * while the main thread is stuck. Event processing is stubbed out, so the
+ * time is the queue's own overhead; the processed counts are what would
+ * have gone through ProcessPointerEvent() and the sprite update.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <X11/X.h>
+
+#include "dix/input_priv.h"
+#include "mi/mi_priv.h"
+
+#include "misc.h"
+#include "inputstr.h"
+#include "eventstr.h"
+#include "bench.h"
+
+#define BURST_EVENTS    10000
+/* the main thread catches up after this many, so nothing is dropped */
+#define STALL_EVENTS    2000
+
+static unsigned long processed_motion, processed_raw;
+
+static void
+bench_process_input(InternalEvent *ev, DeviceIntPtr dev)
+{
+    if (ev->any.type == ET_Motion)
+        processed_motion++;
+    else
+        processed_raw++;
+}
+
+static void
+mieq_bench_one(Bool coalesce)
+{
+    static DeviceIntRec dev;
+    static SpriteInfoRec spriteInfo;
+    static SpriteRec sprite;
+    mieqStatsRec stats;
+    uint64_t ns = 0, t0;
+    char what[64];
+
+    memset(&dev, 0, sizeof(dev));
+    dev.id = 2;
+    dev.enabled = TRUE;
+    dev.spriteInfo = &spriteInfo;
+    spriteInfo.sprite = &sprite;
+    dev.public.processInputProc = bench_process_input;
+    dev.coalesceMotion = coalesce;
+
+    processed_motion = processed_raw = 0;
+    mieqInit();
+
+    for (int i = 0; i < BURST_EVENTS; i += 2) {
+        InternalEvent e = { 0 };
+
+        e.any.header = ET_Internal;
+        e.any.time = i;
+        e.any.type = ET_RawMotion;
+        e.any.length = sizeof(RawDeviceEvent);
+        SetBit(e.raw_event.valuators.mask, 0);
+        SetBit(e.raw_event.valuators.mask, 1);
+        mieqEnqueue(&dev, &e);
+
+        memset(&e, 0, sizeof(e));
+        e.any.header = ET_Internal;
+        e.any.time = i;
+        e.any.type = ET_Motion;
+        e.any.length = sizeof(DeviceEvent);
+        e.device_event.root_x = i % 1024;
+        e.device_event.root_y = i % 768;
+        SetBit(e.device_event.valuators.mask, 0);
+        SetBit(e.device_event.valuators.mask, 1);
+        e.device_event.valuators.data[0] = i % 1024;
+        e.device_event.valuators.data[1] = i % 768;
+        mieqEnqueue(&dev, &e);
+
+        if ((i + 2) % STALL_EVENTS == 0) {
+            t0 = bench_now_ns();
+            mieqProcessInputEvents();
+            ns += bench_now_ns() - t0;
+        }
+    }
+
+    mieqGetStats(&stats);
+    mieqFini();
+
+    snprintf(what, sizeof(what), "drain %d events, coalescing %s",
+             BURST_EVENTS, coalesce ? "on" : "off");
+    bench_report(what, BURST_EVENTS, ns);
+    printf("  %-40s %10lu motion %6lu raw processed, %lu dropped\n", "",
+           processed_motion, processed_raw, (unsigned long) stats.dropped);
+}
+
+void
+mieq_bench(void)
+{
+    mieq_bench_one(FALSE);
+    mieq_bench_one(TRUE);
+}
@@ -0,0 +1,180 @@
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+#include "include/fd_notify.h"
+#include "os/ospoll.h"
+
+#include "bench.h"
+
+/*
+ * Event loop cost with many idle clients: NUM_IDLE connected but silent
+ * sockets are registered like client connections, while one active client
+ * sends a byte per round and gets write interest toggled on and off, the
+ * way FlushClient() does for flow control.
+ *
+ * System calls are counted through the raw_syscalls:sys_enter tracepoint
+ * when the kernel lets us (needs tracefs and perf_event_paranoid <= 1).
+ */
+
+#define NUM_IDLE        1000
+#define ROUNDS          200000
+
+static struct ospoll *bench_poll;
+static unsigned long callbacks;
+
+static void
+active_notify(int fd, int xevents, void *data)
+{
+    char c;
+
+    if (xevents & X_NOTIFY_READ)
+        while (read(fd, &c, 1) == 1)
+            ;
+    if (xevents & X_NOTIFY_WRITE)
+        ospoll_mute(bench_poll, fd, X_NOTIFY_WRITE);
+    callbacks++;
+}
+
+static void
+idle_notify(int fd, int xevents, void *data)
+{
+    abort();
+}
+
+static int
+syscall_counter_open(void)
+{
+#ifdef __linux__
+    static const char *paths[] = {
+        "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+        "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+    };
+    struct perf_event_attr attr = {
+        .type = PERF_TYPE_TRACEPOINT,
+        .size = sizeof(attr),
+        .disabled = 1,
+    };
+
+    for (unsigned i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        FILE *f = fopen(paths[i], "r");
+        unsigned long long id;
+
+        if (!f)
+            continue;
+        if (fscanf(f, "%llu", &id) == 1) {
+            fclose(f);
+            attr.config = id;
+            return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+        fclose(f);
+    }
+#endif
+    return -1;
+}
+
+static void
+ospoll_bench_one(const char *name, bool use_io_uring)
+{
+    static int idle[NUM_IDLE][2];
+    int active[2];
+    int counter = syscall_counter_open();
+    unsigned long long syscalls = 0;
+    char what[128];
+    uint64_t t0, ns;
+
+    ospoll_use_io_uring = use_io_uring;
+    bench_poll = ospoll_create();
+    if (!bench_poll) {
+        printf("  %s: ospoll_create failed\n", name);
+        return;
+    }
+
+    for (int i = 0; i < NUM_IDLE; i++) {
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, idle[i]) < 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        ospoll_add(bench_poll, idle[i][0], ospoll_trigger_edge,
+                   idle_notify, NULL);
+        ospoll_listen(bench_poll, idle[i][0], X_NOTIFY_READ);
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, active) < 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    ospoll_add(bench_poll, active[0], ospoll_trigger_edge,
+               active_notify, NULL);
+    ospoll_listen(bench_poll, active[0], X_NOTIFY_READ);
+
+    /* let the registrations settle */
+    ospoll_wait(bench_poll, 0);
+
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    callbacks = 0;
+    t0 = bench_now_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        if (write(active[1], "x", 1) != 1)
+            abort();
+        ospoll_listen(bench_poll, active[0], X_NOTIFY_WRITE);
+        ospoll_wait(bench_poll, -1);
+    }
+    ns = bench_now_ns() - t0;
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &syscalls, sizeof(syscalls)) != sizeof(syscalls))
+            syscalls = 0;
+        close(counter);
+    }
+
+    snprintf(what, sizeof(what), "%s: wakeup, %d idle fds", name, NUM_IDLE);
+    bench_report(what, ROUNDS, ns);
+    printf("  %-40s %10.0f wakeups/s %6.2f callbacks/round", "",
+           ROUNDS * 1e9 / ns, (double) callbacks / ROUNDS);
+    if (counter >= 0)
+        printf(" %10.0f syscalls/s %6.2f syscalls/round\n",
+               syscalls * 1e9 / ns, (double) syscalls / ROUNDS);
+    else
+        printf("   (no syscall tracepoint, count with strace -c)\n");
+
+    for (int i = 0; i < NUM_IDLE; i++) {
+        ospoll_remove(bench_poll, idle[i][0]);
+        close(idle[i][0]);
+        close(idle[i][1]);
+    }
+    ospoll_remove(bench_poll, active[0]);
+    close(active[0]);
+    close(active[1]);
+    ospoll_wait(bench_poll, 0);
+    ospoll_destroy(bench_poll);
+}
+
+void
+ospoll_bench(void)
+{
+    struct rlimit rl;
+
+    /* two fds per idle client, plus some slack */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < 2 * NUM_IDLE + 64) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    ospoll_bench_one("default", false);
+#ifdef HAVE_LIBURING
+    ospoll_bench_one("io_uring", true);
+#endif
+}
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Small pixmap churn as from toolkits and RENDER clients: glyph, icon and
+ * mask sized pixmaps created, drawn into a 256x256 ARGB window and
+ * destroyed, with a few hundred of them alive at a time. Once with the
+ * pixmaps from the screen's slabs and once from calloc(), and the same
+ * without the compositing, which is the allocator alone.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/X.h>
+
+#include "dix/screenint_priv.h"
+#include "fb/fb_priv.h"
+
+#include "bench.h"
+
+#define NUM_OPS         2000000
+#define LIVE_PIXMAPS    256
+#define DST_SIZE        256
+
+static ScreenRec screen;
+
+static const struct {
+    int width, height, depth;
+} sizes[] = {
+    { 8, 13, 8 },               /* glyph masks */
+    { 12, 20, 8 },
+    { 16, 16, 32 },             /* icons */
+    { 24, 24, 32 },
+    { 32, 32, 32 },
+    { 48, 48, 32 },
+    { 64, 64, 32 },
+    { 64, 16, 8 },              /* temporary masks */
+};
+
+static void
+bench_churn(const char *name, pixman_image_t *dst)
+{
+    PixmapPtr live[LIVE_PIXMAPS] = { NULL };
+    unsigned seed = 1;
+    uint64_t start;
+    char what[64];
+
+    start = bench_now_ns();
+    for (int op = 0; op < NUM_OPS; op++) {
+        int i, s;
+        PixmapPtr pPixmap;
+
+        seed = seed * 1103515245 + 12345;
+        i = (seed >> 8) % LIVE_PIXMAPS;
+        s = (seed >> 20) % ARRAY_SIZE(sizes);
+        if (live[i])
+            fbDestroyPixmap(live[i]);
+        pPixmap = live[i] = fbCreatePixmap(&screen, sizes[s].width,
+                                           sizes[s].height, sizes[s].depth,
+                                           0);
+        if (!pPixmap) {
+            printf("  failed to create a pixmap\n");
+            return;
+        }
+
+        if (dst) {
+            pixman_image_t *src;
+
+            src = pixman_image_create_bits(sizes[s].depth == 8 ?
+                                           PIXMAN_a8 : PIXMAN_a8r8g8b8,
+                                           pPixmap->drawable.width,
+                                           pPixmap->drawable.height,
+                                           pPixmap->devPrivate.ptr,
+                                           pPixmap->devKind);
+            pixman_image_composite32(PIXMAN_OP_OVER, src, NULL, dst,
+                                     0, 0, 0, 0,
+                                     (seed >> 4) % (DST_SIZE - 64),
+                                     (seed >> 12) % (DST_SIZE - 64),
+                                     pPixmap->drawable.width,
+                                     pPixmap->drawable.height);
+            pixman_image_unref(src);
+        }
+    }
+    snprintf(what, sizeof(what), "%s%s", name,
+             dst ? ", composited" : "");
+    bench_report(what, NUM_OPS, bench_now_ns() - start);
+
+    for (int i = 0; i < LIVE_PIXMAPS; i++)
+        if (live[i])
+            fbDestroyPixmap(live[i]);
+}
+
+void
+pixmap_bench(void)
+{
+    pixman_image_t *dst;
+
+    screenInfo.numScreens = 1;
+    screenInfo.screens[0] = &screen;
+    if (!fbSlabScreenInit(&screen)) {
+        printf("  failed to set up the slabs\n");
+        return;
+    }
+    dixInitScreenSpecificPrivates(&screen);
+    PixmapScreenInit(&screen);
+    dst = pixman_image_create_bits(PIXMAN_a8r8g8b8, DST_SIZE, DST_SIZE,
+                                   NULL, 0);
+
+    bench_churn("slabs", NULL);
+    bench_churn("slabs", dst);
+
+    /* without a pool, fbCreatePixmap() falls back to calloc() */
+    fbSlabScreenFini(&screen);
+    bench_churn("calloc", NULL);
+    bench_churn("calloc", dst);
+
+    pixman_image_unref(dst);
+}
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Looking up the privates of windows, pixmaps and GCs the way drawing code
+ * does: the object's own fields, a pointer private like damage's and a
+ * screen-specific struct like fb's GC private, on objects picked at
+ * random from more than fit in the caches. Sixteen privates of other
+ * extensions, registered first, sit in between unless the two are
+ * registered as hot.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <X11/X.h>
+
+#include "dix/screenint_priv.h"
+
+#include "gcstruct.h"
+#include "pixmapstr.h"
+#include "privates.h"
+#include "scrnintstr.h"
+#include "windowstr.h"
+#include "bench.h"
+
+#define NUM_OBJECTS     16384
+#define NUM_LOOKUPS     10000000
+#define COLD_KEYS       16
+
+static ScreenRec screen;
+/* so the lookups aren't optimized away */
+static volatile unsigned long bench_sum;
+
+typedef struct {
+    const char *name;
+    DevPrivateType type;
+    DevPrivateKeyRec cold[COLD_KEYS];
+    DevPrivateKeyRec coldScreen;
+    DevPrivateKeyRec hot;
+    DevPrivateKeyRec hotScreen;
+    void *objects[NUM_OBJECTS];
+} BenchPrivatesRec;
+
+static BenchPrivatesRec window = { .name = "window", .type = PRIVATE_WINDOW };
+static BenchPrivatesRec pixmap = { .name = "pixmap", .type = PRIVATE_PIXMAP };
+static BenchPrivatesRec gc = { .name = "GC", .type = PRIVATE_GC };
+
+static void
+bench_register(BenchPrivatesRec *b, Bool hot)
+{
+    static const unsigned sizes[8] = { 0, 0, 24, 64, 0, 128, 8, 0 };
+
+    for (int i = 0; i < COLD_KEYS; i++)
+        dixRegisterPrivateKey(&b->cold[i], b->type, sizes[i % 8]);
+    dixRegisterScreenSpecificPrivateKey(&screen, &b->coldScreen, b->type, 64);
+    if (hot) {
+        dixRegisterHotPrivateKey(&b->hot, b->type, 0);
+        dixRegisterHotScreenSpecificPrivateKey(&screen, &b->hotScreen,
+                                               b->type, 32);
+    }
+    else {
+        dixRegisterPrivateKey(&b->hot, b->type, 0);
+        dixRegisterScreenSpecificPrivateKey(&screen, &b->hotScreen,
+                                            b->type, 32);
+    }
+}
+
+static void *
+bench_alloc(BenchPrivatesRec *b)
+{
+    switch (b->type) {
+    case PRIVATE_WINDOW:
+        return dixAllocateScreenObjectWithPrivates(&screen, WindowRec,
+                                                   PRIVATE_WINDOW);
+    case PRIVATE_PIXMAP:
+        return dixAllocateScreenObjectWithPrivates(&screen, PixmapRec,
+                                                   PRIVATE_PIXMAP);
+    default:
+        return dixAllocateScreenObjectWithPrivates(&screen, GCRec,
+                                                   PRIVATE_GC);
+    }
+}
+
+static PrivatePtr *
+bench_privates(BenchPrivatesRec *b, void *object)
+{
+    switch (b->type) {
+    case PRIVATE_WINDOW:
+        return &((WindowPtr) object)->devPrivates;
+    case PRIVATE_PIXMAP:
+        return &((PixmapPtr) object)->devPrivates;
+    default:
+        return &((GCPtr) object)->devPrivates;
+    }
+}
+
+static void
+bench_lookups(BenchPrivatesRec *b, const char *layout)
+{
+    unsigned seed = 1;
+    unsigned long sum = 0;
+    uint64_t start;
+    char what[64];
+
+    for (int i = 0; i < NUM_OBJECTS; i++) {
+        PrivatePtr *privates;
+
+        b->objects[i] = bench_alloc(b);
+        privates = bench_privates(b, b->objects[i]);
+        dixSetPrivate(privates, &b->hot, b->objects[i]);
+        *(int *) dixLookupPrivate(privates, &b->hotScreen) = i;
+    }
+
+    start = bench_now_ns();
+    for (int i = 0; i < NUM_LOOKUPS; i++) {
+        void *object;
+        PrivatePtr *privates;
+
+        seed = seed * 1103515245 + 12345;
+        object = b->objects[(seed >> 8) % NUM_OBJECTS];
+        privates = bench_privates(b, object);
+        /* one of the object's own fields, the drawable type or screen */
+        sum += *(unsigned char *) object;
+        sum += (uintptr_t) dixLookupPrivate(privates, &b->hot);
+        sum += *(int *) dixLookupPrivate(privates, &b->hotScreen);
+    }
+    snprintf(what, sizeof(what), "%s privates, %s", b->name, layout);
+    bench_report(what, NUM_LOOKUPS, bench_now_ns() - start);
+    bench_sum = sum;
+
+    for (int i = 0; i < NUM_OBJECTS; i++)
+        _dixFreeObjectWithPrivates(b->objects[i],
+                                   *bench_privates(b, b->objects[i]),
+                                   b->type);
+}
+
+static void
+bench_layout(Bool hot)
+{
+    BenchPrivatesRec *all[] = { &window, &pixmap, &gc };
+
+    dixFreeScreenSpecificPrivates(&screen);
+    dixResetPrivates();
+    memset(screen.screenSpecificPrivates, 0,
+           sizeof(screen.screenSpecificPrivates));
+    dixInitScreenSpecificPrivates(&screen);
+    for (int i = 0; i < ARRAY_SIZE(all); i++)
+        bench_register(all[i], hot);
+    for (int i = 0; i < ARRAY_SIZE(all); i++)
+        bench_lookups(all[i], hot ? "hot ones first" : "as registered");
+}
+
+void
+privates_bench(void)
+{
+    screenInfo.numScreens = 1;
+    screenInfo.screens[0] = &screen;
+
+    bench_layout(FALSE);
+    bench_layout(TRUE);
+    dixFreeScreenSpecificPrivates(&screen);
+    dixResetPrivates();
+}
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Property lookup cost (the GetProperty/ChangeProperty hot path) against
+ * the number of properties on a window, and the cost of building a large
+ * property value through PropModeAppend.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/X.h>
+#include <X11/Xatom.h>
+#include <X11/Xproto.h>
+
+#include "dix/property_priv.h"
+
+#include "misc.h"
+#include "dixstruct.h"
+#include "windowstr.h"
+#include "propertyst.h"
+#include "bench.h"
+
+#define NUM_LOOKUPS 1000000
+#define APPEND_CHUNK 4096
+#define APPEND_TOTAL (512 * 1024)
+
+static void
+free_window_properties(WindowPtr pWin)
+{
+    PropertyPtr pProp = pWin->properties;
+
+    while (pProp) {
+        PropertyPtr next = pProp->next;
+
+        dixPropertyDataUnref(pProp->data);
+        dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
+        pProp = next;
+    }
+    pWin->properties = NULL;
+    free(pWin->propIndex);
+    pWin->propIndex = NULL;
+}
+
+static ClientRec client;
+static WindowOptRec optional;
+
+static void
+property_lookup_bench(void)
+{
+    static const unsigned counts[] = { 1, 4, 16, 64, 256, 1024 };
+    CARD32 value = 0;
+    char what[64];
+
+    for (unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        WindowRec win = { .optional = &optional };
+        PropertyPtr pProp;
+        unsigned long found = 0;
+        uint64_t start;
+
+        for (Atom a = 1; a <= counts[c]; a++)
+            dixChangeWindowProperty(&client, &win, a, XA_CARDINAL, 32,
+                                    PropModeReplace, 1, &value, FALSE);
+
+        start = bench_now_ns();
+        for (unsigned i = 0; i < NUM_LOOKUPS; i++)
+            if (dixLookupProperty(&pProp, &win, 1 + i % counts[c], &client,
+                                  DixReadAccess) == Success)
+                found++;
+        snprintf(what, sizeof(what), "lookup, %u properties", counts[c]);
+        bench_report(what, NUM_LOOKUPS, bench_now_ns() - start);
+
+        start = bench_now_ns();
+        for (unsigned i = 0; i < NUM_LOOKUPS; i++)
+            if (dixLookupProperty(&pProp, &win, counts[c] + 1, &client,
+                                  DixReadAccess) == Success)
+                found++;
+        snprintf(what, sizeof(what), "lookup miss, %u properties", counts[c]);
+        bench_report(what, NUM_LOOKUPS, bench_now_ns() - start);
+
+        if (found != NUM_LOOKUPS)
+            printf("  unexpected lookup result count %lu\n", found);
+        free_window_properties(&win);
+    }
+}
+
+static void
+property_append_bench(void)
+{
+    static CARD32 chunk[APPEND_CHUNK / 4];
+    WindowRec win = { .optional = &optional };
+    char what[64];
+    uint64_t start;
+
+    start = bench_now_ns();
+    for (unsigned i = 0; i < APPEND_TOTAL / APPEND_CHUNK; i++)
+        dixChangeWindowProperty(&client, &win, 1, XA_CARDINAL, 32,
+                                PropModeAppend, APPEND_CHUNK / 4, chunk, FALSE);
+    snprintf(what, sizeof(what), "append %u KB in %u byte chunks",
+             APPEND_TOTAL / 1024, APPEND_CHUNK);
+    bench_report(what, APPEND_TOTAL / APPEND_CHUNK, bench_now_ns() - start);
+    free_window_properties(&win);
+}
+
+void
+property_bench(void)
+{
+    property_lookup_bench();
+    property_append_bench();
+}
@@ -0,0 +1,203 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Region operations of the dix against plain pixman: building a clip
+ * from unsorted rectangles as SetClipRectangles and SHAPE do, validating
+ * the appended regions miValidateTree() collects, clipping a damage or
+ * expose rectangle to a window's many-box clip, and the union of two
+ * rectangles that fills a lot of damage and exposure code.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+
+#include "gc.h"
+#include "regionstr.h"
+#include "bench.h"
+
+#define MAX_RECTS       10000
+#define NUM_RECT_OPS    1000000
+
+static unsigned seed = 1;
+
+static int
+bench_random(int n)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static void
+bench_rects(xRectangle *rects, BoxPtr boxes, int n)
+{
+    for (int i = 0; i < n; i++) {
+        rects[i].x = bench_random(1920);
+        rects[i].y = bench_random(1080);
+        rects[i].width = 1 + bench_random(64);
+        rects[i].height = 1 + bench_random(64);
+        boxes[i].x1 = rects[i].x;
+        boxes[i].y1 = rects[i].y;
+        boxes[i].x2 = rects[i].x + rects[i].width;
+        boxes[i].y2 = rects[i].y + rects[i].height;
+    }
+}
+
+static void
+bench_from_rects(xRectangle *rects, BoxPtr boxes, int n)
+{
+    int reps = 1000000 / n;
+    uint64_t start;
+    char what[64];
+
+    bench_rects(rects, boxes, n);
+
+    start = bench_now_ns();
+    for (int r = 0; r < reps; r++)
+        RegionDestroy(RegionFromRects(n, rects, CT_UNSORTED));
+    snprintf(what, sizeof(what), "RegionFromRects, %d unsorted", n);
+    bench_report(what, reps, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int r = 0; r < reps; r++) {
+        RegionRec reg;
+
+        pixman_region_init_rects(&reg, boxes, n);
+        pixman_region_fini(&reg);
+    }
+    snprintf(what, sizeof(what), "pixman_region_init_rects, %d", n);
+    bench_report(what, reps, bench_now_ns() - start);
+}
+
+static void
+bench_validate(BoxPtr boxes, int n)
+{
+    int reps = 1000000 / n;
+    uint64_t start;
+    char what[64];
+
+    start = bench_now_ns();
+    for (int r = 0; r < reps; r++) {
+        RegionRec reg, part;
+        Bool overlap;
+
+        RegionNull(&reg);
+        for (int i = 0; i < n; i++) {
+            RegionInit(&part, &boxes[i], 1);
+            RegionAppend(&reg, &part);
+        }
+        RegionValidate(&reg, &overlap);
+        RegionUninit(&reg);
+    }
+    snprintf(what, sizeof(what), "RegionAppend + RegionValidate, %d", n);
+    bench_report(what, reps, bench_now_ns() - start);
+}
+
+static void
+bench_intersect(BoxPtr boxes, int n)
+{
+    RegionRec reg, rect, dst;
+    uint64_t start;
+    char what[64];
+
+    pixman_region_init_rects(&reg, boxes, n);
+    RegionNull(&dst);
+
+    start = bench_now_ns();
+    for (int op = 0; op < NUM_RECT_OPS; op++) {
+        BoxRec box;
+
+        box.x1 = bench_random(1900);
+        box.y1 = bench_random(1060);
+        box.x2 = box.x1 + 16;
+        box.y2 = box.y1 + 16;
+        RegionInit(&rect, &box, 1);
+        RegionIntersect(&dst, &rect, &reg);
+    }
+    snprintf(what, sizeof(what), "RegionIntersect 16x16 by %d boxes",
+             RegionNumRects(&reg));
+    bench_report(what, NUM_RECT_OPS, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int op = 0; op < NUM_RECT_OPS; op++) {
+        BoxRec box;
+
+        box.x1 = bench_random(1900);
+        box.y1 = bench_random(1060);
+        box.x2 = box.x1 + 16;
+        box.y2 = box.y1 + 16;
+        RegionInit(&rect, &box, 1);
+        pixman_region_intersect(&dst, &rect, &reg);
+    }
+    snprintf(what, sizeof(what), "pixman_region_intersect 16x16 by %d boxes",
+             RegionNumRects(&reg));
+    bench_report(what, NUM_RECT_OPS, bench_now_ns() - start);
+
+    RegionUninit(&dst);
+    pixman_region_fini(&reg);
+}
+
+static void
+bench_union(void)
+{
+    RegionRec a, b, dst;
+    uint64_t start;
+
+    RegionNull(&dst);
+
+    /* neighbouring boxes along a row, as a run of glyphs or spans damages */
+    start = bench_now_ns();
+    for (int op = 0; op < NUM_RECT_OPS; op++) {
+        BoxRec box = { 0, 0, 8 + op % 64, 16 };
+
+        RegionInit(&a, &box, 1);
+        box.x1 = box.x2 - op % 4;
+        box.x2 = box.x1 + 8;
+        RegionInit(&b, &box, 1);
+        RegionUnion(&dst, &a, &b);
+    }
+    bench_report("RegionUnion of two rects", NUM_RECT_OPS,
+                 bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int op = 0; op < NUM_RECT_OPS; op++) {
+        BoxRec box = { 0, 0, 8 + op % 64, 16 };
+
+        RegionInit(&a, &box, 1);
+        box.x1 = box.x2 - op % 4;
+        box.x2 = box.x1 + 8;
+        RegionInit(&b, &box, 1);
+        pixman_region_union(&dst, &a, &b);
+    }
+    bench_report("pixman_region_union of two rects", NUM_RECT_OPS,
+                 bench_now_ns() - start);
+
+    RegionUninit(&dst);
+}
+
+void
+region_bench(void)
+{
+    static const int counts[] = { 100, 1000, MAX_RECTS };
+    xRectangle *rects = calloc(MAX_RECTS, sizeof(xRectangle));
+    BoxPtr boxes = calloc(MAX_RECTS, sizeof(BoxRec));
+
+    if (!rects || !boxes) {
+        printf("  out of memory\n");
+        goto out;
+    }
+    InitRegions();
+
+    for (int c = 0; c < ARRAY_SIZE(counts); c++)
+        bench_from_rects(rects, boxes, counts[c]);
+    for (int c = 0; c < ARRAY_SIZE(counts); c++)
+        bench_validate(boxes, counts[c]);
+    bench_intersect(boxes, 1000);
+    bench_union();
+
+out:
+    free(rects);
+    free(boxes);
+}
@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Resource table cost at a million resources held by one client, as with
+ * a long running compositor or a leaky toolkit: AddResource() while the
+ * table grows, lookups by type, FreeResource(), and server side IDs from
+ * FakeClientID() once the counter has wrapped around.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <X11/X.h>
+
+#include "dix/dix_priv.h"
+#include "dix/resource_priv.h"
+
+#include "misc.h"
+#include "dixstruct.h"
+#include "resource.h"
+#include "bench.h"
+
+#define NUM_RESOURCES   1000000
+/* fake IDs handed out, every other one is freed before wrapping around */
+#define NUM_FAKE_IDS    100000
+
+static ClientRec server_client;
+static ClientRec bench_client;
+
+static int
+bench_delete(void *value, XID id)
+{
+    return Success;
+}
+
+static inline unsigned
+bench_random(unsigned *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+void
+resource_bench(void)
+{
+    unsigned seed = 1;
+    unsigned long found = 0;
+    uint64_t start;
+    RESTYPE type;
+    XID base, id;
+    void *val;
+
+    serverClient = &server_client;
+    if (!InitClientResources(serverClient)) {
+        printf("  failed to set up the resource tables\n");
+        return;
+    }
+    bench_client.index = 1;
+    bench_client.clientAsMask = (XID) 1 << CLIENTOFFSET;
+    type = CreateNewResourceType(bench_delete, "BenchResource");
+    if (!type || !InitClientResources(&bench_client)) {
+        printf("  failed to set up the resource tables\n");
+        return;
+    }
+    base = bench_client.clientAsMask;
+
+    start = bench_now_ns();
+    for (int i = 1; i <= NUM_RESOURCES; i++)
+        AddResource(base + i, type, (void *) (uintptr_t) i);
+    bench_report("create", NUM_RESOURCES, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < NUM_RESOURCES; i++) {
+        id = base + 1 + bench_random(&seed) % NUM_RESOURCES;
+        if (dixLookupResourceByType(&val, id, type, NULL,
+                                    DixReadAccess) == Success)
+            found++;
+    }
+    bench_report("lookup (hit)", NUM_RESOURCES, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < NUM_RESOURCES; i++) {
+        id = base + NUM_RESOURCES + 1 + bench_random(&seed) % NUM_RESOURCES;
+        if (dixLookupResourceByType(&val, id, type, NULL,
+                                    DixReadAccess) == Success)
+            found++;
+    }
+    bench_report("lookup (miss)", NUM_RESOURCES, bench_now_ns() - start);
+    if (found != NUM_RESOURCES)
+        printf("  %lu lookups found something, expected %d\n",
+               found, NUM_RESOURCES);
+
+    /* server side IDs, interleaved with the client's */
+    for (int i = 0; i < NUM_FAKE_IDS; i++)
+        AddResource(FakeClientID(bench_client.index), type, NULL);
+    for (int i = 0; i < NUM_FAKE_IDS; i += 2)
+        FreeResource(bench_client.clientAsMask | SERVER_BIT | i,
+                     X11_RESTYPE_NONE);
+    /* make the next FakeClientID() wrap around and search for free IDs */
+    for (id = FakeClientID(bench_client.index);
+         (id & RESOURCE_ID_MASK) != RESOURCE_ID_MASK;
+         id = FakeClientID(bench_client.index));
+
+    start = bench_now_ns();
+    for (int i = 0; i < NUM_FAKE_IDS / 2; i++)
+        AddResource(FakeClientID(bench_client.index), type, NULL);
+    bench_report("fake ID after wraparound", NUM_FAKE_IDS / 2,
+                 bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 1; i <= NUM_RESOURCES; i++)
+        FreeResource(base + i, X11_RESTYPE_NONE);
+    bench_report("free", NUM_RESOURCES, bench_now_ns() - start);
+
+    FreeClientResources(&bench_client);
+    FreeClientResources(serverClient);
+}
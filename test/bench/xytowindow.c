@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Pointer-to-window lookup (XYToWindow, done for every motion event) over
+ * a flat tree of many toplevels, as with a compositing desktop full of
+ * override-redirect and input-only windows. Compares the spatial index
+ * against the plain sibling walk miSpriteTrace() used to do, and the
+ * index when the tree is restructured every few motion events.
+ */
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/X.h>
+
+#include "dix/dix_priv.h"
+#include "mi/mi_priv.h"
+
+#include "misc.h"
+#include "inputstr.h"
+#include "scrnintstr.h"
+#include "windowstr.h"
+#include "bench.h"
+
+#define ROOT_WIDTH      3840
+#define ROOT_HEIGHT     2160
+#define NUM_MOTIONS     200000
+/* restructures per motion events in the invalidation run */
+#define RESTRUCTURE_EVERY 100
+
+static ScreenRec screen;
+
+static WindowPtr
+bench_window(WindowPtr parent, int x, int y, int w, int h)
+{
+    WindowPtr pWin = dixAllocateScreenObjectWithPrivates(&screen, WindowRec,
+                                                         PRIVATE_WINDOW);
+
+    pWin->drawable.pScreen = &screen;
+    pWin->drawable.x = x;
+    pWin->drawable.y = y;
+    pWin->drawable.width = w;
+    pWin->drawable.height = h;
+    pWin->mapped = TRUE;
+    pWin->parent = parent;
+    if (parent) {
+        /* new windows go on top */
+        pWin->nextSib = parent->firstChild;
+        if (parent->firstChild)
+            parent->firstChild->prevSib = pWin;
+        else
+            parent->lastChild = pWin;
+        parent->firstChild = pWin;
+    }
+    return pWin;
+}
+
+static void
+bench_free_tree(WindowPtr pWin)
+{
+    WindowPtr pChild = pWin->firstChild;
+
+    while (pChild) {
+        WindowPtr next = pChild->nextSib;
+
+        bench_free_tree(pChild);
+        pChild = next;
+    }
+    dixScreenRaiseWindowDestroy(pWin);
+    dixFreeObjectWithPrivates(pWin, PRIVATE_WINDOW);
+}
+
+/* what miSpriteTrace() did before the index, minus the shape checks */
+static WindowPtr
+bench_linear_lookup(WindowPtr pWin, int x, int y)
+{
+    WindowPtr pChild = pWin->firstChild;
+
+    while (pChild) {
+        if (pChild->mapped &&
+            x >= pChild->drawable.x && y >= pChild->drawable.y &&
+            x < pChild->drawable.x + (int) pChild->drawable.width &&
+            y < pChild->drawable.y + (int) pChild->drawable.height) {
+            pWin = pChild;
+            pChild = pChild->firstChild;
+        }
+        else
+            pChild = pChild->nextSib;
+    }
+    return pWin;
+}
+
+static inline unsigned
+bench_random(unsigned *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static inline void
+bench_pointer(unsigned i, int *x, int *y)
+{
+    /* sweep the screen row by row */
+    *x = (i * 7) % ROOT_WIDTH;
+    *y = (i / 3) % ROOT_HEIGHT;
+}
+
+static void
+xytowindow_bench_one(int num_windows)
+{
+    SpriteRec sprite = { 0 };
+    WindowPtr root, *expected;
+    unsigned seed = 1, mismatches = 0;
+    uint64_t start;
+    char what[64];
+    int x, y;
+
+    root = bench_window(NULL, 0, 0, ROOT_WIDTH, ROOT_HEIGHT);
+    for (int i = 0; i < num_windows; i++) {
+        int w, h, wx, wy;
+        WindowPtr frame;
+
+        w = 24 + bench_random(&seed) % 400;
+        h = 24 + bench_random(&seed) % 300;
+        wx = bench_random(&seed) % (ROOT_WIDTH - w);
+        wy = bench_random(&seed) % (ROOT_HEIGHT - h);
+        frame = bench_window(root, wx, wy, w, h);
+        /* a client window inside the frame */
+        bench_window(frame, wx + 2, wy + 20, w - 4, h - 22);
+    }
+
+    expected = calloc(NUM_MOTIONS, sizeof(WindowPtr));
+    sprite.spriteTraceSize = 32;
+    sprite.spriteTrace = calloc(sprite.spriteTraceSize, sizeof(WindowPtr));
+    sprite.spriteTrace[0] = root;
+
+    start = bench_now_ns();
+    for (unsigned i = 0; i < NUM_MOTIONS; i++) {
+        bench_pointer(i, &x, &y);
+        expected[i] = bench_linear_lookup(root, x, y);
+    }
+    snprintf(what, sizeof(what), "linear walk, %d windows", num_windows);
+    bench_report(what, NUM_MOTIONS, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (unsigned i = 0; i < NUM_MOTIONS; i++) {
+        bench_pointer(i, &x, &y);
+        if (miXYToWindow(&screen, &sprite, x, y) != expected[i])
+            mismatches++;
+    }
+    snprintf(what, sizeof(what), "indexed, %d windows", num_windows);
+    bench_report(what, NUM_MOTIONS, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (unsigned i = 0; i < NUM_MOTIONS; i++) {
+        bench_pointer(i, &x, &y);
+        if (i % RESTRUCTURE_EVERY == 0)
+            miWindowIndexInvalidate();
+        miXYToWindow(&screen, &sprite, x, y);
+    }
+    snprintf(what, sizeof(what), "indexed, restructure every %d",
+             RESTRUCTURE_EVERY);
+    bench_report(what, NUM_MOTIONS, bench_now_ns() - start);
+
+    if (mismatches)
+        printf("  %u lookups disagree with the linear walk\n", mismatches);
+
+    free(expected);
+    free(sprite.spriteTrace);
+    bench_free_tree(root);
+}
+
+void
+xytowindow_bench(void)
+{
+    static const int counts[] = { 10, 100, 1000, 10000 };
+
+    if (!miWindowIndexInit(&screen)) {
+        printf("  failed to set up the window index\n");
+        return;
+    }
+    dixInitScreenSpecificPrivates(&screen);
+
+    for (unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+        xytowindow_bench_one(counts[c]);
+}
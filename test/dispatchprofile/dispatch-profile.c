@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * DISPATCH-PROFILE from the client side, against a server running with
+ * +dispatchprofile. One client sends a known number of requests, then the
+ * counters are read back for that client alone, for all clients and after
+ * clearing them.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+
+#include "include/dispatchprofileproto.h"
+
+#define NUM_NOOP        1000
+
+static uint8_t major_opcode;
+
+static void
+fail(const char *what)
+{
+    fprintf(stderr, "dispatch-profile: %s\n", what);
+    exit(1);
+}
+
+static unsigned int
+send_request(xcb_connection_t *c, void *req, size_t len)
+{
+    struct iovec iov[3] = { [2] = { .iov_base = req, .iov_len = len } };
+    xcb_protocol_request_t pr = { .count = 1 };
+
+    return xcb_send_request(c, XCB_REQUEST_RAW | XCB_REQUEST_CHECKED,
+                            &iov[2], &pr);
+}
+
+static void
+query_version(xcb_connection_t *c)
+{
+    xDispatchProfileQueryVersionReq req = {
+        .reqType = major_opcode,
+        .dispatchProfileReqType = X_DispatchProfileQueryVersion,
+        .length = sizeof(req) / 4,
+        .majorVersion = DISPATCHPROFILE_MAJOR_VERSION,
+        .minorVersion = DISPATCHPROFILE_MINOR_VERSION,
+    };
+    xDispatchProfileQueryVersionReply *rep;
+
+    rep = xcb_wait_for_reply(c, send_request(c, &req, sizeof(req)), NULL);
+    if (!rep)
+        fail("DispatchProfileQueryVersion failed");
+    if (rep->majorVersion != DISPATCHPROFILE_MAJOR_VERSION)
+        fail("DispatchProfileQueryVersion returned the wrong version");
+    free(rep);
+}
+
+static xDispatchProfileGetClientProfileReply *
+get_profile(xcb_connection_t *c, uint32_t client, uint32_t flags,
+            xcb_generic_error_t **err)
+{
+    xDispatchProfileGetClientProfileReq req = {
+        .reqType = major_opcode,
+        .dispatchProfileReqType = X_DispatchProfileGetClientProfile,
+        .length = sizeof(req) / 4,
+        .client = client,
+        .flags = flags,
+    };
+    xDispatchProfileGetClientProfileReply *rep;
+
+    rep = xcb_wait_for_reply(c, send_request(c, &req, sizeof(req)), err);
+    if (rep && rep->length * 4 != rep->numEntries * sz_xDispatchProfileEntry)
+        fail("DispatchProfileGetClientProfile returned the wrong length");
+    return rep;
+}
+
+static const xDispatchProfileEntry *
+find_entry(const xDispatchProfileGetClientProfileReply *rep, uint32_t client,
+           int major, int minor)
+{
+    const xDispatchProfileEntry *e = (const void *) (rep + 1);
+
+    for (uint32_t i = 0; i < rep->numEntries; i++)
+        if (e[i].client == client && e[i].majorOpcode == major &&
+            e[i].minorOpcode == minor)
+            return &e[i];
+    return NULL;
+}
+
+static void
+sync_server(xcb_connection_t *c)
+{
+    free(xcb_get_input_focus_reply(c, xcb_get_input_focus(c), NULL));
+}
+
+int
+main(int argc, char **argv)
+{
+    xcb_connection_t *c = xcb_connect(NULL, NULL);
+    xcb_connection_t *other = xcb_connect(NULL, NULL);
+    xcb_query_extension_reply_t *ext;
+    xDispatchProfileGetClientProfileReply *rep;
+    const xDispatchProfileEntry *e;
+    xcb_generic_error_t *err = NULL;
+    uint32_t base, other_base;
+
+    if (xcb_connection_has_error(c) || xcb_connection_has_error(other))
+        fail("can't connect");
+
+    ext = xcb_query_extension_reply(c,
+        xcb_query_extension(c, strlen(DISPATCHPROFILE_NAME),
+                            DISPATCHPROFILE_NAME),
+        NULL);
+    if (!ext || !ext->present)
+        fail("no DISPATCH-PROFILE, server without +dispatchprofile?");
+    major_opcode = ext->major_opcode;
+    free(ext);
+
+    base = xcb_get_setup(c)->resource_id_base;
+    other_base = xcb_get_setup(other)->resource_id_base;
+
+    query_version(c);
+
+    for (int i = 0; i < NUM_NOOP; i++)
+        xcb_no_operation(c);
+    sync_server(c);
+    sync_server(other);
+
+    /* by any XID of the client, the entries are all its own */
+    rep = get_profile(c, base | 1, 0, NULL);
+    if (!rep)
+        fail("DispatchProfileGetClientProfile failed");
+    e = find_entry(rep, base, X_NoOperation, 0);
+    if (!e || e->count != NUM_NOOP || e->errors != 0)
+        fail("wrong count for NoOperation");
+    if (e->bytesIn != NUM_NOOP * sz_xReq || e->bytesOut != 0)
+        fail("wrong byte counts for NoOperation");
+    if (e->maxTime > e->time)
+        fail("longest NoOperation took longer than all of them");
+    e = find_entry(rep, base, X_GetInputFocus, 0);
+    if (!e || e->count != 1 || e->bytesOut != sz_xGetInputFocusReply)
+        fail("wrong counts for GetInputFocus");
+    e = find_entry(rep, base, major_opcode, X_DispatchProfileQueryVersion);
+    if (!e || e->count != 1 ||
+        e->bytesOut != sz_xDispatchProfileQueryVersionReply)
+        fail("wrong counts for DispatchProfileQueryVersion");
+    if (find_entry(rep, other_base, X_GetInputFocus, 0))
+        fail("entries of another client");
+    free(rep);
+
+    /* None asks for everyone, the previous request is in by now */
+    rep = get_profile(c, None, 0, NULL);
+    if (!rep)
+        fail("DispatchProfileGetClientProfile for all clients failed");
+    e = find_entry(rep, other_base, X_GetInputFocus, 0);
+    if (!e || e->count != 1)
+        fail("no GetInputFocus of the other client");
+    e = find_entry(rep, base, major_opcode, X_DispatchProfileGetClientProfile);
+    if (!e || e->count != 1 ||
+        e->bytesIn != sz_xDispatchProfileGetClientProfileReq)
+        fail("wrong counts for DispatchProfileGetClientProfile");
+    free(rep);
+
+    /* clearing keeps only the clearing request itself */
+    free(get_profile(c, base, DispatchProfileResetMask, NULL));
+    rep = get_profile(c, base, 0, NULL);
+    if (!rep)
+        fail("DispatchProfileGetClientProfile after clearing failed");
+    if (rep->numEntries != 1)
+        fail("clearing left entries behind");
+    e = find_entry(rep, base, major_opcode, X_DispatchProfileGetClientProfile);
+    if (!e || e->count != 1)
+        fail("the clearing request wasn't accounted");
+    free(rep);
+
+    rep = get_profile(c, None, ~DispatchProfileResetMask, &err);
+    if (rep || !err || err->error_code != BadValue)
+        fail("unknown flags didn't fail");
+    free(err);
+
+    /* and the failure was counted */
+    rep = get_profile(c, base, 0, NULL);
+    if (!rep)
+        fail("DispatchProfileGetClientProfile failed");
+    e = find_entry(rep, base, major_opcode, X_DispatchProfileGetClientProfile);
+    if (!e || e->count != 3 || e->errors != 1)
+        fail("the failed request wasn't accounted");
+    free(rep);
+
+    xcb_disconnect(other);
+    xcb_disconnect(c);
+    return 0;
+}
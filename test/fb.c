@@ -0,0 +1,426 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * fbBlt() and fbSolid() against a byte-wise reference, covering the
+ * vectorized middle of the scanlines and the masked edges around it, and
+ * fbBlt() against a bit-wise one for every raster op. Splitting of large
+ * operations into bands for the render threads, the glyph atlas and the
+ * pixmap slabs.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+
+#include "dix/settings_priv.h"
+#include "fb/fb_priv.h"
+#include "fb/fbpict_priv.h"
+
+#include "tests-common.h"
+
+#define TEST_WIDTH      160     /* pixels */
+#define TEST_HEIGHT     6
+
+static FbStride
+test_stride(int bpp)
+{
+    return (TEST_WIDTH * bpp + FB_MASK) >> FB_SHIFT;
+}
+
+static void
+test_pattern(FbBits *bits, int words, unsigned seed)
+{
+    for (int i = 0; i < words; i++)
+        bits[i] = (i + seed) * 2654435761u;
+}
+
+static void
+fb_blt_overlap(void)
+{
+    static const int bpps[] = { 8, 16, 32 };
+
+    for (int b = 0; b < ARRAY_SIZE(bpps); b++) {
+        int bpp = bpps[b], Bpp = bpp / 8;
+        FbStride stride = test_stride(bpp);
+        int words = stride * TEST_HEIGHT;
+        int bytestride = stride * sizeof(FbBits);
+        FbBits *bits = calloc(words, sizeof(FbBits));
+        CARD8 *expect = calloc(words, sizeof(FbBits));
+        CARD8 *tmp = calloc(words, sizeof(FbBits));
+
+        for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -9; dx <= 9; dx++)
+        for (int w = 1; w <= 70; w += 3) {
+            int x = 10, y = 2, h = 3;
+
+            /* the reference goes through a copy, so overlap is no issue */
+            test_pattern(bits, words, w + dx);
+            memcpy(expect, bits, words * sizeof(FbBits));
+            for (int r = 0; r < h; r++)
+                memcpy(tmp + r * w * Bpp,
+                       expect + (y + dy + r) * bytestride + (x + dx) * Bpp,
+                       w * Bpp);
+            for (int r = 0; r < h; r++)
+                memcpy(expect + (y + r) * bytestride + x * Bpp,
+                       tmp + r * w * Bpp, w * Bpp);
+
+            fbBlt(bits + (y + dy) * stride, stride, (x + dx) * bpp,
+                  bits + y * stride, stride, x * bpp,
+                  w * bpp, h, GXcopy, FB_ALLONES, bpp, dx < 0, dy < 0);
+            assert(memcmp(bits, expect, words * sizeof(FbBits)) == 0);
+        }
+        free(bits);
+        free(expect);
+        free(tmp);
+    }
+}
+
+static Bool
+test_bit(const FbBits *line, int x)
+{
+    return (line[x >> FB_SHIFT] & FbBitsMask(x & FB_MASK, 1)) != 0;
+}
+
+/* what alu does to one bit, see the GX function definitions */
+static Bool
+test_rop_bit(int alu, Bool src, Bool dst)
+{
+    return (alu >> (3 - ((src << 1) | dst))) & 1;
+}
+
+static void
+fb_blt_rops(void)
+{
+    static const FbBits pms[] = { FB_ALLONES, 0x00ff0ff0 };
+    const int width = 8 * FB_UNIT, height = 2;
+    FbStride stride = width / FB_UNIT;
+    int words = stride * height;
+    FbBits *src = calloc(words, sizeof(FbBits));
+    FbBits *dst = calloc(words, sizeof(FbBits));
+    FbBits *orig = calloc(words, sizeof(FbBits));
+
+    for (int alu = 0; alu < 16; alu++)
+    for (int p = 0; p < ARRAY_SIZE(pms); p++)
+    for (int srcX = 0; srcX < 40; srcX += 3)
+    for (int dstX = 0; dstX < 40; dstX += 5)
+    for (int w = 1; w < width - 40; w += 17) {
+        FbBits pm = pms[p];
+
+        test_pattern(src, words, alu + w);
+        test_pattern(orig, words, srcX + dstX * 7);
+        memcpy(dst, orig, words * sizeof(FbBits));
+
+        fbBlt(src, stride, srcX, dst, stride, dstX, w, height,
+              alu, pm, 1, FALSE, FALSE);
+
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++) {
+                const FbBits *o = orig + y * stride;
+                Bool expect = test_bit(o, x);
+
+                if (x >= dstX && x < dstX + w &&
+                    test_bit(&pm, x & FB_MASK))
+                    expect = test_rop_bit(alu,
+                                          test_bit(src + y * stride,
+                                                   x - dstX + srcX),
+                                          expect);
+                assert(test_bit(dst + y * stride, x) == expect);
+            }
+    }
+    free(src);
+    free(dst);
+    free(orig);
+}
+
+static void
+fb_solid(void)
+{
+    static const int bpps[] = { 8, 16, 32 };
+    static const int alus[] = { GXcopy, GXxor, GXinvert, GXor };
+
+    for (int b = 0; b < ARRAY_SIZE(bpps); b++)
+    for (int a = 0; a < ARRAY_SIZE(alus); a++) {
+        int bpp = bpps[b], Bpp = bpp / 8;
+        FbStride stride = test_stride(bpp);
+        int words = stride * TEST_HEIGHT;
+        int bytestride = stride * sizeof(FbBits);
+        FbBits fg = fbReplicatePixel(0x12345678, bpp);
+        FbBits and = fbAnd(alus[a], fg, FB_ALLONES);
+        FbBits xor = fbXor(alus[a], fg, FB_ALLONES);
+        const CARD8 *andb = (const CARD8 *) &and;
+        const CARD8 *xorb = (const CARD8 *) &xor;
+        FbBits *bits = calloc(words, sizeof(FbBits));
+        CARD8 *expect = calloc(words, sizeof(FbBits));
+
+        for (int x = 0; x < 9; x++)
+        for (int w = 1; w <= 140; w += 3) {
+            int y = 1, h = 4;
+
+            test_pattern(bits, words, x + w);
+            memcpy(expect, bits, words * sizeof(FbBits));
+            for (int r = y; r < y + h; r++)
+                for (int i = x * Bpp; i < (x + w) * Bpp; i++) {
+                    CARD8 *d = expect + r * bytestride + i;
+                    int o = i % sizeof(FbBits);
+
+                    *d = (*d & andb[o]) ^ xorb[o];
+                }
+
+            fbSolid(bits + y * stride, stride, x * bpp, bpp, w * bpp, h,
+                    and, xor);
+            assert(memcmp(bits, expect, words * sizeof(FbBits)) == 0);
+        }
+        free(bits);
+        free(expect);
+    }
+}
+
+static int band_runs[FB_MAX_THREADS];
+
+static void
+test_band(void *closure, int band)
+{
+    /* every band is handed to exactly one thread */
+    band_runs[band]++;
+}
+
+static void
+fb_parallel(void)
+{
+    const int saved_threads = dixSettingRenderThreads;
+    const int saved_pixels = dixSettingRenderThreadPixels;
+    /* a frame, 2800 pixels: 1000 in the top and bottom bands, 800 between */
+    BoxRec boxes[] = {
+        {  0,  0, 100, 10 },
+        {  0, 10,  10, 50 }, { 90, 10, 100, 50 },
+        {  0, 50, 100, 60 },
+    };
+    BoxRec all = { 0, 0, 100, 60 }, middle = { 0, 20, 100, 40 };
+    RegionRec clip;
+    int ys[FB_MAX_THREADS + 1];
+    int n;
+
+    RegionInitBoxes(&clip, boxes, ARRAY_SIZE(boxes));
+
+    dixSettingRenderThreads = 1;
+    dixSettingRenderThreadPixels = 100;
+    assert(fbParallelSplit(&clip, &all, ys) == 1);
+
+#if INPUTTHREAD
+    /* bands of about the same area, not the same height */
+    dixSettingRenderThreads = 4;
+    assert(fbParallelSplit(&clip, &all, ys) == 4);
+    assert(ys[0] == 0 && ys[1] == 7 && ys[2] == 30 && ys[3] == 53 &&
+           ys[4] == 60);
+
+    assert(fbParallelSplit(&clip, &middle, ys) == 4);
+    assert(ys[0] == 20 && ys[1] == 25 && ys[2] == 30 && ys[3] == 35 &&
+           ys[4] == 40);
+
+    dixSettingRenderThreadPixels = 2801;
+    assert(fbParallelSplit(&clip, &all, ys) == 1);
+
+    /* more threads than rows */
+    dixSettingRenderThreads = 1000;
+    dixSettingRenderThreadPixels = 1;
+    n = fbParallelSplit(&clip, &all, ys);
+    assert(n > 1 && n <= FB_MAX_THREADS);
+    for (int i = 0; i < n; i++)
+        assert(ys[i] < ys[i + 1]);
+    assert(ys[0] == 0 && ys[n] == 60);
+
+    for (int r = 0; r < 100; r++)
+        fbParallelRun(test_band, NULL, n);
+    for (int i = 0; i < n; i++)
+        assert(band_runs[i] == 100);
+#endif
+
+    RegionUninit(&clip);
+    dixSettingRenderThreads = saved_threads;
+    dixSettingRenderThreadPixels = saved_pixels;
+}
+
+static void
+test_glyph(GlyphPtr glyph, int n, int width, int height)
+{
+    uint32_t h = n * 2654435761u;
+
+    memset(glyph, 0, sizeof(*glyph));
+    memcpy(glyph->sha1, &h, sizeof(h));
+    glyph->info.width = width;
+    glyph->info.height = height;
+}
+
+/* the glyph's id is in every pixel of its place in the atlas, and only there */
+static void
+test_atlas_owner(FbGlyphAtlasPtr atlas, FbGlyphAtlasEntryPtr entry, int id)
+{
+    for (int y = 0; y < entry->glyph->info.height; y++)
+        for (int x = 0; x < entry->glyph->info.width; x++)
+            assert(atlas->bits[(entry->y + y) * atlas->stride + entry->x + x]
+                   == id);
+}
+
+static void
+test_atlas_fill(FbGlyphAtlasPtr atlas, FbGlyphAtlasEntryPtr entry, int id)
+{
+    for (int y = 0; y < entry->glyph->info.height; y++)
+        memset(atlas->bits + (entry->y + y) * atlas->stride + entry->x, id,
+               entry->glyph->info.width);
+}
+
+static void
+fb_glyph_atlas(void)
+{
+    /* 16 shelves of 8 rows, room for 12 glyphs of 10x6 on each */
+    const int size = FB_GLYPH_MAX_SIZE, per_shelf = size / 10;
+    const int count = size / 8 * per_shelf;
+    FbGlyphAtlasPtr atlas = fbGlyphAtlasCreate(PIXMAN_a8, size, size);
+    GlyphRec *glyphs = calloc(count + 2, sizeof(GlyphRec));
+    FbGlyphAtlasEntryPtr entry;
+    GlyphRec big;
+    uint8_t mask[4 * 16];
+
+    assert(atlas && glyphs);
+
+    /* one run per shelf's worth */
+    for (int i = 0; i < count; i++) {
+        if (i % per_shelf == 0)
+            atlas->stamp++;
+        test_glyph(&glyphs[i], i, 10, 6);
+        assert(!fbGlyphAtlasLookup(atlas, &glyphs[i]));
+        entry = fbGlyphAtlasAlloc(atlas, &glyphs[i]);
+        assert(entry && entry->glyph == &glyphs[i]);
+        assert(entry->x >= 0 && entry->x + 10 <= size);
+        assert(entry->y >= 0 && entry->y + 6 <= size);
+        test_atlas_fill(atlas, entry, i % 255 + 1);
+    }
+    assert(atlas->evictions == 0 && atlas->misses == count);
+    for (int i = 0; i < count; i++) {
+        entry = fbGlyphAtlasLookup(atlas, &glyphs[i]);
+        assert(entry && entry->glyph == &glyphs[i]);
+        test_atlas_owner(atlas, entry, i % 255 + 1);
+    }
+    assert(atlas->hits == count);
+
+    /* full: the least recently used shelf goes, not the one just used */
+    atlas->stamp++;
+    assert(fbGlyphAtlasLookup(atlas, &glyphs[0]));
+    test_glyph(&glyphs[count], count, 10, 6);
+    assert(fbGlyphAtlasAlloc(atlas, &glyphs[count]));
+    assert(atlas->evictions == per_shelf);
+    assert(fbGlyphAtlasLookup(atlas, &glyphs[0]));
+    assert(!fbGlyphAtlasLookup(atlas, &glyphs[per_shelf]));
+    assert(fbGlyphAtlasLookup(atlas, &glyphs[2 * per_shelf]));
+
+    /* no shelf high enough: the top five go, the rest stays */
+    test_glyph(&glyphs[count + 1], count + 1, 20, 40);
+    entry = fbGlyphAtlasAlloc(atlas, &glyphs[count + 1]);
+    assert(entry && entry->y == size - 40);
+    assert(atlas->evictions == 6 * per_shelf);
+    assert(fbGlyphAtlasLookup(atlas, &glyphs[0]));
+    assert(fbGlyphAtlasLookup(atlas, &glyphs[count - 5 * per_shelf - 1]));
+    assert(!fbGlyphAtlasLookup(atlas, &glyphs[count - 5 * per_shelf]));
+    assert(!fbGlyphAtlasLookup(atlas, &glyphs[count - 1]));
+    assert(fbGlyphAtlasLookup(atlas, &glyphs[count + 1]));
+
+    fbGlyphAtlasRemove(atlas, &glyphs[count + 1]);
+    assert(!fbGlyphAtlasLookup(atlas, &glyphs[count + 1]));
+
+    test_glyph(&big, 0, FB_GLYPH_MAX_SIZE + 1, 1);
+    assert(!fbGlyphAtlasAlloc(atlas, &big));
+
+    /* adding saturates, and tells about overlaps */
+    test_glyph(&glyphs[0], 0, 2, 2);
+    entry = fbGlyphAtlasAlloc(atlas, &glyphs[0]);
+    assert(entry);
+    test_atlas_fill(atlas, entry, 200);
+    memset(mask, 0, sizeof(mask));
+    assert(!fbGlyphAtlasAdd(atlas, entry, mask, 4, 0, 0));
+    assert(!fbGlyphAtlasAdd(atlas, entry, mask, 4, 2, 1));
+    assert(mask[0] == 200 && mask[1] == 200 && mask[2] == 0);
+    assert(mask[4 + 1] == 200 && mask[4 + 2] == 200);
+    assert(fbGlyphAtlasAdd(atlas, entry, mask, 4, 1, 1));
+    assert(mask[4 + 1] == 255 && mask[4 + 2] == 255 && mask[4 + 3] == 200);
+
+    fbGlyphAtlasDestroy(atlas);
+    free(glyphs);
+}
+
+static void
+fb_slab(void)
+{
+    FbSlabPoolPtr pool = fbSlabPoolCreate();
+    FbSlabStatsRec stats;
+    /* more than a slab's worth of the smallest class */
+    enum { count = 600 };
+    unsigned char *objs[count], *obj, *big;
+
+    assert(pool);
+
+    for (int i = 0; i < count; i++) {
+        objs[i] = fbSlabAlloc(pool, 200);
+        assert(objs[i] && ((uintptr_t) objs[i] & 63) == 0);
+        for (int j = 0; j < 200; j++)
+            assert(objs[i][j] == 0);
+        memset(objs[i], 0xa5, 200);
+        for (int j = 0; j < i; j++)
+            assert(objs[j] != objs[i]);
+    }
+    fbSlabGetStats(pool, &stats);
+    assert(stats.allocs == count && stats.slabs == 2);
+
+    /* a freed one is handed out again, zeroed */
+    obj = objs[10];
+    fbSlabFree(obj);
+    objs[10] = fbSlabAlloc(pool, 256);
+    assert(objs[10] == obj && objs[10][0] == 0 && objs[10][255] == 0);
+
+    /* other sizes get their own slabs */
+    big = fbSlabAlloc(pool, 20000);
+    assert(big && ((uintptr_t) big & 63) == 0);
+    memset(big, 0x5a, 20000);
+    assert(!fbSlabAlloc(pool, 24577));
+    fbSlabGetStats(pool, &stats);
+    assert(stats.slabs == 3 && stats.tooLarge == 1);
+    for (int i = 0; i < count; i++)
+        assert(objs[i][1] == (i == 10 ? 0 : 0xa5));
+
+    /* one empty slab per class is kept, trimming gives it back */
+    for (int i = 0; i < count; i++)
+        fbSlabFree(objs[i]);
+    fbSlabFree(big);
+    fbSlabGetStats(pool, &stats);
+    assert(stats.slabs == 2 && stats.slabsFreed == 1);
+    fbSlabTrim(pool);
+    fbSlabGetStats(pool, &stats);
+    assert(stats.slabs == 0 && stats.peakSlabs == 3);
+
+    /* the pool stays until its last object is freed */
+    obj = fbSlabAlloc(pool, 1000);
+    assert(obj);
+    fbSlabPoolDestroy(pool);
+    memset(obj, 0, 1000);
+    fbSlabFree(obj);
+}
+
+const testfunc_t*
+fb_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        fb_blt_overlap,
+        fb_blt_rops,
+        fb_solid,
+        fb_parallel,
+        fb_glyph_atlas,
+        fb_slab,
+        NULL,
+    };
+    return testfuncs;
+}
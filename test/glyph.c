@@ -0,0 +1,249 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Tests for the RENDER glyph cache in render/glyph.c
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <assert.h>
+#include <string.h>
+#include <X11/X.h>
+
+#include "dix/screenint_priv.h"
+#include "render/glyphstr_priv.h"
+
+#include "picturestr.h"
+#include "pixmapstr.h"
+#include "servermd.h"
+#include "tests-common.h"
+
+#define NUM_IDS     1000
+#define NUM_IMAGES  700
+
+static ScreenRec screen;
+
+/* a glyph's picture, in memory like fb has it; never freed */
+typedef struct {
+    PictureRec picture;
+    PixmapRec pixmap;
+    CARD8 bits[64];
+} GlyphTestPictureRec;
+
+static GlyphTestPictureRec pictures[NUM_IMAGES + 1];
+
+/* how glyphs are told apart when their hash matches */
+static void
+glyph_get_image(DrawablePtr pDrawable, int sx, int sy, int w, int h,
+                unsigned int format, unsigned long planeMask, char *pdstLine)
+{
+    PixmapPtr pPixmap = (PixmapPtr) pDrawable;
+
+    assert(sx == 0 && sy == 0 && format == ZPixmap);
+    memcpy(pdstLine, pPixmap->devPrivate.ptr, pPixmap->devKind * h);
+}
+
+static void
+glyph_screen(void)
+{
+    /* 8 bits per pixel, rows padded to 32 bits */
+    PixmapWidthPaddingInfo[8].padPixelsLog2 = 2;
+    PixmapWidthPaddingInfo[8].padRoundUp = 3;
+    PixmapWidthPaddingInfo[8].padBytesLog2 = 2;
+    PixmapWidthPaddingInfo[8].bitsPerPixel = 8;
+    screen.GetImage = glyph_get_image;
+    screenInfo.numScreens = 1;
+    screenInfo.screens[0] = &screen;
+}
+
+/* what ProcRenderAddGlyphs() uploads for a new glyph */
+static void
+glyph_set_picture(GlyphPtr glyph, GlyphTestPictureRec *p, const CARD8 *bits)
+{
+    p->pixmap.drawable.depth = 8;
+    p->pixmap.drawable.bitsPerPixel = 8;
+    p->pixmap.drawable.width = glyph->info.width;
+    p->pixmap.drawable.height = glyph->info.height;
+    p->pixmap.drawable.pScreen = &screen;
+    p->pixmap.devKind = PixmapBytePad(glyph->info.width, 8);
+    p->pixmap.devPrivate.ptr = p->bits;
+    memcpy(p->bits, bits, p->pixmap.devKind * glyph->info.height);
+    p->picture.pDrawable = &p->pixmap.drawable;
+    /* one for us, so FreePicture() never gets to free it */
+    if (!p->picture.refcnt)
+        p->picture.refcnt = 1;
+    p->picture.refcnt++;
+    SetGlyphPicture(glyph, &screen, &p->picture);
+}
+
+static unsigned long
+glyph_image(xGlyphInfo *gi, CARD8 *bits, int content)
+{
+    memset(gi, 0, sizeof(*gi));
+    gi->width = 4 + content % 60;
+    gi->height = 1;
+    memset(bits, content, gi->width);
+    bits[0] = content >> 8;
+    return gi->width;
+}
+
+/* a glyph as ProcRenderAddGlyphs() gets it, shared when it's known */
+static GlyphPtr
+glyph_get(xGlyphInfo *gi, CARD8 *bits, unsigned long size,
+          GlyphTestPictureRec *picture)
+{
+    unsigned char sha1[20];
+    GlyphPtr glyph;
+
+    assert(HashGlyph(gi, bits, size, sha1) == Success);
+    glyph = FindGlyphByHash(sha1, gi, bits, GlyphFormat8);
+    if (glyph) {
+        ++glyph->refcnt;
+        return glyph;
+    }
+    glyph = AllocateGlyph(gi, GlyphFormat8);
+    assert(glyph);
+    glyph_set_picture(glyph, picture, bits);
+    memcpy(glyph->sha1, sha1, 20);
+    return glyph;
+}
+
+static void
+glyph_add(GlyphSetPtr glyphSet, Glyph id, GlyphPtr glyph)
+{
+    assert(ResizeGlyphSet(glyphSet, 1));
+    AddGlyph(glyphSet, glyph, id);
+    FreeGlyph(glyph, glyphSet->fdepth);
+}
+
+static void
+glyph_hash(void)
+{
+    CARD8 bits[64], other[64];
+    unsigned char a[20], b[20];
+    xGlyphInfo gi;
+
+    for (int size = 0; size < sizeof(bits); size++) {
+        memset(bits, 0x55, sizeof(bits));
+        memset(&gi, 0, sizeof(gi));
+        gi.width = size;
+        gi.height = 1;
+        HashGlyph(&gi, bits, size, a);
+        memcpy(other, bits, sizeof(other));
+        HashGlyph(&gi, other, size, b);
+        assert(memcmp(a, b, 20) == 0);
+
+        /* every byte counts, the metrics too, but not what's past the end */
+        for (int i = 0; i < size; i++) {
+            other[i] ^= 1;
+            HashGlyph(&gi, other, size, b);
+            assert(memcmp(a, b, 20) != 0);
+            other[i] ^= 1;
+        }
+        other[size] ^= 1;
+        HashGlyph(&gi, other, size, b);
+        assert(memcmp(a, b, 20) == 0);
+        gi.xOff = 1;
+        HashGlyph(&gi, bits, size, b);
+        assert(memcmp(a, b, 20) != 0);
+    }
+}
+
+static void
+glyph_sets(void)
+{
+    static GlyphPtr model[2][NUM_IDS];
+    GlyphSetPtr sets[2];
+    unsigned seed = 1;
+    CARD8 bits[64];
+    xGlyphInfo gi;
+
+    glyph_screen();
+    memset(model, 0, sizeof(model));
+
+    for (int s = 0; s < 2; s++) {
+        sets[s] = AllocateGlyphSet(GlyphFormat8, NULL);
+        assert(sets[s]);
+    }
+
+    /* enough churn that the tables grow, shrink and move entries back */
+    for (int i = 0; i < 100000; i++) {
+        int s, id;
+
+        seed = seed * 1103515245 + 12345;
+        s = (seed >> 4) & 1;
+        id = (seed >> 8) % NUM_IDS;
+        if ((seed >> 30) & 1) {
+            int image = (seed >> 16) % NUM_IMAGES;
+            unsigned long size = glyph_image(&gi, bits, image);
+
+            glyph_add(sets[s], id,
+                      glyph_get(&gi, bits, size, &pictures[image]));
+            model[s][id] = FindGlyph(sets[s], id);
+            assert(model[s][id]);
+            assert(memcmp(&model[s][id]->info, &gi, sizeof(gi)) == 0);
+        }
+        else {
+            assert(DeleteGlyph(sets[s], id) == (model[s][id] != NULL));
+            model[s][id] = NULL;
+        }
+    }
+    for (int s = 0; s < 2; s++)
+        for (int id = 0; id < NUM_IDS; id++)
+            assert(FindGlyph(sets[s], id) == model[s][id]);
+
+    /* the same glyph in both sets is one */
+    glyph_image(&gi, bits, 42);
+    glyph_add(sets[0], NUM_IDS, glyph_get(&gi, bits, gi.width, &pictures[42]));
+    glyph_add(sets[1], NUM_IDS, glyph_get(&gi, bits, gi.width, &pictures[42]));
+    assert(FindGlyph(sets[0], NUM_IDS) == FindGlyph(sets[1], NUM_IDS));
+
+    for (int s = 0; s < 2; s++)
+        FreeGlyphSet(sets[s], 0);
+}
+
+static void
+glyph_collision(void)
+{
+    GlyphSetPtr glyphSet = AllocateGlyphSet(GlyphFormat8, NULL);
+    GlyphPtr a, b;
+    CARD8 bits[8];
+    xGlyphInfo gi;
+
+    assert(glyphSet);
+    glyph_screen();
+
+    /* two glyphs that hash the same but differ aren't merged */
+    glyph_image(&gi, bits, 1);
+    a = glyph_get(&gi, bits, gi.width, &pictures[1]);
+    glyph_add(glyphSet, 1, a);
+    bits[1] ^= 1;
+    b = AllocateGlyph(&gi, GlyphFormat8);
+    assert(b);
+    glyph_set_picture(b, &pictures[NUM_IMAGES], bits);
+    memcpy(b->sha1, a->sha1, 20);
+    glyph_add(glyphSet, 2, b);
+    assert(FindGlyph(glyphSet, 1) == a);
+    assert(FindGlyph(glyphSet, 2) == b);
+    assert(FindGlyphByHash(a->sha1, &gi, bits, GlyphFormat8) == b);
+
+    /* and freeing one leaves the other */
+    assert(DeleteGlyph(glyphSet, 1));
+    assert(FindGlyphByHash(b->sha1, &gi, bits, GlyphFormat8) == b);
+    FreeGlyphSet(glyphSet, 0);
+}
+
+const testfunc_t*
+glyph_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        glyph_hash,
+        glyph_sets,
+        glyph_collision,
+        NULL,
+    };
+
+    return testfuncs;
+}
@@ -27,6 +27,7 @@
 #include <dix-config.h>
 
 #include <stdint.h>
+#include <pthread.h>
 #include <X11/X.h>
 #include <X11/Xproto.h>
 #include <X11/extensions/XI2proto.h>
@@ -1864,6 +1865,219 @@ mieq_test(void)
     mieqFini();
 }
 
+#ifdef INPUTTHREAD
+/* The threaded mieq test enqueues from a second thread, like the input
+ * thread does, while the main thread keeps draining the queue. Motion events
+ * may get merged and events may get dropped, but whatever is delivered must
+ * come out in order and nothing may be lost without being counted.
+ */
+#define MIEQ_THREADED_EVENTS 200000
+
+static DeviceIntRec mieq_threaded_dev;
+static uint32_t mieq_threaded_last;
+static uint64_t mieq_threaded_delivered;
+static int mieq_threaded_done;
+
+static void
+mieq_threaded_handler(int screenNum, InternalEvent *ie, DeviceIntPtr dev)
+{
+    uint32_t seq;
+
+    assert(dev == &mieq_threaded_dev);
+    if (ie->any.type == ET_Motion)
+        seq = ie->device_event.flags;
+    else
+        seq = ie->raw_event.flags;
+    assert(seq > mieq_threaded_last);
+    mieq_threaded_last = seq;
+    mieq_threaded_delivered++;
+}
+
+static void *
+mieq_threaded_producer(void *arg)
+{
+    uint32_t i;
+
+    for (i = 1; i <= MIEQ_THREADED_EVENTS; i++) {
+        InternalEvent e = { 0 };
+
+        e.any.header = ET_Internal;
+        e.any.time = GetTimeInMillis();
+        /* runs of motion events, broken up by raw events */
+        if (i % 8 < 6) {
+            e.any.type = ET_Motion;
+            e.any.length = sizeof(DeviceEvent);
+            e.device_event.flags = i;
+        }
+        else {
+            e.any.type = ET_RawMotion;
+            e.any.length = sizeof(RawDeviceEvent);
+            e.raw_event.flags = i;
+        }
+
+        input_lock();
+        mieqEnqueue(&mieq_threaded_dev, &e);
+        input_unlock();
+    }
+
+    __atomic_store_n(&mieq_threaded_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void
+mieq_test_threaded(void)
+{
+    static SpriteInfoRec spriteInfo;
+    static SpriteRec sprite;
+    mieqStatsRec stats;
+    uint64_t latency = 0;
+    pthread_t producer;
+    int i;
+
+    memset(&mieq_threaded_dev, 0, sizeof(mieq_threaded_dev));
+    mieq_threaded_dev.id = 2;
+    mieq_threaded_dev.enabled = 1;
+    mieq_threaded_dev.spriteInfo = &spriteInfo;
+    spriteInfo.sprite = &sprite;
+
+    mieqInit();
+    mieqSetHandler(ET_Motion, mieq_threaded_handler);
+    mieqSetHandler(ET_RawMotion, mieq_threaded_handler);
+
+    assert(pthread_create(&producer, NULL, mieq_threaded_producer, NULL) == 0);
+    while (!__atomic_load_n(&mieq_threaded_done, __ATOMIC_ACQUIRE))
+        mieqProcessInputEvents();
+    pthread_join(producer, NULL);
+    mieqProcessInputEvents();
+    assert(!InputCheckPending());
+
+    mieqGetStats(&stats);
+    assert(stats.delivered == mieq_threaded_delivered);
+    assert(stats.enqueued == stats.delivered);
+    assert(stats.enqueued + stats.coalesced + stats.dropped ==
+           MIEQ_THREADED_EVENTS);
+    for (i = 0; i < MIEQ_LATENCY_BUCKETS; i++)
+        latency += stats.latency[i];
+    assert(latency == stats.delivered);
+
+    mieqSetHandler(ET_Motion, NULL);
+    mieqSetHandler(ET_RawMotion, NULL);
+    mieqFini();
+}
+#endif /* INPUTTHREAD */
+
+/* Motion merging for devices with coalesceMotion set: runs of motion are
+ * delivered as one event carrying every valuator of the run, raw events are
+ * all delivered, and anything else ends the run.
+ */
+static struct {
+    Time time;
+    int deviceid;
+    DeviceEvent ev;
+} mieq_coalesce_log[16];
+static int mieq_coalesce_logged;
+
+static void
+mieq_coalesce_handler(int screenNum, InternalEvent *ie, DeviceIntPtr dev)
+{
+    assert(mieq_coalesce_logged < ARRAY_SIZE(mieq_coalesce_log));
+    mieq_coalesce_log[mieq_coalesce_logged].time = ie->any.time;
+    mieq_coalesce_log[mieq_coalesce_logged].deviceid = dev->id;
+    if (ie->any.type != ET_RawMotion)
+        mieq_coalesce_log[mieq_coalesce_logged].ev = ie->device_event;
+    mieq_coalesce_logged++;
+}
+
+static void
+mieq_coalesce_enqueue(DeviceIntPtr dev, enum EventType type, Time time,
+                      int axis, double value, uint32_t flags)
+{
+    InternalEvent e = { 0 };
+
+    e.any.header = ET_Internal;
+    e.any.type = type;
+    e.any.time = time;
+    if (type == ET_RawMotion) {
+        e.any.length = sizeof(RawDeviceEvent);
+    }
+    else {
+        e.any.length = sizeof(DeviceEvent);
+        e.device_event.flags = flags;
+        if (axis >= 0) {
+            SetBit(e.device_event.valuators.mask, axis);
+            e.device_event.valuators.data[axis] = value;
+        }
+    }
+    mieqEnqueue(dev, &e);
+}
+
+static void
+mieq_test_coalesce(void)
+{
+    static const Time expected[] = { 2, 4, 5, 6, 7, 8, 9, 10, 11 };
+    static DeviceIntRec devA, devB;
+    static SpriteInfoRec spriteInfo;
+    static SpriteRec sprite;
+    mieqStatsRec stats;
+    DeviceEvent *m;
+    int i;
+
+    memset(&sprite, 0, sizeof(sprite));
+    memset(&spriteInfo, 0, sizeof(spriteInfo));
+    spriteInfo.sprite = &sprite;
+    memset(&devA, 0, sizeof(devA));
+    devA.id = 2;
+    devA.enabled = 1;
+    devA.spriteInfo = &spriteInfo;
+    devA.coalesceMotion = TRUE;
+    devB = devA;
+    devB.id = 3;
+    devB.coalesceMotion = FALSE;
+
+    mieqInit();
+    mieqSetHandler(ET_Motion, mieq_coalesce_handler);
+    mieqSetHandler(ET_RawMotion, mieq_coalesce_handler);
+    mieqSetHandler(ET_ButtonPress, mieq_coalesce_handler);
+    mieq_coalesce_logged = 0;
+
+    mieq_coalesce_enqueue(&devA, ET_Motion, 1, 0, 10, 0);
+    mieq_coalesce_enqueue(&devA, ET_RawMotion, 2, -1, 0, 0);
+    mieq_coalesce_enqueue(&devA, ET_Motion, 3, 1, 20, 0);
+    mieq_coalesce_enqueue(&devA, ET_RawMotion, 4, -1, 0, 0);
+    mieq_coalesce_enqueue(&devA, ET_Motion, 5, 0, 30, 0);
+    /* other device, not merged and ends A's run */
+    mieq_coalesce_enqueue(&devB, ET_Motion, 6, 0, 1, 0);
+    /* pointer emulation of a touch is never merged */
+    mieq_coalesce_enqueue(&devA, ET_Motion, 7, 0, 40, TOUCH_POINTER_EMULATED);
+    mieq_coalesce_enqueue(&devA, ET_RawMotion, 8, -1, 0, 0);
+    mieq_coalesce_enqueue(&devA, ET_Motion, 9, 0, 50, 0);
+    mieq_coalesce_enqueue(&devA, ET_ButtonPress, 10, -1, 0, 0);
+    /* last in the queue, delivered when it runs empty */
+    mieq_coalesce_enqueue(&devA, ET_Motion, 11, 0, 60, 0);
+
+    mieqProcessInputEvents();
+
+    assert(mieq_coalesce_logged == ARRAY_SIZE(expected));
+    for (i = 0; i < ARRAY_SIZE(expected); i++)
+        assert(mieq_coalesce_log[i].time == expected[i]);
+    assert(mieq_coalesce_log[3].deviceid == devB.id);
+
+    /* 1 and 3 were merged into 5, keeping the valuator only 3 had */
+    m = &mieq_coalesce_log[2].ev;
+    assert(BitIsOn(m->valuators.mask, 0));
+    assert(BitIsOn(m->valuators.mask, 1));
+    assert(m->valuators.data[0] == 30);
+    assert(m->valuators.data[1] == 20);
+
+    mieqGetStats(&stats);
+    assert(stats.merged == 2);
+
+    mieqSetHandler(ET_Motion, NULL);
+    mieqSetHandler(ET_RawMotion, NULL);
+    mieqSetHandler(ET_ButtonPress, NULL);
+    mieqFini();
+}
+
 /* Simple check that we're replaying events in-order */
 static void
 process_input_proc(InternalEvent *ev, DeviceIntPtr device)
@@ -1951,6 +2165,10 @@ input_test(void)
         dix_get_master,
         input_option_test,
         mieq_test,
+        mieq_test_coalesce,
+#ifdef INPUTTHREAD
+        mieq_test_threaded,
+#endif
         NULL,
     };
 
@@ -27,6 +27,7 @@
 #include <dix-config.h>
 
 #include <stdint.h>
+#include <string.h>
 
 #include "dix/input_priv.h"
 #include "dix/screenint_priv.h"
@@ -36,6 +37,7 @@
 #include "scrnintstr.h"
 #include "dix.h"
 #include "dixstruct.h"
+#include "privates.h"
 #include "tests-common.h"
 
 static void
@@ -226,6 +228,49 @@ bswap_test(void)
     assert(result_64 == expect_64);
 }
 
+typedef struct {
+    int id;
+    PrivateRec *devPrivates;
+} TestObjectRec;
+
+static void
+dix_private_layout(void)
+{
+    static DevPrivateKeyRec cold[4], hot[2];
+    static const unsigned cold_sizes[4] = { 0, 40, 0, 20 };
+    int base = dixPrivatesSize(PRIVATE_SYNC_FENCE);
+    TestObjectRec *obj;
+
+    /* hot ones registered in between and after cold ones */
+    assert(dixRegisterPrivateKey(&cold[0], PRIVATE_SYNC_FENCE, cold_sizes[0]));
+    assert(dixRegisterPrivateKey(&cold[1], PRIVATE_SYNC_FENCE, cold_sizes[1]));
+    assert(dixRegisterHotPrivateKey(&hot[0], PRIVATE_SYNC_FENCE, 16));
+    assert(dixRegisterPrivateKey(&cold[2], PRIVATE_SYNC_FENCE, cold_sizes[2]));
+    assert(dixRegisterHotPrivateKey(&hot[1], PRIVATE_SYNC_FENCE, 0));
+    assert(dixRegisterPrivateKey(&cold[3], PRIVATE_SYNC_FENCE, cold_sizes[3]));
+
+    /* hot ones first, small before large, then the rest as registered */
+    assert(dixPrivatesSize(PRIVATE_SYNC_FENCE) == base + 24 + 8 + 40 + 8 + 24);
+    assert(hot[1].offset == base);
+    assert(hot[0].offset == base + 8);
+    assert(cold[0].offset == base + 24);
+    assert(cold[1].offset == base + 32);
+    assert(cold[2].offset == base + 72);
+    assert(cold[3].offset == base + 80);
+
+    obj = dixAllocateObjectWithPrivates(TestObjectRec, PRIVATE_SYNC_FENCE);
+    assert(obj);
+    dixSetPrivate(&obj->devPrivates, &hot[1], obj);
+    dixSetPrivate(&obj->devPrivates, &cold[2], &obj->id);
+    memset(dixLookupPrivate(&obj->devPrivates, &hot[0]), 0xff, 16);
+    memset(dixLookupPrivate(&obj->devPrivates, &cold[3]), 0xff, 20);
+    assert(dixLookupPrivate(&obj->devPrivates, &hot[1]) == obj);
+    assert(dixLookupPrivate(&obj->devPrivates, &cold[2]) == &obj->id);
+    assert(!dixLookupPrivate(&obj->devPrivates, &cold[0]));
+    assert(hot[1].offset == base && cold[3].offset == base + 80);
+    dixFreeObjectWithPrivates(obj, PRIVATE_SYNC_FENCE);
+}
+
 const testfunc_t*
 misc_test(void)
 {
@@ -234,6 +279,7 @@ misc_test(void)
         dix_update_desktop_dimensions,
         dix_request_size_checks,
         bswap_test,
+        dix_private_layout,
         NULL,
     };
     return testfuncs;
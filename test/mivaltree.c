@@ -0,0 +1,315 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * miValidateTree() keeping the clips of windows that aren't affected,
+ * against recomputing all marked ones: two copies of a random window tree
+ * get the same moves, restacks and resizes through miMoveWindow() and
+ * miResizeWindow(), and have to end up with the same clips, visibility
+ * and exposures.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <X11/X.h>
+
+#include "dix/settings_priv.h"
+#include "mi/mi_priv.h"
+#include "mi/mivalidate.h"
+
+#include "scrnintstr.h"
+#include "windowstr.h"
+
+#include "tests-common.h"
+
+#define TEST_WIDTH      640
+#define TEST_HEIGHT     480
+#define TEST_TOPLEVELS  16
+#define TEST_WINDOWS    64
+#define TEST_ROUNDS     2000
+
+typedef struct {
+    WindowPtr windows[TEST_WINDOWS];
+    int num_windows;
+    RegionRec exposed[TEST_WINDOWS];
+    RegionRec borderExposed[TEST_WINDOWS];
+    unsigned long clip_notifies;
+} TestTreeRec;
+
+static TestTreeRec trees[2];
+static TestTreeRec *tree;
+static ScreenRec screen;
+static unsigned test_seed;
+
+static int
+test_random(int n)
+{
+    test_seed = test_seed * 1103515245 + 12345;
+    return (test_seed >> 8) % n;
+}
+
+static void
+test_clip_notify(WindowPtr pWin, int dx, int dy)
+{
+    tree->clip_notifies++;
+}
+
+static void
+test_copy_window(WindowPtr pWin, DDXPointRec oldpt, RegionPtr prgnSrc)
+{
+}
+
+/* what miHandleValidateExposures() would paint */
+static void
+test_handle_exposures(WindowPtr pWin)
+{
+    WindowPtr pChild = pWin;
+
+    while (1) {
+        if (pChild->valdata) {
+            int i = pChild->drawable.id;
+
+            RegionUnion(&tree->exposed[i], &tree->exposed[i],
+                        &pChild->valdata->after.exposed);
+            RegionUnion(&tree->borderExposed[i], &tree->borderExposed[i],
+                        &pChild->valdata->after.borderExposed);
+            RegionUninit(&pChild->valdata->after.exposed);
+            RegionUninit(&pChild->valdata->after.borderExposed);
+            free(pChild->valdata);
+            pChild->valdata = NULL;
+            if (pChild->firstChild) {
+                pChild = pChild->firstChild;
+                continue;
+            }
+        }
+        while (!pChild->nextSib && (pChild != pWin))
+            pChild = pChild->parent;
+        if (pChild == pWin)
+            break;
+        pChild = pChild->nextSib;
+    }
+}
+
+static WindowPtr
+test_window(WindowPtr parent, int x, int y, int w, int h, int bw)
+{
+    WindowPtr pWin = calloc(1, sizeof(WindowRec));
+
+    assert(pWin);
+    pWin->drawable.pScreen = &screen;
+    pWin->drawable.id = tree->num_windows;
+    pWin->drawable.width = w;
+    pWin->drawable.height = h;
+    pWin->borderWidth = bw;
+    pWin->winGravity = NorthWestGravity;
+    pWin->mapped = TRUE;
+    pWin->viewable = TRUE;
+    /* not realized, which keeps the input code out of it */
+    pWin->visibility = VisibilityNotViewable;
+    RegionNull(&pWin->winSize);
+    RegionNull(&pWin->borderSize);
+    RegionNull(&pWin->clipList);
+    RegionNull(&pWin->borderClip);
+    RegionNull(&tree->exposed[tree->num_windows]);
+    RegionNull(&tree->borderExposed[tree->num_windows]);
+    tree->windows[tree->num_windows++] = pWin;
+
+    pWin->parent = parent;
+    if (parent) {
+        pWin->origin.x = x + bw;
+        pWin->origin.y = y + bw;
+        pWin->drawable.x = parent->drawable.x + pWin->origin.x;
+        pWin->drawable.y = parent->drawable.y + pWin->origin.y;
+        SetWinSize(pWin);
+        SetBorderSize(pWin);
+
+        /* new windows go on top */
+        pWin->nextSib = parent->firstChild;
+        if (parent->firstChild)
+            parent->firstChild->prevSib = pWin;
+        else
+            parent->lastChild = pWin;
+        parent->firstChild = pWin;
+    }
+    else {
+        BoxRec box = { 0, 0, w, h };
+
+        RegionReset(&pWin->winSize, &box);
+        RegionReset(&pWin->borderSize, &box);
+        RegionReset(&pWin->clipList, &box);
+        RegionReset(&pWin->borderClip, &box);
+    }
+    return pWin;
+}
+
+/* toplevels with a few children and grandchildren, all mapped at once */
+static void
+test_tree(unsigned seed)
+{
+    WindowPtr root;
+
+    test_seed = seed;
+    root = test_window(NULL, 0, 0, TEST_WIDTH, TEST_HEIGHT, 0);
+    for (int i = 0; i < TEST_TOPLEVELS; i++) {
+        int w = 40 + test_random(200), h = 40 + test_random(160);
+        WindowPtr top = test_window(root, test_random(TEST_WIDTH - 40),
+                                    test_random(TEST_HEIGHT - 40), w, h,
+                                    test_random(3));
+
+        for (int c = test_random(3); c > 0; c--) {
+            WindowPtr child = test_window(top, test_random(w), test_random(h),
+                                          10 + test_random(w),
+                                          10 + test_random(h),
+                                          test_random(2));
+
+            if (test_random(2))
+                test_window(child, test_random(20), test_random(20),
+                            10 + test_random(40), 10 + test_random(40), 0);
+        }
+    }
+
+    for (int i = 0; i < tree->num_windows; i++)
+        miMarkWindow(tree->windows[i]);
+    miValidateTree(root, NullWindow, VTMap);
+    test_handle_exposures(root);
+}
+
+static void
+test_free_tree(void)
+{
+    for (int i = 0; i < tree->num_windows; i++) {
+        WindowPtr pWin = tree->windows[i];
+
+        RegionUninit(&pWin->winSize);
+        RegionUninit(&pWin->borderSize);
+        RegionUninit(&pWin->clipList);
+        RegionUninit(&pWin->borderClip);
+        RegionUninit(&tree->exposed[i]);
+        RegionUninit(&tree->borderExposed[i]);
+        free(pWin);
+    }
+    tree->num_windows = 0;
+}
+
+/* one random ConfigureWindow, as the dix hands it to mi */
+static void
+test_configure(unsigned seed)
+{
+    WindowPtr pWin, pParent, pSib;
+    int x, y;
+
+    test_seed = seed;
+    pWin = tree->windows[1 + test_random(tree->num_windows - 1)];
+    pParent = pWin->parent;
+    x = pWin->drawable.x - pParent->drawable.x - wBorderWidth(pWin);
+    y = pWin->drawable.y - pParent->drawable.y - wBorderWidth(pWin);
+
+    switch (test_random(5)) {
+    case 0:                    /* small move */
+        x += test_random(9) - 4;
+        y += test_random(9) - 4;
+        miMoveWindow(pWin, x, y, pWin->nextSib, VTMove);
+        break;
+    case 1:                    /* move anywhere */
+        x = test_random(pParent->drawable.width);
+        y = test_random(pParent->drawable.height);
+        miMoveWindow(pWin, x, y, pWin->nextSib, VTMove);
+        break;
+    case 2:                    /* raise */
+        pSib = pParent->firstChild;
+        if (pSib != pWin)
+            miMoveWindow(pWin, x, y, pSib, VTOther);
+        break;
+    case 3:                    /* lower */
+        if (pWin->nextSib)
+            miMoveWindow(pWin, x, y, NullWindow, VTOther);
+        break;
+    default:                   /* resize, at times moving it */
+        if (test_random(2)) {
+            x += test_random(9) - 4;
+            y += test_random(9) - 4;
+        }
+        miResizeWindow(pWin, x, y, 10 + test_random(200),
+                       10 + test_random(160), pWin->nextSib);
+        break;
+    }
+}
+
+/* empty regions keep the x1 and y1 they had before, which may differ */
+static Bool
+test_equal(RegionPtr a, RegionPtr b)
+{
+    if (!RegionNotEmpty(a) && !RegionNotEmpty(b))
+        return TRUE;
+    return RegionEqual(a, b);
+}
+
+static void
+test_compare(void)
+{
+    for (int i = 0; i < trees[0].num_windows; i++) {
+        WindowPtr a = trees[0].windows[i], b = trees[1].windows[i];
+
+        assert(a->visibility == b->visibility);
+        assert(test_equal(&a->clipList, &b->clipList));
+        assert(test_equal(&a->borderClip, &b->borderClip));
+        assert(test_equal(&trees[0].exposed[i], &trees[1].exposed[i]));
+        assert(test_equal(&trees[0].borderExposed[i],
+                          &trees[1].borderExposed[i]));
+        RegionEmpty(&trees[0].exposed[i]);
+        RegionEmpty(&trees[1].exposed[i]);
+        RegionEmpty(&trees[0].borderExposed[i]);
+        RegionEmpty(&trees[1].borderExposed[i]);
+    }
+}
+
+static void
+mivaltree_incremental(void)
+{
+    const bool saved = dixSettingIncrementalClips;
+
+    screen.MarkWindow = miMarkWindow;
+    screen.MarkOverlappedWindows = miMarkOverlappedWindows;
+    screen.ValidateTree = miValidateTree;
+    screen.HandleExposures = test_handle_exposures;
+    screen.CopyWindow = test_copy_window;
+    screen.ClipNotify = test_clip_notify;
+
+    for (int t = 0; t < 2; t++) {
+        tree = &trees[t];
+        dixSettingIncrementalClips = !t;
+        test_tree(1);
+    }
+    assert(trees[0].num_windows == trees[1].num_windows);
+    test_compare();
+
+    for (unsigned round = 0; round < TEST_ROUNDS; round++) {
+        for (int t = 0; t < 2; t++) {
+            tree = &trees[t];
+            dixSettingIncrementalClips = !t;
+            test_configure(round + 1);
+        }
+        test_compare();
+    }
+    /* and it did keep some */
+    assert(trees[0].clip_notifies < trees[1].clip_notifies);
+
+    for (int t = 0; t < 2; t++) {
+        tree = &trees[t];
+        test_free_tree();
+    }
+    dixSettingIncrementalClips = saved;
+}
+
+const testfunc_t*
+mivaltree_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        mivaltree_incremental,
+        NULL,
+    };
+    return testfuncs;
+}
@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * RECORD from the client side, the way xmacro and session recorders use it:
+ * one connection draws, in the style of x11perf, small requests with a
+ * round-trip now and then, while another one, on its own thread, records
+ * all clients' core requests, replies and events.
+ *
+ * Without arguments this is a test: every request drawn has to show up in
+ * the recorded stream, once. With --bench it compares the drawing rate
+ * without any context and with one enabled.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/record.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+#include <X11/extensions/recordconst.h>
+
+#define NUM_REQUESTS    20000
+#define BENCH_REQUESTS  500000
+/* requests between round-trips */
+#define BATCH           50
+
+static xcb_connection_t *draw, *ctl, *data;
+static xcb_record_context_t context;
+static uint32_t pixmap, gc;
+
+/* what the recording thread saw */
+static unsigned long recorded_fills;
+static unsigned long recorded_bytes;
+static int started;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+
+static void
+fail(const char *what)
+{
+    fprintf(stderr, "record-throughput: %s\n", what);
+    exit(1);
+}
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static xcb_connection_t *
+connect_server(void)
+{
+    xcb_connection_t *c = xcb_connect(NULL, NULL);
+
+    if (xcb_connection_has_error(c))
+        fail("can't connect");
+    return c;
+}
+
+static void
+setup(void)
+{
+    const xcb_query_extension_reply_t *ext;
+    xcb_screen_t *screen;
+
+    draw = connect_server();
+    ctl = connect_server();
+    data = connect_server();
+
+    ext = xcb_get_extension_data(ctl, &xcb_record_id);
+    if (!ext || !ext->present) {
+        fprintf(stderr, "record-throughput: no RECORD, skipping\n");
+        exit(77);
+    }
+    /* it's a round-trip, better before recording starts */
+    xcb_get_extension_data(data, &xcb_record_id);
+
+    screen = xcb_setup_roots_iterator(xcb_get_setup(draw)).data;
+    pixmap = xcb_generate_id(draw);
+    xcb_create_pixmap(draw, screen->root_depth, pixmap, screen->root,
+                      64, 64);
+    gc = xcb_generate_id(draw);
+    xcb_create_gc(draw, gc, pixmap, 0, NULL);
+}
+
+/* the requests in one recorded FromClient reply, in the client's order */
+static void
+count_requests(const uint8_t *p, int len)
+{
+    while (len >= 4) {
+        const xReq *req = (const xReq *) p;
+        uint32_t size = req->length * 4;
+
+        if (!size) {            /* BIG-REQUESTS */
+            if (len < 8)
+                break;
+            memcpy(&size, p + 4, 4);
+            size *= 4;
+        }
+        if (size < 4 || size > (uint32_t) len)
+            fail("recorded a broken request");
+        if (req->reqType == X_PolyFillRectangle)
+            recorded_fills++;
+        p += size;
+        len -= size;
+    }
+}
+
+static void *
+record_thread(void *arg)
+{
+    xcb_record_enable_context_cookie_t cookie;
+    xcb_record_enable_context_reply_t *rep;
+
+    cookie = xcb_record_enable_context(data, context);
+    while ((rep = xcb_record_enable_context_reply(data, cookie, NULL))) {
+        int category = rep->category;
+
+        recorded_bytes += xcb_record_enable_context_data_length(rep);
+        if (category == XRecordFromClient)
+            count_requests(xcb_record_enable_context_data(rep),
+                           xcb_record_enable_context_data_length(rep));
+        free(rep);
+        if (category == XRecordStartOfData) {
+            pthread_mutex_lock(&lock);
+            started = 1;
+            pthread_cond_signal(&start_cond);
+            pthread_mutex_unlock(&lock);
+        }
+        if (category == XRecordEndOfData)
+            break;
+    }
+    return NULL;
+}
+
+static void
+record_start(pthread_t *thread)
+{
+    xcb_record_client_spec_t spec = XCB_RECORD_CS_ALL_CLIENTS;
+    xcb_record_range_t range;
+    xcb_generic_error_t *error;
+
+    memset(&range, 0, sizeof(range));
+    range.core_requests.first = 1;
+    range.core_requests.last = 127;
+    range.core_replies.first = 1;
+    range.core_replies.last = 127;
+    range.delivered_events.first = KeyPress;
+    range.delivered_events.last = LASTEvent - 1;
+
+    context = xcb_generate_id(ctl);
+    error = xcb_request_check(ctl,
+                              xcb_record_create_context_checked(ctl, context,
+                                                                0, 1, 1,
+                                                                &spec,
+                                                                &range));
+    if (error)
+        fail("RecordCreateContext failed");
+
+    recorded_fills = recorded_bytes = 0;
+    started = 0;
+    if (pthread_create(thread, NULL, record_thread, NULL))
+        fail("can't start the recording thread");
+
+    /* nothing drawn before the context is enabled is recorded */
+    pthread_mutex_lock(&lock);
+    while (!started)
+        pthread_cond_wait(&start_cond, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+static void
+record_stop(pthread_t thread)
+{
+    xcb_record_disable_context(ctl, context);
+    xcb_record_free_context(ctl, context);
+    free(xcb_get_input_focus_reply(ctl, xcb_get_input_focus(ctl), NULL));
+    pthread_join(thread, NULL);
+}
+
+static void
+sync_server(void)
+{
+    free(xcb_get_input_focus_reply(draw, xcb_get_input_focus(draw), NULL));
+}
+
+/* PolyFillRectangle and a round-trip every BATCH requests */
+static void
+draw_requests(int n)
+{
+    for (int i = 0; i < n; i++) {
+        xcb_rectangle_t rect = { i % 56, i % 48, 8, 8 };
+
+        xcb_poly_fill_rectangle(draw, pixmap, gc, 1, &rect);
+        if (i % BATCH == BATCH - 1)
+            sync_server();
+    }
+    sync_server();
+}
+
+static void
+bench_report(const char *what, unsigned long ops, uint64_t ns)
+{
+    printf("  %-40s %10lu ops %10.3f ms %10.1f ns/op %10.0f ops/s\n",
+           what, ops, ns / 1e6, (double) ns / ops, ops * 1e9 / ns);
+}
+
+static void
+bench(void)
+{
+    pthread_t thread;
+    uint64_t start;
+
+    start = now_ns();
+    draw_requests(BENCH_REQUESTS);
+    bench_report("RECORD off, PolyFillRectangle", BENCH_REQUESTS,
+                 now_ns() - start);
+
+    record_start(&thread);
+    start = now_ns();
+    draw_requests(BENCH_REQUESTS);
+    bench_report("RECORD on, PolyFillRectangle", BENCH_REQUESTS,
+                 now_ns() - start);
+    record_stop(thread);
+    printf("  recorded %lu requests, %lu bytes\n", recorded_fills,
+           recorded_bytes);
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t thread;
+
+    setup();
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        bench();
+        return 0;
+    }
+
+    record_start(&thread);
+    draw_requests(NUM_REQUESTS);
+    record_stop(thread);
+    if (recorded_fills != NUM_REQUESTS) {
+        fprintf(stderr, "record-throughput: recorded %lu of %d requests\n",
+                recorded_fills, NUM_REQUESTS);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * The region code in dix against pixman, on random rectangles: building
+ * regions from unsorted rectangles and validating appended ones, which
+ * sort and coalesce, and the rectangle fast paths of RegionIntersect()
+ * and RegionUnion(). Both sides produce the canonical y-x banded form,
+ * so the results have to be equal box for box.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+
+#include "gc.h"
+#include "regionstr.h"
+
+#include "tests-common.h"
+
+#define TEST_ROUNDS     2000
+#define TEST_MAX_RECTS  400
+
+static unsigned test_seed = 1;
+
+static int
+test_random(int n)
+{
+    test_seed = test_seed * 1103515245 + 12345;
+    return (test_seed >> 8) % n;
+}
+
+/* random rectangles, either anywhere or on a grid, which makes for bands
+ * that line up and get coalesced */
+static void
+test_rects(xRectangle *rects, BoxPtr boxes, int n, int grid)
+{
+    for (int i = 0; i < n; i++) {
+        if (grid) {
+            rects[i].x = test_random(12) * 16 - 32;
+            rects[i].y = test_random(12) * 16 - 32;
+            rects[i].width = (1 + test_random(4)) * 16;
+            rects[i].height = (1 + test_random(4)) * 16;
+        }
+        else {
+            rects[i].x = test_random(200) - 32;
+            rects[i].y = test_random(200) - 32;
+            rects[i].width = 1 + test_random(60);
+            rects[i].height = 1 + test_random(60);
+        }
+        boxes[i].x1 = rects[i].x;
+        boxes[i].y1 = rects[i].y;
+        boxes[i].x2 = rects[i].x + rects[i].width;
+        boxes[i].y2 = rects[i].y + rects[i].height;
+    }
+}
+
+static int
+test_cmp_rects(const void *a, const void *b)
+{
+    const xRectangle *ra = a, *rb = b;
+
+    if (ra->y != rb->y)
+        return ra->y - rb->y;
+    return ra->x - rb->x;
+}
+
+/* empty regions keep the x1 and y1 they had before, which may differ */
+static Bool
+test_equal(RegionPtr a, RegionPtr b)
+{
+    if (!RegionNotEmpty(a) && !RegionNotEmpty(b))
+        return TRUE;
+    return pixman_region_equal(a, b);
+}
+
+static void
+region_from_rects(void)
+{
+    xRectangle rects[TEST_MAX_RECTS];
+    BoxRec boxes[TEST_MAX_RECTS];
+
+    InitRegions();
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        int n = 1 + test_random(round % 2 ? TEST_MAX_RECTS : 16);
+        RegionPtr got;
+        RegionRec ref;
+
+        test_rects(rects, boxes, n, round % 3 == 0);
+        /* sorted ones take a shortcut */
+        if (round % 5 == 0)
+            qsort(rects, n, sizeof(xRectangle), test_cmp_rects);
+
+        got = RegionFromRects(n, rects, CT_UNSORTED);
+        assert(pixman_region_init_rects(&ref, boxes, n));
+        assert(pixman_region_equal(got, &ref));
+
+        RegionDestroy(got);
+        pixman_region_fini(&ref);
+    }
+}
+
+static void
+region_validate(void)
+{
+    xRectangle rects[TEST_MAX_RECTS];
+    BoxRec boxes[TEST_MAX_RECTS];
+
+    InitRegions();
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        int n = 1 + test_random(TEST_MAX_RECTS / 4);
+        RegionRec got, ref, part;
+        Bool overlap;
+
+        test_rects(rects, boxes, 2 * n, round % 2);
+
+        /* as miValidateTree() collects the border regions of children */
+        RegionNull(&got);
+        pixman_region_init(&ref);
+        for (int i = 0; i < n; i++) {
+            assert(pixman_region_init_rects(&part, &boxes[2 * i], 2));
+            RegionAppend(&got, &part);
+            assert(pixman_region_union(&ref, &ref, &part));
+            pixman_region_fini(&part);
+        }
+        assert(RegionValidate(&got, &overlap));
+        assert(pixman_region_equal(&got, &ref));
+
+        RegionUninit(&got);
+        pixman_region_fini(&ref);
+    }
+}
+
+static void
+region_intersect_rect(void)
+{
+    xRectangle rects[TEST_MAX_RECTS];
+    BoxRec boxes[TEST_MAX_RECTS];
+
+    InitRegions();
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        int n = 2 + test_random(round % 2 ? TEST_MAX_RECTS - 2 : 16);
+        RegionRec reg, rect, got, ref;
+        BoxRec box;
+
+        test_rects(rects, boxes, n, round % 3 == 0);
+        assert(pixman_region_init_rects(&reg, boxes, n));
+
+        /* inside, across, around or off the region, or empty */
+        box.x1 = test_random(260) - 64;
+        box.y1 = test_random(260) - 64;
+        box.x2 = box.x1 + test_random(round % 4 ? 80 : 300);
+        box.y2 = box.y1 + test_random(round % 4 ? 80 : 300);
+        pixman_region_init_rect(&rect, box.x1, box.y1,
+                                box.x2 - box.x1, box.y2 - box.y1);
+
+        RegionNull(&got);
+        pixman_region_init(&ref);
+        assert(RegionIntersect(&got, &rect, &reg));
+        assert(pixman_region_intersect(&ref, &rect, &reg));
+        assert(pixman_region_equal(&got, &ref));
+
+        /* the other way around, and into one of the sources */
+        assert(RegionIntersect(&got, &reg, &rect));
+        assert(test_equal(&got, &ref));
+        assert(RegionCopy(&got, &reg));
+        assert(RegionIntersect(&got, &got, &rect));
+        assert(test_equal(&got, &ref));
+        assert(RegionCopy(&got, &rect));
+        assert(RegionIntersect(&got, &reg, &got));
+        assert(test_equal(&got, &ref));
+
+        RegionUninit(&got);
+        pixman_region_fini(&ref);
+        pixman_region_fini(&reg);
+        pixman_region_fini(&rect);
+    }
+}
+
+static void
+region_union_rect(void)
+{
+    InitRegions();
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        RegionRec a, b, got, ref;
+        BoxRec box[2];
+
+        /* few distinct edges, so they touch and line up often */
+        for (int i = 0; i < 2; i++) {
+            box[i].x1 = test_random(5) * 8;
+            box[i].y1 = test_random(5) * 8;
+            box[i].x2 = box[i].x1 + 8 * (1 + test_random(4));
+            box[i].y2 = box[i].y1 + 8 * (1 + test_random(4));
+        }
+        RegionInit(&a, &box[0], 1);
+        RegionInit(&b, &box[1], 1);
+
+        RegionNull(&got);
+        pixman_region_init(&ref);
+        assert(RegionUnion(&got, &a, &b));
+        assert(pixman_region_union(&ref, &a, &b));
+        assert(pixman_region_equal(&got, &ref));
+
+        assert(RegionUnion(&a, &a, &b));
+        assert(pixman_region_equal(&a, &ref));
+
+        RegionUninit(&a);
+        RegionUninit(&got);
+        pixman_region_fini(&ref);
+    }
+}
+
+const testfunc_t*
+region_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        region_from_rects,
+        region_validate,
+        region_intersect_rect,
+        region_union_rect,
+        NULL,
+    };
+    return testfuncs;
+}
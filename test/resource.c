@@ -0,0 +1,224 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Tests for the per-client resource tables in dix/resource.c
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <X11/X.h>
+
+#include "dix/dix_priv.h"
+#include "dix/resource_priv.h"
+#include "os/osdep.h"
+
+#include "misc.h"
+#include "dixstruct.h"
+#include "resource.h"
+#include "tests-common.h"
+
+static ClientRec server_client;
+static ClientRec test_client;
+static RESTYPE test_type, other_type;
+
+static XID deleted[8];
+static int num_deleted, total_deleted;
+
+static int
+test_delete(void *value, XID id)
+{
+    if (num_deleted < ARRAY_SIZE(deleted))
+        deleted[num_deleted++] = (XID) (uintptr_t) value;
+    total_deleted++;
+    return Success;
+}
+
+static void
+resource_init(void)
+{
+    serverClient = &server_client;
+    server_client.index = 0;
+    server_client.clientAsMask = 0;
+    assert(InitClientResources(serverClient));
+
+    test_client.index = 1;
+    test_client.clientAsMask = (XID) 1 << CLIENTOFFSET;
+    assert(InitClientResources(&test_client));
+
+    test_type = CreateNewResourceType(test_delete, "TestResource");
+    other_type = CreateNewResourceType(test_delete, "OtherResource");
+    assert(test_type && other_type);
+    num_deleted = total_deleted = 0;
+}
+
+static void
+resource_fini(void)
+{
+    FreeClientResources(&test_client);
+    FreeClientResources(serverClient);
+}
+
+static void
+resource_grow(void)
+{
+    const int count = 100000;
+    XID base;
+    void *val;
+
+    resource_init();
+    base = test_client.clientAsMask;
+
+    /* the table grows while resources are added, they must stay visible */
+    for (int i = 1; i <= count; i++) {
+        int j = 1 + rand() % i;
+
+        assert(AddResource(base + i, test_type, (void *) (uintptr_t) i));
+        assert(dixLookupResourceByType(&val, base + j, test_type, NULL,
+                                       DixReadAccess) == Success);
+        assert(val == (void *) (uintptr_t) j);
+    }
+    for (int i = 1; i <= count; i++) {
+        assert(dixLookupResourceByType(&val, base + i, test_type, NULL,
+                                       DixReadAccess) == Success);
+        assert(val == (void *) (uintptr_t) i);
+        assert(dixLookupResourceByType(&val, base + i, other_type, NULL,
+                                       DixReadAccess) != Success);
+    }
+    assert(dixLookupResourceByType(&val, base + count + 1, test_type, NULL,
+                                   DixReadAccess) != Success);
+
+    for (int i = 1; i <= count; i += 2)
+        FreeResource(base + i, X11_RESTYPE_NONE);
+    assert(total_deleted == count / 2);
+    for (int i = 1; i <= count; i++)
+        assert((dixLookupResourceByType(&val, base + i, test_type, NULL,
+                                        DixReadAccess) == Success) ==
+               !(i & 1));
+
+    resource_fini();
+    assert(total_deleted == count);
+}
+
+static void
+resource_same_id(void)
+{
+    XID id;
+
+    resource_init();
+    id = test_client.clientAsMask | 42;
+
+    /* resources sharing an ID are freed newest first */
+    assert(AddResource(id, test_type, (void *) 1));
+    assert(AddResource(id, other_type, (void *) 2));
+    for (int i = 1; i < 1000; i++)
+        assert(AddResource(id + i, test_type, NULL));
+    FreeResource(id, X11_RESTYPE_NONE);
+    assert(num_deleted == 2);
+    assert(deleted[0] == 2 && deleted[1] == 1);
+
+    resource_fini();
+}
+
+static RESTYPE churned_type;
+
+static int
+churned_delete(void *value, XID id)
+{
+    return Success;
+}
+
+/* adds and frees as many resources, so the count is the same after */
+static int
+churn_delete(void *value, XID id)
+{
+    XID base = test_client.clientAsMask | 0x10000;
+
+    test_delete(value, id);
+    for (int i = 0; i < 5000; i++)
+        assert(AddResource(base + i, churned_type, NULL));
+    for (int i = 0; i < 5000; i++)
+        FreeResource(base + i, X11_RESTYPE_NONE);
+    return Success;
+}
+
+static void
+resource_delete_churn(void)
+{
+    RESTYPE churn_type;
+    XID id;
+    void *val;
+
+    resource_init();
+    churn_type = CreateNewResourceType(churn_delete, "ChurnResource");
+    churned_type = CreateNewResourceType(churned_delete, "ChurnedResource");
+    assert(churn_type && churned_type);
+    id = test_client.clientAsMask | 42;
+
+    /* the table grows and the old one is freed inside FreeResource() */
+    assert(AddResource(id, test_type, (void *) 1));
+    assert(AddResource(id, churn_type, (void *) 2));
+    FreeResource(id, X11_RESTYPE_NONE);
+    assert(num_deleted == 2);
+    assert(deleted[0] == 2 && deleted[1] == 1);
+    assert(dixLookupResourceByClass(&val, id, RC_ANY, NULL,
+                                    DixReadAccess) != Success);
+
+    resource_fini();
+}
+
+static void
+resource_fake_id_reuse(void)
+{
+    const int saved_limit = LimitClients;
+    unsigned int range, reused = 0;
+    XID first, id;
+    void *val;
+
+    /* a smaller per-client ID range, to keep the test quick */
+    LimitClients = 2048;
+    resource_init();
+
+    /* use up the whole server side range, then free every third ID */
+    range = RESOURCE_ID_MASK + 1;
+    first = FakeClientID(test_client.index);
+    assert(first == (test_client.clientAsMask | SERVER_BIT));
+    assert(AddResource(first, test_type, NULL));
+    for (unsigned int i = 1; i < range; i++) {
+        id = FakeClientID(test_client.index);
+        assert(id == first + i);
+        assert(AddResource(id, test_type, NULL));
+    }
+    for (unsigned int i = 0; i < range; i += 3)
+        FreeResource(first + i, X11_RESTYPE_NONE);
+
+    /* after wrapping around, only the free ones are handed out */
+    for (unsigned int i = 0; i < range; i += 3) {
+        id = FakeClientID(test_client.index);
+        assert(id == first + i);
+        assert(dixLookupResourceByClass(&val, id, RC_ANY, NULL,
+                                        DixReadAccess) == BadValue);
+        assert(AddResource(id, test_type, NULL));
+        reused++;
+    }
+    assert(reused == (range + 2) / 3);
+
+    resource_fini();
+    LimitClients = saved_limit;
+}
+
+const testfunc_t*
+resource_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        resource_grow,
+        resource_same_id,
+        resource_delete_churn,
+        resource_fake_id_reuse,
+        NULL,
+    };
+    return testfuncs;
+}
@@ -0,0 +1,668 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * SHM-TRANSPORT from the client side. xcb sets up the connection, after
+ * that the protocol is spoken by hand, so the socket and the rings carry
+ * the very same request stream.
+ *
+ * Without arguments this is a test: an image much larger than the rings
+ * goes in with PutImage and has to come back unchanged from GetImage,
+ * followed by lots of small requests and an error, all with the right
+ * sequence numbers. With --bench it compares the request throughput of
+ * the socket and the rings.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <xcb/xcb.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+
+#include "include/shmtransportproto.h"
+
+/* small, so they wrap around a lot and the server runs out of room */
+#define RING_SIZE       (64 * 1024)
+#define IMAGE_SIZE      256
+#define NUM_SMALL       20000
+#define OUT_BUFSIZE     (64 * 1024)
+
+#define BENCH_SMALL     500000
+#define BENCH_IMAGES    5000
+#define BENCH_IMAGE     128
+
+#define min(a, b)       ((a) < (b) ? (a) : (b))
+
+typedef struct {
+    xShmTransportRing *ctl;
+    char *data;
+    uint32_t size;
+    uint32_t pos;               /* our head or tail */
+    uint32_t published;
+} ring_t;
+
+static int sock;
+static uint32_t seq;            /* of the last request sent */
+static int attached;
+static int drained;             /* the socket, after attaching */
+static int serverfd = -1, clientfd = -1;
+static ring_t request_ring, reply_ring;
+static uint8_t major_opcode;
+
+static char outbuf[OUT_BUFSIZE];
+static size_t outlen;
+/* output that came through the socket after attaching */
+static char early[4096];
+static size_t early_len, early_pos;
+
+static xcb_window_t root;
+static uint8_t depth, bpp;
+static uint32_t pixmap, gc;
+
+static void
+fail(const char *what)
+{
+    fprintf(stderr, "shm-transport: %s\n", what);
+    exit(1);
+}
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+wait_fd(int fd, short events)
+{
+    struct pollfd pfd = { .fd = fd, .events = events };
+
+    if (poll(&pfd, 1, 10000) <= 0 && errno != EINTR)
+        fail("timed out waiting for the server");
+}
+
+static void
+sock_write(const char *data, size_t len)
+{
+    while (len) {
+        ssize_t n = write(sock, data, len);
+
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                fail("write failed");
+            wait_fd(sock, POLLOUT);
+            continue;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static void
+sock_read(void *buf, size_t len)
+{
+    char *p = buf;
+
+    while (len) {
+        ssize_t n = read(sock, p, len);
+
+        if (n == 0)
+            fail("server closed the connection");
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                fail("read failed");
+            wait_fd(sock, POLLIN);
+            continue;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+/* sleep until the server signals, see the ring protocol */
+static void
+ring_wait(void)
+{
+    struct pollfd pfd[2] = {
+        { .fd = clientfd, .events = POLLIN },
+        { .fd = sock, .events = 0 },
+    };
+    uint64_t count;
+
+    if (poll(pfd, 2, 10000) <= 0 && errno != EINTR)
+        fail("timed out waiting for the server");
+    if (pfd[1].revents & (POLLHUP | POLLERR))
+        fail("server closed the connection");
+    if (read(clientfd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        fail("reading the eventfd failed");
+}
+
+static void
+ring_signal(void)
+{
+    uint64_t one = 1;
+
+    if (write(serverfd, &one, sizeof(one)) < 0)
+        fail("writing the eventfd failed");
+}
+
+static void
+ring_publish(ring_t *r)
+{
+    __atomic_store_n(&r->ctl->head, r->pos, __ATOMIC_RELEASE);
+    r->published = r->pos;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->ctl->wakeConsumer, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&r->ctl->wakeConsumer, 0, __ATOMIC_RELAXED))
+        ring_signal();
+}
+
+static uint32_t
+ring_room(ring_t *r)
+{
+    return r->size - (r->pos - __atomic_load_n(&r->ctl->tail,
+                                               __ATOMIC_ACQUIRE));
+}
+
+static void
+ring_put(const char *data, size_t len)
+{
+    ring_t *r = &request_ring;
+
+    while (len) {
+        uint32_t room = ring_room(r), n, offset, first;
+
+        if (!room) {
+            ring_publish(r);
+            __atomic_store_n(&r->ctl->wakeProducer, 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (!ring_room(r))
+                ring_wait();
+            __atomic_store_n(&r->ctl->wakeProducer, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        n = min(room, len);
+        offset = r->pos & (r->size - 1);
+        first = min(n, r->size - offset);
+        memcpy(r->data + offset, data, first);
+        memcpy(r->data, data + first, n - first);
+        r->pos += n;
+        data += n;
+        len -= n;
+        /* batch like the socket does, but keep the server busy */
+        if (r->pos - r->published >= r->size / 4)
+            ring_publish(r);
+    }
+}
+
+/* everything in the socket precedes what's in the ring */
+static void
+sock_drain(void)
+{
+    for (;;) {
+        ssize_t n = recv(sock, early + early_len, sizeof(early) - early_len,
+                         MSG_DONTWAIT);
+
+        if (n == 0)
+            fail("server closed the connection");
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            fail("read failed");
+        }
+        early_len += n;
+        if (early_len == sizeof(early))
+            fail("too much output left on the socket");
+    }
+    drained = 1;
+}
+
+static void
+ring_get(char *buf, size_t len)
+{
+    ring_t *r = &reply_ring;
+
+    while (len) {
+        uint32_t avail, n, offset, first;
+
+        if (early_pos < early_len) {
+            n = min(early_len - early_pos, len);
+            memcpy(buf, early + early_pos, n);
+            early_pos += n;
+            buf += n;
+            len -= n;
+            continue;
+        }
+        avail = __atomic_load_n(&r->ctl->head, __ATOMIC_ACQUIRE) - r->pos;
+        if (avail > r->size)
+            fail("broken reply ring");
+        if (!avail) {
+            __atomic_store_n(&r->ctl->wakeConsumer, 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&r->ctl->head, __ATOMIC_ACQUIRE) == r->pos)
+                ring_wait();
+            __atomic_store_n(&r->ctl->wakeConsumer, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (!drained) {
+            sock_drain();
+            continue;
+        }
+        n = min(avail, len);
+        offset = r->pos & (r->size - 1);
+        first = min(n, r->size - offset);
+        memcpy(buf, r->data + offset, first);
+        memcpy(buf + first, r->data, n - first);
+        r->pos += n;
+        buf += n;
+        len -= n;
+        __atomic_store_n(&r->ctl->tail, r->pos, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&r->ctl->wakeProducer, __ATOMIC_RELAXED) &&
+            __atomic_exchange_n(&r->ctl->wakeProducer, 0, __ATOMIC_RELAXED))
+            ring_signal();
+    }
+}
+
+static void
+out_flush(void)
+{
+    if (attached)
+        ring_publish(&request_ring);
+    else {
+        sock_write(outbuf, outlen);
+        outlen = 0;
+    }
+}
+
+static void
+out_bytes(const void *data, size_t len)
+{
+    if (attached) {
+        ring_put(data, len);
+        return;
+    }
+    if (outlen + len > sizeof(outbuf))
+        out_flush();
+    if (len > sizeof(outbuf))
+        sock_write(data, len);
+    else {
+        memcpy(outbuf + outlen, data, len);
+        outlen += len;
+    }
+}
+
+static void
+out(const void *req, size_t len)
+{
+    seq++;
+    out_bytes(req, len);
+}
+
+static void
+in(void *buf, size_t len)
+{
+    if (attached)
+        ring_get(buf, len);
+    else
+        sock_read(buf, len);
+}
+
+/*
+ * @brief wait for the reply or error to the last request
+ * @return the error code or 0, with the reply in *data (free it)
+ */
+static int
+reply(void **data)
+{
+    xGenericReply rep;
+
+    out_flush();
+    for (;;) {
+        in(&rep, sizeof(rep));
+        if (rep.type == X_Error) {
+            if (rep.sequenceNumber != (seq & 0xffff))
+                fail("error with the wrong sequence number");
+            return ((xError *) &rep)->errorCode;
+        }
+        if (rep.type == X_Reply)
+            break;
+        /* skip events */
+    }
+    if (rep.sequenceNumber != (seq & 0xffff))
+        fail("reply with the wrong sequence number");
+    *data = malloc(sizeof(rep) + rep.length * 4);
+    if (!*data)
+        fail("out of memory");
+    memcpy(*data, &rep, sizeof(rep));
+    in((char *) *data + sizeof(rep), rep.length * 4);
+    return 0;
+}
+
+static void
+sync_server(void)
+{
+    xReq req = { .reqType = X_GetInputFocus, .length = 1 };
+    void *rep;
+
+    out(&req, sizeof(req));
+    if (reply(&rep))
+        fail("GetInputFocus failed");
+    free(rep);
+}
+
+static void
+put_image(const char *image, int w, int h)
+{
+    size_t size = (size_t) w * h * bpp / 8;
+    struct {
+        CARD8 reqType;
+        CARD8 format;
+        CARD16 zero;
+        CARD32 length;          /* BIG-REQUESTS */
+        CARD32 drawable;
+        CARD32 gc;
+        CARD16 width, height;
+        INT16 dstX, dstY;
+        CARD8 leftPad;
+        CARD8 depth;
+        CARD16 pad;
+    } req = {
+        .reqType = X_PutImage,
+        .format = ZPixmap,
+        .length = (sizeof(req) + size) / 4,
+        .drawable = pixmap,
+        .gc = gc,
+        .width = w,
+        .height = h,
+        .depth = depth,
+    };
+
+    out(&req, sizeof(req));
+    out_bytes(image, size);
+}
+
+static char *
+get_image(int w, int h)
+{
+    xGetImageReq req = {
+        .reqType = X_GetImage,
+        .format = ZPixmap,
+        .length = sizeof(req) / 4,
+        .drawable = pixmap,
+        .width = w,
+        .height = h,
+        .planeMask = ~0,
+    };
+    void *rep;
+
+    out(&req, sizeof(req));
+    if (reply(&rep))
+        fail("GetImage failed");
+    return rep;
+}
+
+static void
+fill_rect(int i)
+{
+    struct {
+        xPolyFillRectangleReq req;
+        xRectangle rect;
+    } req = {
+        .req = {
+            .reqType = X_PolyFillRectangle,
+            .length = sizeof(req) / 4,
+            .drawable = pixmap,
+            .gc = gc,
+        },
+        .rect = { i % 64, i % 48, 8, 8 },
+    };
+
+    out(&req, sizeof(req));
+}
+
+static void
+attach(void)
+{
+    xShmTransportAttachReq req = {
+        .reqType = major_opcode,
+        .shmTransportReqType = X_ShmTransportAttach,
+        .length = sizeof(req) / 4,
+        .requestSize = RING_SIZE,
+        .replySize = RING_SIZE,
+    };
+    xShmTransportAttachReply rep;
+    union {
+        struct cmsghdr cmsg;
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+    } control;
+    struct iovec iov = { .iov_base = &rep, .iov_len = sizeof(rep) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    int fds[3] = { -1, -1, -1 };
+    size_t got = 0;
+    char *map;
+
+    out(&req, sizeof(req));
+    out_flush();
+
+    /* the fds come with the first byte of the reply */
+    while (got < sizeof(rep)) {
+        struct cmsghdr *cmsg;
+        ssize_t n;
+
+        iov.iov_base = (char *) &rep + got;
+        iov.iov_len = sizeof(rep) - got;
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (n == 0)
+            fail("server closed the connection");
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                fail("read failed");
+            wait_fd(sock, POLLIN);
+            continue;
+        }
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            if (cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SCM_RIGHTS &&
+                cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+                memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        msg.msg_controllen = 0;
+        got += n;
+    }
+    if (rep.type != X_Reply || rep.sequenceNumber != (seq & 0xffff))
+        fail("ShmTransportAttach failed");
+    if (rep.nfd != 3 || fds[0] < 0)
+        fail("ShmTransportAttach sent no fds");
+    if (rep.requestSize != RING_SIZE || rep.replySize != RING_SIZE)
+        fail("ShmTransportAttach sent wrong ring sizes");
+
+    map = mmap(NULL, rep.size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    if (map == MAP_FAILED)
+        fail("can't map the rings");
+    /* the seals keep either side from resizing it */
+    if (ftruncate(fds[0], 0) == 0)
+        fail("ring memory can be shrunk");
+    close(fds[0]);
+
+    serverfd = fds[1];
+    clientfd = fds[2];
+    request_ring.ctl = (xShmTransportRing *)
+        (map + SHMTRANSPORT_REQUEST_CONTROL);
+    request_ring.data = map + rep.requestOffset;
+    request_ring.size = rep.requestSize;
+    reply_ring.ctl = (xShmTransportRing *) (map + SHMTRANSPORT_REPLY_CONTROL);
+    reply_ring.data = map + rep.replyOffset;
+    reply_ring.size = rep.replySize;
+    attached = 1;
+}
+
+static void
+setup(void)
+{
+    xcb_connection_t *c = xcb_connect(NULL, NULL);
+    const xcb_setup_t *s;
+    xcb_screen_t *screen;
+    xcb_format_iterator_t f;
+    xcb_query_extension_reply_t *ext;
+    xcb_get_input_focus_cookie_t cookie;
+
+    if (xcb_connection_has_error(c))
+        fail("can't connect");
+    s = xcb_get_setup(c);
+    screen = xcb_setup_roots_iterator(s).data;
+    root = screen->root;
+    depth = screen->root_depth;
+    for (f = xcb_setup_pixmap_formats_iterator(s); f.rem; xcb_format_next(&f))
+        if (f.data->depth == depth)
+            bpp = f.data->bits_per_pixel;
+
+    ext = xcb_query_extension_reply(c,
+        xcb_query_extension(c, strlen(SHMTRANSPORT_NAME), SHMTRANSPORT_NAME),
+        NULL);
+    if (!ext || !ext->present) {
+        fprintf(stderr, "shm-transport: no SHM-TRANSPORT, skipping\n");
+        exit(77);
+    }
+    major_opcode = ext->major_opcode;
+    free(ext);
+
+    /* turns on BIG-REQUESTS */
+    if (xcb_get_maximum_request_length(c) < 4 * 1024 * 1024 / 4)
+        fail("no BIG-REQUESTS");
+
+    pixmap = xcb_generate_id(c);
+    xcb_create_pixmap(c, depth, pixmap, root, IMAGE_SIZE, IMAGE_SIZE);
+    gc = xcb_generate_id(c);
+    xcb_create_gc(c, gc, pixmap, 0, NULL);
+
+    /* from here on it's all ours */
+    cookie = xcb_get_input_focus(c);
+    free(xcb_get_input_focus_reply(c, cookie, NULL));
+    seq = cookie.sequence;
+    sock = xcb_get_file_descriptor(c);
+}
+
+static void
+test_image(void)
+{
+    size_t size = IMAGE_SIZE * IMAGE_SIZE * bpp / 8;
+    char *image = malloc(size), *got;
+    xGetImageReply *rep;
+
+    if (!image)
+        fail("out of memory");
+    for (size_t i = 0; i < size; i++)
+        image[i] = i * 7 + i / 4093;
+    /* keep the unused bits of the pixels out of the comparison */
+    if (bpp == 32 && depth == 24)
+        for (size_t i = 3; i < size; i += 4)
+            image[i] = 0;
+
+    put_image(image, IMAGE_SIZE, IMAGE_SIZE);
+    got = get_image(IMAGE_SIZE, IMAGE_SIZE);
+    rep = (xGetImageReply *) got;
+    if (rep->length * 4 != size)
+        fail("GetImage returned the wrong size");
+    if (bpp == 32 && depth == 24)
+        for (size_t i = 3; i < size; i += 4)
+            got[sizeof(*rep) + i] = 0;
+    if (memcmp(got + sizeof(*rep), image, size))
+        fail("GetImage returned a different image");
+
+    free(got);
+    free(image);
+}
+
+static void
+test_small(void)
+{
+    xResourceReq req = {
+        .reqType = X_FreePixmap,
+        .length = sizeof(req) / 4,
+        .id = root,
+    };
+    void *rep;
+
+    for (int i = 0; i < NUM_SMALL; i++)
+        fill_rect(i);
+    sync_server();
+
+    out(&req, sizeof(req));
+    if (reply(&rep) != BadPixmap)
+        fail("FreePixmap on the root window didn't fail");
+    sync_server();
+}
+
+static void
+bench_report(const char *what, unsigned long ops, size_t bytes, uint64_t ns)
+{
+    printf("  %-40s %10lu ops %10.3f ms %10.1f ns/op %8.1f MB/s\n",
+           what, ops, ns / 1e6, (double) ns / ops, bytes * 1e3 / ns);
+}
+
+static void
+bench(const char *transport)
+{
+    char *image = calloc(1, BENCH_IMAGE * BENCH_IMAGE * bpp / 8);
+    char what[64];
+    uint64_t start;
+
+    if (!image)
+        fail("out of memory");
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_SMALL; i++)
+        fill_rect(i);
+    sync_server();
+    snprintf(what, sizeof(what), "%s, PolyFillRectangle", transport);
+    bench_report(what, BENCH_SMALL,
+                 BENCH_SMALL * (sizeof(xPolyFillRectangleReq) +
+                                sizeof(xRectangle)),
+                 now_ns() - start);
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_IMAGES; i++)
+        put_image(image, BENCH_IMAGE, BENCH_IMAGE);
+    sync_server();
+    snprintf(what, sizeof(what), "%s, PutImage %dx%d", transport,
+             BENCH_IMAGE, BENCH_IMAGE);
+    bench_report(what, BENCH_IMAGES,
+                 (size_t) BENCH_IMAGES * BENCH_IMAGE * BENCH_IMAGE * bpp / 8,
+                 now_ns() - start);
+
+    free(image);
+}
+
+int
+main(int argc, char **argv)
+{
+    int benchmark = argc > 1 && strcmp(argv[1], "--bench") == 0;
+
+    setup();
+    if (benchmark) {
+        bench("socket");
+        attach();
+        bench("shm rings");
+        return 0;
+    }
+
+    /* the socket still works the same */
+    test_image();
+    attach();
+    test_image();
+    test_small();
+    return 0;
+}
@@ -33,12 +33,15 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <math.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <X11/X.h>
 #include <X11/Xproto.h>
 #include <X11/keysym.h>
 #include <X11/Xatom.h>
 
 #include "xkb/xkbsrv_priv.h"
+#include "xkb/xkmcache_priv.h"
 
 #include "misc.h"
 #include "inputstr.h"
@@ -184,6 +187,102 @@ xkb_set_get_rules_test(void)
     XkbFreeRMLVOSet(&rmlvo_backup, FALSE);
 }
 
+static void
+xkb_cache_check(XkmCacheKeyPtr key, const char *data)
+{
+    char buf[64] = { 0 };
+    FILE *file = XkmCacheOpen(key);
+
+    assert(file);
+    assert(fread(buf, 1, sizeof(buf) - 1, file) == strlen(data));
+    assert(strcmp(buf, data) == 0);
+    fclose(file);
+}
+
+/**
+ * Store a compiled keymap in the keymap cache, read it back from memory,
+ * push it out of memory with other keymaps and read it back from disk.
+ *
+ * Result: the keymap read back is the one stored, until it's dropped.
+ */
+static void
+xkb_keymap_cache_test(void)
+{
+    char dir[] = "/tmp/xkm-cache-test-XXXXXX", name[PATH_MAX];
+    char cachedir[PATH_MAX], data[PATH_MAX];
+    const char *base = XkbBaseDirectory;
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { 1000000, 0 } };
+    XkmCacheKeyRec key, other;
+    XkmCacheStatsRec before, after;
+    FILE *file;
+
+    assert(mkdtemp(dir));
+    /* parents that don't exist yet are created */
+    snprintf(cachedir, sizeof(cachedir), "%s/cache/xkm", dir);
+    XkbKeymapCacheDirectory = cachedir;
+
+    /* a data file deep down, edited in place, gives a new key */
+    snprintf(data, sizeof(data), "%s/symbols", dir);
+    assert(mkdir(data, 0700) == 0);
+    strcat(data, "/vndr");
+    assert(mkdir(data, 0700) == 0);
+    strcat(data, "/us");
+    file = fopen(data, "w");
+    assert(file);
+    fclose(file);
+    XkbBaseDirectory = dir;
+    assert(XkmCacheKeyFor("xkb_keymap { a };", 17, &key));
+    assert(utimensat(AT_FDCWD, data, times, 0) == 0);
+    assert(XkmCacheKeyFor("xkb_keymap { a };", 17, &other));
+    assert(memcmp(&key, &other, sizeof(key)) != 0);
+    XkbBaseDirectory = base;
+
+    assert(XkmCacheKeyFor("xkb_keymap { a };", 17, &key));
+    assert(XkmCacheKeyFor("xkb_keymap { a };", 17, &other));
+    assert(memcmp(&key, &other, sizeof(key)) == 0);
+    assert(XkmCacheKeyFor("xkb_keymap { b };", 17, &other));
+    assert(memcmp(&key, &other, sizeof(key)) != 0);
+
+    XkmCacheGetStats(&before);
+    assert(XkmCacheOpen(&key) == NULL);
+
+    file = tmpfile();
+    assert(file);
+    fputs("compiled a", file);
+    XkmCacheStore(&key, file);
+    /* left rewound for XkmReadFile() */
+    assert(ftell(file) == 0);
+    fclose(file);
+
+    xkb_cache_check(&key, "compiled a");
+
+    /* more than fit in memory */
+    for (int i = 0; i < 16; i++) {
+        snprintf(name, sizeof(name), "xkb_keymap { %d };", i);
+        assert(XkmCacheKeyFor(name, strlen(name), &other));
+        file = tmpfile();
+        assert(file);
+        fputs(name, file);
+        XkmCacheStore(&other, file);
+        fclose(file);
+    }
+
+    xkb_cache_check(&key, "compiled a");
+    xkb_cache_check(&key, "compiled a");
+
+    XkmCacheGetStats(&after);
+    assert(after.misses == before.misses + 1);
+    assert(after.diskHits == before.diskHits + 1);
+    assert(after.memoryHits == before.memoryHits + 2);
+
+    XkmCacheDrop(&key);
+    assert(XkmCacheOpen(&key) == NULL);
+
+    XkbKeymapCacheDirectory = NULL;
+    snprintf(name, sizeof(name), "rm -rf %s", dir);
+    assert(system(name) == 0);
+}
+
 const testfunc_t*
 xkb_test(void)
 {
@@ -191,6 +290,7 @@ xkb_test(void)
         xkb_set_get_rules_test,
         xkb_get_rules_test,
         xkb_set_rules_test,
+        xkb_keymap_cache_test,
         NULL,
     };
     return testfuncs;
@@ -12,10 +12,17 @@ main(int argc, char **argv)
     run_test(string_test);
 
 #ifdef XORG_TESTS
+    run_test(atom_test);
+    run_test(fb_test);
     run_test(fixes_test);
+    run_test(glyph_test);
     run_test(input_test);
     run_test(misc_test);
+    run_test(mivaltree_test);
+    run_test(region_test);
+    run_test(resource_test);
     run_test(signal_logging_test);
+    run_test(timer_test);
     run_test(touch_test);
     run_test(xfree86_test);
     run_test(xkb_test);
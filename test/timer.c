@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Tests for the OsTimer implementation in os/WaitFor.c
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/X.h>
+
+#include "os/osdep.h"
+
+#include "misc.h"
+#include "os.h"
+#include "tests-common.h"
+
+#define NUM_TIMERS      100000
+#define SPAN            65536
+
+struct test_timer {
+    OsTimerPtr timer;
+    CARD32 expires;
+    unsigned armed_at;          /* arming order, for ties */
+    int fired;
+    Bool armed;
+};
+
+static struct test_timer *tt;
+static unsigned arm_count;
+static CARD32 last_now;         /* "now" of the previous DoTimers() run */
+static CARD32 last_expires;
+static unsigned last_armed_at;
+static unsigned num_fired;
+
+static unsigned rnd_state = 1;
+
+static unsigned
+rnd(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+static CARD32
+stress_callback(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    struct test_timer *t = arg;
+
+    assert(t->timer == timer);
+    assert(t->armed);
+    /* not too early, and not later than the first run it was due in */
+    assert((int) (now - t->expires) >= 0);
+    assert((int) (t->expires - last_now) > 0);
+    /* in expiry order, same expiry in arming order */
+    if (num_fired) {
+        assert((int) (t->expires - last_expires) >= 0);
+        if (t->expires == last_expires)
+            assert(t->armed_at > last_armed_at);
+    }
+    last_expires = t->expires;
+    last_armed_at = t->armed_at;
+
+    t->fired++;
+    t->armed = FALSE;
+    num_fired++;
+    return 0;
+}
+
+static void
+stress_arm(struct test_timer *t, CARD32 expires)
+{
+    t->expires = expires;
+    t->armed_at = arm_count++;
+    t->armed = TRUE;
+    t->timer = TimerSet(t->timer, TimerAbsolute, expires, stress_callback, t);
+    assert(t->timer);
+}
+
+static void
+timer_stress(void)
+{
+    /* far enough ahead that nothing runs before we drive the clock */
+    CARD32 base = GetTimeInMillis() + 0x10000000;
+    CARD32 now;
+    unsigned expected = 0;
+
+    tt = calloc(NUM_TIMERS, sizeof(*tt));
+    assert(tt);
+
+    /* a small range of expiries, so there are plenty of ties */
+    for (int i = 0; i < NUM_TIMERS; i++)
+        stress_arm(&tt[i], base + 1 + rnd() % SPAN);
+
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        switch (rnd() % 8) {
+        case 0:
+        case 1:
+            TimerCancel(tt[i].timer);
+            tt[i].armed = FALSE;
+            break;
+        case 2:
+            stress_arm(&tt[i], base + 1 + rnd() % SPAN);
+            break;
+        case 3:
+            /* cancelling twice is fine */
+            TimerCancel(tt[i].timer);
+            TimerCancel(tt[i].timer);
+            tt[i].armed = FALSE;
+            stress_arm(&tt[i], base + 1 + rnd() % SPAN);
+            break;
+        }
+    }
+    for (int i = 0; i < NUM_TIMERS; i++)
+        if (tt[i].armed)
+            expected++;
+
+    /* drive the clock forward in uneven steps */
+    last_now = base;
+    for (now = base; (int) (now - (base + SPAN + 1)) <= 0; ) {
+        now += 1 + rnd() % 37;
+        DoTimers(now);
+        last_now = now;
+    }
+
+    assert(num_fired == expected);
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        assert(!tt[i].armed);
+        assert(tt[i].fired <= 1);
+        TimerFree(tt[i].timer);
+    }
+    free(tt);
+}
+
+static OsTimerPtr victim, spawned;
+static int victim_fired, spawned_fired, killer_fired;
+
+static CARD32
+count_callback(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    (*(int *) arg)++;
+    return 0;
+}
+
+static CARD32
+killer_callback(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    CARD32 base = *(CARD32 *) arg;
+
+    killer_fired++;
+    TimerCancel(victim);
+    spawned = TimerSet(spawned, TimerAbsolute, base + 15,
+                       count_callback, &spawned_fired);
+    return 0;
+}
+
+static void
+timer_from_callback(void)
+{
+    static CARD32 base;
+    OsTimerPtr killer;
+    OsTimerPtr forced;
+    int forced_fired = 0;
+
+    base = GetTimeInMillis() + 0x10000000;
+
+    killer = TimerSet(NULL, TimerAbsolute, base + 10, killer_callback, &base);
+    victim = TimerSet(NULL, TimerAbsolute, base + 20, count_callback,
+                      &victim_fired);
+    forced = TimerSet(NULL, TimerAbsolute, base + 30, count_callback,
+                      &forced_fired);
+    assert(killer && victim && forced);
+
+    DoTimers(base + 12);
+    assert(killer_fired == 1);
+    DoTimers(base + 16);
+    assert(spawned_fired == 1);
+    assert(victim_fired == 0);
+    assert(forced_fired == 0);
+
+    assert(TimerForce(forced));
+    assert(forced_fired == 1);
+    assert(!TimerForce(forced));
+
+    DoTimers(base + 100);
+    assert(victim_fired == 0);
+    assert(forced_fired == 1);
+
+    /* freeing armed timers must take them out */
+    victim = TimerSet(victim, TimerAbsolute, base + 200, count_callback,
+                      &victim_fired);
+    TimerFree(victim);
+    DoTimers(base + 300);
+    assert(victim_fired == 0);
+
+    TimerFree(killer);
+    TimerFree(spawned);
+    TimerFree(forced);
+}
+
+const testfunc_t*
+timer_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        timer_stress,
+        timer_from_callback,
+        NULL,
+    };
+    return testfuncs;
+}
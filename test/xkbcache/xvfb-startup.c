@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * How long the server takes from exec to accepting clients, once with
+ * every keymap compiled by xkbcomp and once with the keymap cache. The
+ * server writes its display number to -displayfd after the input devices
+ * and their keymaps are set up, which is where the clock stops.
+ *
+ * usage: xvfb-startup [runs] -- server [args]
+ */
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define DEFAULT_RUNS    20
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* start the server and time it until it's ready, 0 if it failed */
+static uint64_t
+startup(char **server, int nserver, const char *opt, const char *arg)
+{
+    char *argv[nserver + 5], fdstr[16], buf[32];
+    uint64_t start, ready = 0;
+    int fds[2], argc = 0, status;
+    ssize_t n;
+    pid_t pid;
+
+    if (pipe(fds) < 0)
+        return 0;
+    snprintf(fdstr, sizeof(fdstr), "%d", fds[1]);
+    for (int i = 0; i < nserver; i++)
+        argv[argc++] = server[i];
+    argv[argc++] = "-displayfd";
+    argv[argc++] = fdstr;
+    argv[argc++] = (char *) opt;
+    if (arg)
+        argv[argc++] = (char *) arg;
+    argv[argc] = NULL;
+
+    start = now_ns();
+    pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        execvp(argv[0], argv);
+        fprintf(stderr, "Error starting the server: %s\n", strerror(errno));
+        _exit(1);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return 0;
+    }
+
+    /* the display number and a newline, or EOF when the server died */
+    do
+        n = read(fds[0], buf, sizeof(buf));
+    while (n < 0 && errno == EINTR);
+    if (n > 0)
+        ready = now_ns() - start;
+    close(fds[0]);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+    return ready;
+}
+
+static int
+bench(const char *what, char **server, int nserver, int runs,
+      const char *opt, const char *arg)
+{
+    uint64_t total = 0, best = UINT64_MAX;
+
+    for (int i = 0; i < runs; i++) {
+        uint64_t ns = startup(server, nserver, opt, arg);
+
+        if (!ns) {
+            fprintf(stderr, "%s: the server failed to start\n", what);
+            return 1;
+        }
+        total += ns;
+        if (ns < best)
+            best = ns;
+    }
+    printf("%-16s %3d runs: %8.2f ms average, %8.2f ms best\n", what, runs,
+           total / 1e6 / runs, best / 1e6);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    char dir[] = "/tmp/xvfb-startup-XXXXXX", cmd[64];
+    int runs = DEFAULT_RUNS, i, ret;
+
+    for (i = 1; i < argc && strcmp(argv[i], "--") != 0; i++)
+        runs = atoi(argv[i]);
+    if (i + 1 >= argc || runs <= 0) {
+        fprintf(stderr, "usage: %s [runs] -- server [args]\n", argv[0]);
+        return 1;
+    }
+    argv += i + 1;
+    argc -= i + 1;
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    ret = bench("xkbcomp", argv, argc, runs, "-noxkbcache", NULL);
+    /* the first run fills the cache */
+    if (!ret && startup(argv, argc, "-xkbcachedir", dir))
+        ret = bench("keymap cache", argv, argc, runs, "-xkbcachedir", dir);
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0)
+        fprintf(stderr, "Failed to remove %s\n", dir);
+    return ret;
+}
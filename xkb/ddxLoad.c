@@ -45,6 +45,7 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "xkb/xkbfmisc_priv.h"
 #include "xkb/xkbrules_priv.h"
 #include "xkb/xkbsrv_priv.h"
+#include "xkb/xkmcache_priv.h"
 
 #include "inputstr.h"
 #include "scrnintstr.h"
@@ -62,7 +63,8 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #endif
 
 static unsigned
-LoadXKM(unsigned want, unsigned need, const char *keymap, XkbDescPtr *xkbRtrn);
+LoadXKM(unsigned want, unsigned need, const char *keymap,
+        XkmCacheKeyPtr key, XkbDescPtr *xkbRtrn);
 
 static void
 OutputDirectory(char *outdir, size_t size)
@@ -230,42 +232,13 @@ xkb_write_keymap_for_names_cb(FILE *out, void *userdata)
     XkbKeymapNamesCtx *ctx = userdata;
 #ifdef DEBUG
     if (xkbDebugFlags) {
-        ErrorF("[xkb] XkbDDXCompileKeymapByNames compiling keymap:\n");
+        ErrorF("[xkb] XkbDDXLoadKeymapByNames compiling keymap:\n");
         XkbWriteXKBKeymapForNames(stderr, ctx->names, ctx->xkb, ctx->want, ctx->need);
     }
 #endif
     XkbWriteXKBKeymapForNames(out, ctx->names, ctx->xkb, ctx->want, ctx->need);
 }
 
-static Bool
-XkbDDXCompileKeymapByNames(XkbDescPtr xkb,
-                           XkbComponentNamesPtr names,
-                           unsigned want,
-                           unsigned need, char *nameRtrn, int nameRtrnLen)
-{
-    char *keymap;
-    Bool rc = FALSE;
-    XkbKeymapNamesCtx ctx = {
-        .xkb = xkb,
-        .names = names,
-        .want = want,
-        .need = need
-    };
-
-    keymap = RunXkbComp(xkb_write_keymap_for_names_cb, &ctx);
-
-    if (keymap) {
-        if(nameRtrn)
-            strlcpy(nameRtrn, keymap, nameRtrnLen);
-
-        free(keymap);
-        rc = TRUE;
-    } else if (nameRtrn)
-        *nameRtrn = '\0';
-
-    return rc;
-}
-
 typedef struct {
     const char *keymap;
     size_t len;
@@ -278,6 +251,97 @@ xkb_write_keymap_string_cb(FILE *out, void *userdata)
     fwrite(s->keymap, s->len, 1, out);
 }
 
+#ifndef WIN32
+/**
+ * Load a keymap from the cache. Returns the components loaded, *xkbRtrn is
+ * NULL if the cache doesn't have it.
+ */
+static unsigned
+LoadCachedXKM(unsigned want, unsigned need, XkmCacheKeyPtr key,
+              XkbDescPtr *xkbRtrn)
+{
+    FILE *file;
+    unsigned missing;
+
+    file = XkmCacheOpen(key);
+    if (file == NULL)
+        return 0;
+    missing = XkmReadFile(file, need, want, xkbRtrn);
+    fclose(file);
+    if (*xkbRtrn == NULL || (missing & need)) {
+        /* it's the same xkbcomp would give us, unless the entry is broken */
+        LogMessage(X_WARNING, "XKB: Dropping unusable cached keymap\n");
+        if (*xkbRtrn) {
+            XkbFreeKeyboard(*xkbRtrn, 0, TRUE);
+            *xkbRtrn = NULL;
+        }
+        XkmCacheDrop(key);
+        return 0;
+    }
+    DebugF("Loaded cached XKB keymap, defined=0x%x\n", (*xkbRtrn)->defined);
+    return (need | want) & (~missing);
+}
+#endif
+
+/**
+ * Compile the keymap the callback writes and load it, or take it from the
+ * keymap cache when it's been compiled before. nameRtrn gets the name of
+ * the compiled keymap, which is empty if it came from the cache.
+ */
+static unsigned
+XkbDDXCompileAndLoadXKM(xkbcomp_buffer_callback callback, void *userdata,
+                        unsigned want, unsigned need, XkbDescPtr *xkbRtrn,
+                        char *nameRtrn, int nameRtrnLen)
+{
+    XkmCacheKeyRec key;
+    XkmCacheKeyPtr cacheKey = NULL;
+    XkbKeymapString input = { 0 };
+    char *buf = NULL, *keymap;
+    unsigned have = 0;
+
+    *xkbRtrn = NULL;
+    if (nameRtrn && nameRtrnLen > 0)
+        *nameRtrn = '\0';
+
+#ifndef WIN32
+    if (XkbWantKeymapCache) {
+        size_t len = 0;
+        FILE *out = open_memstream(&buf, &len);
+
+        /* write the input once, it's hashed and fed to xkbcomp from memory */
+        if (out != NULL) {
+            (*callback)(out, userdata);
+            if (fclose(out) == 0 && XkmCacheKeyFor(buf, len, &key)) {
+                input.keymap = buf;
+                input.len = len;
+                callback = xkb_write_keymap_string_cb;
+                userdata = &input;
+                cacheKey = &key;
+
+                have = LoadCachedXKM(want, need, cacheKey, xkbRtrn);
+                if (*xkbRtrn) {
+                    free(buf);
+                    return have;
+                }
+            }
+        }
+    }
+#endif
+
+    keymap = RunXkbComp(callback, userdata);
+    if (keymap) {
+        if (nameRtrn)
+            strlcpy(nameRtrn, keymap, nameRtrnLen);
+        have = LoadXKM(want, need, keymap, cacheKey, xkbRtrn);
+        free(keymap);
+    }
+    else
+        LogMessage(X_ERROR, "XKB: Couldn't compile keymap\n");
+
+    free(buf);
+    return have;
+}
+
 static unsigned int
 XkbDDXLoadKeymapFromString(DeviceIntPtr keybd,
                           const char *keymap, int keymap_length,
@@ -285,25 +349,13 @@ XkbDDXLoadKeymapFromString(DeviceIntPtr keybd,
                           unsigned int need,
                           XkbDescPtr *xkbRtrn)
 {
-    unsigned int have;
-    char *map_name;
     XkbKeymapString map = {
         .keymap = keymap,
         .len = keymap_length
     };
 
-    *xkbRtrn = NULL;
-
-    map_name = RunXkbComp(xkb_write_keymap_string_cb, &map);
-    if (!map_name) {
-        LogMessage(X_ERROR, "XKB: Couldn't compile keymap\n");
-        return 0;
-    }
-
-    have = LoadXKM(want, need, map_name, xkbRtrn);
-    free(map_name);
-
-    return have;
+    return XkbDDXCompileAndLoadXKM(xkb_write_keymap_string_cb, &map,
+                                   want, need, xkbRtrn, NULL, 0);
 }
 
 static FILE *
@@ -343,7 +395,8 @@ XkbDDXOpenConfigFile(const char *mapName, char *fileNameRtrn, int fileNameRtrnLe
 }
 
 static unsigned
-LoadXKM(unsigned want, unsigned need, const char *keymap, XkbDescPtr *xkbRtrn)
+LoadXKM(unsigned want, unsigned need, const char *keymap,
+        XkmCacheKeyPtr key, XkbDescPtr *xkbRtrn)
 {
     FILE *file;
     char fileName[PATH_MAX];
@@ -365,6 +418,10 @@ LoadXKM(unsigned want, unsigned need, const char *keymap, XkbDescPtr *xkbRtrn)
     else {
         DebugF("Loaded XKB keymap %s, defined=0x%x\n", fileName,
                (*xkbRtrn)->defined);
+#ifndef WIN32
+        if (key)
+            XkmCacheStore(key, file);
+#endif
     }
     fclose(file);
     (void) unlink(fileName);
@@ -393,13 +450,16 @@ XkbDDXLoadKeymapByNames(DeviceIntPtr keybd,
                    keybd && keybd->name ? keybd->name : "(unnamed keyboard)");
         return 0;
     }
-    else if (!XkbDDXCompileKeymapByNames(xkb, names, want, need,
-                                         nameRtrn, nameRtrnLen)) {
-        LogMessage(X_ERROR, "XKB: Couldn't compile keymap\n");
-        return 0;
-    }
 
-    return LoadXKM(want, need, nameRtrn, xkbRtrn);
+    XkbKeymapNamesCtx ctx = {
+        .xkb = xkb,
+        .names = names,
+        .want = want,
+        .need = need
+    };
+
+    return XkbDDXCompileAndLoadXKM(xkb_write_keymap_for_names_cb, &ctx,
+                                   want, need, xkbRtrn, nameRtrn, nameRtrnLen);
 }
 
 Bool
@@ -44,6 +44,7 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "os/cmdline.h"
 #include "os/log_priv.h"
 #include "xkb/xkbsrv_priv.h"
+#include "xkb/xkmcache_priv.h"
 
 #include "misc.h"
 #include "inputstr.h"
@@ -83,6 +84,8 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 const char *XkbBaseDirectory = XKB_BASE_DIRECTORY;
 const char *XkbBinDirectory = XKB_BIN_DIRECTORY;
+Bool XkbWantKeymapCache = TRUE;
+const char *XkbKeymapCacheDirectory = NULL;
 static int XkbWantAccessX = 0;
 
 static char *XkbRulesDflt = NULL;
@@ -761,6 +764,23 @@ XkbProcessArguments(int argc, char *argv[], int i)
             return -1;
         }
     }
+    else if (strcmp(argv[i], "-xkbcachedir") == 0) {
+        if (++i >= argc)
+            return -1;
+#if !defined(WIN32) && !defined(__CYGWIN__)
+        if (getuid() != geteuid()) {
+            LogMessage(X_WARNING,
+                       "-xkbcachedir is not available for setuid X servers\n");
+            return -1;
+        }
+#endif
+        XkbKeymapCacheDirectory = argv[i];
+        return 2;
+    }
+    else if (strcmp(argv[i], "-noxkbcache") == 0) {
+        XkbWantKeymapCache = FALSE;
+        return 1;
+    }
     else if ((strncmp(argv[i], "-accessx", 8) == 0) ||
              (strncmp(argv[i], "+accessx", 8) == 0)) {
         int j = 1;
@@ -825,4 +845,6 @@ XkbUseMsg(void)
     ErrorF("                       enable/disable accessx key sequences\n");
     ErrorF("-ardelay               set XKB autorepeat delay\n");
     ErrorF("-arinterval            set XKB autorepeat interval\n");
+    ErrorF("-noxkbcache            always run xkbcomp, don't cache keymaps\n");
+    ErrorF("-xkbcachedir dir       directory for cached compiled keymaps\n");
 }
@@ -0,0 +1,508 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Cache of keymaps compiled by xkbcomp
+ *
+ * Every keymap the server loads is compiled by forking xkbcomp, which
+ * parses all of the keymap source and writes an .xkm file that is read
+ * back with XkmReadFile(). Servers started by the hundreds and keyboards
+ * being plugged in compile the same few keymaps over and over again.
+ *
+ * The compiled .xkm is kept in memory and in a directory on disk, under
+ * the SHA1 of the xkbcomp input together with the size and mtime of the
+ * xkbcomp binary and of every file in the XKB component directories and
+ * their subdirectories. The input already has the rules resolved to
+ * components, so a changed rules file gives a new key by itself. Data
+ * files being replaced, added or edited in place change the key too.
+ *
+ * The directory is only used when it's ours and nobody else can write to
+ * it, entries are written to a temporary file and renamed into place so
+ * servers starting in parallel never see half of one.
+ */
+#include <dix-config.h>
+
+#include <xkb-config.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <X11/X.h>
+
+#include "os/log_priv.h"
+#include "os/xsha1.h"
+#include "xkb/xkbsrv_priv.h"
+#include "xkb/xkmcache_priv.h"
+
+#include "misc.h"
+#include "os.h"
+
+#define XKM_CACHE_MEMORY_ENTRIES        8
+#define XKM_CACHE_DISK_ENTRIES          64
+/* far beyond anything xkbcomp writes, even with geometry */
+#define XKM_CACHE_MAX_SIZE              (4 * 1024 * 1024)
+#define XKM_CACHE_SUBDIR                "xserver-xkm"
+
+typedef struct {
+    XkmCacheKeyRec key;
+    char *data;
+    size_t size;
+    unsigned long used;
+} XkmCacheEntryRec, *XkmCacheEntryPtr;
+
+static XkmCacheEntryRec xkmMemoryCache[XKM_CACHE_MEMORY_ENTRIES];
+static unsigned long xkmCacheClock;
+static XkmCacheStatsRec xkmCacheStats;
+
+/* what xkbcomp is and what it reads, besides its input */
+static const char *xkmComponentDirs[] = {
+    "keycodes", "types", "compat", "symbols", "geometry",
+};
+/* symbols/ has vendor and language subdirectories, none go deeper */
+#define XKM_CACHE_MAX_DEPTH             4
+
+static int
+XkmCacheHashStat(void *ctx, const char *path, const struct stat *st)
+{
+    char buf[PATH_MAX + 64];
+    int len;
+
+    if (!st)
+        len = snprintf(buf, sizeof(buf), "%s -\n", path);
+    else
+        len = snprintf(buf, sizeof(buf), "%s %llu %lld %lld\n", path,
+                       (unsigned long long) st->st_ino,
+                       (long long) st->st_size, (long long) st->st_mtime);
+    if (len < 0 || len >= (int) sizeof(buf))
+        return 0;
+    return x_sha1_update(ctx, buf, len);
+}
+
+static int
+XkmCacheHashFile(void *ctx, const char *path)
+{
+    struct stat st;
+
+    return XkmCacheHashStat(ctx, path, stat(path, &st) < 0 ? NULL : &st);
+}
+
+/*
+ * Everything below a component directory, in readdir() order: that only
+ * changes along with the directory, which gives a new key anyway.
+ */
+static int
+XkmCacheHashTree(void *ctx, char *path, size_t size, int depth)
+{
+    size_t len = strlen(path);
+    struct dirent *ent;
+    struct stat st;
+    int ok = 1;
+    DIR *d;
+
+    if (!(d = opendir(path)))
+        return XkmCacheHashStat(ctx, path, NULL);
+    while (ok && (ent = readdir(d))) {
+        if (ent->d_name[0] == '.')
+            continue;
+        if (snprintf(path + len, size - len, "/%s", ent->d_name) >=
+            (int) (size - len)) {
+            ok = 0;
+            break;
+        }
+        if (fstatat(dirfd(d), ent->d_name, &st, 0) < 0)
+            ok = XkmCacheHashStat(ctx, path, NULL);
+        else if (!S_ISDIR(st.st_mode))
+            ok = XkmCacheHashStat(ctx, path, &st);
+        /* symlinked directories could loop, xkbcomp has no business there */
+        else if (depth < XKM_CACHE_MAX_DEPTH &&
+                 fstatat(dirfd(d), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+                 S_ISDIR(st.st_mode))
+            ok = XkmCacheHashTree(ctx, path, size, depth + 1);
+    }
+    path[len] = '\0';
+    closedir(d);
+    return ok;
+}
+
+Bool
+XkmCacheKeyFor(const char *input, size_t len, XkmCacheKeyPtr key)
+{
+    char path[PATH_MAX];
+    void *ctx;
+    int ok;
+
+    if (len > INT_MAX || !(ctx = x_sha1_init()))
+        return FALSE;
+
+    ok = x_sha1_update(ctx, "xkm-cache 1\n", strlen("xkm-cache 1\n"));
+    if (XkbBinDirectory) {
+        snprintf(path, sizeof(path), "%s/xkbcomp", XkbBinDirectory);
+        ok = ok && XkmCacheHashFile(ctx, path);
+    }
+    else {
+        /* popen() finds it in $PATH */
+        const char *search = getenv("PATH");
+
+        ok = ok && x_sha1_update(ctx, "xkbcomp\n", strlen("xkbcomp\n"));
+        if (search)
+            ok = ok && x_sha1_update(ctx, (void *) search, strlen(search));
+    }
+    if (XkbBaseDirectory) {
+        for (size_t i = 0; i < ARRAY_SIZE(xkmComponentDirs); i++) {
+            snprintf(path, sizeof(path), "%s/%s", XkbBaseDirectory,
+                     xkmComponentDirs[i]);
+            ok = ok && XkmCacheHashTree(ctx, path, sizeof(path), 0);
+        }
+    }
+    ok = ok && x_sha1_update(ctx, (void *) input, len);
+
+    /* frees ctx whatever happened before */
+    return x_sha1_final(ctx, key->sha1) && ok;
+}
+
+/***====================================================================***/
+
+static XkmCacheEntryPtr
+XkmCacheFindMemory(XkmCacheKeyPtr key)
+{
+    for (int i = 0; i < XKM_CACHE_MEMORY_ENTRIES; i++) {
+        XkmCacheEntryPtr entry = &xkmMemoryCache[i];
+
+        if (entry->data && !memcmp(&entry->key, key, sizeof(*key)))
+            return entry;
+    }
+    return NULL;
+}
+
+/* takes data */
+static XkmCacheEntryPtr
+XkmCacheAddMemory(XkmCacheKeyPtr key, char *data, size_t size)
+{
+    XkmCacheEntryPtr entry = XkmCacheFindMemory(key);
+
+    if (!entry) {
+        /* a free slot, else the one used least recently */
+        entry = &xkmMemoryCache[0];
+        for (int i = 1; i < XKM_CACHE_MEMORY_ENTRIES && entry->data; i++)
+            if (!xkmMemoryCache[i].data ||
+                xkmMemoryCache[i].used < entry->used)
+                entry = &xkmMemoryCache[i];
+    }
+    free(entry->data);
+    entry->key = *key;
+    entry->data = data;
+    entry->size = size;
+    entry->used = ++xkmCacheClock;
+    return entry;
+}
+
+/***====================================================================***/
+
+/* mkdir -p, parents we create are ours alone as well */
+static Bool
+XkmCacheMakeDirectory(char *dir)
+{
+    for (char *slash = strchr(dir + 1, '/'); ; slash = strchr(slash + 1, '/')) {
+        if (slash)
+            *slash = '\0';
+        if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+            LogMessageVerb(X_WARNING, 3,
+                           "XKB: Not caching keymaps, can't create %s: %s\n",
+                           dir, strerror(errno));
+            if (slash)
+                *slash = '/';
+            return FALSE;
+        }
+        if (!slash)
+            return TRUE;
+        *slash = '/';
+    }
+}
+
+/*
+ * Where the cache lives: the xkm output directory when we can write there,
+ * else the user's cache or runtime directory. Those come from the
+ * environment, so not for setuid servers. Never somewhere shared like /tmp.
+ */
+static Bool
+XkmCacheDirectory(char *dir, size_t size)
+{
+    const char *base = NULL, *sub = XKM_CACHE_SUBDIR;
+    struct stat st;
+    int r;
+
+    if (XkbKeymapCacheDirectory) {
+        base = XkbKeymapCacheDirectory;
+        sub = "";
+    }
+    else if (access(XKM_OUTPUT_DIR, W_OK | X_OK) == 0)
+        base = XKM_OUTPUT_DIR;
+    else if (getuid() == geteuid()) {
+        const char *env;
+
+        if ((env = getenv("XDG_CACHE_HOME")) && env[0] == '/')
+            base = env;
+        else if ((env = getenv("HOME")) && env[0] == '/') {
+            r = snprintf(dir, size, "%s/.cache/%s", env, sub);
+            base = dir;
+        }
+        else if ((env = getenv("XDG_RUNTIME_DIR")) && env[0] == '/')
+            base = env;
+    }
+    if (!base)
+        return FALSE;
+
+    if (base != dir)
+        r = snprintf(dir, size, "%s%s%s", base,
+                     (*sub && base[strlen(base) - 1] != '/') ? "/" : "", sub);
+    if (r < 0 || (size_t) r >= size)
+        return FALSE;
+
+    if (!XkmCacheMakeDirectory(dir))
+        return FALSE;
+    if (lstat(dir, &st) < 0 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        LogMessageVerb(X_WARNING, 3,
+                       "XKB: Not caching keymaps in %s, it's not ours alone\n",
+                       dir);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static Bool
+XkmCacheFileName(XkmCacheKeyPtr key, char *name, size_t size)
+{
+    char dir[PATH_MAX];
+    char hex[2 * sizeof(key->sha1) + 1];
+    int r;
+
+    if (!XkmCacheDirectory(dir, sizeof(dir)))
+        return FALSE;
+    for (size_t i = 0; i < sizeof(key->sha1); i++)
+        snprintf(hex + 2 * i, 3, "%02x", key->sha1[i]);
+    r = snprintf(name, size, "%s/%s.xkm", dir, hex);
+    return r > 0 && (size_t) r < size;
+}
+
+static char *
+XkmCacheReadDisk(XkmCacheKeyPtr key, size_t *sizeRtrn)
+{
+    char name[PATH_MAX];
+    struct stat st;
+    char *data = NULL;
+    size_t done = 0;
+    int fd;
+
+    if (!XkmCacheFileName(key, name, sizeof(name)))
+        return NULL;
+    fd = open(name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        st.st_uid != geteuid() ||
+        st.st_size <= 0 || st.st_size > XKM_CACHE_MAX_SIZE)
+        goto out;
+
+    data = malloc(st.st_size);
+    while (data && done < (size_t) st.st_size) {
+        ssize_t n = read(fd, data + done, st.st_size - done);
+
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            free(data);
+            data = NULL;
+            break;
+        }
+        done += n;
+    }
+    if (data) {
+        /* pruning goes by mtime, keep the ones in use */
+        (void) futimens(fd, NULL);
+        *sizeRtrn = done;
+    }
+
+out:
+    close(fd);
+    return data;
+}
+
+static int
+XkmCacheCompareAge(const void *a, const void *b)
+{
+    const struct stat *sa = a, *sb = b;
+
+    if (sa->st_mtime != sb->st_mtime)
+        return sa->st_mtime < sb->st_mtime ? -1 : 1;
+    return 0;
+}
+
+/* remove the least recently used entries beyond XKM_CACHE_DISK_ENTRIES */
+static void
+XkmCachePruneDisk(const char *dir)
+{
+    struct {
+        struct stat st;         /* first, for XkmCacheCompareAge() */
+        char name[64];
+    } *entries = NULL, *tmp;
+    int count = 0, alloc = 0;
+    struct dirent *ent;
+    DIR *d;
+
+    if (!(d = opendir(dir)))
+        return;
+    while ((ent = readdir(d))) {
+        size_t len = strlen(ent->d_name);
+
+        if (len != 44 || strcmp(ent->d_name + 40, ".xkm") != 0)
+            continue;
+        if (count == alloc) {
+            alloc = alloc ? 2 * alloc : 2 * XKM_CACHE_DISK_ENTRIES;
+            tmp = reallocarray(entries, alloc, sizeof(*entries));
+            if (!tmp)
+                goto out;
+            entries = tmp;
+        }
+        if (fstatat(dirfd(d), ent->d_name, &entries[count].st,
+                    AT_SYMLINK_NOFOLLOW) < 0)
+            continue;
+        strcpy(entries[count].name, ent->d_name);
+        count++;
+    }
+    if (count <= XKM_CACHE_DISK_ENTRIES)
+        goto out;
+
+    qsort(entries, count, sizeof(*entries), XkmCacheCompareAge);
+    for (int i = 0; i < count - XKM_CACHE_DISK_ENTRIES; i++)
+        (void) unlinkat(dirfd(d), entries[i].name, 0);
+
+out:
+    free(entries);
+    closedir(d);
+}
+
+static void
+XkmCacheWriteDisk(XkmCacheKeyPtr key, const char *data, size_t size)
+{
+    char name[PATH_MAX], tmpname[PATH_MAX], *slash;
+    size_t done = 0;
+    int fd;
+
+    if (!XkmCacheFileName(key, name, sizeof(name)))
+        return;
+    if (snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", name) >= (int) sizeof(tmpname))
+        return;
+    fd = mkstemp(tmpname);
+    if (fd < 0)
+        return;
+
+    while (done < size) {
+        ssize_t n = write(fd, data + done, size - done);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    if (close(fd) < 0 || done != size || rename(tmpname, name) < 0) {
+        (void) unlink(tmpname);
+        return;
+    }
+
+    slash = strrchr(name, '/');
+    *slash = '\0';
+    XkmCachePruneDisk(name);
+}
+
+/***====================================================================***/
+
+FILE *
+XkmCacheOpen(XkmCacheKeyPtr key)
+{
+    XkmCacheEntryPtr entry = XkmCacheFindMemory(key);
+    const char *from = "in memory";
+    FILE *file;
+
+    if (entry)
+        xkmCacheStats.memoryHits++;
+    else {
+        size_t size;
+        char *data = XkmCacheReadDisk(key, &size);
+
+        if (!data) {
+            xkmCacheStats.misses++;
+            LogMessageVerb(X_INFO, 3, "XKB: Keymap not cached yet "
+                           "(%lu hits in memory, %lu on disk, %lu misses)\n",
+                           xkmCacheStats.memoryHits, xkmCacheStats.diskHits,
+                           xkmCacheStats.misses);
+            return NULL;
+        }
+        xkmCacheStats.diskHits++;
+        from = "on disk";
+        entry = XkmCacheAddMemory(key, data, size);
+    }
+    entry->used = ++xkmCacheClock;
+
+    LogMessageVerb(X_INFO, 3, "XKB: Using keymap cached %s "
+                   "(%lu hits in memory, %lu on disk, %lu misses)\n", from,
+                   xkmCacheStats.memoryHits, xkmCacheStats.diskHits,
+                   xkmCacheStats.misses);
+
+    file = fmemopen(entry->data, entry->size, "rb");
+    if (!file)
+        LogMessage(X_WARNING, "XKB: Couldn't read cached keymap: %s\n",
+                   strerror(errno));
+    return file;
+}
+
+void
+XkmCacheStore(XkmCacheKeyPtr key, FILE *file)
+{
+    char *data;
+    long size;
+
+    if (fseek(file, 0, SEEK_END) < 0 || (size = ftell(file)) <= 0 ||
+        size > XKM_CACHE_MAX_SIZE) {
+        rewind(file);
+        return;
+    }
+    rewind(file);
+
+    data = malloc(size);
+    if (data && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    rewind(file);
+    if (!data)
+        return;
+
+    XkmCacheWriteDisk(key, data, size);
+    XkmCacheAddMemory(key, data, size);
+}
+
+void
+XkmCacheDrop(XkmCacheKeyPtr key)
+{
+    XkmCacheEntryPtr entry = XkmCacheFindMemory(key);
+    char name[PATH_MAX];
+
+    if (entry) {
+        free(entry->data);
+        entry->data = NULL;
+        entry->size = 0;
+    }
+    if (XkmCacheFileName(key, name, sizeof(name)))
+        (void) unlink(name);
+}
+
+void
+XkmCacheGetStats(XkmCacheStatsPtr stats)
+{
+    *stats = xkmCacheStats;
+}
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Cache of keymaps compiled by xkbcomp
+ */
+#ifndef _XSERVER_XKB_XKMCACHE_PRIV_H
+#define _XSERVER_XKB_XKMCACHE_PRIV_H
+
+#include <stdio.h>
+#include <X11/Xdefs.h>
+
+typedef struct {
+    unsigned char sha1[20];
+} XkmCacheKeyRec, *XkmCacheKeyPtr;
+
+typedef struct {
+    unsigned long memoryHits;
+    unsigned long diskHits;
+    unsigned long misses;
+} XkmCacheStatsRec, *XkmCacheStatsPtr;
+
+/* -noxkbcache */
+extern Bool XkbWantKeymapCache;
+/* -xkbcachedir, NULL picks one of the default places */
+extern const char *XkbKeymapCacheDirectory;
+
+/*
+ * @brief compute the cache key for a keymap
+ *
+ * The key covers the xkbcomp input as well as the xkbcomp binary and the
+ * XKB data directory it compiles from.
+ *
+ * @param input     what xkbcomp would be fed on stdin
+ * @param len       length of input in bytes
+ * @param key       filled in with the key
+ * @return FALSE if hashing failed
+ */
+Bool XkmCacheKeyFor(const char *input, size_t len, XkmCacheKeyPtr key);
+
+/*
+ * @brief open the compiled keymap for a key, from memory or disk
+ *
+ * The file reads from memory owned by the cache, it must be closed before
+ * the next call into the cache.
+ *
+ * @return the .xkm as a file to feed XkmReadFile(), or NULL on a miss
+ */
+FILE *XkmCacheOpen(XkmCacheKeyPtr key);
+
+/*
+ * @brief remember the .xkm xkbcomp compiled for a key
+ *
+ * Reads all of file and leaves it rewound.
+ */
+void XkmCacheStore(XkmCacheKeyPtr key, FILE *file);
+
+/*
+ * @brief forget a keymap, for instance because it failed to load
+ */
+void XkmCacheDrop(XkmCacheKeyPtr key);
+
+/*
+ * @brief hits and misses since the server started
+ */
+void XkmCacheGetStats(XkmCacheStatsPtr stats);
+
+#endif /* _XSERVER_XKB_XKMCACHE_PRIV_H */